@@ -65,29 +65,42 @@ LOCAL_SRC_FILES = \
 	voip/qualityindicator.c \
 	voip/bitratecontrol.c \
 	voip/bitratedriver.c \
+	voip/complexitygovernor.c \
 	voip/qosanalyzer.c \
 	utils/dsptools.c \
+	utils/fft.c \
+	utils/audiokernels.c \
+	utils/audioconvert.c \
+	utils/resampler.c \
 	utils/kiss_fft.c \
 	utils/kiss_fftr.c \
 	utils/msjava.c \
+	utils/frameworker.c \
+	utils/asyncwriter.c \
+	utils/filecache.c \
+	utils/g711.c \
 	utils/g722_decode.c \
 	utils/g722_encode.c \
+	utils/g722_qmf.c \
 	otherfilters/msrtp.c \
 	otherfilters/tee.c \
 	otherfilters/join.c \
 	otherfilters/void.c \
 	audiofilters/audiomixer.c \
+	audiofilters/audiorelay.c \
 	audiofilters/alaw.c \
 	audiofilters/ulaw.c \
 	audiofilters/msfileplayer.c \
 	audiofilters/dtmfgen.c \
 	audiofilters/msfilerec.c \
+	audiofilters/payloadrec.c \
 	audiofilters/msconf.c \
 	audiofilters/msvolume.c \
 	audiofilters/equalizer.c \
 	audiofilters/tonedetector.c \
 	audiofilters/msg722.c \
 	audiofilters/l16.c \
+	audiofilters/codecfarm.c \
 	audiofilters/msresample.c \
 	android/androidsound_depr.cpp \
 	android/loader.cpp \
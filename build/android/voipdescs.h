@@ -36,6 +36,9 @@ extern MSFilterDesc ms_g722_dec_desc;
 extern MSFilterDesc ms_g722_enc_desc;
 extern MSFilterDesc ms_l16_enc_desc;
 extern MSFilterDesc ms_l16_dec_desc;
+extern MSFilterDesc ms_codec_farm_desc;
+extern MSFilterDesc ms_audio_relay_desc;
+extern MSFilterDesc ms_payload_rec_desc;
 extern MSFilterDesc ms_jpeg_writer_desc;
 #if defined(__arm__) && defined(BUILD_WEBRTC_AECM)
 extern MSFilterDesc ms_webrtc_aec_desc;
@@ -69,6 +72,9 @@ MSFilterDesc * ms_voip_filter_descs[]={
 &ms_g722_enc_desc,
 &ms_l16_enc_desc,
 &ms_l16_dec_desc,
+&ms_codec_farm_desc,
+&ms_audio_relay_desc,
+&ms_payload_rec_desc,
 #ifdef VIDEO_ENABLED
 &ms_mpeg4_enc_desc,
 &ms_mpeg4_dec_desc,
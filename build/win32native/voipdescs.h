@@ -47,6 +47,9 @@ extern MSFilterDesc ms_vp8_enc_desc;
 extern MSFilterDesc ms_vp8_dec_desc;
 extern MSFilterDesc ms_l16_enc_desc;
 extern MSFilterDesc ms_l16_dec_desc;
+extern MSFilterDesc ms_codec_farm_desc;
+extern MSFilterDesc ms_audio_relay_desc;
+extern MSFilterDesc ms_payload_rec_desc;
 extern MSFilterDesc ms_g722_enc_desc;
 extern MSFilterDesc ms_g722_dec_desc;
 
@@ -97,6 +100,9 @@ MSFilterDesc * ms_voip_filter_descs[]={
 &ms_vp8_dec_desc,
 &ms_l16_enc_desc,
 &ms_l16_dec_desc,
+&ms_codec_farm_desc,
+&ms_audio_relay_desc,
+&ms_payload_rec_desc,
 &ms_g722_enc_desc,
 &ms_g722_dec_desc,
 NULL
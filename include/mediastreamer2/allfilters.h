@@ -139,7 +139,10 @@ typedef enum MSFilterId{
 	MS_AAC_ELD_ENC_ID,
 	MS_AAC_ELD_DEC_ID,
 	MS_OPUS_ENC_ID,
-	MS_OPUS_DEC_ID
+	MS_OPUS_DEC_ID,
+	MS_CODEC_FARM_ID,
+	MS_AUDIO_RELAY_ID,
+	MS_PAYLOAD_REC_ID
 } MSFilterId;
 
 
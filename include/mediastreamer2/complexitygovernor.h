@@ -0,0 +1,96 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+
+ * Copyright (C) 2013  Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef ms2_complexitygovernor_h
+#define ms2_complexitygovernor_h
+
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+
+/**
+ * The complexity governor watches the load of a ticker and lowers the complexity of the encoders it runs
+ * (see MS_FILTER_SET_COMPLEXITY) when the ticker gets close to its deadline, the most expensive encoder first.
+ * The complexity is raised back, one step at a time, once the load has stayed low for a while.
+ * It trades a bit of quality for not running late.
+**/
+typedef struct _MSComplexityGovernor MSComplexityGovernor;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Creates a complexity governor for the filters run by ticker.
+**/
+MS2_PUBLIC MSComplexityGovernor *ms_complexity_governor_new(MSTicker *ticker);
+
+/**
+ * Returns the governor of ticker, created on first use and shared by all the streams whose encoders the ticker runs,
+ * so that it lowers the complexity of the most expensive one instead of all of them at once.
+ * It is given back with ms_complexity_governor_release().
+**/
+MS2_PUBLIC MSComplexityGovernor *ms_complexity_governor_get(MSTicker *ticker);
+
+MS2_PUBLIC void ms_complexity_governor_release(MSComplexityGovernor *obj);
+
+MS2_PUBLIC MSTicker *ms_complexity_governor_get_ticker(const MSComplexityGovernor *obj);
+
+/**
+ * Puts an encoder under the control of the governor. Its current complexity is the maximum the governor will restore.
+ * Returns -1 if the filter does not implement MS_FILTER_GET_COMPLEXITY and MS_FILTER_SET_COMPLEXITY.
+**/
+MS2_PUBLIC int ms_complexity_governor_add_filter(MSComplexityGovernor *obj, MSFilter *f);
+
+/**
+ * Releases a filter, restoring its original complexity.
+**/
+MS2_PUBLIC void ms_complexity_governor_remove_filter(MSComplexityGovernor *obj, MSFilter *f);
+
+/**
+ * Sets the ticker loads, in percent, above which complexity is lowered and below which it is raised.
+ * Defaults are 80 and 50.
+**/
+MS2_PUBLIC void ms_complexity_governor_set_thresholds(MSComplexityGovernor *obj, float low_load, float high_load);
+
+/**
+ * Checks the load and adjusts the complexity of the filters. It must be called regularly from the application thread,
+ * typically from the iterate() function of the streams; decisions are taken at most once per second.
+**/
+MS2_PUBLIC void ms_complexity_governor_update(MSComplexityGovernor *obj);
+
+/**
+ * Destroys the governor, the filters it controls get their original complexity back.
+ * Not to be used on a governor obtained with ms_complexity_governor_get().
+**/
+MS2_PUBLIC void ms_complexity_governor_destroy(MSComplexityGovernor *obj);
+
+/**
+ * Initializes the list of governors shared per ticker.
+ * Called by ms_voip_init(); without it ms_complexity_governor_get() creates a governor per caller.
+**/
+MS2_PUBLIC void ms_complexity_governors_init(void);
+
+MS2_PUBLIC void ms_complexity_governors_uninit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -366,17 +366,50 @@ extern "C"{
 
 /*abstraction layer over kiss fft, taken from speex as well*/
 
+/**
+ * An FFT implementation.
+ * init() returns NULL if the size is not supported. forward() has the semantic of ms_fft(), backward() the one
+ * of ms_ifft(); in and out may be the same buffer. A context is only used by one thread at a time.
+**/
+typedef struct _MSFFTBackend{
+	const char *name;
+	void *(*init)(int size);
+	void (*destroy)(void *ctx);
+	void (*forward)(void *ctx, const ms_word16_t *in, ms_word16_t *out);
+	void (*backward)(void *ctx, const ms_word16_t *in, ms_word16_t *out);
+} MSFFTBackend;
+
+/** The kiss_fft implementation, supporting all sizes. */
+MS2_PUBLIC const MSFFTBackend *ms_fft_get_kiss_backend(void);
+
+/** The native implementation, for power of two sizes. NULL in fixed point builds. */
+MS2_PUBLIC const MSFFTBackend *ms_fft_get_native_backend(void);
+
+/**
+ * Forces the implementation used by the next calls to ms_fft_init(), falling back to kiss_fft for the sizes it
+ * does not support. NULL restores the default, which is the native implementation when available.
+**/
+MS2_PUBLIC void ms_fft_set_backend(const MSFFTBackend *backend);
+
+/**
+ * Initializes the cache of native FFT plans, so that they can be shared among all the FFTs of the same size.
+ * Called by ms_voip_init(); without it each FFT computes its own plan.
+**/
+MS2_PUBLIC void ms_fft_plans_init(void);
+
+MS2_PUBLIC void ms_fft_plans_uninit(void);
+
 /** Compute tables for an FFT */
-void *ms_fft_init(int size);
+MS2_PUBLIC void *ms_fft_init(int size);
 
 /** Destroy tables for an FFT */
-void ms_fft_destroy(void *table);
+MS2_PUBLIC void ms_fft_destroy(void *table);
 
 /** Forward (real to half-complex) transform */
-void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out);
+MS2_PUBLIC void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out);
 
 /** Backward (half-complex to real) transform */
-void ms_ifft(void *table, ms_word16_t *in, ms_word16_t *out);
+MS2_PUBLIC void ms_ifft(void *table, ms_word16_t *in, ms_word16_t *out);
 
 /** digital filtering api*/
 void ms_fir_mem16(const ms_word16_t *x, const ms_coef_t *num, ms_word16_t *y, int N, int ord, ms_mem_t *mem);
@@ -53,6 +53,33 @@ typedef struct _MSDtmfGenCustomTone MSDtmfGenCustomTone;
 /**Sets default amplitude for dtmfs, expressed in the 0..1 range*/
 #define MS_DTMF_GEN_SET_DEFAULT_AMPLITUDE MS_FILTER_METHOD(MS_DTMF_GEN_ID,4,float)
 
+/**
+ * Call progress tones.
+**/
+enum _MSDtmfGenCadenceType{
+	MSDtmfGenRingback,
+	MSDtmfGenBusy,
+	MSDtmfGenCongestion
+};
+
+typedef enum _MSDtmfGenCadenceType MSDtmfGenCadenceType;
+
+/**
+ * Structure describing a call progress tone.
+**/
+struct _MSDtmfGenCadence{
+	char country[4];	/**<Country code: "us", "uk", "fr", "de"; other countries get the CEPT recommendation ("eu")*/
+	MSDtmfGenCadenceType type;
+};
+
+typedef struct _MSDtmfGenCadence MSDtmfGenCadence;
+
+/**
+ * Play a call progress tone, repeated until MS_DTMF_GEN_STOP.
+ * A period of the tone is rendered once for each sample rate and amplitude, each generator playing its own copy of it.
+**/
+#define MS_DTMF_GEN_PLAY_CADENCE	MS_FILTER_METHOD(MS_DTMF_GEN_ID,5,MSDtmfGenCadence)
+
 
 /**
  * Structure carried by MS_DTMF_GEN_EVENT
@@ -71,4 +98,20 @@ typedef struct _MSDtmfGenEvent MSDtmfGenEvent;
 
 extern MSFilterDesc ms_dtmf_gen_desc;
 
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Initializes the cache of rendered call progress tones, so that they can be shared among generators.
+ * Called by ms_voip_init(); without it each generator renders its own tones.
+**/
+MS2_PUBLIC void ms_dtmf_gen_cadences_init(void);
+
+MS2_PUBLIC void ms_dtmf_gen_cadences_uninit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <mediastreamer2/msvideo.h>
 #include <mediastreamer2/bitratecontrol.h>
 #include <mediastreamer2/qualityindicator.h>
+#include <mediastreamer2/complexitygovernor.h>
 #include <mediastreamer2/ice.h>
 #include <ortp/ortp.h>
 #include <ortp/event.h>
@@ -87,6 +88,7 @@ struct _MediaStream {
 	MSFilter *voidsink;
 	MSBitrateController *rc;
 	MSQualityIndicator *qi;
+	MSComplexityGovernor *governor;
 	IceCheckList *ice_check_list;
 	OrtpZrtpContext *zrtp_context;
 	srtp_t srtp_session;
@@ -94,7 +96,8 @@ struct _MediaStream {
 	time_t last_iterate_time;
 	bool_t use_rc;
 	bool_t is_beginning;
-	bool_t pad[2];
+	bool_t use_governor;
+	bool_t pad[1];
 };
 
 typedef struct _MediaStream MediaStream;
@@ -109,6 +112,10 @@ MS2_PUBLIC void media_stream_enable_adaptive_bitrate_control(MediaStream *stream
 
 MS2_PUBLIC void media_stream_enable_adaptive_jittcomp(MediaStream *stream, bool_t enabled);
 
+/*lowers the complexity of the encoder when its ticker is overloaded. The streams run by the same ticker share one MSComplexityGovernor,
+ which steps down the most expensive encoder first*/
+MS2_PUBLIC void media_stream_enable_complexity_governor(MediaStream *stream, bool_t enabled);
+
 MS2_PUBLIC bool_t media_stream_enable_srtp(MediaStream* stream, enum ortp_srtp_crypto_suite_t suite, const char* snd_key, const char* rcv_key);
 
 MS2_PUBLIC const MSQualityIndicator *media_stream_get_quality_indicator(MediaStream *stream);
@@ -149,6 +156,9 @@ struct _AudioStream
 	MSFilter *recorder_mixer;
 	MSFilter *recorder;
 	char *recorder_file;
+	MSFilter *payload_tee;
+	MSFilter *payload_recorder; /*MSPayloadRec, stores the received packets without decoding them*/
+	char *payload_recorder_file;
 	uint64_t last_packet_count;
 	time_t last_packet_time;
 	EchoLimiterType el_type; /*use echo limiter: two MSVolume, measured input level controlling local output level*/
@@ -158,6 +168,8 @@ struct _AudioStream
 	bool_t use_agc;
 	bool_t eq_active;
 	bool_t use_ng;/*noise gate*/
+	bool_t use_dtx;/*discontinuous transmission*/
+	bool_t use_float;/*float samples between the codec and the audio processing*/
 	bool_t is_ec_delay_set;
 };
 
@@ -232,6 +244,7 @@ MS2_PUBLIC AudioStream *audio_stream_new(int loc_rtp_port, int loc_rtcp_port, bo
 #define AUDIO_STREAM_FEATURE_DTMF		(1 << 5)
 #define AUDIO_STREAM_FEATURE_DTMF_ECHO		(1 << 6)
 #define AUDIO_STREAM_FEATURE_MIXED_RECORDING	(1 << 7)
+#define AUDIO_STREAM_FEATURE_PAYLOAD_RECORDING	(1 << 8) /*not part of AUDIO_STREAM_FEATURE_ALL, set by audio_stream_payload_record_open()*/
 
 #define AUDIO_STREAM_FEATURE_ALL	(\
 					AUDIO_STREAM_FEATURE_PLC | \
@@ -291,6 +304,13 @@ MS2_PUBLIC void audio_stream_enable_automatic_gain_control(AudioStream *stream,
 /*to be done before start */
 MS2_PUBLIC void audio_stream_set_echo_canceller_params(AudioStream *st, int tail_len_ms, int delay_ms, int framesize);
 
+/*run the echo canceller in its own thread rather than the ticker's, at the cost of about one tick of additional latency
+ on the sent signal. To be done before start(), has no effect with echo cancellers that cannot run asynchronously*/
+MS2_PUBLIC void audio_stream_enable_async_echo_canceller(AudioStream *stream, bool_t val);
+
+/*load of the echo canceller thread in percent of a cpu since the previous call, 0 when it does not run asynchronously*/
+MS2_PUBLIC float audio_stream_get_echo_canceller_load(AudioStream *stream);
+
 /*enable adaptive rate control */
 static inline void audio_stream_enable_adaptive_bitrate_control(AudioStream *stream, bool_t enabled) {
 	media_stream_enable_adaptive_bitrate_control(&stream->ms, enabled);
@@ -309,6 +329,13 @@ MS2_PUBLIC void audio_stream_mute_rtp(AudioStream *stream, bool_t val);
 /*enable noise gate, must be done before start()*/
 MS2_PUBLIC void audio_stream_enable_noise_gate(AudioStream *stream, bool_t val);
 
+/*enable discontinuous transmission: silence is detected on the sending side, and sent as comfort noise or not at all, depending on the codec*/
+MS2_PUBLIC void audio_stream_enable_dtx(AudioStream *stream, bool_t val);
+
+/*exchange float samples between the codec and the audio processing filters when they all support it, which saves
+ conversions. Must be done before start(), and is not compatible with audio conferences.*/
+MS2_PUBLIC void audio_stream_enable_float_samples(AudioStream *stream, bool_t val);
+
 /*enable parametric equalizer in the stream that goes to the speaker*/
 MS2_PUBLIC void audio_stream_enable_equalizer(AudioStream *stream, bool_t enabled);
 
@@ -326,6 +353,16 @@ MS2_PUBLIC int audio_stream_mixed_record_start(AudioStream *st);
 
 MS2_PUBLIC int audio_stream_mixed_record_stop(AudioStream *st);
 
+/**
+ * Records the received audio as it arrives from the network, without decoding it, see mspayloadrec.h for the
+ * supported codecs and file formats. Like the mixed recording, it has to be requested before the stream is started.
+**/
+MS2_PUBLIC int audio_stream_payload_record_open(AudioStream *st, const char *filename);
+
+MS2_PUBLIC int audio_stream_payload_record_start(AudioStream *st);
+
+MS2_PUBLIC int audio_stream_payload_record_stop(AudioStream *st);
+
 MS2_PUBLIC void audio_stream_set_default_card(int cardindex);
 
 /* retrieve RTP statistics*/
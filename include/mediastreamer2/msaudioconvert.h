@@ -0,0 +1,125 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msaudioconvert_h
+#define msaudioconvert_h
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * Sample format and channel layout conversions.
+ * Like the audio kernels, the best implementation available on the running cpu (plain C, SSE2 or NEON) is selected
+ * the first time one of these functions is called, and all implementations produce exactly the same output.
+ * Stereo samples are interleaved, left channel first.
+**/
+
+/**
+ * Formats of the samples exchanged by audio filters, see MS_FILTER_SET_SAMPLE_FORMAT.
+**/
+typedef enum _MSSampleFormat{
+	MSSampleFormatS16, /**<16 bit signed integers in host byte order, the default*/
+	MSSampleFormatFloat32 /**<32 bit floats, nominally between -1 and 1*/
+} MSSampleFormat;
+
+#define ms_sample_format_get_size(fmt) ((fmt)==MSSampleFormatFloat32 ? 4 : 2)
+
+/*scales between 16 bit samples and MSSampleFormatFloat32 samples*/
+#define MS_AUDIO_CONVERT_S16_TO_FLOAT_SCALE (1.0f/32768.0f)
+#define MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE 32768.0f
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Swaps the bytes of 16 bit samples, ie converts between host and network byte order on little endian hosts.
+ * dst may be equal to src.
+**/
+MS2_PUBLIC void ms_audio_convert_swap16(int16_t *dst, const int16_t *src, int nsamples);
+
+/**
+ * Converts 16 bit samples to host order from network order (big endian). Does nothing but a copy on big endian hosts.
+ * dst may be equal to src.
+**/
+MS2_PUBLIC void ms_audio_convert_ntoh16(int16_t *dst, const int16_t *src, int nsamples);
+
+/**
+ * Converts 16 bit samples from host order to network order (big endian). dst may be equal to src.
+**/
+#define ms_audio_convert_hton16(dst,src,nsamples) ms_audio_convert_ntoh16(dst,src,nsamples)
+
+/**
+ * Converts 16 bit samples to floats: dst[i]=scale*src[i].
+**/
+MS2_PUBLIC void ms_audio_convert_s16_to_float(float *dst, const int16_t *src, int nsamples, float scale);
+
+/**
+ * Converts floats to 16 bit samples: dst[i]=scale*src[i], rounded toward zero and clipped to [-32768, 32767].
+ * dst may be equal to src.
+**/
+MS2_PUBLIC void ms_audio_convert_float_to_s16(int16_t *dst, const float *src, int nsamples, float scale);
+
+/**
+ * Interleaves two mono channels into a stereo buffer of nframes frames.
+**/
+MS2_PUBLIC void ms_audio_convert_interleave(int16_t *dst, const int16_t *left, const int16_t *right, int nframes);
+
+/**
+ * Splits a stereo buffer of nframes frames into two mono channels.
+**/
+MS2_PUBLIC void ms_audio_convert_deinterleave(int16_t *left, int16_t *right, const int16_t *src, int nframes);
+
+/**
+ * Mixes a stereo buffer of nframes frames down to mono, each output sample being the average of the two channels.
+ * dst may be equal to src.
+**/
+MS2_PUBLIC void ms_audio_convert_downmix(int16_t *dst, const int16_t *src, int nframes);
+
+/**
+ * Duplicates a mono buffer of nframes samples into both channels of a stereo buffer. dst must not overlap src.
+**/
+MS2_PUBLIC void ms_audio_convert_upmix(int16_t *dst, const int16_t *src, int nframes);
+
+/**
+ * Converts a message of 16 bit samples between mono and stereo. The message is consumed: the conversion to mono
+ * is done in place when its data is not shared, otherwise a new message carrying the same meta information is returned.
+ * Returns the message unchanged if the numbers of channels are equal or not supported.
+**/
+MS2_PUBLIC mblk_t *ms_audio_convert_channels_msg(mblk_t *im, int in_nchannels, int out_nchannels);
+
+/**
+ * Converts a message of 16 bit samples between network and host byte order. The message is consumed: the conversion
+ * is done in place when its data is not shared, otherwise into a new message carrying the same meta information.
+**/
+MS2_PUBLIC mblk_t *ms_audio_convert_ntoh16_msg(mblk_t *im);
+
+#define ms_audio_convert_hton16_msg(im) ms_audio_convert_ntoh16_msg(im)
+
+/**
+ * Converts a message of samples from in_format to out_format. The message is consumed: the conversion to 16 bit
+ * samples is done in place when its data is not shared, otherwise a new message carrying the same meta information
+ * is returned.
+**/
+MS2_PUBLIC mblk_t *ms_audio_convert_format_msg(mblk_t *im, MSSampleFormat in_format, MSSampleFormat out_format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
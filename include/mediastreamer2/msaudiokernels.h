@@ -0,0 +1,78 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msaudiokernels_h
+#define msaudiokernels_h
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * Measurements of a block of 16 bit samples.
+**/
+typedef struct _MSAudioLevels{
+	int64_t sum; /**<sum of the samples, to estimate the DC offset*/
+	int64_t sum_squares; /**<sum of the squared samples*/
+	int peak; /**<maximum absolute value*/
+} MSAudioLevels;
+
+/**
+ * Table of elementary 16 bit sample processing routines (mixing, gain, level measurement).
+ * The best implementation available on the running cpu (plain C, SSE2, AVX2 or NEON) is selected
+ * once, the first time ms_audio_kernels_get() is called.
+ * All integer routines produce exactly the same output whatever the implementation.
+**/
+typedef struct _MSAudioKernels{
+	const char *name; /**<name of the implementation, for logging purpose*/
+	/** sum[i]+=contrib[i] */
+	void (*accumulate)(int32_t *sum, const int16_t *contrib, int nsamples);
+	/** out[i]=sum[i] clipped to [-limit, limit] */
+	void (*saturate)(int16_t *out, const int32_t *sum, int nsamples, int16_t limit);
+	/** out[i]=sum[i]-own[i] clipped to [-limit, limit], ie the mix without the own contribution of a participant*/
+	void (*saturate_minus)(int16_t *out, const int32_t *sum, const int16_t *own, int nsamples, int16_t limit);
+	/** samples[i]=(int)(gain*samples[i]) clipped to [-32767, 32767] */
+	void (*apply_gain)(int16_t *samples, int nsamples, float gain);
+	/** computes the levels of the samples */
+	void (*measure)(const int16_t *samples, int nsamples, MSAudioLevels *levels);
+	/** samples[i]=(int)(gain*(samples[i]-offset)) clipped to [-32767, 32767].
+	 If levels is not NULL, the samples are measured before being modified, in the same pass*/
+	void (*measure_and_scale)(int16_t *samples, int nsamples, int16_t offset, float gain, MSAudioLevels *levels);
+	/** returns the sum of a[i]*b[i]. As the additions are not done in the same order, the result may differ
+	 in the last bits between implementations.*/
+	float (*dot_product)(const float *a, const float *b, int n);
+} MSAudioKernels;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Returns the audio kernel table best suited to the running cpu.
+**/
+MS2_PUBLIC const MSAudioKernels *ms_audio_kernels_get(void);
+
+/**
+ * Returns the portable C implementation of the audio kernels, mainly useful for testing.
+**/
+MS2_PUBLIC const MSAudioKernels *ms_audio_kernels_get_generic(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,11 +26,30 @@ typedef struct MSAudioMixerCtl{
 	union param_t { 
 		float gain; /**<gain correction */
 		int active; /**< to mute or unmute the channel */
+		int rate; /**< output sample rate of the pin */
+		int shared; /**< the output block may be shared with other listeners */
 	} param;
 } MSAudioMixerCtl;
 
 #define MS_AUDIO_MIXER_SET_INPUT_GAIN			MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,0,MSAudioMixerCtl)
 #define MS_AUDIO_MIXER_SET_ACTIVE				MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,1,MSAudioMixerCtl)
 #define MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE	MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,2,int)
+/**
+ * Limits the mix to the N loudest input channels (active speakers), the others being only listeners.
+ * Speakers are selected on their energy, with some hysteresis to avoid switching at every tick.
+ * 0 (the default) mixes all channels.
+**/
+#define MS_AUDIO_MIXER_SET_MAX_SPEAKERS			MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,3,int)
+/**
+ * Sets the sample rate of an output pin, when it differs from the mixer's one. Takes effect at the next preprocess.
+ * All pins at the same rate share an output sub-bus, so that the mix is resampled once per distinct rate.
+**/
+#define MS_AUDIO_MIXER_SET_OUTPUT_RATE			MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,4,MSAudioMixerCtl)
+/**
+ * Sets whether an output pin receives the same block as the other listeners, which is the default, or its own copy.
+ * A shared block is read-only and must not leave the ticker thread: sharing has to be disabled for pins whose
+ * downstream filters modify it in place or hand it to another thread.
+**/
+#define MS_AUDIO_MIXER_SET_SHARED_OUTPUT		MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,5,MSAudioMixerCtl)
 
 #endif
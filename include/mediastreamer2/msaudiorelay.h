@@ -0,0 +1,57 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msaudiorelay_h
+#define msaudiorelay_h
+
+#include <mediastreamer2/msaudiomixer.h>
+
+/**
+ * The audio relay forwards encoded audio between conference members, without decoding, mixing nor encoding:
+ * input pin i and output pin i belong to member i, and carry the payloads of its RTP streams.
+ * Every member receives the packets of the active speaker, or those of the previous speaker when it is itself the active
+ * speaker. Timestamps are rewritten at each switch so that every output remains a single continuous stream,
+ * which any endpoint can play.
+ * All members must use the same codec, set with MS_AUDIO_RELAY_SET_CODEC, and its RTP clock rate with
+ * MS_FILTER_SET_SAMPLE_RATE. The speaker is selected on an estimate of the energy of the payloads, which is exact for
+ * "pcmu" and "pcma", and is the payload size for other codecs: it follows the voice activity of variable bitrate
+ * codecs, and of any codec using discontinuous transmission.
+**/
+
+#define MS_AUDIO_RELAY_MAX_MEMBERS 512
+
+/**
+ * Sets the codec by its RTP encoding name.
+**/
+#define MS_AUDIO_RELAY_SET_CODEC		MS_FILTER_METHOD(MS_AUDIO_RELAY_ID,0,const char)
+/**
+ * Mutes or unmutes a member: a muted member is never selected as speaker. The param field used is active.
+**/
+#define MS_AUDIO_RELAY_SET_ACTIVE		MS_FILTER_METHOD(MS_AUDIO_RELAY_ID,1,MSAudioMixerCtl)
+/**
+ * Gets the pin of the active speaker, -1 if nobody speaks.
+**/
+#define MS_AUDIO_RELAY_GET_SPEAKER		MS_FILTER_METHOD(MS_AUDIO_RELAY_ID,2,int)
+
+/**
+ * Notified when the active speaker changes, the argument is its pin, -1 if nobody speaks anymore.
+**/
+#define MS_AUDIO_RELAY_SPEAKER_CHANGED	MS_FILTER_EVENT(MS_AUDIO_RELAY_ID,0,int)
+
+#endif
@@ -0,0 +1,50 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef mscodecfarm_h
+#define mscodecfarm_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * The codec farm encodes or decodes many independent streams within a single filter: input pin i and output pin i
+ * carry stream i. The codec states are kept in contiguous arrays and all streams are processed in one call, which is
+ * far more cache friendly than one codec filter per stream on transcoding servers.
+ * Supported codecs are "pcmu", "pcma", "g722" and "l16". All streams share the same codec, mode and ptime.
+ * The usual MS_FILTER_ADD_FMTP (ptime), MS_FILTER_SET_SAMPLE_RATE and MS_FILTER_SET_NCHANNELS (L16 only) apply.
+**/
+
+#define MS_CODEC_FARM_MAX_STREAMS 512
+
+typedef enum _MSCodecFarmMode{
+	MSCodecFarmEncoder,
+	MSCodecFarmDecoder
+} MSCodecFarmMode;
+
+/**
+ * Sets the codec by its RTP encoding name, before the filter is attached to a ticker.
+ * Returns -1 if the codec is not supported.
+**/
+#define MS_CODEC_FARM_SET_CODEC		MS_FILTER_METHOD(MS_CODEC_FARM_ID,0,const char)
+/**
+ * Encoder (the default) or decoder, before the filter is attached to a ticker.
+**/
+#define MS_CODEC_FARM_SET_MODE		MS_FILTER_METHOD(MS_CODEC_FARM_ID,1,MSCodecFarmMode)
+
+#endif
@@ -21,6 +21,7 @@
 #define mscodecutils_h
 
 #include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
 
 /**
  * Helper object for audio decoders to determine whether PLC (packet loss concealment is needed).
@@ -96,6 +97,69 @@ MS2_PUBLIC int ms_concealer_ts_context_inc_sample_ts(MSConcealerTsContext* obj,
 MS2_PUBLIC unsigned long ms_concealer_ts_context_get_total_number_of_plc(MSConcealerTsContext* obj);
 
 
+/**
+ * Helper object allowing several instances of a stateless encoder to share the encoding of identical frames.
+ * Identity is determined from the pcm data blocks themselves: a frame made of the same (dupb'd) blocks as a frame
+ * already encoded gets a reference on the previous result. This is what happens in conferences,
+ * where all listeners receive the same shared mix.
+**/
+typedef struct _MSEncodedFrameCache MSEncodedFrameCache;
+
+#define MS_ENCODED_FRAME_MAX_PIECES 16
+
+/**
+ * Identity of a pcm frame, taken from the head of a MSBufferizer.
+**/
+typedef struct _MSEncodedFrameKey{
+	int npieces;
+	int size;
+	mblk_t *pieces[MS_ENCODED_FRAME_MAX_PIECES]; /*references on the pcm blocks, so that their address stays unique*/
+} MSEncodedFrameKey;
+
+MS2_PUBLIC MSEncodedFrameCache *ms_encoded_frame_cache_new(void);
+
+MS2_PUBLIC void ms_encoded_frame_cache_destroy(MSEncodedFrameCache *obj);
+
+/**
+ * Computes the key of the next frame_size bytes of a bufferizer.
+ * @returns TRUE if this frame is made of shared blocks and can be looked up in a cache, FALSE otherwise.
+ * A key successfully initialized must be given to ms_encoded_frame_cache_store() or released with ms_encoded_frame_key_release().
+**/
+MS2_PUBLIC bool_t ms_encoded_frame_key_init(MSEncodedFrameKey *key, MSBufferizer *bz, int frame_size);
+
+MS2_PUBLIC void ms_encoded_frame_key_release(MSEncodedFrameKey *key);
+
+/**
+ * Looks for a frame already encoded by an encoder of the same type.
+ * @param obj the cache
+ * @param encoder_id the MSFilterId of the encoder, so that different codecs never share results.
+ * @param key the key of the frame.
+ * @returns a new reference on the encoded frame, or NULL if not found.
+**/
+MS2_PUBLIC mblk_t *ms_encoded_frame_cache_lookup(MSEncodedFrameCache *obj, unsigned int encoder_id, const MSEncodedFrameKey *key);
+
+/**
+ * Stores an encoded frame in the cache. The key is released, the encoded frame is not modified.
+**/
+MS2_PUBLIC void ms_encoded_frame_cache_store(MSEncodedFrameCache *obj, unsigned int encoder_id, MSEncodedFrameKey *key, mblk_t *encoded);
+
+/**
+ * Comfort noise helpers, used for discontinuous transmission. The noise level is expressed like in RFC3389,
+ * as an attenuation in dBov between 0 and MS_COMFORT_NOISE_MAX_LEVEL.
+**/
+#define MS_COMFORT_NOISE_MAX_LEVEL 127
+
+/**
+ * Returns the level of a pcm signal, as carried by a comfort noise payload.
+**/
+MS2_PUBLIC int ms_comfort_noise_get_level(const int16_t *samples, int nsamples);
+
+/**
+ * Fills a buffer with white noise of the given level.
+ * @param seed the state of the random generator, to be kept by the caller between calls.
+**/
+MS2_PUBLIC void ms_comfort_noise_generate(int level, int16_t *samples, int nsamples, uint32_t *seed);
+
 /*FEC API*/
 typedef struct _MSRtpPayloadPickerContext MSRtpPayloadPickerContext;
 typedef mblk_t* (*RtpPayloadPicker)(MSRtpPayloadPickerContext* context,unsigned int sequence_number); 
@@ -0,0 +1,82 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef msconf_h
+#define msconf_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * Level of a MSConf channel, as read from the level table.
+**/
+typedef struct MSConfLevel{
+	float energy; /**< smoothed energy of the samples, on the square of the 16 bits scale*/
+	int peak; /**< highest absolute sample value of the last processed block*/
+	bool_t is_speaking; /**< the energy is above the speech threshold*/
+} MSConfLevel;
+
+/**
+ * Table of the channel levels, updated by the MSConf filter every time it mixes, and read by the application
+ * at its own rate with ms_conf_level_table_read(). Reading never blocks the filter.
+ * The table belongs to the filter and remains valid until the filter is destroyed.
+**/
+typedef struct _MSConfLevelTable MSConfLevelTable;
+
+/**
+ * Returns the level table of the filter, the argument is a MSConfLevelTable**.
+**/
+#define MS_CONF_GET_LEVEL_TABLE			MS_FILTER_METHOD(MS_CONF_ID,0,MSConfLevelTable*)
+/**
+ * Enables the MS_CONF_ACTIVE_SPEAKER_CHANGED event. Disabled by default.
+**/
+#define MS_CONF_ENABLE_SPEAKER_EVENTS	MS_FILTER_METHOD(MS_CONF_ID,1,int)
+
+/**
+ * Argument of the MS_CONF_CHANNEL_VOLUME event (see msfilter.h).
+**/
+typedef struct MSConfChannelVolume{
+	float energy; /**< smoothed energy of the channel, as in MSConfLevel*/
+	int channel; /**< pin of the channel*/
+} MSConfChannelVolume;
+
+/**
+ * Notified when the loudest speaking channel changes and remains the loudest for a while.
+ * The argument is the pin of the new active speaker, -1 when nobody speaks anymore.
+**/
+#define MS_CONF_ACTIVE_SPEAKER_CHANGED	MS_FILTER_EVENT(MS_CONF_ID,4,int)
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Copies the current level of the channel of a pin.
+ * @returns 0 if successful, -1 if the pin is out of range.
+**/
+MS2_PUBLIC int ms_conf_level_table_read(const MSConfLevelTable *table, int pin, MSConfLevel *level);
+
+/**
+ * Returns the number of pins covered by the table.
+**/
+MS2_PUBLIC int ms_conf_level_table_get_size(const MSConfLevelTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
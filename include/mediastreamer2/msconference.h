@@ -51,7 +51,8 @@ typedef struct _MSAudioConferenceParams MSAudioConferenceParams;
  * Then, participants to the conference can be added with ms_audio_conference_add_member().
  * The MSAudioConference takes in charge the mixing and dispatching of the audio to the participants.
  * If participants (MSAudioEndpoint) are using sampling rate different from the conference, then sample rate converters are automatically added
- * and configured.
+ * and configured. The mix sent to participants is resampled once per distinct sampling rate, not once per participant,
+ * so the conference rate should be the highest rate in use.
  * Participants can be removed from the conference with ms_audio_conference_remove_member().
  * The conference processing is performed in a new thread run by a MSTicker object, which is owned by the conference.
  * When all participants are removed, the MSAudioConference object can then be safely destroyed with ms_audio_conference_destroy().
@@ -86,6 +87,19 @@ MS2_PUBLIC MSAudioConference * ms_audio_conference_new(const MSAudioConferencePa
 **/
 MS2_PUBLIC const MSAudioConferenceParams *ms_audio_conference_get_params(MSAudioConference *obj);
 
+/**
+ * Turns the conference into a relay, or back into a mixing conference.
+ * @param obj the conference, which must not have any member yet.
+ * @param enabled TRUE to relay.
+ * @returns 0 if successful, -1 if the conference has members.
+ *
+ * A relay conference does not decode, mix nor encode: the encoded audio of the active speaker is forwarded to all
+ * the other members, and the speaker receives the previous one (see MSAudioRelay). Its cost per member is then
+ * a fraction of the one of a mixing conference, but only one participant can be heard at a time, all members must use
+ * the same codec, and recorder endpoints are not supported. Members that do not meet these requirements are not added.
+**/
+MS2_PUBLIC int ms_audio_conference_enable_relay(MSAudioConference *obj, bool_t enabled);
+
 /**
  * Adds a participant to the conference.
  * @param obj the conference
@@ -110,6 +124,17 @@ MS2_PUBLIC void ms_audio_conference_remove_member(MSAudioConference *obj, MSAudi
 **/
 MS2_PUBLIC void ms_audio_conference_mute_member(MSAudioConference *obj, MSAudioEndpoint *ep, bool_t muted);
 
+/**
+ * Limits the mix to the loudest participants.
+ *
+ * @param obj the conference
+ * @param max_speakers the maximum number of participants mixed together, 0 to mix everybody (the default).
+ *
+ * Other participants only listen. This makes the mixing cost depend on the number of speakers
+ * instead of the size of the conference, which is suitable for large conferences.
+**/
+MS2_PUBLIC void ms_audio_conference_set_max_speakers(MSAudioConference *obj, int max_speakers);
+
 /**
  * Returns the size (ie the number of participants) of a conference.
  * @param obj the conference
@@ -28,6 +28,9 @@ extern MSFilterDesc ms_file_rec_desc;
 #define MS_FILE_REC_STOP	MS_FILTER_METHOD_NO_ARG(MS_FILE_REC_ID,2)
 #define MS_FILE_REC_CLOSE	MS_FILTER_METHOD_NO_ARG(MS_FILE_REC_ID,3)
 
+/*notified when recorded data had to be dropped because the disk could not keep up, the argument is the number of bytes*/
+#define MS_FILE_REC_DATA_DROPPED	MS_FILTER_EVENT(MS_FILE_REC_ID,4,int)
+
 
 
 #endif
@@ -158,8 +158,10 @@ struct _MSFilter{
 	/*private attributes */
 	uint32_t last_tick;
 	MSFilterStats *stats;
+	uint64_t elapsed; /*cumulative processing time in nanoseconds, measured when statistics are enabled or measure_time is set*/
 	int postponed_task; /*number of postponed tasks*/
 	bool_t seen;
+	bool_t measure_time;
 };
 
 
@@ -635,8 +637,20 @@ typedef enum _MSFilterInterfaceId MSFilterInterfaceId;
 /* pass value of type MSRtpPayloadPickerContext copied by the filter*/
 #define MS_FILTER_SET_RTP_PAYLOAD_PICKER MS_FILTER_BASE_METHOD(27,void*)
 #define MS_FILTER_SET_OUTPUT_NCHANNELS	MS_FILTER_BASE_METHOD(28,int)
+/* sample format of audio pins, a MSSampleFormat (see msaudioconvert.h). Filters that do not implement it use MSSampleFormatS16.
+ For codecs this is the format of the pcm side. For filters able to convert, it sets both the input and output formats,
+ and MS_FILTER_SET_OUTPUT_SAMPLE_FORMAT can then change the output one.*/
+#define MS_FILTER_SET_SAMPLE_FORMAT	MS_FILTER_BASE_METHOD(29,int)
+#define MS_FILTER_GET_SAMPLE_FORMAT	MS_FILTER_BASE_METHOD(30,int)
+#define MS_FILTER_SET_OUTPUT_SAMPLE_FORMAT	MS_FILTER_BASE_METHOD(31,int)
+/* cpu/quality tradeoff of encoders, from 0 (cheapest) to 10 (best quality), mapped by each codec onto its own scale.
+ It may be changed while the filter is running, see MSComplexityGovernor.*/
+#define MS_FILTER_SET_COMPLEXITY	MS_FILTER_BASE_METHOD(32,int)
+#define MS_FILTER_GET_COMPLEXITY	MS_FILTER_BASE_METHOD(33,int)
 
 #define MS_CONF_SPEEX_PREPROCESS_MIC	MS_FILTER_EVENT(MS_CONF_ID, 1, void*)
+/* last level of each channel, notified every 200 ms with a MSConfChannelVolume (msconf.h). The level table gives the
+ levels at the rate chosen by the application, see MS_CONF_GET_LEVEL_TABLE*/
 #define MS_CONF_CHANNEL_VOLUME	MS_FILTER_EVENT(MS_CONF_ID, 3, void*)
 
 /** @} */
@@ -167,6 +167,15 @@ typedef enum _MSRecorderState MSRecorderState;
 #define MS_ECHO_CANCELLER_SET_STATE_STRING \
 	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,6, const char *)
 
+/** run the echo canceller on a worker thread rather than on the ticker thread, at the cost of about one ticker
+ * interval of additional latency on the near end signal. To be set before the filter is started. */
+#define MS_ECHO_CANCELLER_SET_ASYNC \
+	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,7,bool_t)
+
+/** get the load of the worker thread, in percent of a cpu, since the previous call. 0 if not running asynchronously */
+#define MS_ECHO_CANCELLER_GET_ASYNC_LOAD \
+	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,8,float)
+
 
 
 /** Interface definitions for video decoders */
@@ -209,5 +218,15 @@ typedef enum _MSRecorderState MSRecorderState;
 #define MS_AUDIO_ENCODER_GET_PTIME \
 	MS_FILTER_METHOD(MSFilterAudioEncoderInterface,1,int)
 
+/** Share the encoding of identical frames with other encoders using the same MSEncodedFrameCache (see mscodecutils.h), NULL to stop sharing.
+ Only implemented by encoders whose output depends on nothing but the current frame. */
+#define MS_AUDIO_ENCODER_SET_FRAME_CACHE \
+	MS_FILTER_METHOD(MSFilterAudioEncoderInterface,2,struct _MSEncodedFrameCache*)
+
+/** Lets the encoder replace silence by comfort noise payloads (RFC3389), to be enabled only when a CN payload type was negotiated.
+ Otherwise frames marked as silence are encoded like the others. */
+#define MS_AUDIO_ENCODER_ENABLE_CN \
+	MS_FILTER_METHOD(MSFilterAudioEncoderInterface,3,bool_t)
+
 
 #endif
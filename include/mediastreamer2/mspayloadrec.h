@@ -0,0 +1,39 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef mspayloadrec_h
+#define mspayloadrec_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * The payload recorder writes the encoded audio received from MSRtpRecv into a file, without decoding it.
+ * Opus and Speex payloads are stored in Ogg (RFC 7845 and the Speex Ogg mapping), G.711 payloads as raw
+ * mu-law or A-law samples. The RTP timestamps are kept: missing packets are stored as silence for G.711, and as
+ * empty packets, which decoders conceal, in Ogg. Comfort noise packets are treated as missing packets.
+ * The codec, its RTP clock rate and its number of channels must be set before the file is opened.
+ * The recorder implements the MSRecorderInterface, and the tools/payloadrender program converts its files to wav.
+**/
+
+/**
+ * Sets the codec by its RTP encoding name: "opus", "speex", "pcmu" or "pcma".
+**/
+#define MS_PAYLOAD_REC_SET_CODEC	MS_FILTER_METHOD(MS_PAYLOAD_REC_ID,0,const char)
+
+#endif
@@ -85,6 +85,10 @@ MS2_PUBLIC void ms_queue_destroy(MSQueue *q);
 #define mblk_get_precious_flag(m)    (((m)->reserved2)>>1 & 0x1) /*bit 2*/
 #define mblk_set_plc_flag(m,bit)    __mblk_set_flag(m,2,bit)  /*use to mark a plc generated block*/
 #define mblk_get_plc_flag(m)    (((m)->reserved2)>>1 & 0x2) /*bit 2*/
+#define mblk_set_silence_flag(m,bit)    __mblk_set_flag(m,3,bit)  /*use to mark a block of silence, as decided by a voice activity detector*/
+#define mblk_get_silence_flag(m)    (((m)->reserved2)>>3 & 0x1) /*bit 3*/
+#define mblk_set_cn_flag(m,bit)    __mblk_set_flag(m,4,bit)  /*use to mark a comfort noise payload (RFC3389)*/
+#define mblk_get_cn_flag(m)    (((m)->reserved2)>>4 & 0x1) /*bit 4*/
 #define mblk_set_cseq(m,value) (m)->reserved2=(m)->reserved2| ((value&0xFFFF)<<16);	
 #define mblk_get_cseq(m) ((m)->reserved2>>16)
 	
@@ -115,6 +119,9 @@ static inline int ms_bufferizer_get_avail(MSBufferizer *obj){
 
 MS2_PUBLIC void ms_bufferizer_skip_bytes(MSBufferizer *obj, int bytes);
 
+/* returns TRUE if the next datalen bytes only come from blocks marked with the silence flag*/
+MS2_PUBLIC bool_t ms_bufferizer_is_silent(MSBufferizer *obj, int datalen);
+
 /* purge all data pending in the bufferizer */
 MS2_PUBLIC void ms_bufferizer_flush(MSBufferizer *obj);
 
@@ -0,0 +1,88 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msresampler_h
+#define msresampler_h
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * Polyphase sample rate converter.
+ * The filter tables only depend on the input rate, output rate and quality: they are computed once and shared
+ * by all the resamplers using the same conversion. Each resampler only owns its history buffer.
+**/
+typedef struct _MSResampler MSResampler;
+
+typedef enum _MSResamplerQuality{
+	MSResamplerQualityLow,
+	MSResamplerQualityVoip, /**<the default, suitable for speech*/
+	MSResamplerQualityHigh
+} MSResamplerQuality;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Creates a resampler.
+ * @param in_rate input sample rate in Hz
+ * @param out_rate output sample rate in Hz
+ * @param nchannels number of interleaved channels
+ * @param quality the quality of the anti-aliasing filter, which determines its length.
+ * @returns a new resampler, or NULL if the parameters are invalid.
+**/
+MS2_PUBLIC MSResampler *ms_resampler_new(int in_rate, int out_rate, int nchannels, MSResamplerQuality quality);
+
+MS2_PUBLIC void ms_resampler_destroy(MSResampler *obj);
+
+/**
+ * Clears the history of the resampler, as if it was just created.
+**/
+MS2_PUBLIC void ms_resampler_reset(MSResampler *obj);
+
+/**
+ * Returns the maximum number of frames (samples per channel) output for nframes input frames.
+**/
+MS2_PUBLIC int ms_resampler_get_max_output(MSResampler *obj, int nframes);
+
+/**
+ * Resamples interleaved 16 bit samples.
+ * All the input frames are consumed. Output frames that do not fit in max_out are kept for the next call.
+ * @returns the number of output frames.
+**/
+MS2_PUBLIC int ms_resampler_process(MSResampler *obj, const int16_t *in, int nframes, int16_t *out, int max_out);
+
+/**
+ * Same as ms_resampler_process() for floating point samples. No clipping is performed.
+**/
+MS2_PUBLIC int ms_resampler_process_float(MSResampler *obj, const float *in, int nframes, float *out, int max_out);
+
+/**
+ * Initializes the cache of filter tables, so that they can be shared among resamplers.
+ * Called by ms_voip_init(); without it each resampler computes its own tables.
+**/
+MS2_PUBLIC void ms_resampler_tables_init(void);
+
+MS2_PUBLIC void ms_resampler_tables_uninit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -69,6 +69,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define MS_VOLUME_SET_EA_TRANSMIT_THRESHOLD	MS_FILTER_METHOD(MS_VOLUME_ID,17,float)
 
+/* marks the output blocks that are silence with the silence flag, for discontinuous transmission*/
+#define MS_VOLUME_ENABLE_DTX	MS_FILTER_METHOD(MS_VOLUME_ID,18,int)
+
+/* energy below which a block is considered as silence, in linear scale like the noise gate threshold*/
+#define MS_VOLUME_SET_DTX_THRESHOLD	MS_FILTER_METHOD(MS_VOLUME_ID,19,float)
+
 
 #define MS_VOLUME_DB_LOWEST		(-120)	/*arbitrary value returned when linear volume is 0*/
 
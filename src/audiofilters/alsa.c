@@ -22,6 +22,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include <alsa/asoundlib.h>
+#include <fcntl.h>
+#include <poll.h>
 
 
 #include "mediastreamer2/msfilter.h"
@@ -38,13 +40,28 @@ void ms_alsa_card_set_forced_sample_rate(int samplerate){
 	forced_rate=samplerate;
 }
 
-//#define THREADED_VERSION
+/*capture and playback run in their own threads, woken by the device, instead of polling it from the ticker.
+Define ALSA_NO_THREADS (configure --disable-alsa-threads) to poll the device from the ticker again*/
+#ifndef ALSA_NO_THREADS
+#define THREADED_VERSION
+#endif
 
 /*in case of troubles with a particular driver, try incrementing ALSA_PERIOD_SIZE
 to 512, 1024, 2048, 4096...
 then try incrementing the number of periods*/
 #define ALSA_PERIODS 8
+#ifdef THREADED_VERSION
+/*the device threads are woken at each period, smaller periods give less latency*/
+#define ALSA_PERIOD_SIZE 128
+#else
 #define ALSA_PERIOD_SIZE 256
+#endif
+
+/*samples per block output by the capture filter, at 8kHz*/
+#define ALSA_READ_BLOCK 128
+
+/*delay between two attempts to open a device that failed to open*/
+#define ALSA_REOPEN_INTERVAL 1000
 
 /*uncomment the following line if you have problems with an alsa driver
 having sound quality trouble:*/
@@ -83,7 +100,8 @@ static void alsa_resume(snd_pcm_t *handle){
 	}
 }
 
-static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo, int rate)
+/*mmap, when not NULL, requests the mmap access and tells whether the device accepted it*/
+static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo, int rate, bool_t *mmap)
 {
 	snd_pcm_hw_params_t *hwparams=NULL;
 	snd_pcm_sw_params_t *swparams=NULL;
@@ -106,7 +124,17 @@ static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo,
 		return -1;
 	}
 	
-	if (snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+	if (mmap!=NULL && *mmap){
+		/*tested first, a failed set leaves the configuration space unusable*/
+		if (snd_pcm_hw_params_test_access(pcm_handle, hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0
+			&& snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+			ms_message("alsa_set_params: using mmap access.");
+		}else{
+			ms_message("alsa_set_params: mmap access not supported, using read/write access.");
+			*mmap=FALSE;
+		}
+	}
+	if ((mmap==NULL || !*mmap) && snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
 		ms_warning("alsa_set_params: Error setting access.");
 		return -1;
 	}
@@ -229,26 +257,18 @@ static void alsa_fill_w (snd_pcm_t *pcm_handle)
 }
 #endif
 
-static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
+static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate,bool_t *mmap)
 {
 	snd_pcm_t *pcm_handle;
 	int err;
 
 	ms_message("alsa_open_r: opening %s at %iHz, bits=%i, stereo=%i",pcmdev,rate,bits,stereo);
 
-
-#ifndef THREADED_VERSION
+	/*the threaded version waits for the device with poll() and needs non blocking transfers as well*/
 	if (snd_pcm_open(&pcm_handle, pcmdev,SND_PCM_STREAM_CAPTURE,SND_PCM_NONBLOCK) < 0) {
 		ms_warning("alsa_open_r: Error opening PCM device %s",pcmdev );
 		return NULL;
 	}
-#else
-	/* want blocking mode for threaded version */
-	if (snd_pcm_open(&pcm_handle, pcmdev,SND_PCM_STREAM_CAPTURE,0) < 0) {
-		ms_warning("alsa_open_r: Error opening PCM device %s",pcmdev );
-		return NULL;
-	}
-#endif
 	{
 	struct timeval tv1;
 	struct timeval tv2;
@@ -256,7 +276,7 @@ static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
 	int diff = 0;
 	err = gettimeofday(&tv1, &tz);
 	while (1) { 
-		if (!(alsa_set_params(pcm_handle,0,bits,stereo,rate)<0)){
+		if (!(alsa_set_params(pcm_handle,0,bits,stereo,rate,mmap)<0)){
 			ms_message("alsa_open_r: Audio params set");
 			break;
 		}
@@ -282,7 +302,7 @@ static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
 	return pcm_handle;
 }
 
-static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate)
+static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate,bool_t *mmap)
 {
 	snd_pcm_t *pcm_handle;
 
@@ -301,7 +321,7 @@ static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate)
 	int err;
 	err = gettimeofday(&tv1, &tz);
 	while (1) { 
-		if (!(alsa_set_params(pcm_handle,1,bits,stereo,rate)<0)){
+		if (!(alsa_set_params(pcm_handle,1,bits,stereo,rate,mmap)<0)){
 			ms_message("alsa_open_w: Audio params set");
 			break;
 		}
@@ -746,6 +766,72 @@ static MSSndCard * alsa_card_new(int id)
 	return obj;
 }
 
+#ifdef THREADED_VERSION
+
+#define memory_barrier() __sync_synchronize()
+
+/*
+ * Ring buffer between a device thread and the ticker, with a single producer and a single consumer.
+ * Each position is written by one side only, and the barriers order the accesses to the data with the updates of the
+ * positions, so that neither side ever waits for the other.
+ */
+typedef struct _AlsaRing{
+	uint8_t *buf;
+	unsigned int size; /*a power of two*/
+	volatile unsigned int rpos; /*written by the consumer*/
+	volatile unsigned int wpos; /*written by the producer*/
+} AlsaRing;
+
+static void alsa_ring_init(AlsaRing *r, int min_size){
+	r->size=1;
+	while(r->size<(unsigned int)min_size) r->size<<=1;
+	r->buf=(uint8_t*)ms_malloc(r->size);
+	r->rpos=r->wpos=0;
+}
+
+static void alsa_ring_uninit(AlsaRing *r){
+	if (r->buf!=NULL) ms_free(r->buf);
+	r->buf=NULL;
+}
+
+static int alsa_ring_get_avail(AlsaRing *r){
+	return (int)(r->wpos-r->rpos);
+}
+
+static int alsa_ring_get_space(AlsaRing *r){
+	return (int)(r->size-(r->wpos-r->rpos));
+}
+
+/*contiguous free space, to be filled by the producer then committed*/
+static uint8_t *alsa_ring_get_write_ptr(AlsaRing *r, int *len){
+	unsigned int rpos=r->rpos;
+	unsigned int offset=r->wpos&(r->size-1);
+	memory_barrier();
+	*len=(int)MIN(r->size-(r->wpos-rpos),r->size-offset);
+	return r->buf+offset;
+}
+
+static void alsa_ring_commit_write(AlsaRing *r, int len){
+	memory_barrier();
+	r->wpos+=len;
+}
+
+/*contiguous data, to be read by the consumer then committed*/
+static const uint8_t *alsa_ring_get_read_ptr(AlsaRing *r, int *len){
+	unsigned int wpos=r->wpos;
+	unsigned int offset=r->rpos&(r->size-1);
+	memory_barrier();
+	*len=(int)MIN(wpos-r->rpos,r->size-offset);
+	return r->buf+offset;
+}
+
+static void alsa_ring_commit_read(AlsaRing *r, int len){
+	memory_barrier();
+	r->rpos+=len;
+}
+
+#endif
+
 struct _AlsaReadData{
 	char *pcmdev;
 	snd_pcm_t *handle;
@@ -756,8 +842,13 @@ struct _AlsaReadData{
 
 #ifdef THREADED_VERSION
 	ms_thread_t thread;
-	ms_mutex_t mutex;
-	MSBufferizer * bufferizer;
+	AlsaRing ring;
+	int wakeup[2]; /*pipe waking the device thread up: to stop it, or for playback when the ring gets data again*/
+	snd_pcm_uframes_t buffer_size;
+	snd_pcm_uframes_t period_size;
+	bool_t mmap;
+	bool_t overflow;
+	volatile bool_t idle; /*the playback thread had nothing left to play and waits for the ticker*/
 	bool_t read_started;
 	bool_t write_started;
 #endif
@@ -766,7 +857,7 @@ struct _AlsaReadData{
 typedef struct _AlsaReadData AlsaReadData;
 
 void alsa_read_init(MSFilter *obj){
-	AlsaReadData *ad=ms_new(AlsaReadData,1);
+	AlsaReadData *ad=ms_new0(AlsaReadData,1);
 	ad->pcmdev=NULL;
 	ad->handle=NULL;
 	ad->rate=forced_rate!=-1 ? forced_rate : 8000;
@@ -775,97 +866,326 @@ void alsa_read_init(MSFilter *obj){
 	obj->data=ad;
 
 #ifdef THREADED_VERSION
-	ad->read_started=FALSE;
-	ad->write_started=FALSE;
-	ad->bufferizer=ms_bufferizer_new();
-	ms_mutex_init(&ad->mutex,NULL);
-	ad->thread=0;
+	ad->wakeup[0]=ad->wakeup[1]=-1;
 #endif
 }
 
 #ifdef THREADED_VERSION
 
-static void * alsa_write_thread(void *p){
-	AlsaReadData *ad=(AlsaReadData*)p;
-	int samples=(160*ad->rate)/8000;
+static int alsa_wakeup_init(AlsaReadData *ad){
+	if (pipe(ad->wakeup)!=0){
+		ms_error("alsa: cannot create wakeup pipe: %s",strerror(errno));
+		ad->wakeup[0]=ad->wakeup[1]=-1;
+		return -1;
+	}
+	fcntl(ad->wakeup[0],F_SETFL,O_NONBLOCK);
+	fcntl(ad->wakeup[1],F_SETFL,O_NONBLOCK);
+	return 0;
+}
+
+static void alsa_wakeup_uninit(AlsaReadData *ad){
+	if (ad->wakeup[0]!=-1) close(ad->wakeup[0]);
+	if (ad->wakeup[1]!=-1) close(ad->wakeup[1]);
+	ad->wakeup[0]=ad->wakeup[1]=-1;
+}
+
+static void alsa_wakeup(AlsaReadData *ad){
+	char c=0;
+	/*a full pipe already wakes the thread up*/
+	if (write(ad->wakeup[1],&c,1)==-1 && errno!=EAGAIN) ms_warning("alsa: cannot wake device thread up: %s",strerror(errno));
+}
+
+static void alsa_wakeup_drain(AlsaReadData *ad){
+	char buf[32];
+	while(read(ad->wakeup[0],buf,sizeof(buf))>0);
+}
+
+/*the wakeup pipe comes first, the device descriptors follow*/
+static struct pollfd *alsa_poll_descriptors_new(AlsaReadData *ad, int *npfds){
+	int count=snd_pcm_poll_descriptors_count(ad->handle);
+	struct pollfd *pfds;
+	if (count<=0) return NULL;
+	pfds=ms_new0(struct pollfd,count+1);
+	pfds[0].fd=ad->wakeup[0];
+	pfds[0].events=POLLIN;
+	*npfds=snd_pcm_poll_descriptors(ad->handle,pfds+1,count);
+	return pfds;
+}
+
+/*returns the device events once poll() returned, or 0 when only the wakeup pipe was signaled*/
+static unsigned short alsa_poll_revents(AlsaReadData *ad, struct pollfd *pfds, int npfds){
+	unsigned short revents=0;
+	if (pfds[0].revents & POLLIN) alsa_wakeup_drain(ad);
+	if (snd_pcm_poll_descriptors_revents(ad->handle,pfds+1,npfds,&revents)<0) return 0;
+	return revents;
+}
+
+/*moves everything captured from the device to the ring, directly from the device buffer when it is mapped*/
+static int alsa_capture(AlsaReadData *ad){
+	int frame_size=2*ad->nchannels;
+	snd_pcm_sframes_t avail=alsa_can_read(ad->handle);
 	int err;
-	int count=0;
-	mblk_t *om=NULL;
-	struct timeval timeout;
-	if (ad->handle==NULL && ad->pcmdev!=NULL){
-		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+
+	if (avail<0) return -1;
+	while(avail>0){
+		int space=alsa_ring_get_space(&ad->ring)/frame_size;
+		if (space==0){
+			/*the ticker is late, the newest samples are lost rather than blocking the device*/
+			if (!ad->overflow) ms_warning("alsa_capture: ring full, dropping samples until the ticker catches up.");
+			ad->overflow=TRUE;
+			snd_pcm_forward(ad->handle,avail);
+			break;
+		}
+		ad->overflow=FALSE;
+		if (ad->mmap){
+			const snd_pcm_channel_area_t *areas;
+			snd_pcm_uframes_t offset;
+			snd_pcm_uframes_t frames=MIN(avail,space);
+			const uint8_t *src;
+			int len;
+			if ((err=snd_pcm_mmap_begin(ad->handle,&areas,&offset,&frames))<0){
+				ms_warning("alsa_capture: snd_pcm_mmap_begin() failed: %s",snd_strerror(err));
+				return -1;
+			}
+			src=(const uint8_t*)areas[0].addr+areas[0].first/8+offset*frame_size;
+			len=frames*frame_size;
+			while(len>0){
+				int n;
+				uint8_t *dst=alsa_ring_get_write_ptr(&ad->ring,&n);
+				n=MIN(n,len);
+				memcpy(dst,src,n);
+				alsa_ring_commit_write(&ad->ring,n);
+				src+=n;
+				len-=n;
+			}
+			err=snd_pcm_mmap_commit(ad->handle,offset,frames);
+			if (err<0 || (snd_pcm_uframes_t)err!=frames){
+				ms_warning("alsa_capture: snd_pcm_mmap_commit() failed: %s",snd_strerror(err<0 ? err : -EPIPE));
+				return -1;
+			}
+			avail-=frames;
+		}else{
+			int len;
+			uint8_t *dst=alsa_ring_get_write_ptr(&ad->ring,&len);
+			if ((err=alsa_read(ad->handle,dst,MIN(avail,len/frame_size)))<=0) return -1;
+			alsa_ring_commit_write(&ad->ring,err*frame_size);
+			avail-=err;
+		}
 	}
-	if (ad->handle==NULL) return NULL;
-
-	while (ad->read_started)
-	  {
-	    count = alsa_can_read(ad->handle,samples);
-	    if (count==24)
-	      { /* keep this value for this driver */ }
-	    else if (count<=0)
-	      {
-		count = samples;
-	      }
-	    else if (count>0)
-	      {
-		//ms_warning("%i count", count);
-		//count = samples;
-	      }
-
-	    int size=count*2;
-	    om=allocb(size,0);
-
-	    if ((err=alsa_read(ad->handle,om->b_wptr,count))<=0)
-	      {
-		ms_warning("nothing to read");
-		//ms_warning("Fail to read samples %i", count);
-		freemsg(om); /* leak fixed */
-		continue;
-	      }
-	    //ms_warning(" read %i", err);
-	    
-	    size=err*2;
-	    om->b_wptr+=size;
-
-	    ms_mutex_lock(&ad->mutex);
-	    ms_bufferizer_put(ad->bufferizer,om);
-	    ms_mutex_unlock(&ad->mutex);
-
-	    if (count==24)
-	      {
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 2000;
-		select(0, 0, NULL, NULL, &timeout );
-	      }
-	    else
-	      {
-		/* select will be less active than locking on "read" */
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 5000;
-		select(0, 0, NULL, NULL, &timeout );
-	      }
-	  }
+	return 0;
+}
 
-	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
-	ad->handle=NULL;
+/*opens the device from its thread, as the ticker did at each tick before: a device that is busy or not plugged yet
+is tried again every ALSA_REOPEN_INTERVAL ms until it opens or the filter stops*/
+static int alsa_thread_open(AlsaReadData *ad, bool_t capture){
+	const bool_t *started=capture ? &ad->read_started : &ad->write_started;
+	int attempts=0;
+
+	if (ad->pcmdev==NULL) return -1;
+	while(*started){
+		struct pollfd pfd;
+		ad->mmap=TRUE;
+		if (capture) ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate,&ad->mmap);
+		else ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate,&ad->mmap);
+		if (ad->handle!=NULL){
+			if (attempts>0) ms_message("alsa: %s opened for %s after %i attempts.",ad->pcmdev,capture ? "capture" : "playback",attempts+1);
+			return 0;
+		}
+		if (attempts++==0) ms_error("alsa: cannot open %s for %s, retrying every %i ms.",ad->pcmdev,capture ? "capture" : "playback",ALSA_REOPEN_INTERVAL);
+		/*alsa_stop_r() and alsa_stop_w() interrupt the wait through the wakeup pipe*/
+		pfd.fd=ad->wakeup[0];
+		pfd.events=POLLIN;
+		pfd.revents=0;
+		if (poll(&pfd,1,ALSA_REOPEN_INTERVAL)>0) alsa_wakeup_drain(ad);
+	}
+	return -1;
+}
+
+static void * alsa_read_thread(void *p){
+	AlsaReadData *ad=(AlsaReadData*)p;
+	struct pollfd *pfds;
+	int npfds=0;
+
+	if (ad->handle==NULL && alsa_thread_open(ad,TRUE)!=0) return NULL;
+	if ((pfds=alsa_poll_descriptors_new(ad,&npfds))==NULL){
+		ms_error("alsa_read_thread: no poll descriptors.");
+		return NULL;
+	}
+	while(ad->read_started){
+		unsigned short revents;
+		if (poll(pfds,npfds+1,-1)<0){
+			if (errno==EINTR) continue;
+			ms_error("alsa_read_thread: poll() failed: %s",strerror(errno));
+			break;
+		}
+		revents=alsa_poll_revents(ad,pfds,npfds);
+		if (revents & (POLLIN|POLLERR)){
+			if (alsa_capture(ad)<0){
+				/*do not spin on a device that cannot recover*/
+				poll(pfds,1,10);
+			}
+		}
+	}
+	ms_free(pfds);
 	return NULL;
 }
 
 static void alsa_start_r(AlsaReadData *d){
-	if (d->read_started==FALSE){
-		d->read_started=TRUE;
-		ms_thread_create(&d->thread,NULL,alsa_write_thread,d);
-	}else d->read_started=TRUE;
+	if (d->read_started) return;
+	/*room for the whole device buffer*/
+	alsa_ring_init(&d->ring,ALSA_PERIODS*ALSA_PERIOD_SIZE*(d->rate/8000)*2*d->nchannels);
+	if (alsa_wakeup_init(d)!=0){
+		alsa_ring_uninit(&d->ring);
+		return;
+	}
+	d->read_started=TRUE;
+	ms_thread_create(&d->thread,NULL,alsa_read_thread,d);
 }
 
 static void alsa_stop_r(AlsaReadData *d){
+	if (!d->read_started) return;
 	d->read_started=FALSE;
-	if (d->thread!=0)
-	  {
-	    ms_thread_join(d->thread,NULL);
-	    d->thread=0;
-	  }
+	alsa_wakeup(d);
+	ms_thread_join(d->thread,NULL);
+	d->thread=0;
+	alsa_wakeup_uninit(d);
+	alsa_ring_uninit(&d->ring);
+}
+
+static snd_pcm_sframes_t alsa_can_write(snd_pcm_t *dev){
+	snd_pcm_sframes_t avail=snd_pcm_avail_update(dev);
+	if (avail<0){
+		int err;
+		ms_warning("alsa_can_write: %s, trying to recover.",snd_strerror(avail));
+		if ((err=snd_pcm_recover(dev,avail,1))<0){
+			ms_error("snd_pcm_recover() failed: %s",snd_strerror(err));
+			return -1;
+		}
+		avail=snd_pcm_avail_update(dev);
+	}
+	return avail;
 }
+
+/*moves what the ticker queued in the ring to the device, directly into the device buffer when it is mapped*/
+static int alsa_playback(AlsaReadData *ad){
+	int frame_size=2*ad->nchannels;
+	snd_pcm_sframes_t avail=alsa_can_write(ad->handle);
+	int err;
+
+	if (avail<0) return -1;
+	while(avail>0){
+		int queued=alsa_ring_get_avail(&ad->ring)/frame_size;
+		if (queued==0) break;
+		if (ad->mmap){
+			const snd_pcm_channel_area_t *areas;
+			snd_pcm_uframes_t offset;
+			snd_pcm_uframes_t frames=MIN(avail,queued);
+			uint8_t *dst;
+			int len;
+			if ((err=snd_pcm_mmap_begin(ad->handle,&areas,&offset,&frames))<0){
+				ms_warning("alsa_playback: snd_pcm_mmap_begin() failed: %s",snd_strerror(err));
+				return -1;
+			}
+			dst=(uint8_t*)areas[0].addr+areas[0].first/8+offset*frame_size;
+			len=frames*frame_size;
+			while(len>0){
+				int n;
+				const uint8_t *src=alsa_ring_get_read_ptr(&ad->ring,&n);
+				n=MIN(n,len);
+				memcpy(dst,src,n);
+				alsa_ring_commit_read(&ad->ring,n);
+				dst+=n;
+				len-=n;
+			}
+			err=snd_pcm_mmap_commit(ad->handle,offset,frames);
+			if (err<0 || (snd_pcm_uframes_t)err!=frames){
+				ms_warning("alsa_playback: snd_pcm_mmap_commit() failed: %s",snd_strerror(err<0 ? err : -EPIPE));
+				return -1;
+			}
+			avail-=frames;
+		}else{
+			int len;
+			const uint8_t *src=alsa_ring_get_read_ptr(&ad->ring,&len);
+			if ((err=alsa_write(ad->handle,(unsigned char*)src,MIN(avail,len/frame_size)))<=0) return -1;
+			alsa_ring_commit_read(&ad->ring,err*frame_size);
+			avail-=err;
+		}
+	}
+	/*unlike writes, mmap transfers do not start the device by themselves: same threshold as alsa_set_params()*/
+	if (ad->mmap && snd_pcm_state(ad->handle)==SND_PCM_STATE_PREPARED){
+		avail=snd_pcm_avail_update(ad->handle);
+		if (avail>=0 && ad->buffer_size-avail>=ad->period_size*2 && (err=snd_pcm_start(ad->handle))<0)
+			ms_warning("alsa_playback: snd_pcm_start() failed: %s",snd_strerror(err));
+	}
+	return 0;
+}
+
+static void * alsa_write_thread(void *p){
+	AlsaReadData *ad=(AlsaReadData*)p;
+	struct pollfd *pfds;
+	int npfds=0;
+
+	if (ad->handle==NULL && alsa_thread_open(ad,FALSE)!=0) return NULL;
+	if ((pfds=alsa_poll_descriptors_new(ad,&npfds))==NULL){
+		ms_error("alsa_write_thread: no poll descriptors.");
+		return NULL;
+	}
+	snd_pcm_get_params(ad->handle,&ad->buffer_size,&ad->period_size);
+	while(ad->write_started){
+		unsigned short revents;
+		if (alsa_ring_get_avail(&ad->ring)==0){
+			/*with nothing to play, only the ticker can wake the thread up: the device would keep it busy.
+			 The ring is checked again once the flag is visible, so that what the ticker commits meanwhile is not missed*/
+			int err=0;
+			ad->idle=TRUE;
+			memory_barrier();
+			if (alsa_ring_get_avail(&ad->ring)==0) err=poll(pfds,1,-1);
+			ad->idle=FALSE;
+			if (err<0 && errno!=EINTR){
+				ms_error("alsa_write_thread: poll() failed: %s",strerror(errno));
+				break;
+			}
+			alsa_wakeup_drain(ad);
+			continue;
+		}
+		if (poll(pfds,npfds+1,-1)<0){
+			if (errno==EINTR) continue;
+			ms_error("alsa_write_thread: poll() failed: %s",strerror(errno));
+			break;
+		}
+		revents=alsa_poll_revents(ad,pfds,npfds);
+		if (revents & (POLLOUT|POLLERR)){
+			if (alsa_playback(ad)<0){
+				poll(pfds,1,10);
+			}
+		}
+	}
+	ms_free(pfds);
+	return NULL;
+}
+
+static void alsa_start_w(AlsaReadData *d){
+	if (d->write_started) return;
+	/*two periods: the device buffer already absorbs the jitter of the ticker, more would only add latency*/
+	alsa_ring_init(&d->ring,2*ALSA_PERIOD_SIZE*(d->rate/8000)*2*d->nchannels);
+	if (alsa_wakeup_init(d)!=0){
+		alsa_ring_uninit(&d->ring);
+		return;
+	}
+	d->write_started=TRUE;
+	ms_thread_create(&d->thread,NULL,alsa_write_thread,d);
+}
+
+static void alsa_stop_w(AlsaReadData *d){
+	if (!d->write_started) return;
+	d->write_started=FALSE;
+	alsa_wakeup(d);
+	ms_thread_join(d->thread,NULL);
+	d->thread=0;
+	alsa_wakeup_uninit(d);
+	alsa_ring_uninit(&d->ring);
+}
+
 #endif
 
 static void compute_timespec(AlsaReadData *d) {
@@ -882,6 +1202,7 @@ static void compute_timespec(AlsaReadData *d) {
 void alsa_read_preprocess(MSFilter *obj){
 #ifdef THREADED_VERSION
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
+	ad->read_samples=0;
 	alsa_start_r(ad);
 #endif
 }
@@ -904,10 +1225,6 @@ void alsa_read_uninit(MSFilter *obj){
 #endif
 	if (ad->pcmdev!=NULL) ms_free(ad->pcmdev);
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
-#ifdef THREADED_VERSION
-	ms_bufferizer_destroy(ad->bufferizer);
-	ms_mutex_destroy(&ad->mutex);
-#endif
 	ms_ticker_synchronizer_destroy(ad->ticker_synchronizer);
 	ms_free(ad);
 }
@@ -915,11 +1232,11 @@ void alsa_read_uninit(MSFilter *obj){
 #ifndef THREADED_VERSION
 void alsa_read_process(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
-	int samples=(128*ad->rate)/8000;
+	int samples=(ALSA_READ_BLOCK*ad->rate)/8000;
 	int err;
 	mblk_t *om=NULL;
 	if (ad->handle==NULL && ad->pcmdev!=NULL){
-		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate,NULL);
 		if (ad->handle){
 			ad->read_samples=0;
 			ms_ticker_set_time_func(obj->ticker,(uint64_t (*)(void*))ms_ticker_synchronizer_get_corrected_time, ad->ticker_synchronizer);
@@ -949,20 +1266,30 @@ void alsa_read_process(MSFilter *obj){
 #ifdef THREADED_VERSION
 void alsa_read_process(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
-	mblk_t *om=NULL;
-	int samples=(160*ad->rate)/8000;
+	int samples=(ALSA_READ_BLOCK*ad->rate)/8000;
 	int size=samples*2*ad->nchannels;
-	
-	ms_mutex_lock(&ad->mutex);
-	while (ms_bufferizer_get_avail(ad->bufferizer)>=size){
-	  
-	  om=allocb(size,0);
-	  ms_bufferizer_read(ad->bufferizer,om->b_wptr,size);	  
-	  om->b_wptr+=size;
-	  /*ms_message("alsa_read_process: Outputing %i bytes",size);*/
-	  ms_queue_put(obj->outputs[0],om);
+	mblk_t *om;
+
+	if (!ad->read_started) return;
+	/*the ring buffers what the device thread captured, it goes out in blocks of fixed size like the device was read from the ticker*/
+	while(alsa_ring_get_avail(&ad->ring)>=size){
+		if (ad->read_samples==0){
+			/*the device is running: from now on it drives the ticker*/
+			ms_ticker_set_time_func(obj->ticker,(uint64_t (*)(void*))ms_ticker_synchronizer_get_corrected_time, ad->ticker_synchronizer);
+		}
+		om=allocb(size,0);
+		while(om->b_wptr-om->b_rptr<size){
+			int len;
+			const uint8_t *data=alsa_ring_get_read_ptr(&ad->ring,&len);
+			len=MIN(len,size-(int)(om->b_wptr-om->b_rptr));
+			memcpy(om->b_wptr,data,len);
+			om->b_wptr+=len;
+			alsa_ring_commit_read(&ad->ring,len);
+		}
+		ad->read_samples+=samples;
+		compute_timespec(ad);
+		ms_queue_put(obj->outputs[0],om);
 	}
-	ms_mutex_unlock(&ad->mutex);
 }
 #endif
 
@@ -1024,22 +1351,31 @@ static MSFilter * ms_alsa_read_new(const char *dev){
 typedef struct _AlsaReadData AlsaWriteData;
 
 void alsa_write_init(MSFilter *obj){
-	AlsaWriteData *ad=ms_new(AlsaWriteData,1);
+	AlsaWriteData *ad=ms_new0(AlsaWriteData,1);
 	ad->pcmdev=NULL;
 	ad->handle=NULL;
 	ad->rate=forced_rate!=-1 ? forced_rate : 8000;
 	ad->nchannels=1;
 	obj->data=ad;
+#ifdef THREADED_VERSION
+	ad->wakeup[0]=ad->wakeup[1]=-1;
+#endif
 }
 
 void alsa_write_postprocess(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
+#ifdef THREADED_VERSION
+	alsa_stop_w(ad);
+#endif
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
 	ad->handle=NULL;
 }
 
 void alsa_write_uninit(MSFilter *obj){
 	AlsaWriteData *ad=(AlsaWriteData*)obj->data;
+#ifdef THREADED_VERSION
+	alsa_stop_w(ad);
+#endif
 	if (ad->pcmdev!=NULL) ms_free(ad->pcmdev);
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
 	ms_free(ad);
@@ -1072,6 +1408,42 @@ int alsa_write_set_nchannels(MSFilter *obj, void *data){
 	return 0;
 }
 
+#ifdef THREADED_VERSION
+void alsa_write_process(MSFilter *obj){
+	AlsaWriteData *ad=(AlsaWriteData*)obj->data;
+	int frame_size=2*ad->nchannels;
+	mblk_t *im;
+
+	if (ad->pcmdev!=NULL) alsa_start_w(ad);
+	if (!ad->write_started){
+		ms_queue_flush(obj->inputs[0]);
+		return;
+	}
+	while ((im=ms_queue_get(obj->inputs[0]))!=NULL){
+		int size=im->b_wptr-im->b_rptr;
+		int space=alsa_ring_get_space(&ad->ring);
+		if (size>space){
+			/*the device does not consume fast enough, as with a full device buffer the excess is dropped*/
+			ms_debug("Only %i bytes queued instead of %i",space,size);
+			size=space-space%frame_size;
+		}
+		while(size>0){
+			int len;
+			uint8_t *dst=alsa_ring_get_write_ptr(&ad->ring,&len);
+			len=MIN(len,size);
+			memcpy(dst,im->b_rptr,len);
+			alsa_ring_commit_write(&ad->ring,len);
+			im->b_rptr+=len;
+			size-=len;
+		}
+		/*the device thread only waits for the ticker when it had nothing left to play. The flag is read after the
+		 commit, the thread checks the ring after setting it: one of both sides always sees the other*/
+		memory_barrier();
+		if (ad->idle) alsa_wakeup(ad);
+		freemsg(im);
+	}
+}
+#else
 void alsa_write_process(MSFilter *obj){
 	AlsaWriteData *ad=(AlsaWriteData*)obj->data;
 	mblk_t *im=NULL;
@@ -1079,7 +1451,7 @@ void alsa_write_process(MSFilter *obj){
 	int samples;
 	int err;
 	if (ad->handle==NULL && ad->pcmdev!=NULL){
-		ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+		ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate,NULL);
 #ifdef EPIPE_BUGFIX
 		alsa_fill_w (ad->pcmdev);
 #endif
@@ -1100,6 +1472,7 @@ void alsa_write_process(MSFilter *obj){
 		freemsg(im);
 	}
 }
+#endif
 
 MSFilterMethod alsa_write_methods[]={
 	{MS_FILTER_GET_SAMPLE_RATE,	alsa_write_get_sample_rate},
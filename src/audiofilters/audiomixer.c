@@ -17,8 +17,9 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
-
 #include "mediastreamer2/msaudiomixer.h"
+#include "mediastreamer2/msaudiokernels.h"
+#include "mediastreamer2/msresampler.h"
 #include "mediastreamer2/msticker.h"
 
 #ifdef _MSC_VER
@@ -26,35 +27,38 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define alloca _alloca
 #endif
 
-#define MIXER_MAX_CHANNELS 20
+#define MIXER_MAX_CHANNELS 512
 #define MAX_LATENCY 0.08
 #define ALWAYS_STREAMOUT 1
 
-static void accumulate(int32_t *sum, int16_t* contrib, int nwords){
-	int i;
-	for(i=0;i<nwords;++i){
-		sum[i]+=contrib[i];
-	}
-}
+/*active speaker selection: a channel needs to be louder than this mean square energy (about -50 dBFS) to be selected,
+ and louder than the weakest selected speaker by SPEAKER_SWITCH_RATIO to take its place once its hold time has elapsed*/
+#define SPEAKER_ENERGY_THRESHOLD ((float)32767*32767*1e-5f)
+#define SPEAKER_SWITCH_RATIO 2.0f
+#define SPEAKER_HOLD_TIME 300 /*ms*/
+#define SPEAKER_ENERGY_SMOOTHING 0.3f
 
-static inline int16_t saturate(int32_t s){
-	if (s>32767) return 32767;
-	if (s<-32767) return -32767;
-	return (int16_t)s;
-}
-
-static void apply_gain(int16_t *samples, int nsamples, float gain){
-	int i;
-	for(i=0;i<nsamples;++i){
-		samples[i]=saturate((int)(gain*(float)samples[i]));
-	}
-}
+/*maximum number of distinct output sample rates*/
+#define MIXER_MAX_BUSES 8
 
 typedef struct Channel{
 	MSBufferizer bufferizer;
 	int16_t *input;	/*the channel contribution, for removal at output*/
 	float gain;
+	float energy; /*smoothed mean square of the input, only computed in active speaker mode*/
 	int active;
+	int has_data;
+	int silent; /*the input was marked as silence, it is not mixed*/
+	int speaking; /*selected as one of the loudest speakers*/
+	int hold; /*number of ticks before a speaking channel can be replaced*/
+	int contributing; /*the channel contribution is part of the sum*/
+	int out_rate; /*output sample rate, 0 if same as the mixer*/
+	int bus; /*index of the output sub-bus, -1 if the output is at mixer rate*/
+	int shared; /*the output shares the block of the other listeners, otherwise it gets its own copy*/
+	/*resamples the own contribution of a speaker, so that it can be removed from the resampled sum of its bus*/
+	MSResampler *own_resampler;
+	float *own_out;
+	int own_active;
 } Channel;
 
 static void channel_init(Channel *chan){
@@ -62,54 +66,89 @@ static void channel_init(Channel *chan){
 	chan->input=NULL;
 	chan->gain=1.0;
 	chan->active=1;
+	chan->out_rate=0;
+	chan->shared=1;
 }
 
 static void channel_prepare(Channel *chan, int bytes_per_tick){
 	chan->input=ms_malloc0(bytes_per_tick);
+	chan->energy=0;
+	chan->has_data=0;
+	chan->silent=0;
+	chan->speaking=0;
+	chan->hold=0;
+	chan->contributing=0;
+	chan->bus=-1;
 }
 
-static int channel_process_in(Channel *chan, MSQueue *q, int32_t *sum, int nsamples){
+static void channel_process_in(Channel *chan, const MSAudioKernels *kernels, MSQueue *q, int nsamples, bool_t measure){
 	ms_bufferizer_put_from_queue(&chan->bufferizer,q);
-	if (ms_bufferizer_read(&chan->bufferizer,(uint8_t*)chan->input,nsamples*2)!=0){
-		if (chan->active){
-			if (chan->gain!=1.0){
-				apply_gain(chan->input,nsamples,chan->gain);
+	chan->silent=ms_bufferizer_is_silent(&chan->bufferizer,nsamples*2);
+	if (chan->silent){
+		/*blocks marked as silence (discontinuous transmission) are not mixed, no need to read them*/
+		ms_bufferizer_skip_bytes(&chan->bufferizer,nsamples*2);
+		chan->has_data=1;
+	}else if (ms_bufferizer_read(&chan->bufferizer,(uint8_t*)chan->input,nsamples*2)!=0){
+		if (chan->gain!=1.0){
+			kernels->apply_gain(chan->input,nsamples,chan->gain);
+		}
+		chan->has_data=1;
+	}else{
+		memset(chan->input,0,nsamples*2);
+		chan->has_data=0;
+	}
+	if (measure){
+		float en=0;
+		int i;
+		if (chan->has_data && !chan->silent){
+			for(i=0;i<nsamples;++i){
+				float x=chan->input[i];
+				en+=x*x;
 			}
-			accumulate(sum,chan->input,nsamples);
+			en/=(float)nsamples;
 		}
-		return nsamples;
-	}else memset(chan->input,0,nsamples*2);
-	return 0;
+		chan->energy=(SPEAKER_ENERGY_SMOOTHING*en) + (1.0f-SPEAKER_ENERGY_SMOOTHING)*chan->energy;
+	}
 }
 
-static mblk_t *channel_process_out(Channel *chan, int32_t *sum, int nsamples){
-	int i;
+static mblk_t *channel_process_out(Channel *chan, const MSAudioKernels *kernels, int32_t *sum, int nsamples, bool_t silent){
 	mblk_t *om=allocb(nsamples*2,0);
 	int16_t *out=(int16_t*)om->b_wptr;
 
-	if (chan->active){
-		/*remove own contribution from sum*/
-		for(i=0;i<nsamples;++i){
-			out[i]=saturate(sum[i]-(int32_t)chan->input[i]);
-		}
-	}else{
-		for(i=0;i<nsamples;++i){
-			out[i]=saturate(sum[i]);
-		}
-	}
+	/*remove own contribution from sum*/
+	kernels->saturate_minus(out,sum,chan->input,nsamples,32767);
 	om->b_wptr+=nsamples*2;
+	mblk_set_silence_flag(om,silent);
 	return om;
 }
 
 static void channel_unprepare(Channel *chan){
-	ms_free(chan->input);
-	chan->input=NULL;
+	if (chan->input){
+		ms_free(chan->input);
+		chan->input=NULL;
+	}
+	if (chan->own_resampler){
+		ms_resampler_destroy(chan->own_resampler);
+		chan->own_resampler=NULL;
+		ms_free(chan->own_out);
+		chan->own_out=NULL;
+	}
 }
 
 static void channel_uninit(Channel *chan){
 	ms_bufferizer_uninit(&chan->bufferizer);
 }
 
+/*Output sub-bus: the sum is resampled once for all the output pins running at the same rate, instead of once per pin*/
+typedef struct MixerBus{
+	int rate;
+	int nsamples; /*number of samples output at each tick*/
+	int maxsamples;
+	float *out; /*the resampled sum*/
+	mblk_t *om; /*the saturated output shared by all pins that are not contributing, NULL until needed*/
+	MSResampler *resampler;
+} MixerBus;
+
 typedef struct MixerState{
 	int nchannels;
 	int rate;
@@ -118,6 +157,19 @@ typedef struct MixerState{
 	Channel channels[MIXER_MAX_CHANNELS];
 	int32_t *sum;
 	int conf_mode;
+	int max_speakers; /*0 means that everybody is mixed*/
+	int nspeakers;
+	int hold_ticks;
+	/*connected pins, computed at preprocess so that the processing does not depend on MIXER_MAX_CHANNELS*/
+	int input_pins[MIXER_MAX_CHANNELS];
+	int ninput_pins;
+	int output_pins[MIXER_MAX_CHANNELS];
+	int noutput_pins;
+	MixerBus buses[MIXER_MAX_BUSES];
+	int nbuses;
+	float *fsum; /*sum and channel input converted to float, for resampling*/
+	float *fin;
+	const MSAudioKernels *kernels;
 } MixerState;
 
 
@@ -129,6 +181,7 @@ static void mixer_init(MSFilter *f){
 	
 	s->nchannels=1;
 	s->rate=44100;
+	s->kernels=ms_audio_kernels_get();
 	for(i=0;i<MIXER_MAX_CHANNELS;++i){
 		channel_init(&s->channels[i]);
 	}
@@ -144,14 +197,92 @@ static void mixer_uninit(MSFilter *f){
 	ms_free(s);
 }
 
+static MSResampler *mixer_create_resampler(MixerState *s, int rate){
+	MSResampler *r=ms_resampler_new(s->rate,rate,s->nchannels,MSResamplerQualityVoip);
+	if (r==NULL) ms_error("MSAudioMixer: cannot create resampler from %i to %i Hz",s->rate,rate);
+	return r;
+}
+
+static int mixer_find_bus(MixerState *s, int rate){
+	int b;
+	for(b=0;b<s->nbuses;++b){
+		if (s->buses[b].rate==rate) return b;
+	}
+	if (s->nbuses==MIXER_MAX_BUSES){
+		ms_error("MSAudioMixer: too many different output rates.");
+		return -1;
+	}
+	s->buses[b].resampler=mixer_create_resampler(s,rate);
+	if (s->buses[b].resampler==NULL) return -1;
+	s->buses[b].rate=rate;
+	s->buses[b].maxsamples=ms_resampler_get_max_output(s->buses[b].resampler,s->bytespertick/(2*s->nchannels))*s->nchannels;
+	s->buses[b].out=ms_new(float,s->buses[b].maxsamples);
+	s->buses[b].nsamples=0;
+	s->buses[b].om=NULL;
+	s->nbuses++;
+	ms_message("MSAudioMixer: new output sub-bus at %i Hz",rate);
+	return b;
+}
+
+static void mixer_prepare_buses(MSFilter *f, MixerState *s){
+	int k;
+	s->nbuses=0;
+	s->fsum=NULL;
+	s->fin=NULL;
+	for(k=0;k<s->noutput_pins;++k){
+		Channel *chan=&s->channels[s->output_pins[k]];
+		chan->bus=-1;
+		if (chan->out_rate==0 || chan->out_rate==s->rate) continue;
+		chan->bus=mixer_find_bus(s,chan->out_rate);
+		if (chan->bus!=-1 && s->conf_mode && f->inputs[s->output_pins[k]]){
+			/*this channel may be a speaker, whose contribution has to be removed from its output*/
+			chan->own_resampler=mixer_create_resampler(s,chan->out_rate);
+			chan->own_out=ms_new(float,s->buses[chan->bus].maxsamples);
+			chan->own_active=0;
+		}
+	}
+	if (s->nbuses>0){
+		s->fsum=ms_new(float,s->bytespertick/2);
+		s->fin=ms_new(float,s->bytespertick/2);
+	}
+}
+
+static void mixer_unprepare_buses(MixerState *s){
+	int b;
+	for(b=0;b<s->nbuses;++b){
+		MixerBus *bus=&s->buses[b];
+		if (bus->resampler) ms_resampler_destroy(bus->resampler);
+		bus->resampler=NULL;
+		ms_free(bus->out);
+		bus->out=NULL;
+	}
+	s->nbuses=0;
+	if (s->fsum){
+		ms_free(s->fsum);
+		s->fsum=NULL;
+		ms_free(s->fin);
+		s->fin=NULL;
+	}
+}
+
 static void mixer_preprocess(MSFilter *f){
 	MixerState *s=(MixerState *)f->data;
 	int i;
 	s->purgeoffset=(int)(MAX_LATENCY*(float)(2*s->nchannels*s->rate));
 	s->bytespertick=(2*s->nchannels*s->rate*f->ticker->interval)/1000;
 	s->sum=(int32_t*)ms_malloc0((s->bytespertick/2)*sizeof(int32_t));
-	for(i=0;i<MIXER_MAX_CHANNELS;++i)
-		channel_prepare(&s->channels[i],s->bytespertick);
+	s->hold_ticks=SPEAKER_HOLD_TIME/f->ticker->interval;
+	s->nspeakers=0;
+	s->ninput_pins=0;
+	s->noutput_pins=0;
+	for(i=0;i<MIXER_MAX_CHANNELS;++i){
+		if (f->inputs[i]){
+			channel_prepare(&s->channels[i],s->bytespertick);
+			s->input_pins[s->ninput_pins++]=i;
+		}
+		if (f->outputs[i]) s->output_pins[s->noutput_pins++]=i;
+	}
+	mixer_prepare_buses(f,s);
 	/*ms_message("bytespertick=%i, purgeoffset=%i",s->bytespertick,s->purgeoffset);*/
 }
 
@@ -163,66 +294,210 @@ static void mixer_postprocess(MSFilter *f){
 	s->sum=NULL;
 	for(i=0;i<MIXER_MAX_CHANNELS;++i)
 		channel_unprepare(&s->channels[i]);
-	
+	mixer_unprepare_buses(s);
+}
+
+static Channel *find_weakest_speaker(MixerState *s){
+	Channel *weakest=NULL;
+	int k;
+	for(k=0;k<s->ninput_pins;++k){
+		Channel *chan=&s->channels[s->input_pins[k]];
+		if (chan->speaking && (weakest==NULL || chan->energy<weakest->energy))
+			weakest=chan;
+	}
+	return weakest;
+}
+
+static void set_speaking(MixerState *s, Channel *chan, int speaking){
+	chan->speaking=speaking;
+	chan->hold=speaking ? s->hold_ticks : 0;
+	s->nspeakers+=speaking ? 1 : -1;
+}
+
+/*keep the max_speakers loudest channels, with hysteresis so that speakers do not flip at every tick*/
+static void update_speakers(MixerState *s){
+	int k;
+	Channel *weakest;
+
+	for(k=0;k<s->ninput_pins;++k){
+		Channel *chan=&s->channels[s->input_pins[k]];
+		if (!chan->speaking) continue;
+		if (chan->hold>0) chan->hold--;
+		if (!chan->active || (chan->hold==0 && chan->energy<SPEAKER_ENERGY_THRESHOLD))
+			set_speaking(s,chan,0);
+	}
+	/*in case max_speakers was lowered*/
+	while(s->nspeakers>s->max_speakers && (weakest=find_weakest_speaker(s))!=NULL)
+		set_speaking(s,weakest,0);
+
+	weakest=NULL;
+	for(k=0;k<s->ninput_pins;++k){
+		Channel *chan=&s->channels[s->input_pins[k]];
+		if (chan->speaking || !chan->active || chan->energy<SPEAKER_ENERGY_THRESHOLD) continue;
+		if (s->nspeakers<s->max_speakers){
+			set_speaking(s,chan,1);
+			weakest=NULL;
+			continue;
+		}
+		if (weakest==NULL) weakest=find_weakest_speaker(s);
+		if (weakest!=NULL && weakest->hold==0 && chan->energy>weakest->energy*SPEAKER_SWITCH_RATIO){
+			set_speaking(s,weakest,0);
+			set_speaking(s,chan,1);
+			weakest=NULL;
+		}
+	}
 }
 
-static mblk_t *make_output(int32_t *sum, int nwords){
+static mblk_t *make_output(const MSAudioKernels *kernels, int32_t *sum, int nwords){
 	mblk_t *om=allocb(nwords*2,0);
-	int i;
-	for(i=0;i<nwords;++i,om->b_wptr+=2){
-		*(int16_t*)om->b_wptr=saturate(sum[i]);
+	kernels->saturate((int16_t*)om->b_wptr,sum,nwords,32767);
+	om->b_wptr+=nwords*2;
+	return om;
+}
+
+static int16_t float_to_s16(float x){
+	if (x>32767.0f) return 32767;
+	if (x<-32767.0f) return -32767;
+	return (int16_t)x;
+}
+
+static void mixer_process_buses(MixerState *s, int nwords){
+	int b,j;
+	if (s->nbuses==0) return;
+	for(j=0;j<nwords;++j) s->fsum[j]=(float)s->sum[j];
+	for(b=0;b<s->nbuses;++b){
+		MixerBus *bus=&s->buses[b];
+		int outlen=ms_resampler_process_float(bus->resampler,s->fsum,nwords/s->nchannels,bus->out,bus->maxsamples/s->nchannels);
+		bus->nsamples=outlen*s->nchannels;
+		bus->om=NULL;
 	}
+}
+
+/*mix-minus at the bus rate: as resampling is linear, the resampled own contribution is removed from the resampled sum*/
+static mblk_t *channel_process_bus_out(Channel *chan, MixerState *s, MixerBus *bus, int nwords){
+	mblk_t *om;
+	int16_t *out;
+	int j,outlen,n=bus->nsamples;
+	int was_active=chan->own_active;
+
+	for(j=0;j<nwords;++j) s->fin[j]=chan->contributing ? (float)chan->input[j] : 0;
+	/*keep resampling one tick of silence after the end of the contribution, to flush the resampler history: the bus
+	 resampler still outputs the tail of the contribution, which is removed as well*/
+	outlen=ms_resampler_process_float(chan->own_resampler,s->fin,nwords/s->nchannels,chan->own_out,bus->maxsamples/s->nchannels);
+	chan->own_active=chan->contributing;
+	if (!chan->contributing && !was_active) return NULL;
+
+	n=MIN(n,outlen*s->nchannels);
+	om=allocb(bus->nsamples*2,0);
+	out=(int16_t*)om->b_wptr;
+	for(j=0;j<n;++j) out[j]=float_to_s16(bus->out[j]-chan->own_out[j]);
+	for(;j<bus->nsamples;++j) out[j]=float_to_s16(bus->out[j]);
+	om->b_wptr+=bus->nsamples*2;
 	return om;
 }
 
+static mblk_t *make_bus_output(MixerBus *bus){
+	mblk_t *om=allocb(bus->nsamples*2,0);
+	int16_t *out=(int16_t*)om->b_wptr;
+	int j;
+	for(j=0;j<bus->nsamples;++j) out[j]=float_to_s16(bus->out[j]);
+	om->b_wptr+=bus->nsamples*2;
+	return om;
+}
+
+static mblk_t *mixer_bus_output(MixerState *s, Channel *chan, int nwords){
+	MixerBus *bus=&s->buses[chan->bus];
+	if (chan->own_resampler && (chan->contributing || chan->own_active)){
+		mblk_t *om=channel_process_bus_out(chan,s,bus,nwords);
+		if (om) return om;
+	}
+	if (!chan->shared) return make_bus_output(bus);
+	if (bus->om==NULL){
+		bus->om=make_bus_output(bus);
+		return bus->om;
+	}
+	return dupb(bus->om);
+}
+
 static void mixer_process(MSFilter *f){
 	MixerState *s=(MixerState *)f->data;
-	int i;
+	int i,k;
 	int nwords=s->bytespertick/2;
 	bool_t got_something=FALSE;
+	bool_t speaker_mode;
+	int ncontributing=0;
+	int nsilent=0;
 
+	ms_filter_lock(f);
+	speaker_mode=s->max_speakers>0;
 	memset(s->sum,0,nwords*sizeof(int32_t));
 
-	/* read from all inputs and sum everybody */
-	for(i=0;i<MIXER_MAX_CHANNELS;++i){
-		MSQueue *q=f->inputs[i];
-		if (q){
-			if (channel_process_in(&s->channels[i],q,s->sum,nwords))
-				got_something=TRUE;
-			/*FIXME: incorporate the following into the channel and use a better flow control algorithm*/
-			if (ms_bufferizer_get_avail(&s->channels[i].bufferizer)>s->purgeoffset){
-				ms_warning("Too much data in channel %i",i);
-				ms_bufferizer_flush(&s->channels[i].bufferizer);
-			}
+	/* read from all inputs */
+	for(k=0;k<s->ninput_pins;++k){
+		Channel *chan;
+		i=s->input_pins[k];
+		chan=&s->channels[i];
+		channel_process_in(chan,s->kernels,f->inputs[i],nwords,speaker_mode);
+		if (chan->has_data)
+			got_something=TRUE;
+		if (chan->silent)
+			nsilent++;
+		/*FIXME: incorporate the following into the channel and use a better flow control algorithm*/
+		if (ms_bufferizer_get_avail(&chan->bufferizer)>s->purgeoffset){
+			ms_warning("Too much data in channel %i",i);
+			ms_bufferizer_flush(&chan->bufferizer);
+		}
+	}
+	if (speaker_mode) update_speakers(s);
+
+	/* sum everybody, or only the selected speakers */
+	for(k=0;k<s->ninput_pins;++k){
+		Channel *chan=&s->channels[s->input_pins[k]];
+		chan->contributing=chan->has_data && !chan->silent && chan->active && (!speaker_mode || chan->speaking);
+		if (chan->contributing){
+			s->kernels->accumulate(s->sum,chan->input,nwords);
+			ncontributing++;
 		}
 	}
 #ifdef ALWAYS_STREAMOUT
 	got_something=TRUE;
 #endif
-	/* compute outputs. In conference mode each one has a different output, because its channel own contribution has to be removed*/
+	/* compute outputs. In conference mode each contributing channel has a different output, because its own contribution
+	 has to be removed. The listeners share the same block, which lets the encoders recognize identical frames, see
+	 MSEncodedFrameCache, except those whose output was set as not shared, that get their own copy. When the inputs were marked as silence, so are the outputs without anything mixed,
+	 so that the encoders can stop transmitting*/
 	if (got_something){
-		if (s->conf_mode==0){
-			mblk_t *om=NULL;
-			for(i=0;i<MIXER_MAX_CHANNELS;++i){
-				MSQueue *q=f->outputs[i];
-				if (q){
-					if (om==NULL){
-						om=make_output(s->sum,nwords);
-					}else{
-						om=dupb(om);
-					}
-					ms_queue_put(q,om);
-				}
+		mblk_t *om=NULL;
+		mixer_process_buses(s,nwords);
+		for(k=0;k<s->noutput_pins;++k){
+			i=s->output_pins[k];
+			if (s->channels[i].bus!=-1){
+				mblk_t *bm=mixer_bus_output(s,&s->channels[i],nwords);
+				bool_t own=s->conf_mode!=0 && s->channels[i].contributing;
+				mblk_set_silence_flag(bm,nsilent>0 && ncontributing==(own ? 1 : 0));
+				ms_queue_put(f->outputs[i],bm);
+				continue;
 			}
-		}else{
-			for(i=0;i<MIXER_MAX_CHANNELS;++i){
-				MSQueue *q=f->outputs[i];
-				if (q){
-					ms_queue_put(q,channel_process_out(&s->channels[i],s->sum,nwords));
-				}
+			if (s->conf_mode!=0 && s->channels[i].contributing){
+				ms_queue_put(f->outputs[i],channel_process_out(&s->channels[i],s->kernels,s->sum,nwords,nsilent>0 && ncontributing==1));
+				continue;
 			}
+			if (!s->channels[i].shared){
+				mblk_t *lm=make_output(s->kernels,s->sum,nwords);
+				mblk_set_silence_flag(lm,nsilent>0 && ncontributing==0);
+				ms_queue_put(f->outputs[i],lm);
+				continue;
+			}
+			if (om==NULL){
+				om=make_output(s->kernels,s->sum,nwords);
+				mblk_set_silence_flag(om,nsilent>0 && ncontributing==0);
+			}else{
+				om=dupb(om);
+			}
+			ms_queue_put(f->outputs[i],om);
 		}
 	}
+	ms_filter_unlock(f);
 }
 
 static int mixer_set_rate(MSFilter *f, void *data){
@@ -277,6 +552,48 @@ static int mixer_set_conference_mode(MSFilter *f, void *data){
 	return 0;
 }
 
+static int mixer_set_max_speakers(MSFilter *f, void *data){
+	MixerState *s=(MixerState *)f->data;
+	int max_speakers=*(int*)data;
+	if (max_speakers<0){
+		ms_warning("mixer_set_max_speakers: invalid value %i",max_speakers);
+		return -1;
+	}
+	ms_filter_lock(f);
+	if (max_speakers==0){
+		int i;
+		for(i=0;i<MIXER_MAX_CHANNELS;++i) s->channels[i].speaking=0;
+		s->nspeakers=0;
+	}
+	s->max_speakers=max_speakers;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int mixer_set_output_rate(MSFilter *f, void *data){
+	MixerState *s=(MixerState *)f->data;
+	MSAudioMixerCtl *ctl=(MSAudioMixerCtl*)data;
+	if (ctl->pin<0 || ctl->pin>=MIXER_MAX_CHANNELS){
+		ms_warning("mixer_set_output_rate: invalid pin number %i",ctl->pin);
+		return -1;
+	}
+	s->channels[ctl->pin].out_rate=ctl->param.rate;
+	return 0;
+}
+
+static int mixer_set_shared_output(MSFilter *f, void *data){
+	MixerState *s=(MixerState *)f->data;
+	MSAudioMixerCtl *ctl=(MSAudioMixerCtl*)data;
+	if (ctl->pin<0 || ctl->pin>=MIXER_MAX_CHANNELS){
+		ms_warning("mixer_set_shared_output: invalid pin number %i",ctl->pin);
+		return -1;
+	}
+	ms_filter_lock(f);
+	s->channels[ctl->pin].shared=ctl->param.shared;
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static MSFilterMethod methods[]={
 	{	MS_FILTER_SET_NCHANNELS , mixer_set_nchannels },
 	{	MS_FILTER_GET_NCHANNELS , mixer_get_nchannels },
@@ -285,6 +602,9 @@ static MSFilterMethod methods[]={
 	{	MS_AUDIO_MIXER_SET_INPUT_GAIN , mixer_set_input_gain },
 	{	MS_AUDIO_MIXER_SET_ACTIVE , mixer_set_active },
 	{	MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE, mixer_set_conference_mode	},
+	{	MS_AUDIO_MIXER_SET_MAX_SPEAKERS, mixer_set_max_speakers },
+	{	MS_AUDIO_MIXER_SET_OUTPUT_RATE, mixer_set_output_rate },
+	{	MS_AUDIO_MIXER_SET_SHARED_OUTPUT, mixer_set_shared_output },
 	{0,NULL}
 };
 
@@ -0,0 +1,317 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/msaudiorelay.h"
+#include "mediastreamer2/msticker.h"
+#include "g711common.h"
+
+/*same hysteresis as the active speaker selection of MSAudioMixer*/
+#define SPEAKER_ENERGY_THRESHOLD ((float)32767*32767*1e-5f)
+#define SPEAKER_SIZE_THRESHOLD 0.5f /*relative increase of the payload size over the silence size*/
+#define SPEAKER_SWITCH_RATIO 2.0f
+#define SPEAKER_HOLD_TIME 300 /*ms*/
+#define SPEAKER_ENERGY_SMOOTHING 0.3f
+#define SPEAKER_TIMEOUT 200 /*ms without packets after which a member is considered silent*/
+
+typedef enum RelayEstimator{
+	RelayEstimatorSize,
+	RelayEstimatorUlaw,
+	RelayEstimatorAlaw
+} RelayEstimator;
+
+typedef struct Member{
+	int active;
+	float energy; /*smoothed estimate, whose scale depends on the estimator*/
+	float silence_size; /*payload size when the member does not speak, size estimator only*/
+	uint64_t last_packet_time;
+	int hold; /*number of ticks before the member can be replaced as speaker*/
+	/*output side*/
+	int source; /*member whose packets are forwarded to this one, -1 if none*/
+	bool_t out_started;
+	bool_t out_switched; /*the next forwarded packet is the first of a new source*/
+	uint32_t ts_offset;
+	uint32_t last_ts;
+	uint32_t last_step;
+	uint64_t last_time;
+} Member;
+
+typedef struct RelayState{
+	Member members[MS_AUDIO_RELAY_MAX_MEMBERS];
+	RelayEstimator estimator;
+	float threshold;
+	int rate;
+	int speaker;
+	int previous_speaker;
+	int hold_ticks;
+	/*connected pins, computed at preprocess so that the processing does not depend on MS_AUDIO_RELAY_MAX_MEMBERS*/
+	int input_pins[MS_AUDIO_RELAY_MAX_MEMBERS];
+	int ninput_pins;
+	int output_pins[MS_AUDIO_RELAY_MAX_MEMBERS];
+	int noutput_pins;
+} RelayState;
+
+static void relay_init(MSFilter *f){
+	RelayState *s=ms_new0(RelayState,1);
+	int i;
+	for(i=0;i<MS_AUDIO_RELAY_MAX_MEMBERS;++i)
+		s->members[i].active=1;
+	s->estimator=RelayEstimatorSize;
+	s->threshold=SPEAKER_SIZE_THRESHOLD;
+	s->rate=8000;
+	f->data=s;
+}
+
+static void relay_uninit(MSFilter *f){
+	ms_free(f->data);
+}
+
+static void relay_preprocess(MSFilter *f){
+	RelayState *s=(RelayState*)f->data;
+	int i;
+	s->hold_ticks=SPEAKER_HOLD_TIME/f->ticker->interval;
+	s->speaker=-1;
+	s->previous_speaker=-1;
+	s->ninput_pins=0;
+	s->noutput_pins=0;
+	for(i=0;i<MS_AUDIO_RELAY_MAX_MEMBERS;++i){
+		Member *m=&s->members[i];
+		m->energy=0;
+		m->silence_size=0;
+		m->last_packet_time=0;
+		m->hold=0;
+		m->source=-1;
+		m->out_started=FALSE;
+		m->out_switched=FALSE;
+		if (f->inputs[i]) s->input_pins[s->ninput_pins++]=i;
+		if (f->outputs[i]) s->output_pins[s->noutput_pins++]=i;
+	}
+}
+
+/*mean square of the decoded samples, every other sample is enough to compare speakers*/
+static float g711_energy(const uint8_t *payload, int size, RelayEstimator estimator){
+	float en=0;
+	int i,n=0;
+	for(i=0;i<size;i+=2,++n){
+		float x=(float)(estimator==RelayEstimatorUlaw ? ulaw_to_s16(payload[i]) : alaw_to_s16(payload[i]));
+		en+=x*x;
+	}
+	return n>0 ? en/(float)n : 0;
+}
+
+/*the silence size follows the smallest payloads quickly, and the larger ones slowly, so that it adapts to bitrate changes*/
+static float size_activity(Member *m, int size){
+	float fsize=(float)size;
+	if (m->silence_size==0 || fsize<m->silence_size) m->silence_size=fsize;
+	else m->silence_size+=(fsize-m->silence_size)*0.001f;
+	return (fsize-m->silence_size)/(m->silence_size+4.0f);
+}
+
+static void member_measure(RelayState *s, Member *m, MSQueue *q, uint64_t time){
+	mblk_t *im;
+	for(im=qbegin(&q->q);!qend(&q->q,im);im=qnext(&q->q,im)){
+		float instant=0;
+		if (!mblk_get_cn_flag(im) && !mblk_get_silence_flag(im)){
+			int size=(int)(im->b_wptr-im->b_rptr);
+			if (s->estimator==RelayEstimatorSize) instant=size_activity(m,size);
+			else instant=g711_energy(im->b_rptr,size,s->estimator);
+		}
+		m->energy=(SPEAKER_ENERGY_SMOOTHING*instant) + (1.0f-SPEAKER_ENERGY_SMOOTHING)*m->energy;
+		m->last_packet_time=time;
+	}
+	/*with discontinuous transmission a silent member sends nothing*/
+	if (time-m->last_packet_time>SPEAKER_TIMEOUT) m->energy=0;
+}
+
+static void set_speaker(MSFilter *f, RelayState *s, int speaker){
+	if (s->speaker!=-1) s->previous_speaker=s->speaker;
+	s->speaker=speaker;
+	if (speaker!=-1) s->members[speaker].hold=s->hold_ticks;
+	ms_message("MSAudioRelay: active speaker is now pin %i",speaker);
+	ms_filter_notify(f,MS_AUDIO_RELAY_SPEAKER_CHANGED,&speaker);
+}
+
+/*the speaker remains until somebody else speaks louder, so that the listeners keep receiving its comfort noise*/
+static void update_speaker(MSFilter *f, RelayState *s){
+	Member *cur=s->speaker!=-1 ? &s->members[s->speaker] : NULL;
+	int k,loudest=-1;
+	float max_energy=s->threshold;
+
+	if (cur && cur->hold>0) cur->hold--;
+	for(k=0;k<s->ninput_pins;++k){
+		int i=s->input_pins[k];
+		Member *m=&s->members[i];
+		if (m->active && m->energy>max_energy){
+			max_energy=m->energy;
+			loudest=i;
+		}
+	}
+	if (cur && !cur->active){
+		set_speaker(f,s,loudest);
+	}else if (loudest!=-1 && loudest!=s->speaker){
+		if (cur==NULL || (cur->hold==0 && (cur->energy<s->threshold || max_energy>cur->energy*SPEAKER_SWITCH_RATIO)))
+			set_speaker(f,s,loudest);
+	}
+}
+
+/*the forwarded packets get the timestamps of a continuous stream: after a switch they follow the last packet of the
+ previous source by the elapsed time, or at least by one packet duration*/
+static void forward(RelayState *s, Member *out, MSQueue *in, MSQueue *q, uint64_t time){
+	mblk_t *im;
+	for(im=qbegin(&in->q);!qend(&in->q,im);im=qnext(&in->q,im)){
+		mblk_t *om=dupmsg(im);
+		uint32_t ts=mblk_get_timestamp_info(im);
+		if (out->out_switched){
+			if (out->out_started){
+				uint32_t elapsed=(uint32_t)(((time-out->last_time)*s->rate)/1000);
+				out->ts_offset=out->last_ts+MAX(elapsed,out->last_step)-ts;
+			}else out->ts_offset=0;
+			mblk_set_marker_info(om,TRUE);
+			out->out_switched=FALSE;
+		}else if (out->out_started){
+			out->last_step=ts+out->ts_offset-out->last_ts;
+		}
+		ts+=out->ts_offset;
+		mblk_set_timestamp_info(om,ts);
+		out->last_ts=ts;
+		out->last_time=time;
+		out->out_started=TRUE;
+		ms_queue_put(q,om);
+	}
+}
+
+static void relay_process(MSFilter *f){
+	RelayState *s=(RelayState*)f->data;
+	uint64_t time=f->ticker->time;
+	int i,k;
+
+	for(k=0;k<s->ninput_pins;++k){
+		i=s->input_pins[k];
+		member_measure(s,&s->members[i],f->inputs[i],time);
+	}
+	update_speaker(f,s);
+
+	for(k=0;k<s->noutput_pins;++k){
+		Member *out;
+		int source;
+		i=s->output_pins[k];
+		out=&s->members[i];
+		source=(s->speaker!=i) ? s->speaker : s->previous_speaker;
+		if (source==i || (source!=-1 && f->inputs[source]==NULL)) source=-1;
+		if (source!=out->source){
+			out->source=source;
+			out->out_switched=TRUE;
+		}
+		if (source!=-1) forward(s,out,f->inputs[source],f->outputs[i],time);
+	}
+
+	for(k=0;k<s->ninput_pins;++k)
+		ms_queue_flush(f->inputs[s->input_pins[k]]);
+}
+
+static int relay_set_codec(MSFilter *f, void *arg){
+	RelayState *s=(RelayState*)f->data;
+	const char *name=(const char*)arg;
+	if (strcasecmp(name,"pcmu")==0){
+		s->estimator=RelayEstimatorUlaw;
+		s->threshold=SPEAKER_ENERGY_THRESHOLD;
+	}else if (strcasecmp(name,"pcma")==0){
+		s->estimator=RelayEstimatorAlaw;
+		s->threshold=SPEAKER_ENERGY_THRESHOLD;
+	}else{
+		s->estimator=RelayEstimatorSize;
+		s->threshold=SPEAKER_SIZE_THRESHOLD;
+	}
+	return 0;
+}
+
+static int relay_set_sr(MSFilter *f, void *arg){
+	RelayState *s=(RelayState*)f->data;
+	s->rate=*(int*)arg;
+	return 0;
+}
+
+static int relay_get_sr(MSFilter *f, void *arg){
+	RelayState *s=(RelayState*)f->data;
+	*(int*)arg=s->rate;
+	return 0;
+}
+
+static int relay_set_active(MSFilter *f, void *arg){
+	RelayState *s=(RelayState*)f->data;
+	MSAudioMixerCtl *ctl=(MSAudioMixerCtl*)arg;
+	if (ctl->pin<0 || ctl->pin>=MS_AUDIO_RELAY_MAX_MEMBERS){
+		ms_warning("relay_set_active: invalid pin number %i",ctl->pin);
+		return -1;
+	}
+	s->members[ctl->pin].active=ctl->param.active;
+	return 0;
+}
+
+static int relay_get_speaker(MSFilter *f, void *arg){
+	RelayState *s=(RelayState*)f->data;
+	*(int*)arg=s->speaker;
+	return 0;
+}
+
+static MSFilterMethod relay_methods[]={
+	{	MS_AUDIO_RELAY_SET_CODEC	,	relay_set_codec		},
+	{	MS_AUDIO_RELAY_SET_ACTIVE	,	relay_set_active	},
+	{	MS_AUDIO_RELAY_GET_SPEAKER	,	relay_get_speaker	},
+	{	MS_FILTER_SET_SAMPLE_RATE	,	relay_set_sr		},
+	{	MS_FILTER_GET_SAMPLE_RATE	,	relay_get_sr		},
+	{	0				,	NULL			}
+};
+
+#ifdef _MSC_VER
+
+MSFilterDesc ms_audio_relay_desc={
+	MS_AUDIO_RELAY_ID,
+	"MSAudioRelay",
+	N_("A filter that forwards the encoded audio of the active speaker to conference members"),
+	MS_FILTER_OTHER,
+	NULL,
+	MS_AUDIO_RELAY_MAX_MEMBERS,
+	MS_AUDIO_RELAY_MAX_MEMBERS,
+	relay_init,
+	relay_preprocess,
+	relay_process,
+	NULL,
+	relay_uninit,
+	relay_methods
+};
+
+#else
+
+MSFilterDesc ms_audio_relay_desc={
+	.id=MS_AUDIO_RELAY_ID,
+	.name="MSAudioRelay",
+	.text=N_("A filter that forwards the encoded audio of the active speaker to conference members"),
+	.category=MS_FILTER_OTHER,
+	.ninputs=MS_AUDIO_RELAY_MAX_MEMBERS,
+	.noutputs=MS_AUDIO_RELAY_MAX_MEMBERS,
+	.init=relay_init,
+	.preprocess=relay_preprocess,
+	.process=relay_process,
+	.uninit=relay_uninit,
+	.methods=relay_methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_audio_relay_desc)
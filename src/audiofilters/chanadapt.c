@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/mschanadapter.h"
+#include "mediastreamer2/msaudioconvert.h"
 
 /*
  This filter transforms stereo buffers to mono and vice versa.
@@ -42,30 +43,10 @@ static void adapter_uninit(MSFilter *f){
 
 static void adapter_process(MSFilter *f){
 	AdapterState *s=(AdapterState*)f->data;
-	mblk_t *im,*om;
-	int msgsize;
+	mblk_t *im;
 	
 	while((im=ms_queue_get(f->inputs[0]))!=NULL){
-		if (s->inputchans==s->outputchans){
-			ms_queue_put(f->outputs[0],im);
-		}else if (s->inputchans==2){
-			msgsize=msgdsize(im)/2;
-			om=allocb(msgsize,0);
-			for (;im->b_rptr<im->b_wptr;im->b_rptr+=4,om->b_wptr+=2){
-				*(int16_t*)om->b_wptr=*(int16_t*)im->b_rptr;
-			}
-			ms_queue_put(f->outputs[0],om);
-			freemsg(im);
-		}else if (s->outputchans==2){
-			msgsize=msgdsize(im)*2;
-			om=allocb(msgsize,0);
-			for (;im->b_rptr<im->b_wptr;im->b_rptr+=2,om->b_wptr+=4){
-				((int16_t*)om->b_wptr)[0]=*(int16_t*)im->b_rptr;
-				((int16_t*)om->b_wptr)[1]=*(int16_t*)im->b_rptr;
-			}
-			ms_queue_put(f->outputs[0],om);
-			freemsg(im);
-		}
+		ms_queue_put(f->outputs[0],ms_audio_convert_channels_msg(im,s->inputchans,s->outputchans));
 	}
 }
 
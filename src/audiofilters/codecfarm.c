@@ -0,0 +1,341 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/mscodecfarm.h"
+#include "mediastreamer2/msaudioconvert.h"
+#include "g711common.h"
+/*always the built-in G.722, whose state can be allocated by the caller*/
+#include "g722.h"
+
+typedef enum FarmCodec{
+	FarmCodecNone,
+	FarmCodecPcmu,
+	FarmCodecPcma,
+	FarmCodecG722,
+	FarmCodecL16
+} FarmCodec;
+
+typedef struct FarmStream{
+	MSBufferizer bufferizer;
+	uint32_t ts;
+} FarmStream;
+
+typedef struct CodecFarm{
+	FarmCodec codec;
+	MSCodecFarmMode mode;
+	int rate;
+	int nchannels;
+	int ptime;
+	int frame_size; /*bytes of PCM per packet*/
+	/*streams whose pins are connected, computed at preprocess. All arrays below have nstreams entries.*/
+	int pins[MS_CODEC_FARM_MAX_STREAMS];
+	int nstreams;
+	FarmStream *streams;
+	g722_encode_state_t *g722_enc;
+	g722_decode_state_t *g722_dec;
+	int16_t *scratch; /*shared by all streams, so that it stays in the cache*/
+} CodecFarm;
+
+static void farm_init(MSFilter *f){
+	CodecFarm *s=ms_new0(CodecFarm,1);
+	s->codec=FarmCodecNone;
+	s->mode=MSCodecFarmEncoder;
+	s->rate=8000;
+	s->nchannels=1;
+	s->ptime=20;
+	g711_init_tables();
+	f->data=s;
+}
+
+static void farm_uninit(MSFilter *f){
+	ms_free(f->data);
+}
+
+static void farm_update_frame_size(CodecFarm *s){
+	s->frame_size=(2*s->nchannels*s->rate*s->ptime)/1000;
+}
+
+static void farm_preprocess(MSFilter *f){
+	CodecFarm *s=(CodecFarm*)f->data;
+	int i,k;
+
+	if (s->codec==FarmCodecNone){
+		ms_error("MSCodecFarm: no codec set.");
+	}
+	s->nstreams=0;
+	for(i=0;i<MS_CODEC_FARM_MAX_STREAMS;++i){
+		if (f->inputs[i]!=NULL && f->outputs[i]!=NULL) s->pins[s->nstreams++]=i;
+	}
+	s->streams=ms_new0(FarmStream,MAX(1,s->nstreams));
+	for(k=0;k<s->nstreams;++k) ms_bufferizer_init(&s->streams[k].bufferizer);
+	if (s->codec==FarmCodecG722){
+		if (s->mode==MSCodecFarmEncoder){
+			s->g722_enc=ms_new0(g722_encode_state_t,MAX(1,s->nstreams));
+			for(k=0;k<s->nstreams;++k) g722_encode_init(&s->g722_enc[k],64000,0);
+		}else{
+			s->g722_dec=ms_new0(g722_decode_state_t,MAX(1,s->nstreams));
+			for(k=0;k<s->nstreams;++k) g722_decode_init(&s->g722_dec[k],64000,0);
+		}
+	}
+	farm_update_frame_size(s);
+	ms_message("MSCodecFarm: %s of %i streams.",s->mode==MSCodecFarmEncoder ? "encoding" : "decoding",s->nstreams);
+}
+
+static void farm_postprocess(MSFilter *f){
+	CodecFarm *s=(CodecFarm*)f->data;
+	int k;
+	for(k=0;k<s->nstreams;++k) ms_bufferizer_uninit(&s->streams[k].bufferizer);
+	ms_free(s->streams);
+	s->streams=NULL;
+	if (s->g722_enc){
+		ms_free(s->g722_enc);
+		s->g722_enc=NULL;
+	}
+	if (s->g722_dec){
+		ms_free(s->g722_dec);
+		s->g722_dec=NULL;
+	}
+	if (s->scratch){
+		ms_free(s->scratch);
+		s->scratch=NULL;
+	}
+	s->nstreams=0;
+}
+
+static int16_t *farm_get_scratch(CodecFarm *s){
+	/*the frame size is bounded by the ptime, sized for the maximum one*/
+	if (s->scratch==NULL) s->scratch=ms_new(int16_t,(s->nchannels*s->rate*100)/1000);
+	return s->scratch;
+}
+
+static mblk_t *farm_encode(CodecFarm *s, int k){
+	MSBufferizer *bz=&s->streams[k].bufferizer;
+	int nsamples=s->frame_size/2;
+	mblk_t *om;
+	int16_t *pcm;
+
+	switch(s->codec){
+		case FarmCodecPcmu:
+		case FarmCodecPcma:
+			om=allocb(nsamples,0);
+			g711_encode_from_bufferizer(bz,om->b_wptr,nsamples,s->codec==FarmCodecPcmu ? s16_to_ulaw_buf : s16_to_alaw_buf);
+			om->b_wptr+=nsamples;
+			s->streams[k].ts+=nsamples;
+			break;
+		case FarmCodecG722:
+			pcm=farm_get_scratch(s);
+			ms_bufferizer_read(bz,(uint8_t*)pcm,s->frame_size);
+			om=allocb(nsamples/2,0);
+			om->b_wptr+=g722_encode_block(&s->g722_enc[k],om->b_wptr,pcm,nsamples);
+			/*the G.722 RTP clock rate is 8000 Hz*/
+			s->streams[k].ts+=nsamples/2;
+			break;
+		default:
+			om=allocb(s->frame_size,0);
+			ms_bufferizer_read(bz,om->b_wptr,s->frame_size);
+			ms_audio_convert_hton16((int16_t*)om->b_wptr,(int16_t*)om->b_wptr,nsamples);
+			om->b_wptr+=s->frame_size;
+			s->streams[k].ts+=nsamples/s->nchannels;
+			break;
+	}
+	return om;
+}
+
+static mblk_t *farm_decode(CodecFarm *s, int k, mblk_t *im){
+	int len;
+	mblk_t *om;
+
+	msgpullup(im,-1);
+	len=(int)(im->b_wptr-im->b_rptr);
+	switch(s->codec){
+		case FarmCodecPcmu:
+		case FarmCodecPcma:
+			om=allocb(len*2,0);
+			if (s->codec==FarmCodecPcmu) ulaw_to_s16_buf(im->b_rptr,(int16_t*)om->b_wptr,len);
+			else alaw_to_s16_buf(im->b_rptr,(int16_t*)om->b_wptr,len);
+			om->b_wptr+=len*2;
+			break;
+		case FarmCodecG722:
+			om=allocb(len*4,0);
+			len=g722_decode_block(&s->g722_dec[k],(int16_t*)om->b_wptr,im->b_rptr,len);
+			if (len<0){
+				ms_warning("MSCodecFarm: g722_decode error!");
+				freemsg(om);
+				freemsg(im);
+				return NULL;
+			}
+			om->b_wptr+=len*2;
+			break;
+		default:
+			/*byte swap in place, unless the packet is shared*/
+			return ms_audio_convert_ntoh16_msg(im);
+	}
+	mblk_meta_copy(im,om);
+	freemsg(im);
+	return om;
+}
+
+static void farm_process(MSFilter *f){
+	CodecFarm *s=(CodecFarm*)f->data;
+	int k;
+
+	ms_filter_lock(f);
+	if (s->codec==FarmCodecNone){
+		for(k=0;k<s->nstreams;++k) ms_queue_flush(f->inputs[s->pins[k]]);
+	}else if (s->mode==MSCodecFarmEncoder){
+		for(k=0;k<s->nstreams;++k){
+			FarmStream *st=&s->streams[k];
+			int pin=s->pins[k];
+			ms_bufferizer_put_from_queue(&st->bufferizer,f->inputs[pin]);
+			while(ms_bufferizer_get_avail(&st->bufferizer)>=s->frame_size){
+				uint32_t ts=st->ts;
+				mblk_t *om=farm_encode(s,k);
+				mblk_set_timestamp_info(om,ts);
+				ms_queue_put(f->outputs[pin],om);
+			}
+		}
+	}else{
+		for(k=0;k<s->nstreams;++k){
+			int pin=s->pins[k];
+			mblk_t *im;
+			while((im=ms_queue_get(f->inputs[pin]))!=NULL){
+				mblk_t *om=farm_decode(s,k,im);
+				if (om) ms_queue_put(f->outputs[pin],om);
+			}
+		}
+	}
+	ms_filter_unlock(f);
+}
+
+static int farm_set_codec(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	const char *name=(const char*)arg;
+	if (strcasecmp(name,"pcmu")==0){
+		s->codec=FarmCodecPcmu;
+		s->rate=8000;
+	}else if (strcasecmp(name,"pcma")==0){
+		s->codec=FarmCodecPcma;
+		s->rate=8000;
+	}else if (strcasecmp(name,"g722")==0){
+		s->codec=FarmCodecG722;
+		s->rate=16000;
+	}else if (strcasecmp(name,"l16")==0){
+		s->codec=FarmCodecL16;
+	}else{
+		ms_error("MSCodecFarm: unsupported codec %s",name);
+		return -1;
+	}
+	s->nchannels=1;
+	return 0;
+}
+
+static int farm_set_mode(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	s->mode=*(MSCodecFarmMode*)arg;
+	return 0;
+}
+
+static int farm_add_fmtp(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	const char *fmtp=(const char*)arg;
+	char tmp[16]={0};
+	if (fmtp_get_value(fmtp,"ptime",tmp,sizeof(tmp))){
+		int ptime=atoi(tmp);
+		if (ptime>0 && ptime<=100){
+			ms_filter_lock(f);
+			s->ptime=ptime;
+			farm_update_frame_size(s);
+			ms_filter_unlock(f);
+		}
+	}
+	return 0;
+}
+
+static int farm_set_sr(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	if (s->codec!=FarmCodecL16){
+		return *(int*)arg==s->rate ? 0 : -1;
+	}
+	s->rate=*(int*)arg;
+	return 0;
+}
+
+static int farm_get_sr(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	*(int*)arg=s->rate;
+	return 0;
+}
+
+static int farm_set_nchannels(MSFilter *f, void *arg){
+	CodecFarm *s=(CodecFarm*)f->data;
+	if (s->codec!=FarmCodecL16){
+		return *(int*)arg==1 ? 0 : -1;
+	}
+	s->nchannels=*(int*)arg;
+	return 0;
+}
+
+static MSFilterMethod farm_methods[]={
+	{	MS_CODEC_FARM_SET_CODEC		,	farm_set_codec		},
+	{	MS_CODEC_FARM_SET_MODE		,	farm_set_mode		},
+	{	MS_FILTER_ADD_FMTP		,	farm_add_fmtp		},
+	{	MS_FILTER_SET_SAMPLE_RATE	,	farm_set_sr		},
+	{	MS_FILTER_GET_SAMPLE_RATE	,	farm_get_sr		},
+	{	MS_FILTER_SET_NCHANNELS		,	farm_set_nchannels	},
+	{	0				,	NULL			}
+};
+
+#ifdef _MSC_VER
+
+MSFilterDesc ms_codec_farm_desc={
+	MS_CODEC_FARM_ID,
+	"MSCodecFarm",
+	N_("Encodes or decodes many streams at once"),
+	MS_FILTER_OTHER,
+	NULL,
+	MS_CODEC_FARM_MAX_STREAMS,
+	MS_CODEC_FARM_MAX_STREAMS,
+	farm_init,
+	farm_preprocess,
+	farm_process,
+	farm_postprocess,
+	farm_uninit,
+	farm_methods
+};
+
+#else
+
+MSFilterDesc ms_codec_farm_desc={
+	.id=MS_CODEC_FARM_ID,
+	.name="MSCodecFarm",
+	.text=N_("Encodes or decodes many streams at once"),
+	.category=MS_FILTER_OTHER,
+	.ninputs=MS_CODEC_FARM_MAX_STREAMS,
+	.noutputs=MS_CODEC_FARM_MAX_STREAMS,
+	.init=farm_init,
+	.preprocess=farm_preprocess,
+	.process=farm_process,
+	.postprocess=farm_postprocess,
+	.uninit=farm_uninit,
+	.methods=farm_methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_codec_farm_desc)
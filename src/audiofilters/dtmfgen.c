@@ -17,12 +17,25 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
 #include "mediastreamer2/dtmfgen.h"
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msaudioconvert.h"
 
 
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DTMFGEN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DTMFGEN_NEON
+#endif
+
 #ifndef M_PI
 #define M_PI       3.14159265358979323846
 #endif
@@ -36,6 +49,208 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define TRAILLING_SILENCE 500 /*ms*/
 #endif
 
+/*
+ * Sum of two sine waves, computed with recursive oscillators on 4 consecutive samples at once:
+ * sin(w*(n+4)) = 2*cos(4*w)*sin(w*n) - sin(w*(n-4)).
+ * The oscillators are seeded from the exact phase at each call, so that rounding errors do not accumulate over
+ * long tones. Frequencies are in cycles per sample, a null frequency giving silence.
+ */
+static void oscillator_seed(float *cur, float *prev, float *coef, int pos, float freq, float amplitude){
+	int k;
+	for(k=0;k<4;++k){
+		cur[k]=amplitude*(float)sin(2*M_PI*fmod((double)freq*(pos+k),1.0));
+		prev[k]=amplitude*(float)sin(2*M_PI*fmod((double)freq*(pos+k-4),1.0));
+	}
+	*coef=(float)(2*cos(2*M_PI*4*(double)freq));
+}
+
+static void tone_synth(int16_t *out, int pos, int nsamples, float lowfreq, float highfreq, float amplitude){
+	float lcur[4],lprev[4],hcur[4],hprev[4],lc,hc;
+	int i=0,k;
+
+	oscillator_seed(lcur,lprev,&lc,pos,lowfreq,amplitude);
+	oscillator_seed(hcur,hprev,&hc,pos,highfreq,amplitude);
+#if defined(DTMFGEN_SSE2)
+	{
+		__m128 l1=_mm_loadu_ps(lcur), l2=_mm_loadu_ps(lprev), h1=_mm_loadu_ps(hcur), h2=_mm_loadu_ps(hprev);
+		__m128 vlc=_mm_set1_ps(lc), vhc=_mm_set1_ps(hc);
+		for(;i+4<=nsamples;i+=4){
+			/*each tone is truncated separately, as the former sin() based implementation did*/
+			__m128i v=_mm_add_epi32(_mm_cvttps_epi32(l1),_mm_cvttps_epi32(h1));
+			__m128 l0=_mm_sub_ps(_mm_mul_ps(vlc,l1),l2);
+			__m128 h0=_mm_sub_ps(_mm_mul_ps(vhc,h1),h2);
+			_mm_storel_epi64((__m128i*)(out+i),_mm_packs_epi32(v,v));
+			l2=l1; l1=l0;
+			h2=h1; h1=h0;
+		}
+		_mm_storeu_ps(lcur,l1);
+		_mm_storeu_ps(hcur,h1);
+	}
+#elif defined(DTMFGEN_NEON)
+	{
+		float32x4_t l1=vld1q_f32(lcur), l2=vld1q_f32(lprev), h1=vld1q_f32(hcur), h2=vld1q_f32(hprev);
+		for(;i+4<=nsamples;i+=4){
+			int32x4_t v=vaddq_s32(vcvtq_s32_f32(l1),vcvtq_s32_f32(h1));
+			float32x4_t l0=vsubq_f32(vmulq_n_f32(l1,lc),l2);
+			float32x4_t h0=vsubq_f32(vmulq_n_f32(h1,hc),h2);
+			vst1_s16(out+i,vqmovn_s32(v));
+			l2=l1; l1=l0;
+			h2=h1; h1=h0;
+		}
+		vst1q_f32(lcur,l1);
+		vst1q_f32(hcur,h1);
+	}
+#else
+	for(;i+4<=nsamples;i+=4){
+		for(k=0;k<4;++k){
+			int v=(int)lcur[k]+(int)hcur[k];
+			float l0=lc*lcur[k]-lprev[k];
+			float h0=hc*hcur[k]-hprev[k];
+			out[i+k]=(int16_t)MAX(-32768,MIN(32767,v));
+			lprev[k]=lcur[k]; lcur[k]=l0;
+			hprev[k]=hcur[k]; hcur[k]=h0;
+		}
+	}
+#endif
+	for(k=0;i<nsamples;++i,++k){
+		int v=(int)lcur[k]+(int)hcur[k];
+		out[i]=(int16_t)MAX(-32768,MIN(32767,v));
+	}
+}
+
+/*samples are written at the beginning of the buffer, then spread to all the channels starting from the end*/
+static void expand_channels(int16_t *sample, int nsamples, int nchannels){
+	int i,j;
+	if (nchannels==1) return;
+	for(i=nsamples-1;i>=0;--i){
+		int16_t v=sample[i];
+		for(j=0;j<nchannels;++j) sample[i*nchannels+j]=v;
+	}
+}
+
+/*
+ * Call progress tones. Cadences are pairs of on/off durations in milliseconds.
+ * The "eu" entry is the CEPT recommendation, used for the countries not listed.
+ */
+typedef struct _CadenceDef{
+	const char *country;
+	MSDtmfGenCadenceType type;
+	const char *name;
+	int frequencies[2];
+	int cadence[4];
+}CadenceDef;
+
+static const CadenceDef cadence_defs[]={
+	{ "eu",	MSDtmfGenRingback,	"ring",	{ 425, 0 },	{ 1000, 4000, 0, 0 }	},
+	{ "eu",	MSDtmfGenBusy,		"busy",	{ 425, 0 },	{ 500, 500, 0, 0 }	},
+	{ "eu",	MSDtmfGenCongestion,	"cong",	{ 425, 0 },	{ 250, 250, 0, 0 }	},
+	{ "us",	MSDtmfGenRingback,	"ring",	{ 440, 480 },	{ 2000, 4000, 0, 0 }	},
+	{ "us",	MSDtmfGenBusy,		"busy",	{ 480, 620 },	{ 500, 500, 0, 0 }	},
+	{ "us",	MSDtmfGenCongestion,	"cong",	{ 480, 620 },	{ 250, 250, 0, 0 }	},
+	{ "uk",	MSDtmfGenRingback,	"ring",	{ 400, 450 },	{ 400, 200, 400, 2000 }	},
+	{ "uk",	MSDtmfGenBusy,		"busy",	{ 400, 0 },	{ 375, 375, 0, 0 }	},
+	{ "uk",	MSDtmfGenCongestion,	"cong",	{ 400, 0 },	{ 400, 350, 225, 525 }	},
+	{ "fr",	MSDtmfGenRingback,	"ring",	{ 440, 0 },	{ 1500, 3500, 0, 0 }	},
+	{ "fr",	MSDtmfGenBusy,		"busy",	{ 440, 0 },	{ 500, 500, 0, 0 }	},
+	{ "fr",	MSDtmfGenCongestion,	"cong",	{ 440, 0 },	{ 250, 250, 0, 0 }	},
+	{ "de",	MSDtmfGenRingback,	"ring",	{ 425, 0 },	{ 1000, 4000, 0, 0 }	},
+	{ "de",	MSDtmfGenBusy,		"busy",	{ 425, 0 },	{ 480, 480, 0, 0 }	},
+	{ "de",	MSDtmfGenCongestion,	"cong",	{ 425, 0 },	{ 240, 240, 0, 0 }	},
+	{ NULL,	0,			NULL,	{ 0, 0 },	{ 0, 0, 0, 0 }		}
+};
+
+static const CadenceDef *cadence_def_find(const MSDtmfGenCadence *cadence){
+	const CadenceDef *def;
+	const CadenceDef *fallback=NULL;
+	for(def=cadence_defs;def->country!=NULL;++def){
+		if (def->type!=cadence->type) continue;
+		if (strcasecmp(def->country,cadence->country)==0) return def;
+		if (strcmp(def->country,"eu")==0) fallback=def;
+	}
+	return fallback;
+}
+
+/*one period of the cadence, in mono*/
+static mblk_t *cadence_render(const CadenceDef *def, int rate, float amplitude){
+	int total=0,i,pos=0;
+	int block=rate/100;
+	mblk_t *m;
+	for(i=0;i<4;++i) total+=(def->cadence[i]*rate)/1000;
+	m=allocb(total*2,0);
+	for(i=0;i<4;++i){
+		int n=(def->cadence[i]*rate)/1000;
+		int16_t *out=(int16_t*)m->b_wptr+pos;
+		if ((i&1)==0){
+			int j;
+			/*synthesized by 10 ms blocks like the DTMFs, the oscillators being seeded again for each of them*/
+			for(j=0;j<n;j+=block)
+				tone_synth(out+j,j,MIN(block,n-j),(float)def->frequencies[0]/rate,(float)def->frequencies[1]/rate,amplitude);
+		}else memset(out,0,n*2);
+		pos+=n;
+	}
+	m->b_wptr+=total*2;
+	ms_message("MSDtmfGen: rendered %s tone for country %s at %i Hz",def->name,def->country,rate);
+	return m;
+}
+
+typedef struct _CadenceRendering{
+	const CadenceDef *def;
+	int rate;
+	float amplitude;
+	mblk_t *period;
+}CadenceRendering;
+
+static MSList *renderings=NULL;
+static ms_mutex_t renderings_lock;
+static bool_t renderings_initialized=FALSE;
+
+void ms_dtmf_gen_cadences_init(void){
+	if (renderings_initialized) return;
+	ms_mutex_init(&renderings_lock,NULL);
+	renderings_initialized=TRUE;
+}
+
+void ms_dtmf_gen_cadences_uninit(void){
+	MSList *elem;
+	if (!renderings_initialized) return;
+	for(elem=renderings;elem!=NULL;elem=elem->next){
+		CadenceRendering *r=(CadenceRendering*)elem->data;
+		freemsg(r->period);
+		ms_free(r);
+	}
+	renderings=ms_list_free(renderings);
+	ms_mutex_destroy(&renderings_lock);
+	renderings_initialized=FALSE;
+}
+
+/*returns a copy of the rendered period, to be released with freemsg(). The rendering itself is never handed out:
+ its reference count is not atomic, and the blocks sent downstream may be modified in place.*/
+static mblk_t *cadence_get(const CadenceDef *def, int rate, float amplitude){
+	CadenceRendering *r=NULL;
+	MSList *elem;
+	mblk_t *m;
+	if (!renderings_initialized) return cadence_render(def,rate,amplitude);
+	ms_mutex_lock(&renderings_lock);
+	for(elem=renderings;elem!=NULL;elem=elem->next){
+		CadenceRendering *it=(CadenceRendering*)elem->data;
+		if (it->def==def && it->rate==rate && it->amplitude==amplitude){
+			r=it;
+			break;
+		}
+	}
+	if (r==NULL){
+		r=ms_new0(CadenceRendering,1);
+		r->def=def;
+		r->rate=rate;
+		r->amplitude=amplitude;
+		r->period=cadence_render(def,rate,amplitude);
+		renderings=ms_list_append(renderings,r);
+	}
+	m=copyb(r->period);
+	ms_mutex_unlock(&renderings_lock);
+	return m;
+}
+
 
 struct DtmfGenState{
 	int rate;
@@ -50,6 +265,10 @@ struct DtmfGenState{
 	float default_amplitude;
 	int repeat_count;
 	MSDtmfGenCustomTone current_tone;
+	mblk_t *cadence; /*period of the call progress tone being played*/
+	int cadence_pos;
+	MSSampleFormat sample_format;
+	bool_t cadence_notified;
 	bool_t playing;
 };
 
@@ -69,7 +288,15 @@ static void dtmfgen_init(MSFilter *f){
 	f->data=s;
 }
 
+static void dtmfgen_stop_cadence(DtmfGenState *s){
+	if (s->cadence){
+		freemsg(s->cadence);
+		s->cadence=NULL;
+	}
+}
+
 static void dtmfgen_uninit(MSFilter *f){
+	dtmfgen_stop_cadence((DtmfGenState*)f->data);
 	ms_free(f->data);
 }
 
@@ -154,6 +381,7 @@ static int dtmfgen_put(MSFilter *f, void *arg){
 			return -1;
 	}
 	ms_filter_lock(f);
+	dtmfgen_stop_cadence(s);
 	s->pos=0;
 	s->lowfreq=s->lowfreq/s->rate;
 	s->highfreq=s->highfreq/s->rate;
@@ -175,6 +403,7 @@ static int dtmfgen_play_tone(MSFilter *f, void *arg){
 	ms_message("Playing tones of frequencies %i,%i Hz, duration=%i, amplitude=%f interval=%i, repeat_count=%i",def->frequencies[0],
 			   def->frequencies[1],def->duration,def->amplitude, def->interval, def->repeat_count);
 	ms_filter_lock(f);
+	dtmfgen_stop_cadence(s);
 	s->current_tone=*def;
 	s->pos=0;
 	s->dur=(s->rate*def->duration)/1000;
@@ -189,6 +418,30 @@ static int dtmfgen_play_tone(MSFilter *f, void *arg){
 	return 0;
 }
 
+static int dtmfgen_play_cadence(MSFilter *f, void *arg){
+	DtmfGenState *s=(DtmfGenState*)f->data;
+	const CadenceDef *def=cadence_def_find((MSDtmfGenCadence*)arg);
+	mblk_t *cadence;
+
+	if (def==NULL){
+		ms_warning("No such call progress tone.");
+		return -1;
+	}
+	cadence=cadence_get(def,s->rate,s->default_amplitude*0.7*32767);
+	ms_filter_lock(f);
+	dtmfgen_stop_cadence(s);
+	s->cadence=cadence;
+	s->cadence_pos=0;
+	s->cadence_notified=FALSE;
+	memset(&s->current_tone,0,sizeof(s->current_tone));
+	strncpy(s->current_tone.tone_name,def->name,sizeof(s->current_tone.tone_name)-1);
+	s->pos=0;
+	s->silence=0;
+	s->playing=TRUE;
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static int dtmfgen_start(MSFilter *f, void *arg){
 	if (dtmfgen_put(f,arg)==0){
 		DtmfGenState *s=(DtmfGenState*)f->data;
@@ -202,7 +455,12 @@ static int dtmfgen_stop(MSFilter *f, void *arg){
 	DtmfGenState *s=(DtmfGenState*)f->data;
 	int min_duration=(100*s->rate)/1000; /*wait at least 100 ms*/
 	ms_filter_lock(f);
-	if (s->pos<min_duration)
+	if (s->cadence){
+		dtmfgen_stop_cadence(s);
+		s->playing=FALSE;
+		s->silence=TRAILLING_SILENCE;
+		s->dur=0;
+	}else if (s->pos<min_duration)
 		s->dur=min_duration;
 	else s->dur=0;
 	memset(&s->current_tone,0,sizeof(s->current_tone));
@@ -234,6 +492,18 @@ static int dtmfgen_get_nchannels(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int dtmfgen_set_sample_format(MSFilter *f, void *arg){
+	DtmfGenState *s=(DtmfGenState*)f->data;
+	s->sample_format=(MSSampleFormat)*(int*)arg;
+	return 0;
+}
+
+static int dtmfgen_get_sample_format(MSFilter *f, void *arg){
+	DtmfGenState *s=(DtmfGenState*)f->data;
+	*(int*)arg=s->sample_format;
+	return 0;
+}
+
 static int dtmfgen_set_amp(MSFilter *f, void *arg){
 	DtmfGenState *s=(DtmfGenState*)f->data;
 	s->default_amplitude=*(float*)arg;
@@ -242,20 +512,12 @@ static int dtmfgen_set_amp(MSFilter *f, void *arg){
 
 
 static void write_dtmf(DtmfGenState *s , int16_t *sample, int nsamples){
-	int i, j;
-	int16_t dtmf_sample;
-	for (i=0;i<nsamples && s->pos<s->dur;i++,s->pos++){
-		dtmf_sample = (int16_t)(((float)s->amplitude)*sin(2*M_PI*(float)s->pos*s->lowfreq));
-		if (s->highfreq!=0) dtmf_sample += (int16_t)(((float)s->amplitude)*sin(2*M_PI*(float)s->pos*s->highfreq));
-		for (j = 0; j < s->nchannels; j++) {
-			sample[(i * s->nchannels) + j] = dtmf_sample;
-		}
-	}
-	for (;i<nsamples;++i){
-		for (j = 0; j < s->nchannels; j++) {
-			sample[(i * s->nchannels) + j] = 0;
-		}
-	}
+	int n=MAX(0,MIN(nsamples,s->dur-s->pos));
+
+	tone_synth(sample,s->pos,n,s->lowfreq,s->highfreq,(float)s->amplitude);
+	expand_channels(sample,n,s->nchannels);
+	s->pos+=n;
+	memset(sample+n*s->nchannels,0,(nsamples-n)*s->nchannels*2);
 	if (s->pos>=s->dur){
 		s->pos=0;
 		if (s->current_tone.interval > 0) {
@@ -271,9 +533,48 @@ static void write_dtmf(DtmfGenState *s , int16_t *sample, int nsamples){
 	}
 }
 
+static int cadence_samples(DtmfGenState *s){
+	return (int)(s->cadence->b_wptr-s->cadence->b_rptr)/2;
+}
+
+/*copies the cadence into the samples of an incoming stream*/
+static void write_cadence(DtmfGenState *s, int16_t *sample, int nsamples){
+	const int16_t *period=(const int16_t*)s->cadence->b_rptr;
+	int total=cadence_samples(s);
+	int i=0;
+	while(i<nsamples){
+		int n=MIN(nsamples-i,total-s->cadence_pos);
+		memcpy(sample+i,period+s->cadence_pos,n*2);
+		i+=n;
+		s->cadence_pos=(s->cadence_pos+n)%total;
+	}
+	expand_channels(sample,nsamples,s->nchannels);
+}
+
+/*tones are synthesized in 16 bit samples, converted if the stream carries floats*/
+static void write_tone(DtmfGenState *s, uint8_t *out, int nsamples){
+	int16_t *samples=(int16_t*)out;
+	if (s->sample_format==MSSampleFormatFloat32)
+		samples=(int16_t*)alloca(nsamples*s->nchannels*2);
+	if (s->cadence)
+		write_cadence(s,samples,nsamples);
+	else
+		write_dtmf(s,samples,nsamples);
+	if (s->sample_format==MSSampleFormatFloat32)
+		ms_audio_convert_s16_to_float((float*)out,samples,nsamples*s->nchannels,MS_AUDIO_CONVERT_S16_TO_FLOAT_SCALE);
+}
+
+static void notify_tone_start(MSFilter *f, DtmfGenState *s){
+	MSDtmfGenEvent ev;
+	ev.tone_start_time=f->ticker->time;
+	strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
+	ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
+}
+
 static void dtmfgen_process(MSFilter *f){
 	mblk_t *m;
 	DtmfGenState *s=(DtmfGenState*)f->data;
+	int frame_size=s->nchannels*ms_sample_format_get_size(s->sample_format);
 	int nsamples;
 
 	ms_filter_lock(f);
@@ -283,22 +584,29 @@ static void dtmfgen_process(MSFilter *f){
 			/*after 100 ms without stream we decide to generate our own sample
 			 instead of writing into incoming stream samples*/
 			nsamples=(f->ticker->interval*s->rate)/1000;
-			m=allocb(nsamples*s->nchannels*2,0);
-			if (s->silence==0){
-				if (s->pos==0){
-					MSDtmfGenEvent ev;
-					ev.tone_start_time=f->ticker->time;
-					strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
-					ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
+			if (s->cadence){
+				if (!s->cadence_notified){
+					notify_tone_start(f,s);
+					s->cadence_notified=TRUE;
 				}
-				write_dtmf(s,(int16_t*)m->b_wptr,nsamples);
+				m=allocb(nsamples*frame_size,0);
+				write_tone(s,m->b_wptr,nsamples);
+				m->b_wptr+=nsamples*frame_size;
+				ms_queue_put(f->outputs[0],m);
 			}else{
-				memset(m->b_wptr,0,nsamples*s->nchannels*2);
-				s->silence-=f->ticker->interval;
-				if (s->silence<0) s->silence=0;
+				m=allocb(nsamples*frame_size,0);
+				if (s->silence==0){
+					if (s->pos==0) notify_tone_start(f,s);
+					write_tone(s,m->b_wptr,nsamples);
+				}else{
+					/*all bits cleared is 0 in both sample formats*/
+					memset(m->b_wptr,0,nsamples*frame_size);
+					s->silence-=f->ticker->interval;
+					if (s->silence<0) s->silence=0;
+				}
+				m->b_wptr+=nsamples*frame_size;
+				ms_queue_put(f->outputs[0],m);
 			}
-			m->b_wptr+=nsamples*s->nchannels*2;
-			ms_queue_put(f->outputs[0],m);
 		}
 	}else{
 		s->nosamples_time=0;
@@ -307,15 +615,24 @@ static void dtmfgen_process(MSFilter *f){
 			if (s->silence<0) s->silence=0;
 		} else s->silence=0;
 		while((m=ms_queue_get(f->inputs[0]))!=NULL){
-			if (s->playing && s->silence==0){
-				if (s->pos==0){
-					MSDtmfGenEvent ev;
-					ev.tone_start_time=f->ticker->time;
-					strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
-					ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
+			nsamples=(m->b_wptr-m->b_rptr)/frame_size;
+			if ((s->cadence || (s->playing && s->silence==0)) && m->b_datap->db_ref>1){
+				/*the tone is written into the samples, which must not be shared with other blocks*/
+				mblk_t *copy=copymsg(m);
+				freemsg(m);
+				m=copy;
+			}
+			if (s->cadence){
+				if (!s->cadence_notified){
+					notify_tone_start(f,s);
+					s->cadence_notified=TRUE;
 				}
-				nsamples=(m->b_wptr-m->b_rptr)/(2*s->nchannels);
-				write_dtmf(s, (int16_t*)m->b_rptr,nsamples);
+				write_tone(s,m->b_rptr,nsamples);
+				mblk_set_silence_flag(m,0);
+			}else if (s->playing && s->silence==0){
+				if (s->pos==0) notify_tone_start(f,s);
+				write_tone(s,m->b_rptr,nsamples);
+				mblk_set_silence_flag(m,0);
 			}
 			ms_queue_put(f->outputs[0],m);
 		}
@@ -333,6 +650,9 @@ MSFilterMethod dtmfgen_methods[]={
 	{	MS_DTMF_GEN_STOP		, 	dtmfgen_stop },
 	{	MS_DTMF_GEN_PLAY_CUSTOM, dtmfgen_play_tone },
 	{	MS_DTMF_GEN_SET_DEFAULT_AMPLITUDE, dtmfgen_set_amp },
+	{	MS_DTMF_GEN_PLAY_CADENCE	,	dtmfgen_play_cadence	},
+	{	MS_FILTER_SET_SAMPLE_FORMAT	,	dtmfgen_set_sample_format	},
+	{	MS_FILTER_GET_SAMPLE_FORMAT	,	dtmfgen_get_sample_format	},
 	{	0				,	NULL			}
 };
 
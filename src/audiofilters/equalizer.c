@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <mediastreamer2/msequalizer.h>
 #include <mediastreamer2/dsptools.h>
+#include <mediastreamer2/msaudioconvert.h>
 
 #include <math.h>
 
@@ -32,8 +33,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define GAIN_ZERODB 1.0
 #endif
 
+/*number of taps at 8 kHz, scaled with the sample rate to keep the same frequency resolution*/
 #define TAPS 128
 
+#ifndef MS_FIXED_POINT
+/*above this number of taps the convolution is done in the frequency domain*/
+#define FFT_CONVOLUTION_MIN_TAPS 256
+#endif
+
 typedef struct _EqualizerState{
 	int rate;
 	int nfft; /*number of fft points in time*/
@@ -41,6 +48,17 @@ typedef struct _EqualizerState{
 	int fir_len;
 	ms_word16_t *fir;
 	ms_mem_t *mem; /*memories for filtering computations*/
+	void *fft_handle; /*nfft points*/
+	MSList *gains; /*the last gain setting of each frequency, replayed when the rate changes*/
+	/*overlap-add convolution, see equalizer_state_run_fft()*/
+	int conv_len; /*number of fft points, 0 if not set up*/
+	int conv_block; /*maximum number of samples processed at once*/
+	void *conv_fft;
+	ms_word16_t *conv_h; /*transfer function of the fir, in ms_fft() format*/
+	ms_word16_t *conv_buf;
+	ms_word16_t *conv_overlap; /*tail of the previous block, fir_len-1 samples*/
+	MSSampleFormat in_format;
+	MSSampleFormat out_format;
 	bool_t needs_update;
 	bool_t active;
 } EqualizerState;
@@ -53,25 +71,47 @@ static void equalizer_state_flatten(EqualizerState *s){
 		s->fft_cpx[i]=val;
 }
 
-/* TODO: rate also beyond 8000 */
-static EqualizerState * equalizer_state_new(int nfft){
-	EqualizerState *s=(EqualizerState *)ms_new0(EqualizerState,1);
-	s->rate=8000;
+static void equalizer_state_free_convolution(EqualizerState *s){
+	if (s->conv_len==0) return;
+	ms_fft_destroy(s->conv_fft);
+	ms_free(s->conv_h);
+	ms_free(s->conv_buf);
+	ms_free(s->conv_overlap);
+	s->conv_len=0;
+}
+
+static void equalizer_state_alloc(EqualizerState *s, int nfft){
 	s->nfft=nfft;
 	s->fft_cpx=(ms_word16_t*)ms_new0(ms_word16_t,s->nfft);
 	equalizer_state_flatten(s);
 	s->fir_len=s->nfft;
 	s->fir=(ms_word16_t*)ms_new(ms_word16_t,s->fir_len);
 	s->mem=(ms_mem_t*)ms_new0(ms_mem_t,s->fir_len);
+	s->fft_handle=ms_fft_init(s->nfft);
 	s->needs_update=TRUE;
-	s->active=TRUE;
-	return s;
 }
 
-static void equalizer_state_destroy(EqualizerState *s){
+static void equalizer_state_free(EqualizerState *s){
+	equalizer_state_free_convolution(s);
+	ms_fft_destroy(s->fft_handle);
 	ms_free(s->fft_cpx);
 	ms_free(s->fir);
 	ms_free(s->mem);
+}
+
+static EqualizerState * equalizer_state_new(void){
+	EqualizerState *s=(EqualizerState *)ms_new0(EqualizerState,1);
+	s->rate=8000;
+	equalizer_state_alloc(s,TAPS);
+	s->active=TRUE;
+	s->in_format=s->out_format=MSSampleFormatS16;
+	return s;
+}
+
+static void equalizer_state_destroy(EqualizerState *s){
+	equalizer_state_free(s);
+	ms_list_for_each(s->gains,ms_free);
+	ms_list_free(s->gains);
 	ms_free(s);
 }
 
@@ -119,6 +159,7 @@ static float equalizer_compute_gainpoint(int f, int freq_0, float sqrt_gain, int
 }
 
 static void equalizer_point_set(EqualizerState *s, int i, int f, float gain){
+	if (i<1 || i>=s->nfft/2) return;
 	ms_message("Setting gain %f for freq_index %i (%i Hz)\n",gain,i,f);
 	s->fft_cpx[1+((i-1)*2)] = (s->fft_cpx[1+((i-1)*2)]*(int)(gain*32768))/32768;
 }
@@ -153,16 +194,6 @@ static void equalizer_state_set(EqualizerState *s, int freq_0, float gain, int f
 	s->needs_update=TRUE;
 }
 
-static void dump_table(ms_word16_t *t, int len){
-	int i;
-	for(i=0;i<len;i++)
-#ifdef MS_FIXED_POINT
-		ms_message("[%i]\t%i",i,t[i]);
-#else
-		ms_message("[%i]\t%f",i,t[i]);
-#endif
-}
-
 static void time_shift(ms_word16_t *s, int len){
 	int i;
 	int half=len/2;
@@ -194,63 +225,120 @@ static void norm_and_apodize(ms_word16_t *s, int len){
 	}	
 }
 
+static void equalizer_state_compute_transfer_function(EqualizerState *s);
+
 static void equalizer_state_compute_impulse_response(EqualizerState *s){
-	void *fft_handle=ms_fft_init(s->nfft);
-	ms_message("Spectral domain:");
-	dump_table(s->fft_cpx,s->nfft);
-	ms_ifft(fft_handle,s->fft_cpx,s->fir);
-	ms_fft_destroy(fft_handle);
-	/*
-	ms_message("Inverse fft result:");
-	dump_table(s->fir,s->fir_len);
-	*/
+	ms_ifft(s->fft_handle,s->fft_cpx,s->fir);
 	time_shift(s->fir,s->fir_len);
-	/*
-	ms_message("Time shifted:");
-	dump_table(s->fir,s->fir_len);
-	*/
 	norm_and_apodize(s->fir,s->fir_len);
-	ms_message("Apodized impulse response:");
-	dump_table(s->fir,s->fir_len);
+	if (s->conv_len) equalizer_state_compute_transfer_function(s);
 	s->needs_update=FALSE;
 }
 
 
 
-#ifdef MS_FIXED_POINT
-#define INT16_TO_WORD16(i,w,l) w=(i)
-#define WORD16_TO_INT16(i,w,l) i=(w)
-#else
+#ifdef FFT_CONVOLUTION_MIN_TAPS
 
-static void int16_to_word16(const int16_t *is, ms_word16_t *w, int l){
+/*
+ * Overlap-add convolution: each block of input is zero padded to conv_len points, multiplied by the transfer function
+ * of the fir in the frequency domain, and the fir_len-1 samples beyond the block are added to the next block.
+ * Blocks are the incoming frames, so that no latency is added: the cost is O(log(conv_len)) per sample instead of
+ * O(fir_len) for the time domain fir.
+ */
+
+static void equalizer_state_compute_transfer_function(EqualizerState *s){
 	int i;
-	for(i=0;i<l;++i){
-		w[i]=(ms_word16_t)is[i];
-	}
+	memcpy(s->conv_buf,s->fir,s->fir_len*sizeof(ms_word16_t));
+	memset(s->conv_buf+s->fir_len,0,(s->conv_len-s->fir_len)*sizeof(ms_word16_t));
+	ms_fft(s->conv_fft,s->conv_buf,s->conv_h);
+	/*ms_fft() scales by 1/conv_len, and ms_ifft() does not rescale*/
+	for(i=0;i<s->conv_len;++i) s->conv_h[i]*=s->conv_len;
 }
 
-static void word16_to_int16(const ms_word16_t *w, int16_t *is, int l){
+static void equalizer_state_setup_convolution(EqualizerState *s, int nsamples){
+	int len=2;
+	equalizer_state_free_convolution(s);
+	while(len<nsamples+s->fir_len-1) len*=2;
+	s->conv_len=len;
+	s->conv_block=len-s->fir_len+1;
+	s->conv_fft=ms_fft_init(len);
+	s->conv_h=(ms_word16_t*)ms_new(ms_word16_t,len);
+	s->conv_buf=(ms_word16_t*)ms_new(ms_word16_t,len);
+	s->conv_overlap=(ms_word16_t*)ms_new0(ms_word16_t,s->fir_len-1);
+	equalizer_state_compute_transfer_function(s);
+	ms_message("MSEqualizer: %i taps convolution done with %i points ffts",s->fir_len,len);
+}
+
+/*complex multiplication of two spectrums in the packed format of ms_fft(): DC, (re,im)..., nyquist*/
+static void spectrum_mult(ms_word16_t *x, const ms_word16_t *h, int len){
 	int i;
-	for (i=0;i<l;++i)
-		is[i]=(int16_t)w[i];
+	x[0]*=h[0];
+	for(i=1;i<len-1;i+=2){
+		ms_word16_t re=x[i]*h[i]-x[i+1]*h[i+1];
+		ms_word16_t im=x[i]*h[i+1]+x[i+1]*h[i];
+		x[i]=re;
+		x[i+1]=im;
+	}
+	x[len-1]*=h[len-1];
+}
+
+static void equalizer_state_run_fft(EqualizerState *s, float *samples, int nsamples){
+	int overlap=s->fir_len-1;
+	ms_word16_t *y=(ms_word16_t*)alloca(s->conv_len*sizeof(ms_word16_t));
+	int i,n;
+
+	for(;nsamples>0;samples+=n,nsamples-=n){
+		n=MIN(nsamples,s->conv_block);
+		memcpy(s->conv_buf,samples,n*sizeof(float));
+		memset(s->conv_buf+n,0,(s->conv_len-n)*sizeof(ms_word16_t));
+		ms_fft(s->conv_fft,s->conv_buf,s->conv_buf);
+		spectrum_mult(s->conv_buf,s->conv_h,s->conv_len);
+		ms_ifft(s->conv_fft,s->conv_buf,y);
+		for(i=0;i<overlap;++i) y[i]+=s->conv_overlap[i];
+		memcpy(samples,y,n*sizeof(float));
+		/*the part of the tail not output yet, plus the tail of this block*/
+		memcpy(s->conv_overlap,y+n,overlap*sizeof(ms_word16_t));
+	}
 }
 
-#define INT16_TO_WORD16(i,w,l) w=(ms_word16_t*)alloca(sizeof(ms_word16_t)*(l));int16_to_word16(i,w,l)
-#define WORD16_TO_INT16(w,i,l) word16_to_int16(w,i,l)
 #endif
 
+#ifdef MS_FIXED_POINT
+
 static void equalizer_state_run(EqualizerState *s, int16_t *samples, int nsamples){
-	ms_word16_t *w;
 	if (s->needs_update)
 		equalizer_state_compute_impulse_response(s);
-	INT16_TO_WORD16(samples,w,nsamples);
-	ms_fir_mem16(w,s->fir,w,nsamples,s->fir_len,s->mem);
-	WORD16_TO_INT16(w,samples,nsamples);
+	ms_fir_mem16(samples,s->fir,samples,nsamples,s->fir_len,s->mem);
+}
+
+#else
+
+/*the filter is linear: floats in the 16 bit range and MSSampleFormatFloat32 samples are processed alike*/
+static void equalizer_state_run_float(EqualizerState *s, float *samples, int nsamples){
+	if (s->fir_len>=FFT_CONVOLUTION_MIN_TAPS){
+		if (s->conv_len==0 || nsamples>s->conv_block) equalizer_state_setup_convolution(s,nsamples);
+		if (s->needs_update)
+			equalizer_state_compute_impulse_response(s);
+		equalizer_state_run_fft(s,samples,nsamples);
+		return;
+	}
+	if (s->needs_update)
+		equalizer_state_compute_impulse_response(s);
+	ms_fir_mem16(samples,s->fir,samples,nsamples,s->fir_len,s->mem);
 }
 
+static void equalizer_state_run(EqualizerState *s, int16_t *samples, int nsamples){
+	float *w=(float*)alloca(sizeof(float)*nsamples);
+	ms_audio_convert_s16_to_float(w,samples,nsamples,1.0f);
+	equalizer_state_run_float(s,w,nsamples);
+	ms_audio_convert_float_to_s16(samples,w,nsamples,1.0f);
+}
+
+#endif
+
 
 static void equalizer_init(MSFilter *f){
-	f->data=equalizer_state_new(TAPS);
+	f->data=equalizer_state_new();
 }
 
 static void equalizer_uninit(MSFilter *f){
@@ -260,18 +348,47 @@ static void equalizer_uninit(MSFilter *f){
 static void equalizer_process(MSFilter *f){
 	mblk_t *m;
 	EqualizerState *s=(EqualizerState*)f->data;
+	ms_filter_lock(f);
 	while((m=ms_queue_get(f->inputs[0]))!=NULL){
 		if (s->active){
-			equalizer_state_run(s,(int16_t*)m->b_rptr,(m->b_wptr-m->b_rptr)/2);
+			if (m->b_datap->db_ref>1){
+				/*shared samples, such as those of the file cache, are read-only*/
+				mblk_t *copy=copymsg(m);
+				freemsg(m);
+				m=copy;
+			}
+#ifndef MS_FIXED_POINT
+			if (s->in_format==MSSampleFormatFloat32)
+				equalizer_state_run_float(s,(float*)m->b_rptr,(m->b_wptr-m->b_rptr)/4);
+			else
+#endif
+				equalizer_state_run(s,(int16_t*)m->b_rptr,(m->b_wptr-m->b_rptr)/2);
 		}
-		ms_queue_put(f->outputs[0],m);
+		ms_queue_put(f->outputs[0],ms_audio_convert_format_msg(m,s->in_format,s->out_format));
 	}
+	ms_filter_unlock(f);
 }
 
 static int equalizer_set_gain(MSFilter *f, void *data){
 	EqualizerState *s=(EqualizerState*)f->data;
 	MSEqualizerGain *d=(MSEqualizerGain*)data;
+	MSList *it;
+	ms_filter_lock(f);
+	/*only the last setting of a frequency is kept, so that the list stays bounded*/
+	for(it=s->gains;it!=NULL;it=it->next){
+		MSEqualizerGain *g=(MSEqualizerGain*)it->data;
+		if (g->frequency==d->frequency){
+			*g=*d;
+			break;
+		}
+	}
+	if (it==NULL){
+		MSEqualizerGain *copy=ms_new(MSEqualizerGain,1);
+		*copy=*d;
+		s->gains=ms_list_append(s->gains,copy);
+	}
 	equalizer_state_set(s,d->frequency,d->gain,d->width);
+	ms_filter_unlock(f);
 	return 0;
 }
 
@@ -285,8 +402,22 @@ static int equalizer_get_gain(MSFilter *f, void *data){
 
 static int equalizer_set_rate(MSFilter *f, void *data){
 	EqualizerState *s=(EqualizerState*)f->data;
-	s->rate=*(int*)data;
+	int rate=*(int*)data;
+	/*an even number of taps, as required by the fft*/
+	int nfft=((TAPS*rate)/8000)&~1;
+	ms_filter_lock(f);
+	s->rate=rate;
+	if (nfft!=s->nfft){
+		MSList *it;
+		equalizer_state_free(s);
+		equalizer_state_alloc(s,nfft);
+		for(it=s->gains;it!=NULL;it=it->next){
+			MSEqualizerGain *d=(MSEqualizerGain*)it->data;
+			equalizer_state_set(s,d->frequency,d->gain,d->width);
+		}
+	}
 	s->needs_update=TRUE;
+	ms_filter_unlock(f);
 	return 0;
 }
 
@@ -309,6 +440,30 @@ static int equalizer_dump(MSFilter *f, void *data){
 	return 0;
 }
 
+static int equalizer_set_sample_format(MSFilter *f, void *data){
+	EqualizerState *s=(EqualizerState*)f->data;
+	MSSampleFormat fmt=(MSSampleFormat)*(int*)data;
+#ifdef MS_FIXED_POINT
+	if (fmt!=MSSampleFormatS16) return -1;
+#endif
+	s->in_format=s->out_format=fmt;
+	return 0;
+}
+
+static int equalizer_get_sample_format(MSFilter *f, void *data){
+	EqualizerState *s=(EqualizerState*)f->data;
+	*(int*)data=s->in_format;
+	return 0;
+}
+
+static int equalizer_set_output_sample_format(MSFilter *f, void *data){
+	EqualizerState *s=(EqualizerState*)f->data;
+	MSSampleFormat fmt=(MSSampleFormat)*(int*)data;
+	if (fmt!=s->in_format && fmt!=MSSampleFormatS16) return -1;
+	s->out_format=fmt;
+	return 0;
+}
+
 static int equalizer_get_nfreqs(MSFilter *f, void *data){
 	EqualizerState *s=(EqualizerState*)f->data;
 	*(int*)data=s->nfft/2;
@@ -322,6 +477,9 @@ static MSFilterMethod equalizer_methods[]={
 	{	MS_FILTER_SET_SAMPLE_RATE	,	equalizer_set_rate	},
 	{	MS_EQUALIZER_DUMP_STATE		,	equalizer_dump		},
 	{	MS_EQUALIZER_GET_NUM_FREQUENCIES,	equalizer_get_nfreqs	},
+	{	MS_FILTER_SET_SAMPLE_FORMAT	,	equalizer_set_sample_format	},
+	{	MS_FILTER_GET_SAMPLE_FORMAT	,	equalizer_get_sample_format	},
+	{	MS_FILTER_SET_OUTPUT_SAMPLE_FORMAT,	equalizer_set_output_sample_format	},
 	{	0				,	NULL			}
 };
 
@@ -21,11 +21,38 @@
 #include <mediastreamer2/mscodecutils.h>
 #include <mediastreamer2/msticker.h>
 
+/*
+ * Waveform substitution, in the spirit of ITU-T G.711 Appendix I: when a frame is missing, the pitch period of the
+ * last received signal is estimated and the last periods are repeated, with overlap-add at the loop boundaries.
+ * The number of repeated periods grows with the length of the loss to avoid a buzzy sound, and the output is
+ * attenuated until it is muted. When the real signal comes back, it is cross-faded with the synthesized one.
+ */
+#define PLC_PITCH_MIN_HZ 66 /*longest period: 15 ms*/
+#define PLC_PITCH_MAX_HZ 200 /*shortest period: 5 ms*/
+#define PLC_CORR_MS 20 /*length of the signal used for pitch estimation*/
+#define PLC_EXPAND_MS 10 /*one more period is repeated every PLC_EXPAND_MS, up to 3*/
+#define PLC_ATTENUATION_START_MS 10
+#define PLC_ATTENUATION_MS 50 /*time to decrease from full level to silence*/
+#define PLC_REENTRY_MIN_MS 4
+#define PLC_REENTRY_MAX_MS 10
+
 /*filter common method*/
 typedef struct {
 	MSConcealerContext* concealer;
 	int rate;
 	int nchannels;
+	int16_t *history; /*the last hist_frames frames output, interleaved*/
+	int hist_frames;
+	int16_t *pitch_buf; /*copy of the history at the beginning of the loss*/
+	int16_t *synth; /*synthesized signal cross-faded with the first received frame after a loss*/
+	int pitch; /*in frames*/
+	int ola; /*overlap-add length at the loop boundaries*/
+	int nperiods;
+	int pos; /*read position in pitch_buf, in frames*/
+	int concealing;
+	int conceal_frames; /*number of frames concealed since the beginning of the loss*/
+	int cn_level; /*level of the last frame received if it was marked as silence, -1 otherwise*/
+	uint32_t cn_seed;
 } generic_plc_struct;
 
 const static unsigned int MAX_PLC_COUNT = UINT32_MAX;
@@ -33,11 +60,161 @@ const static unsigned int MAX_PLC_COUNT = UINT32_MAX;
 static void generic_plc_init(MSFilter *f) {
 	generic_plc_struct *mgps = (generic_plc_struct*) ms_new0(generic_plc_struct, 1);
 	mgps->concealer = ms_concealer_context_new(MAX_PLC_COUNT);
+	mgps->rate = 8000;
 	mgps->nchannels = 1;
+	mgps->cn_level = -1;
 	f->data = mgps;
 
 }
 
+static void generic_plc_preprocess(MSFilter *f) {
+	generic_plc_struct *mgps=(generic_plc_struct*)f->data;
+	int pmax=mgps->rate/PLC_PITCH_MIN_HZ;
+	/*enough for three periods and an overlap-add, and for the pitch search*/
+	mgps->hist_frames=3*pmax+pmax/4;
+	mgps->history=(int16_t*)ms_malloc0(mgps->hist_frames*mgps->nchannels*sizeof(int16_t));
+	mgps->pitch_buf=(int16_t*)ms_malloc0(mgps->hist_frames*mgps->nchannels*sizeof(int16_t));
+	mgps->synth=(int16_t*)ms_malloc0((mgps->rate*PLC_REENTRY_MAX_MS/1000)*mgps->nchannels*sizeof(int16_t));
+	mgps->concealing=FALSE;
+}
+
+static void generic_plc_postprocess(MSFilter *f) {
+	generic_plc_struct *mgps=(generic_plc_struct*)f->data;
+	ms_free(mgps->history);
+	ms_free(mgps->pitch_buf);
+	ms_free(mgps->synth);
+	mgps->history=mgps->pitch_buf=mgps->synth=NULL;
+}
+
+static void plc_history_append(generic_plc_struct *s, const int16_t *data, int nframes){
+	int nch=s->nchannels;
+	if (nframes>=s->hist_frames){
+		memcpy(s->history,data+(nframes-s->hist_frames)*nch,s->hist_frames*nch*sizeof(int16_t));
+		return;
+	}
+	memmove(s->history,s->history+nframes*nch,(s->hist_frames-nframes)*nch*sizeof(int16_t));
+	memcpy(s->history+(s->hist_frames-nframes)*nch,data,nframes*nch*sizeof(int16_t));
+}
+
+/*returns the lag in [from,to] maximizing the normalized correlation between ref and the signal lag frames before it.
+ The first channel only is used, every step frames.*/
+static int plc_search_pitch(generic_plc_struct *s, const int16_t *ref, int len, int from, int to, int step, int best){
+	int nch=s->nchannels;
+	double best_score=0;
+	int p,i;
+	for(p=from;p<=to;p+=step){
+		const int16_t *cand=ref-p*nch;
+		int64_t c=0,e=1;
+		for(i=0;i<len;i+=step){
+			c+=(int32_t)ref[i*nch]*cand[i*nch];
+			e+=(int32_t)cand[i*nch]*cand[i*nch];
+		}
+		/*compare c/sqrt(e) without computing the square root*/
+		if (c>0 && (double)c*(double)c/(double)e>best_score){
+			best_score=(double)c*(double)c/(double)e;
+			best=p;
+		}
+	}
+	return best;
+}
+
+static int plc_find_pitch(generic_plc_struct *s){
+	int pmin=s->rate/PLC_PITCH_MAX_HZ;
+	int pmax=s->rate/PLC_PITCH_MIN_HZ;
+	int corrlen=s->rate*PLC_CORR_MS/1000;
+	int step=MAX(1,s->rate/4000);
+	const int16_t *ref=s->history+(s->hist_frames-corrlen)*s->nchannels;
+	int best;
+	/*coarse search on a decimated signal, then refinement around the best lag*/
+	best=plc_search_pitch(s,ref,corrlen,pmin,pmax,step,pmax);
+	return plc_search_pitch(s,ref,corrlen,MAX(pmin,best-step+1),MIN(pmax,best+step-1),1,best);
+}
+
+static void plc_start(generic_plc_struct *s){
+	s->pitch=plc_find_pitch(s);
+	s->ola=MAX(1,s->pitch/4);
+	s->nperiods=1;
+	s->pos=s->hist_frames-s->pitch;
+	s->conceal_frames=0;
+	s->concealing=TRUE;
+	memcpy(s->pitch_buf,s->history,s->hist_frames*s->nchannels*sizeof(int16_t));
+}
+
+static float plc_gain(generic_plc_struct *s){
+	int start=s->rate*PLC_ATTENUATION_START_MS/1000;
+	int len=s->rate*PLC_ATTENUATION_MS/1000;
+	if (s->conceal_frames<=start) return 1;
+	if (s->conceal_frames>=start+len) return 0;
+	return 1.0f-(float)(s->conceal_frames-start)/(float)len;
+}
+
+/*loops over the last nperiods periods of the pitch buffer. Close to the end of the loop, the signal is blended with
+ the one preceding the loop start, so that the jump back is continuous.*/
+static void plc_synthesize(generic_plc_struct *s, int16_t *out, int nframes){
+	int nch=s->nchannels;
+	int end=s->hist_frames;
+	int len=s->nperiods*s->pitch;
+	int i,c;
+
+	if (plc_gain(s)==0){
+		/*muted: just keep counting*/
+		memset(out,0,nframes*nch*sizeof(int16_t));
+		s->conceal_frames+=nframes;
+		return;
+	}
+	for(i=0;i<nframes;++i){
+		const int16_t *cur=s->pitch_buf+s->pos*nch;
+		float g=plc_gain(s);
+		if (s->pos>=end-s->ola){
+			float w;
+			if (s->pos==end-s->ola){
+				/*entering the overlap zone: the length of the next loop is decided now*/
+				s->nperiods=MIN(3,1+s->conceal_frames/(s->rate*PLC_EXPAND_MS/1000));
+				len=s->nperiods*s->pitch;
+			}
+			w=(float)(s->pos-(end-s->ola)+1)/(float)(s->ola+1);
+			for(c=0;c<nch;++c){
+				out[i*nch+c]=(int16_t)(g*((1.0f-w)*cur[c]+w*cur[c-len*nch]));
+			}
+		}else{
+			for(c=0;c<nch;++c){
+				out[i*nch+c]=(int16_t)(g*cur[c]);
+			}
+		}
+		s->pos++;
+		if (s->pos==end) s->pos=end-len;
+		s->conceal_frames++;
+	}
+}
+
+/*cross-fades the first received frame after a loss with the continuation of the synthesized signal*/
+static mblk_t *plc_reenter(generic_plc_struct *s, mblk_t *m){
+	int nch=s->nchannels;
+	int nframes=(int)((m->b_wptr-m->b_rptr)/(nch*sizeof(int16_t)));
+	int lost_ms=(s->conceal_frames*1000)/s->rate;
+	int len_ms=MIN(PLC_REENTRY_MAX_MS,PLC_REENTRY_MIN_MS+PLC_REENTRY_MIN_MS*MAX(0,lost_ms-PLC_EXPAND_MS)/PLC_EXPAND_MS);
+	int len=MIN(nframes,s->rate*len_ms/1000);
+	int16_t *samples;
+	int i,c;
+
+	s->concealing=FALSE;
+	if (len==0) return m;
+	if (m->b_datap->db_ref>1){
+		mblk_t *copy=copymsg(m);
+		freemsg(m);
+		m=copy;
+	}
+	samples=(int16_t*)m->b_rptr;
+	plc_synthesize(s,s->synth,len);
+	for(i=0;i<len;++i){
+		float w=(float)(i+1)/(float)(len+1);
+		for(c=0;c<nch;++c){
+			samples[i*nch+c]=(int16_t)(w*samples[i*nch+c]+(1.0f-w)*s->synth[i*nch+c]);
+		}
+	}
+	return m;
+}
+
 static void generic_plc_process(MSFilter *f) {
 	generic_plc_struct *mgps=(generic_plc_struct*)f->data;
 	unsigned int buff_size = mgps->rate*sizeof(int16_t)*mgps->nchannels*f->ticker->interval/1000;
@@ -45,15 +222,27 @@ static void generic_plc_process(MSFilter *f) {
 	while((m=ms_queue_get(f->inputs[0]))!=NULL){
 		unsigned int time = (1000*(m->b_wptr - m->b_rptr))/(mgps->rate*sizeof(int16_t)*mgps->nchannels);
 		ms_concealer_inc_sample_time(mgps->concealer, f->ticker->time, time, TRUE);
+		mgps->cn_level = mblk_get_silence_flag(m) ? ms_comfort_noise_get_level((int16_t*)m->b_rptr,(int)((m->b_wptr-m->b_rptr)/sizeof(int16_t))) : -1;
+		if (mgps->concealing) m=plc_reenter(mgps,m);
+		plc_history_append(mgps,(int16_t*)m->b_rptr,(int)((m->b_wptr-m->b_rptr)/(sizeof(int16_t)*mgps->nchannels)));
 		ms_queue_put(f->outputs[0], m);
 	}
 	if (ms_concealer_context_is_concealement_required(mgps->concealer, f->ticker->time)) {
+		int nframes=buff_size/(sizeof(int16_t)*mgps->nchannels);
 		m = allocb(buff_size, 0);
-		memset(m->b_wptr, 0, buff_size);
+		if (mgps->cn_level != -1) {
+			/*the sender stopped transmitting during a silence: this is not a loss, comfort noise is generated instead*/
+			ms_comfort_noise_generate(mgps->cn_level,(int16_t*)m->b_wptr,nframes*mgps->nchannels,&mgps->cn_seed);
+			mblk_set_silence_flag(m, 1);
+		} else {
+			if (!mgps->concealing) plc_start(mgps);
+			plc_synthesize(mgps,(int16_t*)m->b_wptr,nframes);
+			mblk_set_plc_flag(m, 1);
+		}
+		plc_history_append(mgps,(int16_t*)m->b_wptr,nframes);
 		m->b_wptr += buff_size;
 		ms_queue_put(f->outputs[0], m);
-		mblk_set_plc_flag(m, 1);
-		ms_concealer_inc_sample_time(mgps->concealer, f->ticker->time, f->ticker->interval, FALSE);
+		ms_concealer_inc_sample_time(mgps->concealer, f->ticker->time, f->ticker->interval, mgps->cn_level != -1);
 	}
 }
 
@@ -99,9 +288,9 @@ MSFilterDesc ms_genericplc_desc= {
 	1,
 	1,
 	generic_plc_init,
-	NULL,
+	generic_plc_preprocess,
 	generic_plc_process,
-	NULL,
+	generic_plc_postprocess,
 	generic_plc_unit,
 	generic_plc_methods,
 	MS_FILTER_IS_PUMP
@@ -117,7 +306,9 @@ MSFilterDesc ms_genericplc_desc = {
 	.ninputs = 1,
 	.noutputs = 1,
 	.init = generic_plc_init,
+	.preprocess = generic_plc_preprocess,
 	.process = generic_plc_process,
+	.postprocess = generic_plc_postprocess,
 	.uninit = generic_plc_unit,
 	.flags = MS_FILTER_IS_PUMP,
 	.methods = generic_plc_methods
@@ -23,8 +23,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msaudiokernels.h"
+#include "mediastreamer2/msconf.h"
 #include <math.h>
 
+#if defined(_MSC_VER)
+#include <windows.h>
+#define memory_barrier() MemoryBarrier()
+#else
+#define memory_barrier() __sync_synchronize()
+#endif
+
 #if defined(_WIN32_WCE)
 #define DISABLE_SPEEX
 #endif
@@ -45,6 +55,52 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static const float max_e=(float)32767*32767;
 static const float coef=(float)0.01;
 
+#define CONF_SPEAKING_ENERGY 65
+#define ACTIVE_SPEAKER_HOLD 10 /*number of mixed blocks a new speaker must remain the loudest before being notified*/
+#define CHANNEL_VOLUME_INTERVAL 200 /*ms between two MS_CONF_CHANNEL_VOLUME events of a channel*/
+
+/*
+ * The level table is written by the ticker thread only and read by the application without locking, each slot being
+ * protected by a sequence counter: it is odd while the slot is written, and a reader retries
+ * when it has changed during the copy.
+ */
+typedef struct LevelSlot{
+	volatile unsigned int seq;
+	MSConfLevel level;
+} LevelSlot;
+
+struct _MSConfLevelTable{
+	LevelSlot slots[CONF_MAX_PINS];
+};
+
+static void level_table_write(MSConfLevelTable *table, int pin, const MSConfLevel *level){
+	LevelSlot *slot=&table->slots[pin];
+	slot->seq++;
+	memory_barrier();
+	slot->level=*level;
+	memory_barrier();
+	slot->seq++;
+}
+
+int ms_conf_level_table_read(const MSConfLevelTable *table, int pin, MSConfLevel *level){
+	const LevelSlot *slot;
+	unsigned int seq;
+	if (pin<0 || pin>=CONF_MAX_PINS)
+		return -1;
+	slot=&table->slots[pin];
+	do{
+		while((seq=slot->seq) & 1);
+		memory_barrier();
+		*level=slot->level;
+		memory_barrier();
+	}while(seq!=slot->seq);
+	return 0;
+}
+
+int ms_conf_level_table_get_size(const MSConfLevelTable *table){
+	return CONF_MAX_PINS;
+}
+
 typedef struct Channel{
 	MSBufferizer buff;
 	int16_t input[CONF_NSAMPLES];
@@ -67,12 +123,14 @@ typedef struct Channel{
 
 	float energy;
 	double average_psd;
+	MSConfLevel level; /*last value published in the level table*/
 
 } Channel;
 
 typedef struct ConfState{
 	Channel channels[CONF_MAX_PINS];
-	int sum[CONF_NSAMPLES];
+	int32_t sum[CONF_NSAMPLES];
+	const MSAudioKernels *kernels;
 	int enable_directmode;
 	int enable_vad;
 
@@ -88,6 +146,17 @@ typedef struct ConfState{
 	int adaptative_msconf_buf;
 	int conf_gran;
 	int conf_nsamples;
+
+	/*connected pins, so that processing cost does not depend on CONF_MAX_PINS*/
+	int pins[CONF_MAX_PINS];
+	int npins;
+
+	MSConfLevelTable levels;
+	bool_t enable_speaker_events;
+	int active_speaker;
+	int speaker_candidate;
+	int speaker_count;
+	uint64_t next_volume_time; /*ticker time of the next MS_CONF_CHANNEL_VOLUME events*/
 } ConfState;
 
 
@@ -184,6 +253,7 @@ static void conf_init(MSFilter *f){
 	s->samplerate=8000;
 	s->conf_gran=((16 * s->samplerate) / 800) *2;
 	s->conf_nsamples=s->conf_gran/2;
+	s->kernels=ms_audio_kernels_get();
     for (i=0;i<CONF_MAX_PINS;i++)
 		channel_init(s, &s->channels[i], i);
 	s->enable_directmode=FALSE;
@@ -192,6 +262,8 @@ static void conf_init(MSFilter *f){
 	s->max_gain=30;
 	s->mix_mode=TRUE;
 	s->adaptative_msconf_buf=2;
+	s->active_speaker=-1;
+	s->speaker_candidate=-1;
 	f->data=s;
 }
 
@@ -206,6 +278,7 @@ static void conf_uninit(MSFilter *f){
 static void conf_preprocess(MSFilter *f){
 	ConfState *s=(ConfState*)f->data;
 	int i;
+	s->npins=0;
 	for (i=0;i<CONF_MAX_PINS;i++)
 	  {
 	    s->channels[i].is_used=FALSE;
@@ -213,13 +286,19 @@ static void conf_preprocess(MSFilter *f){
 	    s->channels[i].stat_discarded=0;
 	    s->channels[i].stat_missed=0;
 	    s->channels[i].stat_processed=0;
+	    if (f->inputs[i]!=NULL || f->outputs[i]!=NULL)
+	      s->pins[s->npins++]=i;
 	  }
+	s->active_speaker=-1;
+	s->speaker_candidate=-1;
+	s->speaker_count=0;
+	s->next_volume_time=0;
 }
 
 static bool_t should_process(MSFilter *f, ConfState *s){
 	Channel *chan;
 	int active_channel=0;
-	int i;
+	int i,k;
 
 	if (ms_bufferizer_get_avail(&(&s->channels[0])->buff)>s->conf_gran
 	    && s->channels[0].is_used==FALSE)
@@ -233,7 +312,9 @@ static bool_t should_process(MSFilter *f, ConfState *s){
 	  }
 
 	/* count active channel */
-	for (i=1;i<CONF_MAX_PINS;++i){
+	for (k=0;k<s->npins;++k){
+		i=s->pins[k];
+		if (i==0) continue;
 		chan=&s->channels[i];
 		if (chan->is_used == TRUE)
 		{
@@ -305,10 +386,81 @@ static double powerspectrum_stat_beyond8K(struct Channel *chan){
 }
 #endif
 
+static void channel_update_level(ConfState *s, Channel *chan, int pin){
+	float en=chan->energy;
+	int peak=0;
+	int j;
+	for(j=0;j<s->conf_nsamples;++j){
+		int v=chan->input[j];
+		float sample=(float)v;
+		en=(sample*sample*coef) + ((float)1.0-coef)*en;
+		if (v<0) v=-v;
+		if (v>peak) peak=v;
+	}
+	chan->energy=en;
+	chan->level.energy=en;
+	chan->level.peak=peak;
+	chan->level.is_speaking=(en>CONF_SPEAKING_ENERGY);
+	level_table_write(&s->levels,pin,&chan->level);
+}
+
+static void channel_clear_level(ConfState *s, Channel *chan, int pin){
+	memset(&chan->level,0,sizeof(chan->level));
+	level_table_write(&s->levels,pin,&chan->level);
+}
+
+/*the active speaker is the loudest speaking channel, once it has remained so for ACTIVE_SPEAKER_HOLD blocks*/
+static void update_active_speaker(MSFilter *f, ConfState *s){
+	int i,k;
+	int loudest=-1;
+	float max_energy=0;
+
+	for (k=0;k<s->npins;++k){
+		Channel *chan;
+		i=s->pins[k];
+		chan=&s->channels[i];
+		if (chan->level.is_speaking && chan->level.energy>max_energy){
+			max_energy=chan->level.energy;
+			loudest=i;
+		}
+	}
+	if (loudest==s->active_speaker){
+		s->speaker_candidate=loudest;
+		s->speaker_count=0;
+		return;
+	}
+	if (loudest!=s->speaker_candidate){
+		s->speaker_candidate=loudest;
+		s->speaker_count=0;
+	}
+	if (++s->speaker_count>=ACTIVE_SPEAKER_HOLD){
+		s->active_speaker=loudest;
+		s->speaker_count=0;
+		if (s->enable_speaker_events)
+			ms_filter_notify(f, MS_CONF_ACTIVE_SPEAKER_CHANGED, &loudest);
+	}
+}
+
+/*the levels are still notified for the applications listening to MS_CONF_CHANNEL_VOLUME, but only the last one of each
+ channel every CHANNEL_VOLUME_INTERVAL, so that the event queue is not flooded*/
+static void notify_channel_volumes(MSFilter *f, ConfState *s){
+	int k;
+	if (f->ticker->time<s->next_volume_time) return;
+	s->next_volume_time=f->ticker->time+CHANNEL_VOLUME_INTERVAL;
+	for (k=0;k<s->npins;++k){
+		MSConfChannelVolume vol;
+		int i=s->pins[k];
+		if (f->inputs[i]==NULL) continue;
+		vol.energy=s->channels[i].level.energy;
+		vol.channel=i;
+		ms_filter_notify(f, MS_CONF_CHANNEL_VOLUME, (void*)&vol);
+	}
+}
+
 static void conf_sum(MSFilter *f, ConfState *s){
-	int i,j;
+	int i,k;
 	Channel *chan;
-	memset(s->sum,0,s->conf_nsamples*sizeof(int));
+	memset(s->sum,0,s->conf_nsamples*sizeof(int32_t));
 
 	chan=&s->channels[0];
 	if (s->adaptative_msconf_buf*s->conf_gran<ms_bufferizer_get_avail(&chan->buff))
@@ -339,7 +491,8 @@ static void conf_sum(MSFilter *f, ConfState *s){
 	if (s->adaptative_msconf_buf>6)
 		s->adaptative_msconf_buf=6;
 
-	for (i=0;i<CONF_MAX_PINS;++i){
+	for (k=0;k<s->npins;++k){
+		i=s->pins[k];
 		chan=&s->channels[i];
 
 		/* skip soundread and short buffer entry */
@@ -377,37 +530,19 @@ static void conf_sum(MSFilter *f, ConfState *s){
 				chan->stat_discarded++;
 			}
 
-			for(j=0;j<s->conf_nsamples;++j){
-				s->sum[j]+=chan->input[j];
-			}
+			s->kernels->accumulate(s->sum,chan->input,s->conf_nsamples);
 			chan->has_contributed=TRUE;
 
 			chan->stat_processed++;
 		}
 		else if (ms_bufferizer_get_avail(&chan->buff)>=s->conf_gran)
 		{
-			struct channel_volume {
-				float energy;
-				int channel;
-			};
-			struct channel_volume vol;
-			float en;
-
 			ms_bufferizer_read(&chan->buff,(uint8_t*)chan->input,s->conf_gran);
-
-			en=chan->energy;
-			for(j=0;j<s->conf_nsamples;++j){
-				float s=chan->input[j];
-				en=(s*s*coef) + ((float)1.0-coef)*en;
-			}
-			chan->energy=en;
-			vol.energy = chan->energy; //10*log10f(chan->energy/max_e);
-			vol.channel = i;
-			ms_filter_notify(f, MS_CONF_CHANNEL_VOLUME, (void*)&vol);
+			channel_update_level(s,chan,i);
 
 			if (i>0) /* not for MIC */
 			{
-				if (chan->energy>65)
+				if (chan->level.is_speaking)
 					chan->count_speaking++;
 				else
 					chan->count_speaking=0;
@@ -458,9 +593,7 @@ static void conf_sum(MSFilter *f, ConfState *s){
 			}
 #endif
 
-			for(j=0;j<s->conf_nsamples;++j){
-				s->sum[j]+=chan->input[j];
-			}
+			s->kernels->accumulate(s->sum,chan->input,s->conf_nsamples);
 			chan->has_contributed=TRUE;
 
 			chan->stat_processed++;
@@ -473,6 +606,7 @@ static void conf_sum(MSFilter *f, ConfState *s){
 				if (chan->missed>15)
 				{
 					chan->is_used=FALSE;
+					channel_clear_level(s,chan,i);
 					ms_message("msconf: deleted contributing stream (pin=%i)", i);
 				}
 				/* couldn't we add confort noise for those outputs? */
@@ -480,43 +614,37 @@ static void conf_sum(MSFilter *f, ConfState *s){
 			chan->has_contributed=FALSE;
 		}
 	}
-	return;
+	update_active_speaker(f,s);
+	notify_channel_volumes(f,s);
 }
 
-static inline int16_t saturate(int sample){
-	if (sample>32000)
-		sample=32000;
-	else if (sample<-32000)
-		sample=-32000;
-	return (int16_t)sample;
-}
+#define CONF_SATURATION 32000
 
 static mblk_t * conf_output(ConfState *s, Channel *chan, int16_t attenuation){
 	mblk_t *m=allocb(s->conf_gran,0);
+	int16_t *out=(int16_t*)m->b_wptr;
 	int i;
-	int tmp;
 	if (chan->has_contributed==TRUE){
-		for (i=0;i<s->conf_nsamples;++i){
-			tmp=s->sum[i]-(int)chan->input[i];
-			*((int16_t*)m->b_wptr)=saturate(tmp)/attenuation;
-			m->b_wptr+=2;
-		}
+		s->kernels->saturate_minus(out,s->sum,chan->input,s->conf_nsamples,CONF_SATURATION);
 	}else{
+		s->kernels->saturate(out,s->sum,s->conf_nsamples,CONF_SATURATION);
+	}
+	if (attenuation!=1){
 		for (i=0;i<s->conf_nsamples;++i){
-			tmp=s->sum[i];
-			*((int16_t*)m->b_wptr)=saturate(tmp)/attenuation;
-			m->b_wptr+=2;
+			out[i]/=attenuation;
 		}
 	}
+	m->b_wptr+=s->conf_nsamples*2;
 	return m;
 }
 
 static void conf_dispatch(MSFilter *f, ConfState *s){
-	int i;
+	int i,k;
 	Channel *chan;
 	mblk_t *m;
 
-	for (i=0;i<CONF_MAX_PINS;++i){
+	for (k=0;k<s->npins;++k){
+		i=s->pins[k];
 		if (f->outputs[i]!=NULL){
 			chan=&s->channels[i];
 			if (s->channels[0].is_speaking>0 // if MIC is speaking 
@@ -538,12 +666,13 @@ static void conf_dispatch(MSFilter *f, ConfState *s){
 }
 
 static void conf_process(MSFilter *f){
-	int i;
+	int i,k;
 	ConfState *s=(ConfState*)f->data;
 	Channel *chan;
 	Channel *chan0;
 	/*read from all inputs and put into bufferizers*/
-	for (i=0;i<CONF_MAX_PINS;++i){
+	for (k=0;k<s->npins;++k){
+		i=s->pins[k];
 		if (f->inputs[i]!=NULL){
 			chan=&s->channels[i];
 			ms_bufferizer_put_from_queue(&chan->buff,f->inputs[i]);
@@ -612,8 +741,10 @@ static void conf_process(MSFilter *f){
 static void conf_postprocess(MSFilter *f){
 	int i;
 	ConfState *s=(ConfState*)f->data;
-	for (i=0;i<CONF_MAX_PINS;i++)
+	for (i=0;i<CONF_MAX_PINS;i++){
 		channel_uninit(&s->channels[i]);
+		channel_clear_level(s,&s->channels[i],i);
+	}
     for (i=0;i<CONF_MAX_PINS;i++)
 		channel_init(s, &s->channels[i], i);
 }
@@ -759,6 +890,18 @@ static int msconf_get_stat_processed(MSFilter *f, void *arg){
 	return -1;
 }
 
+static int msconf_get_level_table(MSFilter *f, void *arg){
+	ConfState *s=(ConfState*)f->data;
+	*(MSConfLevelTable**)arg=&s->levels;
+	return 0;
+}
+
+static int msconf_enable_speaker_events(MSFilter *f, void *arg){
+	ConfState *s=(ConfState*)f->data;
+	s->enable_speaker_events = *(int*)arg;
+	return 0;
+}
+
 static MSFilterMethod msconf_methods[]={
 	{	MS_FILTER_SET_SAMPLE_RATE, msconf_set_sr },
 	{	MS_FILTER_ENABLE_DIRECTMODE, msconf_enable_directmode },
@@ -773,6 +916,9 @@ static MSFilterMethod msconf_methods[]={
 	{	MS_FILTER_ENABLE_HALFDUPLEX, msconf_enable_halfduplex },
 	{	MS_FILTER_SET_VAD_PROB_START, msconf_set_vad_prob_start },
 	{	MS_FILTER_SET_VAD_PROB_CONTINUE, msconf_set_vad_prob_continue },
+
+	{	MS_CONF_GET_LEVEL_TABLE, msconf_get_level_table },
+	{	MS_CONF_ENABLE_SPEAKER_EVENTS, msconf_enable_speaker_events },
 	{	0			, NULL}
 };
 
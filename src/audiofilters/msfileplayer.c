@@ -22,8 +22,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/msfileplayer.h"
+#include "mediastreamer2/msaudioconvert.h"
 #include "waveheader.h"
 #include "mediastreamer2/msticker.h"
+#include "filecache.h"
 
 #ifdef HAVE_PCAP
 #include <pcap/pcap.h>
@@ -39,6 +41,8 @@ static int player_close(MSFilter *f, void *arg);
 
 struct _PlayerData{
 	int fd;
+	mblk_t *mapped; /*content of the file when it is played from the file cache, fd is then unused*/
+	int pos; /*read position in the mapped content*/
 	MSPlayerState state;
 	int rate;
 	int nchannels;
@@ -66,6 +70,8 @@ typedef struct _PlayerData PlayerData;
 static void player_init(MSFilter *f){
 	PlayerData *d=ms_new0(PlayerData,1);
 	d->fd=-1;
+	d->mapped=NULL;
+	d->pos=0;
 	d->state=MSPlayerClosed;
 	d->swap=FALSE;
 	d->rate=8000;
@@ -144,19 +150,56 @@ int ms_read_wav_header_from_fd(wave_header_t *header,int fd){
 		return -1;
 }
 
-static int read_wav_header(PlayerData *d){
-	wave_header_t header;
-	format_t *format_chunk=&header.format_chunk;
-	int ret=ms_read_wav_header_from_fd(&header,d->fd);
-	
-	if (ret==-1) goto not_a_wav;
-	
+/*same as ms_read_wav_header_from_fd(), on the content of a file in memory. The chunk lengths come from the file: they
+ are checked against the remaining size before moving on, so that a corrupted header cannot make it read outside*/
+static int read_wav_header_from_buffer(wave_header_t *header, const uint8_t *data, int size){
+	int count;
+	int pos=sizeof(riff_t)+sizeof(format_t);
+	uint32_t len;
+
+	if (size<pos) return -1;
+	memcpy(&header->riff_chunk,data,sizeof(riff_t));
+	if (0!=strncmp(header->riff_chunk.riff, "RIFF", 4) || 0!=strncmp(header->riff_chunk.wave, "WAVE", 4)){
+		return -1;
+	}
+	memcpy(&header->format_chunk,data+sizeof(riff_t),sizeof(format_t));
+	pos=sizeof(riff_t)+0x8;
+	len=le_uint32(header->format_chunk.len);
+	if (len>(uint32_t)(size-pos)){
+		ms_warning("Wrong wav header: format chunk is truncated");
+		return -1;
+	}
+	pos+=len;
+	for(count=0;count<30;count++){
+		if (size-pos<(int)sizeof(data_t)){
+			ms_warning("Wrong wav header: file is truncated");
+			return -1;
+		}
+		memcpy(&header->data_chunk,data+pos,sizeof(data_t));
+		pos+=sizeof(data_t);
+		if (strncmp(header->data_chunk.data, "data", 4)==0) return pos;
+		ms_warning("skipping chunk=%.4s len=%i", header->data_chunk.data, header->data_chunk.len);
+		len=le_uint32(header->data_chunk.len);
+		if (len>(uint32_t)(size-pos)){
+			ms_warning("Wrong wav header: chunk is truncated");
+			return -1;
+		}
+		pos+=len;
+	}
+	return -1;
+}
+
+static int apply_wav_header(PlayerData *d, const wave_header_t *header, int hsize){
+	const format_t *format_chunk=&header->format_chunk;
+
+	if (hsize==-1) goto not_a_wav;
+
 	d->rate=le_uint32(format_chunk->rate);
 	d->nchannels=le_uint16(format_chunk->channel);
 	if (d->nchannels==0) goto not_a_wav;
 	d->samplesize=le_uint16(format_chunk->blockalign)/d->nchannels;
-	d->hsize=ret;
-	
+	d->hsize=hsize;
+
 	#ifdef WORDS_BIGENDIAN
 	if (le_uint16(format_chunk->blockalign)==le_uint16(format_chunk->channel) * 2)
 		d->swap=TRUE;
@@ -165,21 +208,49 @@ static int read_wav_header(PlayerData *d){
 	return 0;
 
 	not_a_wav:
-		/*rewind*/
-		lseek(d->fd,0,SEEK_SET);
 		d->hsize=0;
 		d->is_raw=TRUE;
 		return -1;
 }
 
+static int read_wav_header(PlayerData *d){
+	wave_header_t header;
+	if (apply_wav_header(d,&header,ms_read_wav_header_from_fd(&header,d->fd))!=0){
+		/*rewind*/
+		lseek(d->fd,0,SEEK_SET);
+		return -1;
+	}
+	return 0;
+}
+
+/*prompts are played from the process-wide file cache: no file descriptor nor system call per tick*/
+static int player_open_mapped(PlayerData *d, const char *file){
+	wave_header_t header;
+	int size;
+#ifdef HAVE_PCAP
+	if (strstr(file, ".pcap")) return -1;
+#endif
+	if ((d->mapped=ms_file_cache_get(file))==NULL) return -1;
+	size=d->mapped->b_wptr-d->mapped->b_rptr;
+	if (apply_wav_header(d,&header,read_wav_header_from_buffer(&header,d->mapped->b_rptr,size))!=0 && strstr(file,".wav")){
+		ms_warning("File %s has .wav extension but wav header could be found.",file);
+	}
+	d->pos=d->hsize;
+	d->state=MSPlayerPaused;
+	d->ts=0;
+	ms_message("%s opened from file cache: rate=%i,channel=%i",file,d->rate,d->nchannels);
+	return 0;
+}
+
 static int player_open(MSFilter *f, void *arg){
 	PlayerData *d=(PlayerData*)f->data;
 	int fd;
 	const char *file=(const char*)arg;
 
-	if (d->fd!=-1){
+	if (d->fd!=-1 || d->mapped!=NULL){
 		player_close(f,NULL);
 	}
+	if (player_open_mapped(d,file)==0) return 0;
 	if ((fd=open(file,O_RDONLY|O_BINARY))==-1){
 		ms_warning("Failed to open %s",file);
 		return -1;
@@ -220,7 +291,8 @@ static int player_stop(MSFilter *f, void *arg){
 	ms_filter_lock(f);
 	if (d->state!=MSPlayerClosed){
 		d->state=MSPlayerPaused;
-		lseek(d->fd,d->hsize,SEEK_SET);
+		if (d->mapped) d->pos=d->hsize;
+		else lseek(d->fd,d->hsize,SEEK_SET);
 	}
 	ms_filter_unlock(f);
 	return 0;
@@ -244,6 +316,12 @@ static int player_close(MSFilter *f, void *arg){
 #endif
 	if (d->fd!=-1)	close(d->fd);
 	d->fd=-1;
+	if (d->mapped){
+		ms_filter_lock(f);
+		freemsg(d->mapped);
+		d->mapped=NULL;
+		ms_filter_unlock(f);
+	}
 	d->state=MSPlayerClosed;
 	return 0;
 }
@@ -256,18 +334,20 @@ static int player_get_state(MSFilter *f, void *arg){
 
 static void player_uninit(MSFilter *f){
 	PlayerData *d=(PlayerData*)f->data;
-	if (d->fd!=-1) player_close(f,NULL);
+	if (d->fd!=-1 || d->mapped!=NULL) player_close(f,NULL);
 	ms_free(d);
 }
 
-static void swap_bytes(unsigned char *bytes, int len){
-	int i;
-	unsigned char tmp;
-	for(i=0;i<len;i+=2){
-		tmp=bytes[i];
-		bytes[i]=bytes[i+1];
-		bytes[i+1]=tmp;
-	}
+/*the samples are copied out of the cached content: duplicates of it would share its reference count, which is not
+ atomic, with the sound card threads downstream. Like read(), b_wptr is left at the start of the returned block*/
+static mblk_t *player_read_mapped(PlayerData *d, int bytes, int *err){
+	int avail=(d->mapped->b_wptr-d->mapped->b_rptr)-d->pos;
+	mblk_t *om=allocb(bytes,0);
+	*err=MIN(bytes,avail);
+	memcpy(om->b_wptr,d->mapped->b_rptr+d->pos,*err);
+	if (d->swap) ms_audio_convert_swap16((int16_t*)om->b_wptr,(int16_t*)om->b_wptr,*err/2);
+	d->pos+=*err;
+	return om;
 }
 
 static void player_process(MSFilter *f){
@@ -346,14 +426,18 @@ static void player_process(MSFilter *f){
 #endif
 		{
 			int err;
-			mblk_t *om=allocb(bytes,0);
+			mblk_t *om;
 			if (d->pause_time>0){
+				om=allocb(bytes,0);
 				err=bytes;
 				memset(om->b_wptr,0,bytes);
 				d->pause_time-=f->ticker->interval;
+			}else if (d->mapped){
+				om=player_read_mapped(d,bytes,&err);
 			}else{
+				om=allocb(bytes,0);
 				err=read(d->fd,om->b_wptr,bytes);
-				if (d->swap) swap_bytes(om->b_wptr,bytes);
+				if (d->swap) ms_audio_convert_swap16((int16_t*)om->b_wptr,(int16_t*)om->b_wptr,bytes/2);
 			}
 			if (err>=0){
 				if (err!=0){
@@ -366,7 +450,8 @@ static void player_process(MSFilter *f){
 				}else freemsg(om);
 				if (err<bytes){
 					ms_filter_notify_no_arg(f,MS_FILE_PLAYER_EOF);
-					lseek(d->fd,d->hsize,SEEK_SET);
+					if (d->mapped) d->pos=d->hsize;
+					else lseek(d->fd,d->hsize,SEEK_SET);
 
 					/* special value for playing file only once */
 					if (d->loop_after<0)
@@ -22,7 +22,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/msfilerec.h"
+#include "mediastreamer2/msticker.h"
 #include "waveheader.h"
+#include "asyncwriter.h"
+
+/*the queued data is handed to the I/O thread at least this often, in milliseconds*/
+#define FLUSH_INTERVAL 1000
+/*and the header is rewritten this often, so that a file left unclosed by a crash remains readable*/
+#define HEADER_INTERVAL 5000
 
 
 static int rec_close(MSFilter *f, void *arg);
@@ -33,6 +40,9 @@ typedef struct RecState{
 	int nchannels;
 	int size;
 	MSRecorderState state;
+	MSAsyncWriter *writer; /*NULL if the data is written by the filter itself*/
+	uint64_t last_flush;
+	uint64_t last_header;
 } RecState;
 
 static void rec_init(MSFilter *f){
@@ -42,30 +52,97 @@ static void rec_init(MSFilter *f){
 	s->nchannels = 1;
 	s->size=0;
 	s->state=MSRecorderClosed;
+	s->writer=NULL;
 	f->data=s;
 }
 
+static void make_wav_header(wave_header_t *header, int rate, int nchannels, int size){
+	memcpy(&header->riff_chunk.riff,"RIFF",4);
+	header->riff_chunk.len=le_uint32(size+32);
+	memcpy(&header->riff_chunk.wave,"WAVE",4);
+
+	memcpy(&header->format_chunk.fmt,"fmt ",4);
+	header->format_chunk.len=le_uint32(0x10);
+	header->format_chunk.type=le_uint16(0x1);
+	header->format_chunk.channel=le_uint16(nchannels);
+	header->format_chunk.rate=le_uint32(rate);
+	header->format_chunk.bps=le_uint32(rate*2*nchannels);
+	header->format_chunk.blockalign=le_uint16(2*nchannels);
+	header->format_chunk.bitpspl=le_uint16(16);
+
+	memcpy(&header->data_chunk.data,"data",4);
+	header->data_chunk.len=le_uint32(size);
+}
+
+static void write_wav_header(int fd, int rate, int nchannels, int size){
+	wave_header_t header;
+	make_wav_header(&header,rate,nchannels,size);
+	lseek(fd,0,SEEK_SET);
+	if (write(fd,&header,sizeof(header))!=sizeof(header)){
+		ms_warning("Fail to write wav header.");
+	}
+}
+
+static void queue_wav_header(RecState *s){
+	wave_header_t header;
+	make_wav_header(&header,s->rate,s->nchannels,s->size);
+	ms_async_writer_write_at(s->writer,(const uint8_t*)&header,sizeof(header),0);
+}
+
+static void rec_account_dropped(MSFilter *f, int dropped){
+	RecState *s=(RecState*)f->data;
+	s->size-=dropped;
+	ms_warning("MSFileRec: the disk is too slow, %i bytes dropped.",dropped);
+	ms_filter_notify(f,MS_FILE_REC_DATA_DROPPED,&dropped);
+}
+
+static void rec_write(MSFilter *f, const uint8_t *data, int len){
+	RecState *s=(RecState*)f->data;
+	int err;
+	s->size+=len;
+	if (s->writer){
+		int dropped=ms_async_writer_write(s->writer,data,len);
+		if (dropped>0) rec_account_dropped(f,dropped);
+	}else if ((err=write(s->fd,data,len))!=len){
+		if (err<0)
+			ms_warning("MSFileRec: fail to write %i bytes: %s",len,strerror(errno));
+	}
+}
+
+/*hands the data to the I/O thread regularly, otherwise it would wait for a full chunk, and keeps the header up to date*/
+static void rec_flush(MSFilter *f){
+	RecState *s=(RecState*)f->data;
+	uint64_t now=f->ticker->time;
+	if (s->writer==NULL) return;
+	if (now-s->last_flush>=FLUSH_INTERVAL){
+		int dropped=ms_async_writer_flush(s->writer);
+		if (dropped>0) rec_account_dropped(f,dropped);
+		s->last_flush=now;
+	}
+	if (now-s->last_header>=HEADER_INTERVAL){
+		queue_wav_header(s);
+		s->last_header=now;
+	}
+}
+
 static void rec_process(MSFilter *f){
 	RecState *s=(RecState*)f->data;
 	mblk_t *m;
-	int err;
 	while((m=ms_queue_get(f->inputs[0]))!=NULL){
 		mblk_t *it=m;
 		ms_mutex_lock(&f->lock);
 		if (s->state==MSRecorderRunning){
 			while(it!=NULL){
-				int len=it->b_wptr-it->b_rptr;
-				if ((err=write(s->fd,it->b_rptr,len))!=len){
-					if (err<0)
-						ms_warning("MSFileRec: fail to write %i bytes: %s",len,strerror(errno));
-				}
+				rec_write(f,it->b_rptr,it->b_wptr-it->b_rptr);
 				it=it->b_cont;
-				s->size+=len;
 			}
 		}
 		ms_mutex_unlock(&f->lock);
 		freemsg(m);
 	}
+	ms_mutex_lock(&f->lock);
+	if (s->state==MSRecorderRunning) rec_flush(f);
+	ms_mutex_unlock(&f->lock);
 }
 
 static int rec_get_length(const char *file, int *length){
@@ -109,8 +186,13 @@ static int rec_open(MSFilter *f, void *arg){
 				ms_error("Could not lseek to end of file: %s",strerror(errno));
 			}
 		}else ms_error("fstat() failed: %s",strerror(errno));
+	}else{
+		/*the data starts after the header, which is rewritten with the right size at close*/
+		write_wav_header(s->fd,s->rate,s->nchannels,0);
 	}
 	ms_mutex_lock(&f->lock);
+	s->writer=ms_async_writer_new(s->fd);
+	s->last_flush=s->last_header=f->ticker ? f->ticker->time : 0;
 	s->state=MSRecorderPaused;
 	ms_mutex_unlock(&f->lock);
 	return 0;
@@ -136,39 +218,24 @@ static int rec_stop(MSFilter *f, void *arg){
 	return 0;
 }
 
-static void write_wav_header(int fd, int rate, int nchannels, int size){
-	wave_header_t header;
-	memcpy(&header.riff_chunk.riff,"RIFF",4);
-	header.riff_chunk.len=le_uint32(size+32);
-	memcpy(&header.riff_chunk.wave,"WAVE",4);
-
-	memcpy(&header.format_chunk.fmt,"fmt ",4);
-	header.format_chunk.len=le_uint32(0x10);
-	header.format_chunk.type=le_uint16(0x1);
-	header.format_chunk.channel=le_uint16(nchannels);
-	header.format_chunk.rate=le_uint32(rate);
-	header.format_chunk.bps=le_uint32(rate*2*nchannels);
-	header.format_chunk.blockalign=le_uint16(2*nchannels);
-	header.format_chunk.bitpspl=le_uint16(16);
-
-	memcpy(&header.data_chunk.data,"data",4);
-	header.data_chunk.len=le_uint32(size);
-	lseek(fd,0,SEEK_SET);
-	if (write(fd,&header,sizeof(header))!=sizeof(header)){
-		ms_warning("Fail to write wav header.");
-	}
-}
-
 static int rec_close(MSFilter *f, void *arg){
 	RecState *s=(RecState*)f->data;
+	MSAsyncWriter *writer=NULL;
 	ms_mutex_lock(&f->lock);
 	s->state=MSRecorderClosed;
-	if (s->fd!=-1){
+	if (s->writer){
+		queue_wav_header(s);
+		writer=s->writer;
+		s->writer=NULL;
+		s->fd=-1;
+	}else if (s->fd!=-1){
 		write_wav_header(s->fd, s->rate, s->nchannels, s->size);
 		close(s->fd);
 		s->fd=-1;
 	}
 	ms_mutex_unlock(&f->lock);
+	/*waits for the I/O thread without blocking the ticker*/
+	if (writer) ms_async_writer_close(writer);
 	return 0;
 }
 
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include <mediastreamer2/msfilter.h>
+#include <mediastreamer2/mscodecutils.h>
 
 
 #ifdef HAVE_SPANDSP
@@ -58,6 +59,8 @@ static void enc_uninit(MSFilter *f)
 	f->data = 0;
 };
 
+#ifdef HAVE_SPANDSP
+/*spandsp has no block functions: the samples are scaled around the per sample codec*/
 static void scale_down(int16_t *samples, int count){
 	int i;
 	for (i=0;i<count;++i)
@@ -69,6 +72,7 @@ static void scale_up(int16_t *samples, int count){
 	for (i=0;i<count;++i)
 		samples[i]=samples[i]<<1;
 }
+#endif
 
 static void enc_process(MSFilter *f)
 {
@@ -96,8 +100,12 @@ static void enc_process(MSFilter *f)
 		mblk_t *om=allocb(nbytes*frame_per_packet,0);//too large...
 		int k;
 		
+#ifdef HAVE_SPANDSP
 		scale_down((int16_t *)buf,chunksize/2);
-		k = g722_encode(s->state, om->b_wptr, (int16_t *)buf, chunksize/2);		
+		k = g722_encode(s->state, om->b_wptr, (int16_t *)buf, chunksize/2);
+#else
+		k = g722_encode_block(s->state, om->b_wptr, (int16_t *)buf, chunksize/2);
+#endif
 		om->b_wptr += k;
 		mblk_set_timestamp_info(om,s->ts);		
 		ms_queue_put(f->outputs[0],om);
@@ -181,6 +189,7 @@ MSFilterDesc ms_g722_enc_desc={
 
 struct DecState {
 	g722_decode_state_t *state;
+	uint32_t cn_seed;
 };
 
 static void dec_init(MSFilter *f){
@@ -188,6 +197,7 @@ static void dec_init(MSFilter *f){
 	f->data=s;
 
 	s->state = g722_decode_init(NULL, 64000, 0);
+	s->cn_seed = 0;
 };
 
 static void dec_uninit(MSFilter *f)
@@ -208,13 +218,31 @@ static void dec_process(MSFilter *f)
 		int payloadlen = im->b_wptr - im->b_rptr;
 		int declen;
 
+		if (mblk_get_cn_flag(im)) {
+			/* comfort noise (RFC3389): 20 ms of noise marked as silence, extended by the PLC filter */
+			int level = payloadlen>0 ? (im->b_rptr[0] & 0x7f) : MS_COMFORT_NOISE_MAX_LEVEL;
+			om=allocb(320*2,0);
+			mblk_meta_copy(im, om);
+			mblk_set_cn_flag(om, 0);
+			mblk_set_silence_flag(om, 1);
+			ms_comfort_noise_generate(level, (int16_t *)om->b_wptr, 320, &s->cn_seed);
+			om->b_wptr += 320*2;
+			ms_queue_put(f->outputs[0],om);
+			freemsg(im);
+			continue;
+		}
 		om=allocb(payloadlen*4,0);
 		mblk_meta_copy(im, om);
-		if ((declen = g722_decode(s->state,(int16_t *)om->b_wptr, im->b_rptr, payloadlen))<0) {
+#ifdef HAVE_SPANDSP
+		declen = g722_decode(s->state,(int16_t *)om->b_wptr, im->b_rptr, payloadlen);
+		if (declen>0) scale_up((int16_t *)om->b_wptr,declen);
+#else
+		declen = g722_decode_block(s->state,(int16_t *)om->b_wptr, im->b_rptr, payloadlen);
+#endif
+		if (declen<0) {
 			ms_warning("g722_decode error!");
 			freemsg(om);
 		} else {
-			scale_up((int16_t *)om->b_wptr,declen);
 			om->b_wptr  += declen*2;
 			ms_queue_put(f->outputs[0],om);
 		}
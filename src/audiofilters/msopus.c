@@ -24,13 +24,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mscodecutils.h"
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msaudioconvert.h"
 #include "ortp/rtp.h"
 
 
 #include <opus/opus.h>
 
-#define SIGNAL_SAMPLE_SIZE  2 // 2 bytes per sample
-
 /* Define codec specific settings */
 #define FRAME_LENGTH			20 // ptime may be 20, 40, 60, 80, 100 or 120, packets composed of multiples 20ms frames 
 #define MAX_BYTES_PER_FRAME     500 // Equals peak bitrate of 200 kbps
@@ -46,9 +45,12 @@ typedef struct _OpusEncData {
 	uint32_t ts;
 	int samplerate;
 	int channels;
+	MSSampleFormat sample_format;
 	int application;
 	int max_network_bitrate;
 	int bitrate;
+	int complexity;
+	bool_t complexity_changed; /*applied by the process function, that owns the encoder state*/
 
 	int maxplaybackrate;
 	int maxptime;
@@ -82,6 +84,8 @@ static void ms_opus_enc_init(MSFilter *f) {
 	d->application = OPUS_APPLICATION_VOIP; // property not really needed as we are always in this application mode
 	d->bitrate = -1;
 	d->max_network_bitrate = 46000;
+	d->complexity = -1;
+	d->complexity_changed = FALSE;
 
 	/* set default parameters according to draft RFC RTP Payload Format for Opus codec section 6.1 */
 	d->maxplaybackrate = 48000;
@@ -91,6 +95,7 @@ static void ms_opus_enc_init(MSFilter *f) {
 	d->maxaveragebitrate = -1;
 	d->stereo = 1;
 	d->channels = 1;
+	d->sample_format = MSSampleFormatS16;
 	d->vbr = 1;
 	d->useinbandfec = 0;
 	d->usedtx = 0;
@@ -110,9 +115,15 @@ static void ms_opus_enc_preprocess(MSFilter *f) {
 	}
 
 	/* set complexity to 0 for arm devices */
+	if (d->complexity == -1) {
 #ifdef __arm__
-	opus_encoder_ctl(d->state, OPUS_SET_COMPLEXITY(0));
+		opus_encoder_ctl(d->state, OPUS_SET_COMPLEXITY(0));
 #endif
+		opus_encoder_ctl(d->state, OPUS_GET_COMPLEXITY(&d->complexity));
+	} else {
+		opus_encoder_ctl(d->state, OPUS_SET_COMPLEXITY(d->complexity));
+	}
+	d->complexity_changed = FALSE;
 	error = opus_encoder_ctl(d->state, OPUS_SET_PACKET_LOSS_PERC(10));
 	if (error != OPUS_OK) {
 		ms_error("Could not set default loss percentage to opus encoder: %s", opus_strerror(error));
@@ -153,11 +164,16 @@ static void ms_opus_enc_process(MSFilter *f) {
 	opus_int32 ret = 0;
 	opus_int32 totalLength = 0;
 	int frame_size = d->samplerate * FRAME_LENGTH / 1000; /* in samples */
+	int sample_size = ms_sample_format_get_size(d->sample_format);
 
 	// lock the access while getting ptime
 	ms_filter_lock(f);
 	frameNumber = d->ptime/FRAME_LENGTH; /* encode 20ms frames, ptime is a multiple of 20ms */
 	packet_size = d->samplerate * d->ptime / 1000; /* in samples */
+	if (d->complexity_changed) {
+		opus_encoder_ctl(d->state, OPUS_SET_COMPLEXITY(d->complexity));
+		d->complexity_changed = FALSE;
+	}
 	ms_filter_unlock(f);
 
 
@@ -168,15 +184,19 @@ static void ms_opus_enc_process(MSFilter *f) {
 	for (i=0; i<MAX_INPUT_FRAMES; i++) {
 		codedFrameBuffer[i]=NULL;
 	}
-	while (ms_bufferizer_get_avail(d->bufferizer) >= (d->channels * packet_size * SIGNAL_SAMPLE_SIZE)) {
+	while (ms_bufferizer_get_avail(d->bufferizer) >= (d->channels * packet_size * sample_size)) {
+		bool_t silent = ms_bufferizer_is_silent(d->bufferizer, d->channels * packet_size * sample_size);
 		totalLength = 0;
 		opus_repacketizer_init(rp);
 		for (i=0; i<frameNumber; i++) { /* encode 20ms by 20ms and repacketize all of them together */
 			if (!codedFrameBuffer[i]) codedFrameBuffer[i] = ms_malloc(MAX_BYTES_PER_FRAME); /* the repacketizer need the pointer to packet to remain valid, so we shall have a buffer for each coded frame */
-			if (!signalFrameBuffer) signalFrameBuffer = ms_malloc(frame_size * SIGNAL_SAMPLE_SIZE * d->channels);
+			if (!signalFrameBuffer) signalFrameBuffer = ms_malloc(frame_size * sample_size * d->channels);
 
-			ms_bufferizer_read(d->bufferizer, signalFrameBuffer, frame_size * SIGNAL_SAMPLE_SIZE * d->channels);
-			ret = opus_encode(d->state, (opus_int16 *)signalFrameBuffer, frame_size, codedFrameBuffer[i], MAX_BYTES_PER_FRAME);
+			ms_bufferizer_read(d->bufferizer, signalFrameBuffer, frame_size * sample_size * d->channels);
+			if (d->sample_format == MSSampleFormatFloat32)
+				ret = opus_encode_float(d->state, (float *)signalFrameBuffer, frame_size, codedFrameBuffer[i], MAX_BYTES_PER_FRAME);
+			else
+				ret = opus_encode(d->state, (opus_int16 *)signalFrameBuffer, frame_size, codedFrameBuffer[i], MAX_BYTES_PER_FRAME);
 			if (ret < 0) {
 				ms_error("Opus encoder error: %s", opus_strerror(ret));
 				break;
@@ -191,12 +211,17 @@ static void ms_opus_enc_process(MSFilter *f) {
 			}
 		}
 
-		if (ret > 0) {
+		if (ret > 0 && d->usedtx && totalLength <= 2*frameNumber) {
+			/* the encoder only produced DTX frames, which do not need to be transmitted: the decoder generates comfort noise */
+			d->ts += packet_size*48000/d->samplerate;
+			ret = 0;
+		} else if (ret > 0) {
 			om = allocb(totalLength+frameNumber + 1, 0); /* opus repacktizer API: allocate at leat number of frame + size of all data added before */ 
 			ret = opus_repacketizer_out(rp, om->b_wptr, totalLength+frameNumber);
 
 			om->b_wptr += ret;
 			mblk_set_timestamp_info(om, d->ts);
+			mblk_set_silence_flag(om, silent);
 			ms_queue_put(f->outputs[0], om);
 			d->ts += packet_size*48000/d->samplerate; /* RFC payload RTP opus 03 - section 4: RTP timestamp multiplier : WARNING works only with sr at 48000 */
 			ret = 0;
@@ -459,6 +484,40 @@ static int ms_opus_enc_set_nchannels(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_opus_enc_set_sample_format(MSFilter *f, void *arg) {
+	OpusEncData *d = (OpusEncData *)f->data;
+	d->sample_format = (MSSampleFormat)*(int*)arg;
+	return 0;
+}
+
+static int ms_opus_enc_get_sample_format(MSFilter *f, void *arg) {
+	OpusEncData *d = (OpusEncData *)f->data;
+	*(int*)arg = d->sample_format;
+	return 0;
+}
+
+static int ms_opus_enc_set_complexity(MSFilter *f, void *arg) {
+	OpusEncData *d = (OpusEncData *)f->data;
+	int complexity = *(int*)arg;
+
+	if (complexity < 0 || complexity > 10) {
+		ms_error("Opus encoder: invalid complexity %i", complexity);
+		return -1;
+	}
+	ms_filter_lock(f);
+	d->complexity = complexity;
+	d->complexity_changed = TRUE;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int ms_opus_enc_get_complexity(MSFilter *f, void *arg) {
+	OpusEncData *d = (OpusEncData *)f->data;
+	if (d->complexity == -1) return -1; /* library default, known once the encoder is created */
+	*(int*)arg = d->complexity;
+	return 0;
+}
+
 static int ms_opus_enc_set_vbr(MSFilter *f) {
 	OpusEncData *d = (OpusEncData *)f->data;
 	int error;
@@ -544,6 +603,10 @@ static MSFilterMethod ms_opus_enc_methods[] = {
 	{	MS_AUDIO_ENCODER_SET_PTIME,	ms_opus_enc_set_ptime		},
 	{	MS_AUDIO_ENCODER_GET_PTIME,	ms_opus_enc_get_ptime		},
 	{	MS_FILTER_SET_NCHANNELS		,	ms_opus_enc_set_nchannels},
+	{	MS_FILTER_SET_SAMPLE_FORMAT	,	ms_opus_enc_set_sample_format},
+	{	MS_FILTER_GET_SAMPLE_FORMAT	,	ms_opus_enc_get_sample_format},
+	{	MS_FILTER_SET_COMPLEXITY	,	ms_opus_enc_set_complexity},
+	{	MS_FILTER_GET_COMPLEXITY	,	ms_opus_enc_get_complexity},
 	{	0,				NULL				}
 };
 
@@ -612,6 +675,7 @@ typedef struct _OpusDecData {
 	OpusDecoder *state;
 	int samplerate;
 	int channels;
+	MSSampleFormat sample_format;
 
 	/* concealment properties */
 	MSConcealerContext *concealer;
@@ -634,6 +698,7 @@ static void ms_opus_dec_init(MSFilter *f) {
 	d->state = NULL;
 	d->samplerate = 48000;
 	d->channels = 1;
+	d->sample_format = MSSampleFormatS16;
 	d->lastPacketLength = 20;
 	d->statsfec = 0;
 	d->statsplc = 0;
@@ -651,24 +716,31 @@ static void ms_opus_dec_preprocess(MSFilter *f) {
 	d->concealer = ms_concealer_context_new(UINT32_MAX);
 }
 
+static int ms_opus_dec_decode(OpusDecData *d, const unsigned char *data, opus_int32 len, uint8_t *out, int frame_size, int decode_fec) {
+	if (d->sample_format == MSSampleFormatFloat32)
+		return opus_decode_float(d->state, data, len, (float *)out, frame_size, decode_fec);
+	return opus_decode(d->state, data, len, (opus_int16 *)out, frame_size, decode_fec);
+}
+
 static void ms_opus_dec_process(MSFilter *f) {
 	OpusDecData *d = (OpusDecData *)f->data;
 	mblk_t *im;
 	mblk_t *om;
 	int frames;
+	int sample_size = ms_sample_format_get_size(d->sample_format);
 
 	/* decode available packets */
 	while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-		om = allocb(5760 * d->channels * SIGNAL_SAMPLE_SIZE, 0); /* 5760 is the maximum number of sample in a packet (120ms at 48KHz) */
+		om = allocb(5760 * d->channels * sample_size, 0); /* 5760 is the maximum number of sample in a packet (120ms at 48KHz) */
 
-		frames = opus_decode(d->state, (const unsigned char *)im->b_rptr, im->b_wptr - im->b_rptr, (opus_int16 *)om->b_wptr, 5760, 0);
+		frames = ms_opus_dec_decode(d, (const unsigned char *)im->b_rptr, im->b_wptr - im->b_rptr, om->b_wptr, 5760, 0);
 
 		if (frames < 0) {
 			ms_warning("Opus decoder error: %s", opus_strerror(frames));
 			freemsg(om);
 		} else {
 			d->lastPacketLength = frames; // store the packet length for eventual PLC if next two packets are missing
-			om->b_wptr += frames * d->channels * SIGNAL_SAMPLE_SIZE;
+			om->b_wptr += frames * d->channels * sample_size;
 			ms_queue_put(f->outputs[0], om);
 			d->sequence_number = mblk_get_cseq(im); // used to get eventual FEC information if next packet is missing
 			ms_concealer_inc_sample_time(d->concealer,f->ticker->time, frames*1000/d->samplerate, 1);
@@ -692,22 +764,22 @@ static void ms_opus_dec_process(MSFilter *f) {
 				d->statsplc++;
 			}
 		}
-		om = allocb(5760 * d->channels * SIGNAL_SAMPLE_SIZE, 0); /* 5760 is the maximum number of sample in a packet (120ms at 48KHz) */
+		om = allocb(5760 * d->channels * sample_size, 0); /* 5760 is the maximum number of sample in a packet (120ms at 48KHz) */
 		/* call to the decoder, we'll have either FEC or PLC, do it on the same length that last received packet */
 		if (payload) { // found frame to try FEC
-			frames = opus_decode(d->state, payload, imLength, (opus_int16 *)om->b_wptr, d->lastPacketLength, 1);
+			frames = ms_opus_dec_decode(d, payload, imLength, om->b_wptr, d->lastPacketLength, 1);
 		} else { // do PLC: PLC doesn't seem to be able to generate more than 960 samples (20 ms at 48000 Hz), get PLC until we have the correct number of sample
 			//frames = opus_decode(d->state, NULL, 0, (opus_int16 *)om->b_wptr, d->lastPacketLength, 0); // this should have work if opus_decode returns the requested number of samples
 			frames = 0;
 			while (frames < d->lastPacketLength) {
-				frames += opus_decode(d->state, NULL, 0, (opus_int16 *)(om->b_wptr + (frames*d->channels*SIGNAL_SAMPLE_SIZE)), d->lastPacketLength-frames, 0);
+				frames += ms_opus_dec_decode(d, NULL, 0, om->b_wptr + (frames*d->channels*sample_size), d->lastPacketLength-frames, 0);
 			}
 		}
 		if (frames < 0) {
 			ms_warning("Opus decoder error in concealment: %s", opus_strerror(frames));
 			freemsg(om);
 		} else {
-			om->b_wptr += frames * d->channels * SIGNAL_SAMPLE_SIZE;
+			om->b_wptr += frames * d->channels * sample_size;
 			ms_queue_put(f->outputs[0], om);
 			d->sequence_number++;
 			ms_concealer_inc_sample_time(d->concealer,f->ticker->time, frames*1000/d->samplerate, 0);
@@ -779,6 +851,18 @@ static int ms_opus_dec_set_nchannels(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_opus_dec_set_sample_format(MSFilter *f, void *arg) {
+	OpusDecData *d = (OpusDecData *)f->data;
+	d->sample_format = (MSSampleFormat)*(int*)arg;
+	return 0;
+}
+
+static int ms_opus_dec_get_sample_format(MSFilter *f, void *arg) {
+	OpusDecData *d = (OpusDecData *)f->data;
+	*(int*)arg = d->sample_format;
+	return 0;
+}
+
 static MSFilterMethod ms_opus_dec_methods[] = {
 	{	MS_FILTER_SET_SAMPLE_RATE,	ms_opus_dec_set_sample_rate	},
 	{	MS_FILTER_GET_SAMPLE_RATE,	ms_opus_dec_get_sample_rate	},
@@ -786,6 +870,8 @@ static MSFilterMethod ms_opus_dec_methods[] = {
 	{	MS_FILTER_SET_RTP_PAYLOAD_PICKER,	ms_opus_set_rtp_picker	},
 	{ 	MS_DECODER_HAVE_PLC,		ms_opus_dec_have_plc		},
 	{	MS_FILTER_SET_NCHANNELS		,	ms_opus_dec_set_nchannels},
+	{	MS_FILTER_SET_SAMPLE_FORMAT	,	ms_opus_dec_set_sample_format},
+	{	MS_FILTER_GET_SAMPLE_FORMAT	,	ms_opus_dec_get_sample_format},
 	{	0,				NULL				}
 };
 
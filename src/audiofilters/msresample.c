@@ -18,18 +18,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msresampler.h"
+#include "mediastreamer2/msaudioconvert.h"
 
-#ifdef _MSC_VER
-#include <malloc.h>
-#endif
-
-#include <speex/speex_resampler.h>
-#include <speex/speex.h>
-
-#ifdef ANDROID
-#include "cpu-features.h"
-#endif
-	
 typedef struct _ResampleData{
 	MSBufferizer *bz;
 	uint32_t ts;
@@ -37,7 +28,7 @@ typedef struct _ResampleData{
 	uint32_t output_rate;
 	int in_nchannels;
 	int out_nchannels;
-	SpeexResamplerState *handle;
+	MSResampler *handle;
 } ResampleData;
 
 static ResampleData * resample_data_new(){
@@ -53,29 +44,12 @@ static ResampleData * resample_data_new(){
 
 static void resample_data_destroy(ResampleData *obj){
 	if (obj->handle!=NULL)
-		speex_resampler_destroy(obj->handle);
+		ms_resampler_destroy(obj->handle);
 	ms_bufferizer_destroy(obj->bz);
 	ms_free(obj);
 }
 
 static void resample_init(MSFilter *obj){
-#ifdef SPEEX_LIB_SET_CPU_FEATURES
-	int cpuFeatures = 0;
-#ifdef __arm__
-	#ifdef ANDROID
-	if (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM 
-		&& (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) != 0) {
-		cpuFeatures = SPEEX_LIB_CPU_FEATURE_NEON;
-	}
-	#elif defined(__ARM_NEON__)
-	cpuFeatures = SPEEX_LIB_CPU_FEATURE_NEON;
-	#endif
-	ms_message("speex_lib_ctl init with neon ? %d", (cpuFeatures == SPEEX_LIB_CPU_FEATURE_NEON));
-#endif
-	speex_lib_ctl(SPEEX_LIB_SET_CPU_FEATURES, &cpuFeatures);
-#else
-	ms_message("speex_lib_ctl does not support SPEEX_LIB_CPU_FEATURE_NEON");
-#endif
 	obj->data=resample_data_new();
 }
 
@@ -83,104 +57,82 @@ static void resample_uninit(MSFilter *obj){
 	resample_data_destroy((ResampleData*)obj->data); 
 }
 
-static int resample_channel_adapt(int in_nchannels, int out_nchannels, mblk_t *im, mblk_t **om) {
-	if ((in_nchannels == 2) && (out_nchannels == 1)) {
-		int msgsize = msgdsize(im) / 2;
-		*om = allocb(msgsize, 0);
-		for (; im->b_rptr < im->b_wptr; im->b_rptr += 4, (*om)->b_wptr += 2) {
-			*(int16_t *)(*om)->b_wptr = *(int16_t *)im->b_rptr;
-		}
-		return 1;
-	} else if ((in_nchannels == 1) && (out_nchannels == 2)) {
-		int msgsize = msgdsize(im) * 2;
-		*om = allocb(msgsize, 0);
-		for (; im->b_rptr < im->b_wptr; im->b_rptr += 2, (*om)->b_wptr += 4) {
-			((int16_t *)(*om)->b_wptr)[0] = *(int16_t *)im->b_rptr;
-			((int16_t *)(*om)->b_wptr)[1] = *(int16_t *)im->b_rptr;
-		}
-		return 1;
-	}
-	return 0;
-}
-
 static void resample_process_ms2(MSFilter *obj){
 	ResampleData *dt=(ResampleData*)obj->data;
-	mblk_t *im, *om = NULL, *om_chan = NULL;
+	mblk_t *im, *om = NULL;
 	
 	if (dt->output_rate==dt->input_rate){
 		while((im=ms_queue_get(obj->inputs[0]))!=NULL){
-			if (resample_channel_adapt(dt->in_nchannels, dt->out_nchannels, im, &om) == 0) {
-				ms_queue_put(obj->outputs[0], im);
-			} else {
-				ms_queue_put(obj->outputs[0], om);
-				freemsg(im);
-			}
+			ms_queue_put(obj->outputs[0], ms_audio_convert_channels_msg(im, dt->in_nchannels, dt->out_nchannels));
 		}
 		return;
 	}
 	ms_filter_lock(obj);
-	if (dt->handle!=NULL){
-		unsigned int inrate=0, outrate=0;
-		speex_resampler_get_rate(dt->handle,&inrate,&outrate);
-		if (inrate!=dt->input_rate || outrate!=dt->output_rate){
-			speex_resampler_destroy(dt->handle);
-			dt->handle=0;
-		}
-	}
 	if (dt->handle==NULL){
-		int err=0;
-		dt->handle=speex_resampler_init(dt->in_nchannels, dt->input_rate, dt->output_rate, SPEEX_RESAMPLER_QUALITY_VOIP, &err);
+		/*cheap: the filter tables are shared between all the resamplers doing the same conversion*/
+		dt->handle=ms_resampler_new(dt->input_rate, dt->output_rate, dt->in_nchannels, MSResamplerQualityVoip);
+		if (dt->handle==NULL){
+			ms_error("MSResample: cannot convert from %u to %u Hz", dt->input_rate, dt->output_rate);
+			ms_queue_flush(obj->inputs[0]);
+			ms_filter_unlock(obj);
+			return;
+		}
 	}
-
-	
-	while((im=ms_queue_get(obj->inputs[0]))!=NULL){
-		unsigned int inlen=(im->b_wptr-im->b_rptr)/(2*dt->in_nchannels);
-		unsigned int outlen=((inlen*dt->output_rate)/dt->input_rate)+1;
-		unsigned int inlen_orig=inlen;
-		om=allocb(outlen*2*dt->in_nchannels,0);
-		mblk_meta_copy(im, om);
-		if (dt->in_nchannels==1){
-			speex_resampler_process_int(dt->handle, 
-					0, 
-					(int16_t*)im->b_rptr, 
-					&inlen, 
-					(int16_t*)om->b_wptr, 
-					&outlen);
-		}else{
-			speex_resampler_process_interleaved_int(dt->handle, 
-					(int16_t*)im->b_rptr, 
-					&inlen, 
-					(int16_t*)om->b_wptr, 
-					&outlen);
+	if (!ms_queue_empty(obj->inputs[0])){
+		/*resample everything queued during this tick into a single output block*/
+		int frame_size=2*dt->in_nchannels;
+		int inlen=0;
+		int outlen;
+		bool_t silent=TRUE;
+		for(im=qbegin(&obj->inputs[0]->q);!qend(&obj->inputs[0]->q,im);im=qnext(&obj->inputs[0]->q,im)){
+			inlen+=(int)((im->b_wptr-im->b_rptr)/frame_size);
+			silent=silent && mblk_get_silence_flag(im);
 		}
-		if (inlen_orig!=inlen){
-			ms_error("Bug in resampler ! only %u samples consumed instead of %u, out=%u",
-				inlen,inlen_orig,outlen);
+		im=qbegin(&obj->inputs[0]->q);
+		outlen=ms_resampler_get_max_output(dt->handle,inlen);
+		om=allocb(outlen*frame_size,0);
+		mblk_meta_copy(im, om);
+		/*blocks of silence still carry comfort noise, they are resampled like the others*/
+		mblk_set_silence_flag(om, silent);
+		while((im=ms_queue_get(obj->inputs[0]))!=NULL){
+			int nframes=(int)((im->b_wptr-im->b_rptr)/frame_size);
+			int nout=ms_resampler_process(dt->handle, (int16_t*)im->b_rptr, nframes,
+				(int16_t*)om->b_wptr, (int)((om->b_datap->db_lim-om->b_wptr)/frame_size));
+			om->b_wptr+=nout*frame_size;
+			freemsg(im);
 		}
-		om->b_wptr+=outlen*2*dt->in_nchannels;
+		outlen=(int)((om->b_wptr-om->b_rptr)/frame_size);
 		mblk_set_timestamp_info(om,dt->ts);
 		dt->ts+=outlen;
-		if (resample_channel_adapt(dt->in_nchannels, dt->out_nchannels, om, &om_chan) == 0) {
-			ms_queue_put(obj->outputs[0], om);
-		} else {
-			ms_queue_put(obj->outputs[0], om_chan);
-			freemsg(om);
-		}
-		freemsg(im);
+		/*om is not shared: a conversion to mono is done in place*/
+		ms_queue_put(obj->outputs[0], ms_audio_convert_channels_msg(om, dt->in_nchannels, dt->out_nchannels));
 	}
 	ms_filter_unlock(obj);
 }
 
 
+static void resample_reset_handle(ResampleData *dt){
+	if (dt->handle!=NULL){
+		ms_resampler_destroy(dt->handle);
+		dt->handle=NULL;
+	}
+}
+
 static int ms_resample_set_sr(MSFilter *obj, void *arg){
 	ResampleData *dt=(ResampleData*)obj->data;
+	ms_filter_lock(obj);
+	if (dt->input_rate!=(uint32_t)((int*)arg)[0]) resample_reset_handle(dt);
 	dt->input_rate=((int*)arg)[0];
+	ms_filter_unlock(obj);
 	return 0;
 }
 
 static int ms_resample_set_output_sr(MSFilter *obj, void *arg){
 	ResampleData *dt=(ResampleData*)obj->data;
+	ms_filter_lock(obj);
+	if (dt->output_rate!=(uint32_t)((int*)arg)[0]) resample_reset_handle(dt);
 	dt->output_rate=((int*)arg)[0];
+	ms_filter_unlock(obj);
 	return 0;
 }
 
@@ -188,10 +140,7 @@ static int set_input_nchannels(MSFilter *f, void *arg){
 	ResampleData *dt=(ResampleData*)f->data;
 	int chans=*(int*)arg;
 	ms_filter_lock(f);
-	if (dt->in_nchannels!=chans && dt->handle!=NULL){
-		speex_resampler_destroy(dt->handle);
-		dt->handle=NULL;
-	}
+	if (dt->in_nchannels!=chans) resample_reset_handle(dt);
 	dt->in_nchannels=chans;
 	ms_filter_unlock(f);
 	return 0;
@@ -201,10 +150,7 @@ static int set_output_nchannels(MSFilter *f, void *arg) {
 	ResampleData *dt = (ResampleData *)f->data;
 	int chans = *(int *)arg;
 	ms_filter_lock(f);
-	if (dt->out_nchannels != chans && dt->handle != NULL) {
-		speex_resampler_destroy(dt->handle);
-		dt->handle = NULL;
-	}
+	if (dt->out_nchannels != chans) resample_reset_handle(dt);
 	dt->out_nchannels = chans;
 	ms_filter_unlock(f);
 	return 0;
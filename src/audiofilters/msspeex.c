@@ -39,12 +39,18 @@ typedef struct SpeexEncState{
 	int vbr;
 	int cng;
 	int mode;
+	int complexity; /*-1 until known, the speex default*/
 	int frame_size;
 	void *state;
 	uint32_t ts;
+	int dtx_count; /*number of packets of silence not transmitted, -1 while speech is transmitted*/
 	MSBufferizer *bufferizer;
 } SpeexEncState;
 
+/*during silence, a packet of null frames is sent regularly so that the decoder keeps generating comfort noise instead
+ of giving up its packet loss concealment, which lasts 200 ms (plc_max frames)*/
+static const int dtx_refresh=160; /*ms*/
+
 static void enc_init(MSFilter *f){
 	SpeexEncState *s=(SpeexEncState *)ms_new(SpeexEncState,1);
 #ifdef SPEEX_LIB_SET_CPU_FEATURES
@@ -56,11 +62,13 @@ static void enc_init(MSFilter *f){
 	s->ip_bitrate=-1;
 	s->ptime=20;
 	s->mode=-1;
+	s->complexity=-1;
 	s->vbr=0;
 	s->cng=0;
 	s->frame_size=0;
 	s->state=0;
 	s->ts=0;
+	s->dtx_count=-1;
 	s->bufferizer=ms_bufferizer_new();
 	f->data=s;
 
@@ -225,7 +233,10 @@ static void enc_preprocess(MSFilter *f){
 		}
 	}
 	apply_max_bitrate(s);
-
+	if (s->complexity==-1)
+		speex_encoder_ctl(s->state,SPEEX_GET_COMPLEXITY,&s->complexity);
+	else if (speex_encoder_ctl(s->state,SPEEX_SET_COMPLEXITY,&s->complexity)!=0)
+		ms_error("Could not set complexity %i to speex encoder.",s->complexity);
 
 	speex_mode_query(mode,SPEEX_MODE_FRAME_SIZE,&s->frame_size);
 }
@@ -258,18 +269,37 @@ static void enc_process(MSFilter *f){
 	while((im=ms_queue_get(f->inputs[0]))!=NULL){
 		ms_bufferizer_put(s->bufferizer,im);
 	}
-	while(ms_bufferizer_read(s->bufferizer,buf,nbytes*frame_per_packet)==nbytes*frame_per_packet){
-		mblk_t *om=allocb(nbytes*frame_per_packet,0);//too large...
+	while(ms_bufferizer_get_avail(s->bufferizer)>=nbytes*frame_per_packet){
+		mblk_t *om;
 		int k;
 		SpeexBits bits;
-		speex_bits_init(&bits);
-		for (k=0;k<frame_per_packet;k++)
-		{
-			speex_encode_int(s->state,(int16_t*)(buf + (k*s->frame_size*2)),&bits);
-			s->ts+=s->frame_size;
+
+		if (ms_bufferizer_is_silent(s->bufferizer,nbytes*frame_per_packet)){
+			/*no need to run the encoder: null frames (narrowband mode 0) make the decoder generate comfort noise
+			 from the last spectral envelope it received*/
+			ms_bufferizer_skip_bytes(s->bufferizer,nbytes*frame_per_packet);
+			s->ts+=s->frame_size*frame_per_packet;
+			if (s->dtx_count!=-1 && ++s->dtx_count*frame_per_packet*20<dtx_refresh)
+				continue;
+			s->dtx_count=0;
+			om=allocb(frame_per_packet+1,0);
+			speex_bits_init(&bits);
+			for (k=0;k<frame_per_packet;k++)
+				speex_bits_pack(&bits,0,5);
+			mblk_set_silence_flag(om,1);
+		}else{
+			ms_bufferizer_read(s->bufferizer,buf,nbytes*frame_per_packet);
+			s->dtx_count=-1;
+			om=allocb(nbytes*frame_per_packet,0);//too large...
+			speex_bits_init(&bits);
+			for (k=0;k<frame_per_packet;k++)
+			{
+				speex_encode_int(s->state,(int16_t*)(buf + (k*s->frame_size*2)),&bits);
+				s->ts+=s->frame_size;
+			}
 		}
 		speex_bits_insert_terminator(&bits);
-		k=speex_bits_write(&bits, (char*)om->b_wptr, nbytes*frame_per_packet);
+		k=speex_bits_write(&bits, (char*)om->b_wptr, om->b_datap->db_lim-om->b_wptr);
 		om->b_wptr+=k;
 
 		mblk_set_timestamp_info(om,s->ts-s->frame_size);
@@ -312,6 +342,25 @@ static int enc_get_br(MSFilter *f, void *arg){
 	return 0;
 }
 
+static int enc_set_complexity(MSFilter *f, void *arg){
+	SpeexEncState *s=(SpeexEncState*)f->data;
+	int complexity=*(int*)arg;
+	if (complexity<0 || complexity>10) return -1;
+	ms_filter_lock(f);
+	s->complexity=complexity;
+	if (s->state && speex_encoder_ctl(s->state,SPEEX_SET_COMPLEXITY,&s->complexity)!=0)
+		ms_error("Could not set complexity %i to speex encoder.",s->complexity);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int enc_get_complexity(MSFilter *f, void *arg){
+	SpeexEncState *s=(SpeexEncState*)f->data;
+	if (s->complexity==-1) return -1;
+	*(int*)arg=s->complexity;
+	return 0;
+}
+
 static int enc_set_ptime(MSFilter *f, void *arg){
 	SpeexEncState *s=(SpeexEncState*)f->data;
 	s->ptime=*(int*)arg;
@@ -427,6 +476,8 @@ static MSFilterMethod enc_methods[]={
 	{	MS_FILTER_ADD_ATTR		,	enc_add_attr	},
 	{	MS_AUDIO_ENCODER_SET_PTIME	,	enc_set_ptime	},
 	{	MS_AUDIO_ENCODER_GET_PTIME	,	enc_get_ptime	},
+	{	MS_FILTER_SET_COMPLEXITY	,	enc_set_complexity	},
+	{	MS_FILTER_GET_COMPLEXITY	,	enc_get_complexity	},
 	{	0				,	NULL		}
 };
 
@@ -22,6 +22,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/msvolume.h"
+#include "mediastreamer2/msaudiokernels.h"
+#include "mediastreamer2/msaudioconvert.h"
 #include "mediastreamer2/msticker.h"
 #include <math.h>
 
@@ -39,6 +41,7 @@ static const float noise_thres=0.1;
 static const float transmit_thres=4;
 static const float min_ng_floorgain=0.005;
 static const float agc_threshold=0.5;
+static const float dtx_thres=0.01;
 
 typedef struct Volume{
 	float energy;
@@ -69,11 +72,18 @@ typedef struct Volume{
 	float ng_threshold;
 	float ng_floorgain;
 	float ng_gain;
+	int dtx_hangover; /*time in ms during which blocks are still transmitted after the last speech detected*/
+	int dtx_hangover_dur;
+	float dtx_threshold;
 	MSBufferizer *buffer;
+	MSSampleFormat in_format;
+	MSSampleFormat out_format;
 	bool_t agc_enabled;
 	bool_t noise_gate_enabled;
 	bool_t remove_dc;
 	bool_t fast_upramp;
+	bool_t dtx_enabled;
+	const MSAudioKernels *kernels;
 }Volume;
 
 static void volume_init(MSFilter *f){
@@ -102,6 +112,12 @@ static void volume_init(MSFilter *f){
 	v->ng_floorgain=min_ng_floorgain;
 	v->ng_gain = 1;
 	v->remove_dc=FALSE;
+	v->dtx_enabled=FALSE;
+	v->dtx_hangover=200;
+	v->dtx_hangover_dur=0;
+	v->dtx_threshold=dtx_thres;
+	v->kernels=ms_audio_kernels_get();
+	v->in_format=v->out_format=MSSampleFormatS16;
 #ifdef HAVE_SPEEXDSP
 	v->speex_pp=NULL;
 #endif
@@ -118,6 +134,10 @@ static void volume_uninit(MSFilter *f){
 	ms_free(f->data);
 }
 
+static inline int block_samples(Volume *v, mblk_t *m){
+	return (int)(m->b_wptr-m->b_rptr)/ms_sample_format_get_size(v->in_format);
+}
+
 static inline float linear_to_db(float linear){
 	if (linear==0) return MS_VOLUME_DB_LOWEST;
 	return 10*ortp_log10f(linear);
@@ -179,7 +199,7 @@ static inline float compute_gain(Volume *v, float energy, float weight) {
 static float volume_echo_avoider_process(Volume *v, mblk_t *om) {
 	static int counter;
 	float peer_e,peer_pk;
-	int nsamples = ((om->b_wptr - om->b_rptr) / 2);
+	int nsamples = block_samples(v, om);
 	float mic_spk_ratio;
 	peer_e = ((Volume *)(v->peer->data))->energy;
 	peer_pk=((Volume *)(v->peer->data))->energy;
@@ -219,7 +239,7 @@ static float volume_echo_avoider_process(Volume *v, mblk_t *om) {
 static void volume_noise_gate_process(Volume *v , float energy, mblk_t *om){
 	static int counter;
 	float tgain = v->ng_floorgain;  /* start with floorgain */
-	int nsamples=((om->b_wptr-om->b_rptr)/2);
+	int nsamples=block_samples(v, om);
 	if (energy > v->ng_threshold) {
 		v->ng_noise_dur = v->ng_cut_time;
 		tgain = 1.0;
@@ -238,6 +258,18 @@ static void volume_noise_gate_process(Volume *v , float energy, mblk_t *om){
 				          (v->peer!=NULL)?1:0, energy, v->energy, tgain, v->ng_gain);
 }
 
+/*voice activity detection: the blocks are marked as silence once the energy stays below the threshold for the hangover time,
+ so that the end of words is not cut*/
+static void volume_dtx_process(Volume *v, mblk_t *om){
+	int nsamples=block_samples(v, om);
+	if (v->instant_energy > v->dtx_threshold) {
+		v->dtx_hangover_dur = v->dtx_hangover;
+	}else if (v->dtx_hangover_dur > 0) {
+		v->dtx_hangover_dur -= (nsamples * 1000) / v->sample_rate;
+	}
+	mblk_set_silence_flag(om, v->dtx_hangover_dur <= 0);
+}
+
 static int volume_set_db_gain(MSFilter *f, void *gain){
 	float *fgain=(float*)gain;
 	Volume *v=(Volume*)f->data;
@@ -352,44 +384,57 @@ static int volume_set_noise_gate_floorgain(MSFilter *f, void *arg){
 	return 0;
 }
 
-static int volume_remove_dc(MSFilter *f, void *arg){
+static int volume_enable_dtx(MSFilter *f, void *arg){
 	Volume *v=(Volume*)f->data;
-	v->remove_dc=*(int*)arg;
+	v->dtx_enabled=*(int*)arg;
+	v->dtx_hangover_dur=0;
+	return 0;
+}
+
+static int volume_set_dtx_threshold(MSFilter *f, void *arg){
+	Volume *v=(Volume*)f->data;
+	v->dtx_threshold=*(float*)arg;
+	return 0;
+}
+
+static int volume_set_sample_format(MSFilter *f, void *arg){
+	Volume *v=(Volume*)f->data;
+	v->in_format=v->out_format=(MSSampleFormat)*(int*)arg;
+	return 0;
+}
+
+static int volume_get_sample_format(MSFilter *f, void *arg){
+	Volume *v=(Volume*)f->data;
+	*(int*)arg=v->in_format;
+	return 0;
+}
+
+static int volume_set_output_sample_format(MSFilter *f, void *arg){
+	Volume *v=(Volume*)f->data;
+	v->out_format=(MSSampleFormat)*(int*)arg;
 	return 0;
 }
 
-static inline int16_t saturate(int val) {
-	return (val>32767) ? 32767 : ( (val<-32767) ? -32767 : val);
+static int volume_remove_dc(MSFilter *f, void *arg){
+	Volume *v=(Volume*)f->data;
+	v->remove_dc=*(int*)arg;
+	return 0;
 }
 
 // note: number of samples should not vary much
 // with filtered peak detection, variable buffer size from volume_process call is not optimal
-static void update_energy(int16_t *signal, int numsamples, Volume *v) {
-	int i;
-	float acc = 0;
+static void update_energy(Volume *v, const MSAudioLevels *levels, int numsamples) {
 	float en;
-	int lp = 0, pk = 0;
-		
-	for (i=0;i<numsamples;++i){
-		int s=signal[i];
-		acc += s * s;
-
-		lp = abs(s);
-		if (lp > pk)
-			pk = lp;
-	}
-	en = (sqrt(acc / numsamples)+1) / max_e;
+
+	if (numsamples==0) return;
+	en = (sqrt((float)levels->sum_squares / numsamples)+1) / max_e;
 	v->energy = (en * coef) + v->energy * (1.0 - coef);
-	v->level_pk = (float)pk / max_e;
+	v->level_pk = (float)levels->peak / max_e;
 	v->instant_energy = en;// currently non-averaged energy seems better (short artefacts)
 }
 
-static void apply_gain(Volume *v, mblk_t *m, float tgain) {
-	int16_t *sample;
-	int dc_offset = 0;
-	int32_t intgain;
-	float gain;
-
+/* ramps the gain toward tgain, and returns the gain to apply to the current block */
+static float update_gain(Volume *v, float tgain) {
 	/* ramps with factors means linear ramps in logarithmic domain */
 	
 	if (v->gain < tgain) {
@@ -404,29 +449,101 @@ static void apply_gain(Volume *v, mblk_t *m, float tgain) {
 			v->gain = tgain;
 		v->fast_upramp=FALSE;
 	}
+	//if (v->peer) ms_message("MSVolume:%p Applying gain %5f, v->gain=%5f, tgain=%5f, ng_gain=%5f",v,gain,v->gain,tgain,v->ng_gain); 
+	return v->gain * v->ng_gain;
+}
 
-	gain=v->gain * v->ng_gain;
-	intgain = gain* 4096;
+static void update_dc_offset(Volume *v, const MSAudioLevels *levels, int numsamples) {
+	/* offset smoothing */
+	if (v->remove_dc && numsamples>0)
+		v->dc_offset = (v->dc_offset*7 + (int)(levels->sum/numsamples)) / 8;
+}
 
+/*
+ * MSSampleFormatFloat32 blocks: the levels are expressed in the 16 bit range so that the energy computations are
+ * the same, and the samples are not clipped, which is done when they are converted back.
+ */
+static void measure_float(const float *samples, int nsamples, MSAudioLevels *levels){
+	int i;
+	float sum=0,sum_squares=0,peak=0;
+	for(i=0;i<nsamples;++i){
+		float s=samples[i];
+		float a=fabsf(s);
+		sum+=s;
+		sum_squares+=s*s;
+		if (a>peak) peak=a;
+	}
+	levels->sum=(int64_t)(sum*MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE);
+	levels->sum_squares=(int64_t)(sum_squares*MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE*MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE);
+	levels->peak=(int)MIN(peak*MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE,32767);
+}
 
-	//if (v->peer) ms_message("MSVolume:%p Applying gain %5f, v->gain=%5f, tgain=%5f, ng_gain=%5f",v,gain,v->gain,tgain,v->ng_gain); 
+static void scale_float(float *samples, int nsamples, int offset, float gain){
+	int i;
+	float foffset=(float)offset*MS_AUDIO_CONVERT_S16_TO_FLOAT_SCALE;
+	for(i=0;i<nsamples;++i){
+		samples[i]=gain*(samples[i]-foffset);
+	}
+}
 
-	if (v->remove_dc){
-		for (	sample=(int16_t*)m->b_rptr;
-					sample<(int16_t*)m->b_wptr;
-					++sample){
-			dc_offset+= *sample;
-			*sample = saturate(((*sample - v->dc_offset) * intgain) / 4096);
-		}
-		/* offset smoothing */
-		v->dc_offset = (v->dc_offset*7 + dc_offset*2/(m->b_wptr - m->b_rptr)) / 8;
-	}else if (gain!=1){
-		for (	sample=(int16_t*)m->b_rptr;
-					sample<(int16_t*)m->b_wptr;
-					++sample){
-			*sample = saturate(((*sample) * intgain) / 4096);
+/*shared blocks, such as the prompts played from the file cache, are read-only: they are scaled in a copy*/
+static mblk_t *make_writable(mblk_t *m) {
+	if (m->b_datap->db_ref>1){
+		mblk_t *copy=copymsg(m);
+		freemsg(m);
+		return copy;
+	}
+	return m;
+}
+
+/*
+ * Measures the block, and applies the gain resulting from tgain and the gain ramp.
+ * When the target gain does not depend on the measure of the block itself, both are done in a single pass.
+ */
+static mblk_t *measure_and_apply_gain(Volume *v, mblk_t *m, float tgain) {
+	int nsamples=block_samples(v, m);
+	MSAudioLevels levels;
+	float gain=update_gain(v, tgain);
+
+	if (v->in_format==MSSampleFormatFloat32){
+		measure_float((float*)m->b_rptr, nsamples, &levels);
+		if (v->remove_dc || gain!=1){
+			m=make_writable(m);
+			scale_float((float*)m->b_rptr, nsamples, v->dc_offset, gain);
 		}
+	}else if (v->remove_dc || gain!=1){
+		m=make_writable(m);
+		v->kernels->measure_and_scale((int16_t*)m->b_rptr, nsamples, v->dc_offset, gain, &levels);
+	}else{
+		v->kernels->measure((int16_t*)m->b_rptr, nsamples, &levels);
+	}
+	update_energy(v, &levels, nsamples);
+	update_dc_offset(v, &levels, nsamples);
+	return m;
+}
+
+static void measure(Volume *v, mblk_t *m, MSAudioLevels *levels) {
+	int nsamples=block_samples(v, m);
+	if (v->in_format==MSSampleFormatFloat32)
+		measure_float((float*)m->b_rptr, nsamples, levels);
+	else
+		v->kernels->measure((int16_t*)m->b_rptr, nsamples, levels);
+	update_energy(v, levels, nsamples);
+}
+
+static mblk_t *apply_gain(Volume *v, mblk_t *m, const MSAudioLevels *levels, float tgain) {
+	int nsamples=block_samples(v, m);
+	float gain=update_gain(v, tgain);
+
+	if (v->remove_dc || gain!=1){
+		m=make_writable(m);
+		if (v->in_format==MSSampleFormatFloat32)
+			scale_float((float*)m->b_rptr, nsamples, v->dc_offset, gain);
+		else
+			v->kernels->measure_and_scale((int16_t*)m->b_rptr, nsamples, v->dc_offset, gain, NULL);
 	}
+	update_dc_offset(v, levels, nsamples);
+	return m;
 }
 
 static void volume_preprocess(MSFilter *f){
@@ -462,13 +579,14 @@ static void volume_process(MSFilter *f){
 	 */
 	if (v->agc_enabled || v->peer!=NULL){
 		mblk_t *om;
-		int nbytes=v->nsamples*2;
+		int nbytes=v->nsamples*ms_sample_format_get_size(v->in_format);
 		ms_bufferizer_put_from_queue(v->buffer,f->inputs[0]);
 		while(ms_bufferizer_get_avail(v->buffer)>=nbytes){
+			MSAudioLevels levels;
 			om=allocb(nbytes,0);
 			ms_bufferizer_read(v->buffer,om->b_wptr,nbytes);
 			om->b_wptr+=nbytes;
-			update_energy((int16_t*)om->b_rptr, v->nsamples, v);
+			measure(v, om, &levels);
 			target_gain = v->static_gain;
 
 			if (v->peer)  /* this ptr set = echo limiter enable flag */
@@ -482,19 +600,28 @@ static void volume_process(MSFilter *f){
 			if (v->agc_enabled) target_gain/= volume_agc_process(v, om);
 			if (v->noise_gate_enabled)
 				volume_noise_gate_process(v, v->instant_energy, om);
-			apply_gain(v, om, target_gain);
-			ms_queue_put(f->outputs[0],om);
+			om=apply_gain(v, om, &levels, target_gain);
+			if (v->dtx_enabled)
+				volume_dtx_process(v, om);
+			ms_queue_put(f->outputs[0],ms_audio_convert_format_msg(om,v->in_format,v->out_format));
 		}
 	}else{
 		/*light processing: no agc. Work in place in the input buffer*/
 		while((m=ms_queue_get(f->inputs[0]))!=NULL){
-			update_energy((int16_t*)m->b_rptr, (m->b_wptr - m->b_rptr) / 2, v);
 			target_gain = v->static_gain;
 
-			if (v->noise_gate_enabled)
+			if (v->noise_gate_enabled){
+				/*the noise gate needs the energy of the block before the gain can be applied*/
+				MSAudioLevels levels;
+				measure(v, m, &levels);
 				volume_noise_gate_process(v, v->instant_energy, m);
-			apply_gain(v, m, target_gain);
-			ms_queue_put(f->outputs[0],m);
+				m=apply_gain(v, m, &levels, target_gain);
+			}else{
+				m=measure_and_apply_gain(v, m, target_gain);
+			}
+			if (v->dtx_enabled)
+				volume_dtx_process(v, m);
+			ms_queue_put(f->outputs[0],ms_audio_convert_format_msg(m,v->in_format,v->out_format));
 		}
 	}
 }
@@ -518,6 +645,11 @@ static MSFilterMethod methods[]={
 	{	MS_VOLUME_GET_GAIN	,	volume_get_gain		},
 	{	MS_VOLUME_GET_GAIN_DB	,	volume_get_gain_db		},
 	{	MS_VOLUME_REMOVE_DC, volume_remove_dc },
+	{	MS_VOLUME_ENABLE_DTX	,	volume_enable_dtx	},
+	{	MS_VOLUME_SET_DTX_THRESHOLD,	volume_set_dtx_threshold	},
+	{	MS_FILTER_SET_SAMPLE_FORMAT,	volume_set_sample_format	},
+	{	MS_FILTER_GET_SAMPLE_FORMAT,	volume_get_sample_format	},
+	{	MS_FILTER_SET_OUTPUT_SAMPLE_FORMAT,	volume_set_output_sample_format	},
 	{	0			,	NULL			}
 };
 
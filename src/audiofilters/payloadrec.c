@@ -0,0 +1,502 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/mspayloadrec.h"
+#include "mediastreamer2/msticker.h"
+#include "waveheader.h"
+#include "g711common.h"
+#include "asyncwriter.h"
+
+#define MAX_GAP 60 /*seconds of missing packets that are stored, a larger timestamp jump starts a new timeline*/
+#define FLUSH_INTERVAL 1000 /*ms, the queued data is handed to the I/O thread at least this often*/
+#define OGG_PAGE_MAX_SIZE 8192
+#define OGG_PAGE_MAX_PACKETS 50 /*a page is written about every second, which bounds the loss on a crash*/
+
+#define OGG_BOS 0x2
+#define OGG_EOS 0x4
+
+typedef enum RecCodec{
+	RecCodecOpus,
+	RecCodecSpeex,
+	RecCodecPcmu,
+	RecCodecPcma
+} RecCodec;
+
+typedef struct OggStream{
+	uint32_t serial;
+	uint32_t seq;
+	int64_t granule;
+	int nsegments;
+	int npackets;
+	int len;
+	uint8_t segments[255];
+	uint8_t data[OGG_PAGE_MAX_SIZE];
+} OggStream;
+
+typedef struct PayloadRecState{
+	int fd;
+	MSAsyncWriter *writer; /*NULL if the data is written by the filter itself*/
+	RecCodec codec;
+	int rate;
+	int nchannels;
+	MSRecorderState state;
+	bool_t synced; /*the next packet continues the timeline of the previous one*/
+	uint32_t last_ts;
+	uint32_t next_ts; /*expected timestamp of the next packet*/
+	int64_t position; /*number of samples stored so far, the granule position of Ogg*/
+	int speex_duration; /*estimated from the timestamps, the frames of a Speex packet cannot be counted without decoding*/
+	bool_t speex_duration_known;
+	uint8_t last_toc;
+	uint64_t last_flush;
+	OggStream ogg;
+} PayloadRecState;
+
+static void put_le32(uint8_t *p, uint32_t val){
+	p[0]=val&0xff;
+	p[1]=(val>>8)&0xff;
+	p[2]=(val>>16)&0xff;
+	p[3]=(val>>24)&0xff;
+}
+
+static void put_le16(uint8_t *p, uint16_t val){
+	p[0]=val&0xff;
+	p[1]=(val>>8)&0xff;
+}
+
+static bool_t codec_uses_ogg(RecCodec codec){
+	return codec==RecCodecOpus || codec==RecCodecSpeex;
+}
+
+static void rec_write(PayloadRecState *s, const uint8_t *data, int len){
+	if (s->writer){
+		int dropped=ms_async_writer_write(s->writer,data,len);
+		if (dropped>0) ms_warning("MSPayloadRec: the disk is too slow, %i bytes dropped.",dropped);
+	}else if (write(s->fd,data,len)!=len){
+		ms_warning("MSPayloadRec: fail to write %i bytes: %s",len,strerror(errno));
+	}
+}
+
+/*the CRC of Ogg pages: polynomial 0x04c11db7, neither reflected nor inverted. Pages are few, a table is not worth it*/
+static uint32_t ogg_crc(uint32_t crc, const uint8_t *data, int len){
+	int i,j;
+	for(i=0;i<len;++i){
+		crc^=(uint32_t)data[i]<<24;
+		for(j=0;j<8;++j)
+			crc=(crc&0x80000000) ? (crc<<1)^0x04c11db7 : crc<<1;
+	}
+	return crc;
+}
+
+static void ogg_write_page(PayloadRecState *s, int flags){
+	OggStream *o=&s->ogg;
+	uint8_t header[27+255];
+	int hlen=27+o->nsegments;
+	uint32_t crc;
+
+	if (o->seq==0) flags|=OGG_BOS;
+	memcpy(header,"OggS",4);
+	header[4]=0;
+	header[5]=flags;
+	put_le32(header+6,(uint32_t)(o->granule&0xffffffff));
+	put_le32(header+10,(uint32_t)(o->granule>>32));
+	put_le32(header+14,o->serial);
+	put_le32(header+18,o->seq);
+	put_le32(header+22,0);
+	header[26]=o->nsegments;
+	memcpy(header+27,o->segments,o->nsegments);
+	crc=ogg_crc(0,header,hlen);
+	crc=ogg_crc(crc,o->data,o->len);
+	put_le32(header+22,crc);
+	rec_write(s,header,hlen);
+	rec_write(s,o->data,o->len);
+	o->seq++;
+	o->nsegments=0;
+	o->npackets=0;
+	o->len=0;
+}
+
+/*packets never span pages, which keeps the pages independent*/
+static void ogg_add_packet(PayloadRecState *s, const uint8_t *data, int len, int64_t granule){
+	OggStream *o=&s->ogg;
+	int nsegments=len/255+1;
+	int i;
+
+	if (len>OGG_PAGE_MAX_SIZE){
+		ms_warning("MSPayloadRec: %i bytes packet too large, dropped.",len);
+		return;
+	}
+	if (o->nsegments+nsegments>255 || o->len+len>OGG_PAGE_MAX_SIZE) ogg_write_page(s,0);
+	for(i=0;i<nsegments-1;++i) o->segments[o->nsegments++]=255;
+	o->segments[o->nsegments++]=len%255;
+	memcpy(o->data+o->len,data,len);
+	o->len+=len;
+	o->npackets++;
+	o->granule=granule;
+	if (o->npackets>=OGG_PAGE_MAX_PACKETS) ogg_write_page(s,0);
+}
+
+static void write_comment_header(PayloadRecState *s, const char *magic){
+	const char *vendor="mediastreamer2";
+	int mlen=strlen(magic);
+	int vlen=strlen(vendor);
+	uint8_t header[64];
+	memcpy(header,magic,mlen);
+	put_le32(header+mlen,vlen);
+	memcpy(header+mlen+4,vendor,vlen);
+	put_le32(header+mlen+4+vlen,0); /*no user comment*/
+	ogg_add_packet(s,header,mlen+8+vlen,0);
+	ogg_write_page(s,0);
+}
+
+/*RFC 7845: the identification header alone on the first page, then the comment header*/
+static void write_opus_headers(PayloadRecState *s){
+	uint8_t header[19];
+	memcpy(header,"OpusHead",8);
+	header[8]=1; /*version*/
+	header[9]=s->nchannels;
+	put_le16(header+10,0); /*pre-skip: the stream was not encoded here, there is no encoder delay to skip*/
+	put_le32(header+12,s->rate);
+	put_le16(header+16,0); /*output gain*/
+	header[18]=0; /*channel mapping family*/
+	ogg_add_packet(s,header,sizeof(header),0);
+	ogg_write_page(s,0);
+	write_comment_header(s,"OpusTags");
+}
+
+static int speex_frame_size(int rate){
+	return rate/50;
+}
+
+static void write_speex_headers(PayloadRecState *s){
+	uint8_t header[80];
+	memset(header,0,sizeof(header));
+	memcpy(header,"Speex   ",8);
+	memcpy(header+8,"1.2",3); /*version string*/
+	put_le32(header+28,1); /*version id*/
+	put_le32(header+32,sizeof(header));
+	put_le32(header+36,s->rate);
+	put_le32(header+40,s->rate>=32000 ? 2 : (s->rate>=16000 ? 1 : 0)); /*mode*/
+	put_le32(header+44,4); /*mode bitstream version*/
+	put_le32(header+48,s->nchannels);
+	put_le32(header+52,(uint32_t)-1); /*bitrate*/
+	put_le32(header+56,speex_frame_size(s->rate));
+	put_le32(header+60,0); /*vbr*/
+	put_le32(header+64,1); /*frames per packet: indicative, RTP packets may carry several frames*/
+	ogg_add_packet(s,header,sizeof(header),0);
+	ogg_write_page(s,0);
+	/*the comment header of Speex has no magic*/
+	write_comment_header(s,"");
+}
+
+/*RFC 6716: the duration of an Opus packet is given by its first bytes*/
+static int opus_packet_duration(const uint8_t *data, int len){
+	static const int silk_frames[4]={480,960,1920,2880};
+	int config,frame,count;
+	if (len<1) return 0;
+	config=data[0]>>3;
+	if (config<12) frame=silk_frames[config&3];
+	else if (config<16) frame=(config&1) ? 960 : 480;
+	else frame=120<<(config&3);
+	switch(data[0]&3){
+		case 0:
+			count=1;
+		break;
+		case 3:
+			if (len<2) return 0;
+			count=data[1]&0x3f;
+		break;
+		default:
+			count=2;
+	}
+	return frame*count;
+}
+
+static int packet_duration(PayloadRecState *s, const uint8_t *data, int len){
+	switch(s->codec){
+		case RecCodecOpus:
+			return opus_packet_duration(data,len);
+		case RecCodecSpeex:
+			return s->speex_duration;
+		default:
+			return len/s->nchannels;
+	}
+}
+
+static void store_payload(PayloadRecState *s, const uint8_t *data, int len, int duration){
+	s->position+=duration;
+	if (codec_uses_ogg(s->codec)) ogg_add_packet(s,data,len,s->position);
+	else rec_write(s,data,len);
+}
+
+/*G.711 gaps are filled with silence, Ogg gaps with empty packets, which decoders treat as lost packets*/
+static void fill_gap(PayloadRecState *s, int gap){
+	if (codec_uses_ogg(s->codec)){
+		uint8_t toc=s->last_toc&0xfc; /*a code 0 packet without frame*/
+		/*an empty Speex packet is concealed as a single frame*/
+		int step=(s->codec==RecCodecOpus) ? opus_packet_duration(&toc,1) : speex_frame_size(s->rate);
+		for(;gap>=step;gap-=step)
+			store_payload(s,&toc,s->codec==RecCodecOpus ? 1 : 0,step);
+	}else{
+		uint8_t silence[160];
+		int bytes=gap*s->nchannels;
+		memset(silence,s->codec==RecCodecPcmu ? s16_to_ulaw(0) : s16_to_alaw(0),sizeof(silence));
+		while(bytes>0){
+			int n=MIN(bytes,(int)sizeof(silence));
+			rec_write(s,silence,n);
+			bytes-=n;
+		}
+		s->position+=gap;
+	}
+}
+
+/*the smallest interval between two packets is their duration, the larger ones include losses*/
+static void update_speex_duration(PayloadRecState *s, int delta){
+	if (delta>speex_frame_size(s->rate)*10) return;
+	if (!s->speex_duration_known || delta<s->speex_duration){
+		s->speex_duration=delta;
+		s->speex_duration_known=TRUE;
+		s->next_ts=s->last_ts+delta;
+	}
+}
+
+static void rec_packet(PayloadRecState *s, mblk_t *m){
+	uint32_t ts=mblk_get_timestamp_info(m);
+	int len;
+	int duration;
+
+	if (m->b_cont) msgpullup(m,-1);
+	len=m->b_wptr-m->b_rptr;
+	if (s->synced){
+		int32_t delta=(int32_t)(ts-s->last_ts);
+		int32_t gap;
+		if (delta<=0) return; /*duplicated or late packet*/
+		if (s->codec==RecCodecSpeex) update_speex_duration(s,delta);
+		gap=(int32_t)(ts-s->next_ts);
+		if (gap>MAX_GAP*s->rate){
+			ms_warning("MSPayloadRec: timestamp jump of %i, starting a new timeline.",gap);
+		}else if (gap>0){
+			fill_gap(s,gap);
+		}
+	}
+	duration=packet_duration(s,m->b_rptr,len);
+	if (duration<=0){
+		ms_warning("MSPayloadRec: invalid packet of %i bytes.",len);
+		return;
+	}
+	store_payload(s,m->b_rptr,len,duration);
+	if (s->codec==RecCodecOpus) s->last_toc=m->b_rptr[0];
+	s->synced=TRUE;
+	s->last_ts=ts;
+	s->next_ts=ts+duration;
+}
+
+static void rec_init(MSFilter *f){
+	PayloadRecState *s=ms_new0(PayloadRecState,1);
+	s->fd=-1;
+	s->codec=RecCodecPcmu;
+	s->rate=8000;
+	s->nchannels=1;
+	s->state=MSRecorderClosed;
+	f->data=s;
+}
+
+static void rec_process(MSFilter *f){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	mblk_t *m;
+	ms_mutex_lock(&f->lock);
+	while((m=ms_queue_get(f->inputs[0]))!=NULL){
+		/*comfort noise is not stored, it is a gap like any other*/
+		if (s->state==MSRecorderRunning && !mblk_get_cn_flag(m)) rec_packet(s,m);
+		freemsg(m);
+	}
+	if (s->writer && s->state==MSRecorderRunning && f->ticker->time-s->last_flush>=FLUSH_INTERVAL){
+		int dropped=ms_async_writer_flush(s->writer);
+		if (dropped>0) ms_warning("MSPayloadRec: the disk is too slow, %i bytes dropped.",dropped);
+		s->last_flush=f->ticker->time;
+	}
+	ms_mutex_unlock(&f->lock);
+}
+
+static int rec_close(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	MSAsyncWriter *writer=NULL;
+	ms_mutex_lock(&f->lock);
+	if (s->fd!=-1){
+		if (codec_uses_ogg(s->codec)) ogg_write_page(s,OGG_EOS);
+		if (s->writer){
+			writer=s->writer;
+			s->writer=NULL;
+		}else close(s->fd);
+		s->fd=-1;
+	}
+	s->state=MSRecorderClosed;
+	ms_mutex_unlock(&f->lock);
+	/*waits for the I/O thread without blocking the ticker*/
+	if (writer) ms_async_writer_close(writer);
+	return 0;
+}
+
+static int rec_open(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	const char *filename=(const char*)arg;
+	MSTimeSpec now;
+	int fd;
+
+	if (s->fd!=-1) rec_close(f,NULL);
+	fd=open(filename,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,S_IRUSR|S_IWUSR);
+	if (fd==-1){
+		ms_warning("Cannot open %s: %s",filename,strerror(errno));
+		return -1;
+	}
+	ms_mutex_lock(&f->lock);
+	s->fd=fd;
+	s->writer=ms_async_writer_new(fd);
+	s->synced=FALSE;
+	s->position=0;
+	s->speex_duration=speex_frame_size(s->rate);
+	s->speex_duration_known=FALSE;
+	s->last_flush=f->ticker ? f->ticker->time : 0;
+	memset(&s->ogg,0,sizeof(s->ogg));
+	ms_get_cur_time(&now);
+	s->ogg.serial=(uint32_t)(now.tv_sec^now.tv_nsec);
+	if (s->codec==RecCodecOpus) write_opus_headers(s);
+	else if (s->codec==RecCodecSpeex) write_speex_headers(s);
+	s->state=MSRecorderPaused;
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int rec_start(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	if (s->state!=MSRecorderPaused){
+		ms_error("MSPayloadRec: cannot start, state=%i",s->state);
+		return -1;
+	}
+	ms_mutex_lock(&f->lock);
+	s->state=MSRecorderRunning;
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int rec_pause(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	if (s->state==MSRecorderRunning){
+		s->state=MSRecorderPaused;
+		/*the paused period is not part of the recording*/
+		s->synced=FALSE;
+	}
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int rec_get_state(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	*(MSRecorderState*)arg=s->state;
+	return 0;
+}
+
+static int rec_set_codec(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	const char *codec=(const char*)arg;
+	if (s->state!=MSRecorderClosed){
+		ms_error("MSPayloadRec: the codec cannot be changed once the file is opened.");
+		return -1;
+	}
+	if (strcasecmp(codec,"opus")==0) s->codec=RecCodecOpus;
+	else if (strcasecmp(codec,"speex")==0) s->codec=RecCodecSpeex;
+	else if (strcasecmp(codec,"pcmu")==0) s->codec=RecCodecPcmu;
+	else if (strcasecmp(codec,"pcma")==0) s->codec=RecCodecPcma;
+	else{
+		ms_error("MSPayloadRec: unsupported codec %s",codec);
+		return -1;
+	}
+	return 0;
+}
+
+static int rec_set_sr(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	s->rate=*(int*)arg;
+	return 0;
+}
+
+static int rec_set_nchannels(MSFilter *f, void *arg){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	s->nchannels=*(int*)arg;
+	return 0;
+}
+
+static void rec_uninit(MSFilter *f){
+	PayloadRecState *s=(PayloadRecState*)f->data;
+	if (s->fd!=-1) rec_close(f,NULL);
+	ms_free(s);
+}
+
+static MSFilterMethod rec_methods[]={
+	{	MS_PAYLOAD_REC_SET_CODEC	,	rec_set_codec		},
+	{	MS_FILTER_SET_SAMPLE_RATE	,	rec_set_sr		},
+	{	MS_FILTER_SET_NCHANNELS		,	rec_set_nchannels	},
+	{	MS_RECORDER_OPEN		,	rec_open		},
+	{	MS_RECORDER_START		,	rec_start		},
+	{	MS_RECORDER_PAUSE		,	rec_pause		},
+	{	MS_RECORDER_CLOSE		,	rec_close		},
+	{	MS_RECORDER_GET_STATE		,	rec_get_state		},
+	{	0				,	NULL			}
+};
+
+#ifdef _MSC_VER
+
+MSFilterDesc ms_payload_rec_desc={
+	MS_PAYLOAD_REC_ID,
+	"MSPayloadRec",
+	N_("Records received RTP payloads without decoding them"),
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	0,
+	rec_init,
+	NULL,
+	rec_process,
+	NULL,
+	rec_uninit,
+	rec_methods
+};
+
+#else
+
+MSFilterDesc ms_payload_rec_desc={
+	.id=MS_PAYLOAD_REC_ID,
+	.name="MSPayloadRec",
+	.text=N_("Records received RTP payloads without decoding them"),
+	.category=MS_FILTER_OTHER,
+	.ninputs=1,
+	.noutputs=0,
+	.init=rec_init,
+	.process=rec_process,
+	.uninit=rec_uninit,
+	.methods=rec_methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_payload_rec_desc)
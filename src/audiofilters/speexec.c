@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <speex/speex_echo.h>
 #include <speex/speex_preprocess.h>
 #include "ortp/b64.h"
+#include "frameworker.h"
 
 #ifdef HAVE_CONFIG_H
 #include "mediastreamer-config.h"
@@ -147,6 +148,7 @@ typedef struct SpeexECState{
 	AudioFlowController afc;
 	uint64_t flow_control_time;
 	char *state_str;
+	MSFrameRunner runner; /*runs the canceller inline, or in its own thread in async mode*/
 #ifdef EC_DUMP
 	FILE *echofile;
 	FILE *reffile;
@@ -155,8 +157,11 @@ typedef struct SpeexECState{
 	bool_t echostarted;
 	bool_t bypass_mode;
 	bool_t using_zeroes;
+	bool_t async;
 }SpeexECState;
 
+static mblk_t *speex_ec_run(void *data, mblk_t *job);
+
 static void speex_ec_init(MSFilter *f){
 	SpeexECState *s=(SpeexECState *)ms_new(SpeexECState,1);
 
@@ -173,6 +178,8 @@ static void speex_ec_init(MSFilter *f){
 	s->using_zeroes=FALSE;
 	s->echostarted=FALSE;
 	s->bypass_mode=FALSE;
+	s->async=FALSE;
+	ms_frame_runner_init(&s->runner,speex_ec_run,s);
 
 #ifdef EC_DUMP
 	{
@@ -254,6 +261,31 @@ static void fetch_config(SpeexECState *s){
 
 #endif
 
+/*a job is a frame of echo followed by the matching frame of delayed reference signal*/
+static mblk_t *speex_ec_run(void *data, mblk_t *job){
+	SpeexECState *s=(SpeexECState*)data;
+	int nbytes=s->framesize*2;
+	mblk_t *oecho=allocb(nbytes,0);
+	uint8_t *echo=job->b_rptr;
+	uint8_t *ref=job->b_cont->b_rptr;
+
+#ifdef EC_DUMP
+	if (s->reffile)
+		fwrite(ref,nbytes,1,s->reffile);
+	if (s->echofile)
+		fwrite(echo,nbytes,1,s->echofile);
+#endif
+	speex_echo_cancellation(s->ecstate,(short*)echo,(short*)ref,(short*)oecho->b_wptr);
+	speex_preprocess_run(s->den, (short*)oecho->b_wptr);
+#ifdef EC_DUMP
+	if (s->cleanfile)
+		fwrite(oecho->b_wptr,nbytes,1,s->cleanfile);
+#endif
+	oecho->b_wptr+=nbytes;
+	freemsg(job);
+	return oecho;
+}
+
 static void speex_ec_preprocess(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 	int delay_samples=0;
@@ -277,6 +309,14 @@ static void speex_ec_preprocess(MSFilter *f){
 	s->nominal_ref_samples=delay_samples;
 	audio_flow_controller_init(&s->afc);
 	s->flow_control_time = f->ticker->time;
+	if (s->async){
+		int tick_samples=(f->ticker->interval*s->samplerate)/1000;
+		int depth=(tick_samples+s->framesize-1)/s->framesize;
+		ms_message("Speex echo canceler running in its own thread, %i frames of additional latency",depth);
+		ms_filter_lock(f);
+		ms_frame_runner_start_async(&s->runner,depth);
+		ms_filter_unlock(f);
+	}
 #ifdef SPEEX_ECHO_GET_BLOB
 	apply_config(s);
 #else
@@ -293,9 +333,9 @@ static void speex_ec_process(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 	int nbytes=s->framesize*2;
 	mblk_t *refm;
-	uint8_t *ref,*echo;
 	
 	if (s->bypass_mode) {
+		ms_frame_runner_collect(&s->runner,f->outputs[1],TRUE);
 		while((refm=ms_queue_get(f->inputs[0]))!=NULL){
 			ms_queue_put(f->outputs[0],refm);
 		}
@@ -320,13 +360,15 @@ static void speex_ec_process(MSFilter *f){
 
 	ms_bufferizer_put_from_queue(&s->echo,f->inputs[1]);
 	
-	ref=(uint8_t*)alloca(nbytes);
-	echo=(uint8_t*)alloca(nbytes);
-	while (ms_bufferizer_read(&s->echo,echo,nbytes)>=nbytes){
-		mblk_t *oecho=allocb(nbytes,0);
+	while (ms_bufferizer_get_avail(&s->echo)>=nbytes){
+		mblk_t *echom=allocb(nbytes,0);
+		mblk_t *delayedm=allocb(nbytes,0);
 		int avail;
 		int avail_samples;
 
+		ms_bufferizer_read(&s->echo,echom->b_wptr,nbytes);
+		echom->b_wptr+=nbytes;
+
 		if (!s->echostarted) s->echostarted=TRUE;
 		if ((avail=ms_bufferizer_get_avail(&s->delayed_ref))<((s->nominal_ref_samples*2)+nbytes)){
 			/*we don't have enough to read in a reference signal buffer, inject silence instead*/
@@ -354,30 +396,20 @@ static void speex_ec_process(MSFilter *f){
 		}
 
 		/*now read a valid buffer of delayed ref samples*/
-		if (ms_bufferizer_read(&s->delayed_ref,ref,nbytes)==0){
+		if (ms_bufferizer_read(&s->delayed_ref,delayedm->b_wptr,nbytes)==0){
 			ms_fatal("Should never happen");
 		}
+		delayedm->b_wptr+=nbytes;
+		echom->b_cont=delayedm;
 		avail-=nbytes;
 		avail_samples=avail/2;
 		if (avail_samples<s->min_ref_samples || s->min_ref_samples==-1){
 			s->min_ref_samples=avail_samples;
 		}
-		
-#ifdef EC_DUMP
-		if (s->reffile)
-			fwrite(ref,nbytes,1,s->reffile);
-		if (s->echofile)
-			fwrite(echo,nbytes,1,s->echofile);
-#endif
-		speex_echo_cancellation(s->ecstate,(short*)echo,(short*)ref,(short*)oecho->b_wptr);
-		speex_preprocess_run(s->den, (short*)oecho->b_wptr);
-#ifdef EC_DUMP
-		if (s->cleanfile)
-			fwrite(oecho->b_wptr,nbytes,1,s->cleanfile);
-#endif
-		oecho->b_wptr+=nbytes;
-		ms_queue_put(f->outputs[1],oecho);
+		ms_frame_runner_submit(&s->runner,echom,f->outputs[1]);
 	}
+	/*the last frames submitted are left to the worker until the next tick*/
+	ms_frame_runner_collect(&s->runner,f->outputs[1],FALSE);
 
 	/*verify our ref buffer does not become too big, meaning that we are receiving more samples than we are sending*/
 	if ((((uint32_t)(f->ticker->time - s->flow_control_time)) >= flow_control_interval_ms) && (s->min_ref_samples != -1)) {
@@ -395,6 +427,9 @@ static void speex_ec_process(MSFilter *f){
 static void speex_ec_postprocess(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 
+	ms_filter_lock(f);
+	ms_frame_runner_stop(&s->runner);
+	ms_filter_unlock(f);
 	ms_bufferizer_flush (&s->delayed_ref);
 	ms_bufferizer_flush (&s->echo);
 	ms_bufferizer_flush (&s->ref);
@@ -443,6 +478,20 @@ static int speex_ec_get_bypass_mode(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int speex_ec_set_async(MSFilter *f, void *arg){
+	SpeexECState *s=(SpeexECState*)f->data;
+	s->async=*(bool_t*)arg;
+	return 0;
+}
+
+static int speex_ec_get_async_load(MSFilter *f, void *arg){
+	SpeexECState *s=(SpeexECState*)f->data;
+	ms_filter_lock(f);
+	*(float*)arg=ms_frame_runner_get_load(&s->runner);
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static int speex_ec_set_state(MSFilter *f, void *arg){
 	SpeexECState *s=(SpeexECState*)f->data;
 	s->state_str=ms_strdup((const char*)arg);
@@ -466,7 +515,10 @@ static MSFilterMethod speex_ec_methods[]={
 	{	MS_ECHO_CANCELLER_SET_BYPASS_MODE	,	speex_ec_set_bypass_mode	},
 	{	MS_ECHO_CANCELLER_GET_BYPASS_MODE	,	speex_ec_get_bypass_mode	},
 	{	MS_ECHO_CANCELLER_GET_STATE_STRING	,	speex_ec_get_state		},
-	{	MS_ECHO_CANCELLER_SET_STATE_STRING	,	speex_ec_set_state		}
+	{	MS_ECHO_CANCELLER_SET_STATE_STRING	,	speex_ec_set_state		},
+	{	MS_ECHO_CANCELLER_SET_ASYNC		,	speex_ec_set_async		},
+	{	MS_ECHO_CANCELLER_GET_ASYNC_LOAD	,	speex_ec_get_async_load		},
+	{	0					,	NULL				}
 };
 
 #ifdef _MSC_VER
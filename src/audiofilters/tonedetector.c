@@ -31,43 +31,145 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define M_PI       3.14159265358979323846
 #endif
 
-#define MAX_SCANS 10
+#define MAX_SCANS 16
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GOERTZEL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GOERTZEL_NEON
+#endif
 
 static const float energy_min_threshold=0.01;
 
 typedef struct _GoertzelState{
 	uint64_t starttime;
 	int dur;
-	float coef;
 	bool_t event_sent;
 	bool_t pad[3];
 }GoertzelState;
 
-static void goertzel_state_init(GoertzelState *gs, int frequency, int sampling_frequency){
-	gs->coef=(float)2*(float)cos(2*M_PI*((float)frequency/(float)sampling_frequency));
-	gs->starttime=0;
-	gs->dur=0;
+/*
+ * The Goertzel filters of all the scanned tones, run together over each frame: the recursions of 4 tones are
+ * computed in a single vector operation. Unused slots have a null coefficient and are simply ignored.
+ */
+typedef struct _GoertzelBank{
+	float coef[MAX_SCANS];
+	float q1[MAX_SCANS];
+	float q2[MAX_SCANS];
+	float energy; /*total energy of the current frame*/
+	int nsamples; /*number of samples of the current frame run so far*/
+}GoertzelBank;
+
+static void goertzel_bank_set_frequency(GoertzelBank *bank, int i, int frequency, int sampling_frequency){
+	bank->coef[i]=(frequency==0) ? 0 : (float)2*(float)cos(2*M_PI*((float)frequency/(float)sampling_frequency));
+}
+
+static void goertzel_bank_reset(GoertzelBank *bank){
+	memset(bank->q1,0,sizeof(bank->q1));
+	memset(bank->q2,0,sizeof(bank->q2));
+	bank->energy=0;
+	bank->nsamples=0;
+}
+
+#if defined(GOERTZEL_SSE2)
+
+/*tones [g,g+4) and [g+4,g+8) together so that the two dependency chains are interleaved*/
+static void goertzel_bank_run8(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	__m128 c0=_mm_loadu_ps(bank->coef+g), c1=_mm_loadu_ps(bank->coef+g+4);
+	__m128 a1=_mm_loadu_ps(bank->q1+g), b1=_mm_loadu_ps(bank->q1+g+4);
+	__m128 a2=_mm_loadu_ps(bank->q2+g), b2=_mm_loadu_ps(bank->q2+g+4);
+	int i;
+	for(i=0;i<nsamples;++i){
+		__m128 x=_mm_set1_ps((float)samples[i]);
+		__m128 a0=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(c0,a1),a2),x);
+		__m128 b0=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(c1,b1),b2),x);
+		a2=a1; a1=a0;
+		b2=b1; b1=b0;
+	}
+	_mm_storeu_ps(bank->q1+g,a1); _mm_storeu_ps(bank->q1+g+4,b1);
+	_mm_storeu_ps(bank->q2+g,a2); _mm_storeu_ps(bank->q2+g+4,b2);
+}
+
+static void goertzel_bank_run4(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	__m128 c=_mm_loadu_ps(bank->coef+g), q1=_mm_loadu_ps(bank->q1+g), q2=_mm_loadu_ps(bank->q2+g);
+	int i;
+	for(i=0;i<nsamples;++i){
+		__m128 q0=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(c,q1),q2),_mm_set1_ps((float)samples[i]));
+		q2=q1; q1=q0;
+	}
+	_mm_storeu_ps(bank->q1+g,q1);
+	_mm_storeu_ps(bank->q2+g,q2);
+}
+
+#elif defined(GOERTZEL_NEON)
+
+static void goertzel_bank_run8(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	float32x4_t c0=vld1q_f32(bank->coef+g), c1=vld1q_f32(bank->coef+g+4);
+	float32x4_t a1=vld1q_f32(bank->q1+g), b1=vld1q_f32(bank->q1+g+4);
+	float32x4_t a2=vld1q_f32(bank->q2+g), b2=vld1q_f32(bank->q2+g+4);
+	int i;
+	for(i=0;i<nsamples;++i){
+		float32x4_t x=vdupq_n_f32((float)samples[i]);
+		float32x4_t a0=vaddq_f32(vsubq_f32(vmulq_f32(c0,a1),a2),x);
+		float32x4_t b0=vaddq_f32(vsubq_f32(vmulq_f32(c1,b1),b2),x);
+		a2=a1; a1=a0;
+		b2=b1; b1=b0;
+	}
+	vst1q_f32(bank->q1+g,a1); vst1q_f32(bank->q1+g+4,b1);
+	vst1q_f32(bank->q2+g,a2); vst1q_f32(bank->q2+g+4,b2);
 }
 
-static float goertzel_state_run(GoertzelState *gs,int16_t  *samples, int nsamples, float total_energy){
+static void goertzel_bank_run4(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	float32x4_t c=vld1q_f32(bank->coef+g), q1=vld1q_f32(bank->q1+g), q2=vld1q_f32(bank->q2+g);
 	int i;
-	float tmp;
-	float q1=0;
-	float q2=0;
-	float freq_en;
+	for(i=0;i<nsamples;++i){
+		float32x4_t q0=vaddq_f32(vsubq_f32(vmulq_f32(c,q1),q2),vdupq_n_f32((float)samples[i]));
+		q2=q1; q1=q0;
+	}
+	vst1q_f32(bank->q1+g,q1);
+	vst1q_f32(bank->q2+g,q2);
+}
+
+#else
 
+static void goertzel_bank_run4(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	float *coef=bank->coef+g, *q1=bank->q1+g, *q2=bank->q2+g;
+	int i,k;
 	for(i=0;i<nsamples;++i){
-		tmp=q1;
-		q1=(gs->coef*q1) - q2 + (float)samples[i];
-		q2=tmp;
+		float x=(float)samples[i];
+		for(k=0;k<4;++k){
+			float tmp=q1[k];
+			q1[k]=(coef[k]*q1[k]) - q2[k] + x;
+			q2[k]=tmp;
+		}
+	}
+}
+
+static void goertzel_bank_run8(GoertzelBank *bank, int g, const int16_t *samples, int nsamples){
+	goertzel_bank_run4(bank,g,samples,nsamples);
+	goertzel_bank_run4(bank,g+4,samples,nsamples);
+}
+
+#endif
+
+static void goertzel_bank_run(GoertzelBank *bank, int ntones, const int16_t *samples, int nsamples){
+	int g;
+	for(g=0;g<ntones;g+=8){
+		if (g+4<ntones) goertzel_bank_run8(bank,g,samples,nsamples);
+		else goertzel_bank_run4(bank,g,samples,nsamples);
 	}
-	
-	freq_en= (q1*q1) + (q2*q2) - (q1*q2*gs->coef);
-	/*return a relative frequency energy compared over the total signal energy */
-	return freq_en/(total_energy*(float)nsamples*0.5);
 }
 
-static float compute_energy(int16_t *samples, int nsamples){
+/*returns a relative frequency energy compared over the total signal energy*/
+static float goertzel_bank_get_energy(GoertzelBank *bank, int i){
+	float q1=bank->q1[i], q2=bank->q2[i];
+	float freq_en=(q1*q1) + (q2*q2) - (q1*q2*bank->coef[i]);
+	return freq_en/(bank->energy*(float)bank->nsamples*0.5);
+}
+
+static float compute_energy(const int16_t *samples, int nsamples){
 	float en=0;
 	int i;
 	for(i=0;i<nsamples;++i){
@@ -80,25 +182,32 @@ static float compute_energy(int16_t *samples, int nsamples){
 typedef struct _DetectorState{
 	MSToneDetectorDef tone_def[MAX_SCANS];
 	GoertzelState tone_gs[MAX_SCANS];
+	GoertzelBank bank;
 	int nscans;
-	MSBufferizer *buf;
 	int rate;
-	int framesize;
+	int framesize; /*in samples*/
 	int frame_ms;
+	uint8_t odd_byte; /*first half of a sample split across two blocks*/
+	bool_t has_odd_byte;
 }DetectorState;
 
+static void detector_update_rate(DetectorState *s){
+	int i;
+	s->framesize=(s->frame_ms*s->rate)/1000;
+	for(i=0;i<MAX_SCANS;++i)
+		goertzel_bank_set_frequency(&s->bank,i,s->tone_def[i].frequency,s->rate);
+	goertzel_bank_reset(&s->bank);
+}
+
 static void detector_init(MSFilter *f){
 	DetectorState *s=ms_new0(DetectorState,1);
-	s->buf=ms_bufferizer_new();
 	s->rate=8000;
 	s->frame_ms=20;
-	s->framesize=2*(s->frame_ms*s->rate)/1000;
+	detector_update_rate(s);
 	f->data=s;
 }
 
 static void detector_uninit(MSFilter *f){
-	DetectorState *s=(DetectorState *)f->data;
-	ms_bufferizer_destroy (s->buf);
 	ms_free(f->data);
 }
 
@@ -117,23 +226,27 @@ static int detector_add_scan(MSFilter *f, void *arg){
 	int i=find_free_slot(s);
 	if (i!=-1){
 		s->tone_def[i]=*def;
+		memset(&s->tone_gs[i],0,sizeof(s->tone_gs[i]));
 		s->nscans++;
-		goertzel_state_init(&s->tone_gs[i],def->frequency,s->rate);
-		return 0;
+		goertzel_bank_set_frequency(&s->bank,i,def->frequency,s->rate);
+		/*restart the current frame, so that the new tone is scanned over a complete one*/
+		goertzel_bank_reset(&s->bank);
 	}
-	return -1;
+	return (i!=-1) ? 0 : -1;
 }
 
 static int detector_clear_scans(MSFilter *f, void *arg){
 	DetectorState *s=(DetectorState *)f->data;
 	memset(&s->tone_def,0,sizeof(s->tone_def));
 	s->nscans=0;
+	detector_update_rate(s);
 	return 0;
 }
 
 static int detector_set_rate(MSFilter *f, void *arg){
 	DetectorState *s=(DetectorState *)f->data;
 	s->rate = *((int*) arg);
+	detector_update_rate(s);
 	return 0;
 }
 
@@ -146,46 +259,90 @@ static void end_all_tones(DetectorState *s){
 	}
 }
 
+static void detector_end_frame(MSFilter *f, DetectorState *s){
+	if (s->bank.energy>energy_min_threshold*(32767.0*32767.0*0.7)){
+		int i;
+		for(i=0;i<s->nscans;++i){
+			GoertzelState *gs=&s->tone_gs[i];
+			MSToneDetectorDef *tone_def=&s->tone_def[i];
+			float freq_en=goertzel_bank_get_energy(&s->bank,i);
+			if (freq_en>=tone_def->min_amplitude){
+				if (gs->dur==0) gs->starttime=f->ticker->time;
+				gs->dur+=s->frame_ms;
+				if (gs->dur>=tone_def->min_duration && !gs->event_sent){
+					MSToneDetectorEvent event;
+
+					strncpy(event.tone_name,tone_def->tone_name,sizeof(event.tone_name));
+					event.tone_start_time=gs->starttime;
+					ms_filter_notify(f,MS_TONE_DETECTOR_EVENT,&event);
+					gs->event_sent=TRUE;
+				}
+			}else{
+				gs->event_sent=FALSE;
+				gs->dur=0;
+				gs->starttime=0;
+			}
+		}
+	}else end_all_tones(s);
+	goertzel_bank_reset(&s->bank);
+}
+
+/*runs the bank over samples, evaluating the tones each time a frame is complete*/
+static void detector_feed(MSFilter *f, DetectorState *s, const int16_t *samples, int nsamples){
+	while(nsamples>0){
+		int chunk=MIN(nsamples,s->framesize-s->bank.nsamples);
+		goertzel_bank_run(&s->bank,s->nscans,samples,chunk);
+		s->bank.energy+=compute_energy(samples,chunk);
+		s->bank.nsamples+=chunk;
+		samples+=chunk;
+		nsamples-=chunk;
+		if (s->bank.nsamples==s->framesize) detector_end_frame(f,s);
+	}
+}
+
+/*the samples are read in place from the blocks, which are then forwarded untouched*/
+static void detector_scan(MSFilter *f, DetectorState *s, mblk_t *im){
+	mblk_t *m;
+	for(m=im;m!=NULL;m=m->b_cont){
+		const uint8_t *p=m->b_rptr;
+		int len=(int)(m->b_wptr-m->b_rptr);
+		if (len==0) continue;
+		if (s->has_odd_byte){
+			int16_t sample;
+			((uint8_t*)&sample)[0]=s->odd_byte;
+			((uint8_t*)&sample)[1]=*p++;
+			len--;
+			detector_feed(f,s,&sample,1);
+			s->has_odd_byte=FALSE;
+		}
+		if (((intptr_t)p)&1){
+			/*misaligned block, should not happen with audio*/
+			while(len>=2){
+				int16_t sample;
+				memcpy(&sample,p,2);
+				detector_feed(f,s,&sample,1);
+				p+=2;
+				len-=2;
+			}
+		}else{
+			detector_feed(f,s,(const int16_t*)p,len/2);
+			p+=len&~1;
+			len&=1;
+		}
+		if (len){
+			s->odd_byte=*p;
+			s->has_odd_byte=TRUE;
+		}
+	}
+}
+
 static void detector_process(MSFilter *f){
 	DetectorState *s=(DetectorState *)f->data;
 	mblk_t *m;
-	
+
 	while ((m=ms_queue_get(f->inputs[0]))!=NULL){
+		if (s->nscans>0) detector_scan(f,s,m);
 		ms_queue_put(f->outputs[0],m);
-		if (s->nscans>0){
-			ms_bufferizer_put(s->buf,dupmsg(m));
-		}
-	}
-	if (s->nscans>0){
-		uint8_t *buf=alloca(s->framesize);
-
-		while(ms_bufferizer_read(s->buf,buf,s->framesize)!=0){
-			float en=compute_energy((int16_t*)buf,s->framesize/2);
-			if (en>energy_min_threshold*(32767.0*32767.0*0.7)){
-				int i;
-				for(i=0;i<s->nscans;++i){
-					GoertzelState *gs=&s->tone_gs[i];
-					MSToneDetectorDef *tone_def=&s->tone_def[i];
-					float freq_en=goertzel_state_run(gs,(int16_t*)buf,s->framesize/2,en);
-					if (freq_en>=tone_def->min_amplitude){
-						if (gs->dur==0) gs->starttime=f->ticker->time;
-						gs->dur+=s->frame_ms;
-						if (gs->dur>=tone_def->min_duration && !gs->event_sent){
-							MSToneDetectorEvent event;
-						
-							strncpy(event.tone_name,tone_def->tone_name,sizeof(event.tone_name));
-							event.tone_start_time=gs->starttime;
-							ms_filter_notify(f,MS_TONE_DETECTOR_EVENT,&event);
-							gs->event_sent=TRUE;
-						}
-					}else{
-						gs->event_sent=FALSE;
-						gs->dur=0;
-						gs->starttime=0;
-					}
-				}
-			}else end_all_tones(s);
-		}
 	}
 }
 
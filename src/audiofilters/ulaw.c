@@ -19,12 +19,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/mscodecutils.h"
 #include "g711common.h"
 
 typedef struct _UlawEncData{
 	MSBufferizer *bz;
 	int ptime;
 	uint32_t ts;
+	MSEncodedFrameCache *cache; /*not owned*/
+	G711Dtx dtx;
+	bool_t cn; /*comfort noise can be sent, otherwise silence is encoded like speech*/
 } UlawEncData;
 
 static UlawEncData * ulaw_enc_data_new(){
@@ -32,6 +36,9 @@ static UlawEncData * ulaw_enc_data_new(){
 	obj->bz=ms_bufferizer_new();
 	obj->ptime=0;
 	obj->ts=0;
+	obj->cache=NULL;
+	g711_dtx_reset(&obj->dtx);
+	obj->cn=FALSE;
 	return obj;
 }
 
@@ -41,6 +48,7 @@ static void ulaw_enc_data_destroy(UlawEncData *obj){
 }
 
 static void ulaw_enc_init(MSFilter *obj){
+	g711_init_tables();
 	obj->data=ulaw_enc_data_new();
 }
 
@@ -51,7 +59,6 @@ static void ulaw_enc_uninit(MSFilter *obj){
 static void ulaw_enc_process(MSFilter *obj){
 	UlawEncData *dt=(UlawEncData*)obj->data;
 	MSBufferizer *bz=dt->bz;
-	uint8_t buffer[2240];
 	int frame_per_packet=2;
 	int size_of_pcm=320;
 
@@ -73,12 +80,32 @@ static void ulaw_enc_process(MSFilter *obj){
 		ms_bufferizer_put(bz,m);
 	}
 
-	while (ms_bufferizer_read(bz,buffer,size_of_pcm)==size_of_pcm){
-		mblk_t *o=allocb(size_of_pcm/2,0);
-		int i;
-		for (i=0;i<size_of_pcm/2;i++){
-			*o->b_wptr=s16_to_ulaw(((int16_t*)buffer)[i]);
-			o->b_wptr++;
+	while (ms_bufferizer_get_avail(bz)>=size_of_pcm){
+		mblk_t *o=NULL;
+		MSEncodedFrameKey key;
+		bool_t cacheable;
+
+		if (dt->cn && ms_bufferizer_is_silent(bz,size_of_pcm)){
+			o=g711_dtx_process(&dt->dtx,bz,size_of_pcm/2);
+			if (o){
+				mblk_set_timestamp_info(o,dt->ts);
+				ms_queue_put(obj->outputs[0],o);
+			}
+			dt->ts+=size_of_pcm/2;
+			continue;
+		}
+		g711_dtx_reset(&dt->dtx);
+		cacheable=dt->cache!=NULL && ms_encoded_frame_key_init(&key,bz,size_of_pcm);
+
+		if (cacheable && (o=ms_encoded_frame_cache_lookup(dt->cache,obj->desc->id,&key))!=NULL){
+			/*this frame was already encoded by another encoder*/
+			ms_encoded_frame_key_release(&key);
+			ms_bufferizer_skip_bytes(bz,size_of_pcm);
+		}else{
+			o=allocb(size_of_pcm/2,0);
+			g711_encode_from_bufferizer(bz,o->b_wptr,size_of_pcm/2,s16_to_ulaw_buf);
+			o->b_wptr+=size_of_pcm/2;
+			if (cacheable) ms_encoded_frame_cache_store(dt->cache,obj->desc->id,&key,o);
 		}
 		mblk_set_timestamp_info(o,dt->ts);
 		dt->ts+=size_of_pcm/2;
@@ -133,9 +160,23 @@ static int enc_add_attr(MSFilter *f, void *arg){
 	return 0;
 }
 
+static int enc_set_frame_cache(MSFilter *f, void *arg){
+	UlawEncData *s=(UlawEncData*)f->data;
+	s->cache=(MSEncodedFrameCache*)arg;
+	return 0;
+}
+
+static int enc_enable_cn(MSFilter *f, void *arg){
+	UlawEncData *s=(UlawEncData*)f->data;
+	s->cn=*(bool_t*)arg;
+	return 0;
+}
+
 static MSFilterMethod enc_methods[]={
 	{	MS_FILTER_ADD_ATTR		,	enc_add_attr},
 	{	MS_FILTER_ADD_FMTP		,	enc_add_fmtp},
+	{	MS_AUDIO_ENCODER_SET_FRAME_CACHE,	enc_set_frame_cache},
+	{	MS_AUDIO_ENCODER_ENABLE_CN,	enc_enable_cn},
 	{	0				,	NULL		}
 };
 
@@ -175,16 +216,26 @@ MSFilterDesc ms_ulaw_enc_desc={
 
 #endif
 
+static void ulaw_dec_init(MSFilter *obj){
+	g711_init_tables();
+}
+
 static void ulaw_dec_process(MSFilter *obj){
 	mblk_t *m;
 	while((m=ms_queue_get(obj->inputs[0]))!=NULL){
 		mblk_t *o;
+		int nsamples;
+		if (mblk_get_cn_flag(m)){
+			ms_queue_put(obj->outputs[0],g711_decode_cn(m));
+			freemsg(m);
+			continue;
+		}
 		msgpullup(m,-1);
-		o=allocb((m->b_wptr-m->b_rptr)*2,0);
+		nsamples=(int)(m->b_wptr-m->b_rptr);
+		o=allocb(nsamples*2,0);
 		mblk_meta_copy(m, o);
-		for(;m->b_rptr<m->b_wptr;m->b_rptr++,o->b_wptr+=2){
-			*((int16_t*)(o->b_wptr))=ulaw_to_s16(*m->b_rptr);
-		}
+		ulaw_to_s16_buf(m->b_rptr,(int16_t*)o->b_wptr,nsamples);
+		o->b_wptr+=nsamples*2;
 		freemsg(m);
 		ms_queue_put(obj->outputs[0],o);
 	}
@@ -200,7 +251,7 @@ MSFilterDesc ms_ulaw_dec_desc={
 	"pcmu",
 	1,
 	1,
-	NULL,
+	ulaw_dec_init,
     NULL,
     ulaw_dec_process,
     NULL,
@@ -218,6 +269,7 @@ MSFilterDesc ms_ulaw_dec_desc={
 	.enc_fmt="pcmu",
 	.ninputs=1,
 	.noutputs=1,
+	.init=ulaw_dec_init,
 	.process=ulaw_dec_process,
 };
 
@@ -34,6 +34,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msfilter.h"
 
 #include "basedescs.h"
+#include <math.h>
 
 #if !defined(_WIN32_WCE)
 #include <sys/types.h>
@@ -673,3 +674,141 @@ unsigned int ms_concealer_ts_context_is_concealement_required(MSConcealerTsConte
 }
 
 /*** plc context end***/
+
+/*** encoded frame cache begin***/
+
+#define MS_ENCODED_FRAME_CACHE_SIZE 4
+
+typedef struct _MSEncodedFrameCacheEntry{
+	unsigned int encoder_id;
+	MSEncodedFrameKey key;
+	mblk_t *encoded;
+} MSEncodedFrameCacheEntry;
+
+struct _MSEncodedFrameCache{
+	ms_mutex_t lock;
+	MSEncodedFrameCacheEntry entries[MS_ENCODED_FRAME_CACHE_SIZE];
+	int next; /*next entry to be replaced*/
+	unsigned long hits;
+	unsigned long misses;
+};
+
+MSEncodedFrameCache *ms_encoded_frame_cache_new(void){
+	MSEncodedFrameCache *obj=ms_new0(MSEncodedFrameCache,1);
+	ms_mutex_init(&obj->lock,NULL);
+	return obj;
+}
+
+static void encoded_frame_cache_entry_clear(MSEncodedFrameCacheEntry *entry){
+	ms_encoded_frame_key_release(&entry->key);
+	if (entry->encoded){
+		freemsg(entry->encoded);
+		entry->encoded=NULL;
+	}
+}
+
+void ms_encoded_frame_cache_destroy(MSEncodedFrameCache *obj){
+	int i;
+	ms_message("Encoded frame cache destroyed: %lu hits, %lu misses",obj->hits,obj->misses);
+	for(i=0;i<MS_ENCODED_FRAME_CACHE_SIZE;++i)
+		encoded_frame_cache_entry_clear(&obj->entries[i]);
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+bool_t ms_encoded_frame_key_init(MSEncodedFrameKey *key, MSBufferizer *bz, int frame_size){
+	mblk_t *m;
+	int size=0;
+	key->npieces=0;
+	key->size=frame_size;
+	if (ms_bufferizer_get_avail(bz)<frame_size) return FALSE;
+	for(m=qbegin(&bz->q);!qend(&bz->q,m) && size<frame_size;m=qnext(&bz->q,m)){
+		/*only blocks shared by several receivers are worth being looked up*/
+		if (m->b_cont!=NULL || m->b_datap->db_ref<2 || key->npieces==MS_ENCODED_FRAME_MAX_PIECES){
+			ms_encoded_frame_key_release(key);
+			return FALSE;
+		}
+		key->pieces[key->npieces]=dupb(m);
+		size+=m->b_wptr-m->b_rptr;
+		if (size>frame_size) key->pieces[key->npieces]->b_wptr-=size-frame_size;
+		key->npieces++;
+	}
+	return TRUE;
+}
+
+void ms_encoded_frame_key_release(MSEncodedFrameKey *key){
+	int i;
+	for(i=0;i<key->npieces;++i)
+		freeb(key->pieces[i]);
+	key->npieces=0;
+}
+
+static bool_t encoded_frame_key_equals(const MSEncodedFrameKey *k1, const MSEncodedFrameKey *k2){
+	int i;
+	if (k1->npieces!=k2->npieces || k1->size!=k2->size) return FALSE;
+	for(i=0;i<k1->npieces;++i){
+		const mblk_t *p1=k1->pieces[i],*p2=k2->pieces[i];
+		if (p1->b_datap!=p2->b_datap || p1->b_rptr!=p2->b_rptr || p1->b_wptr!=p2->b_wptr)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+mblk_t *ms_encoded_frame_cache_lookup(MSEncodedFrameCache *obj, unsigned int encoder_id, const MSEncodedFrameKey *key){
+	mblk_t *ret=NULL;
+	int i;
+	ms_mutex_lock(&obj->lock);
+	for(i=0;i<MS_ENCODED_FRAME_CACHE_SIZE;++i){
+		MSEncodedFrameCacheEntry *entry=&obj->entries[i];
+		if (entry->encoded!=NULL && entry->encoder_id==encoder_id && encoded_frame_key_equals(&entry->key,key)){
+			ret=dupmsg(entry->encoded);
+			break;
+		}
+	}
+	if (ret) obj->hits++;
+	else obj->misses++;
+	ms_mutex_unlock(&obj->lock);
+	return ret;
+}
+
+void ms_encoded_frame_cache_store(MSEncodedFrameCache *obj, unsigned int encoder_id, MSEncodedFrameKey *key, mblk_t *encoded){
+	MSEncodedFrameCacheEntry *entry;
+	ms_mutex_lock(&obj->lock);
+	entry=&obj->entries[obj->next];
+	obj->next=(obj->next+1)%MS_ENCODED_FRAME_CACHE_SIZE;
+	encoded_frame_cache_entry_clear(entry);
+	entry->encoder_id=encoder_id;
+	entry->key=*key;
+	entry->encoded=dupmsg(encoded);
+	ms_mutex_unlock(&obj->lock);
+	key->npieces=0;
+}
+
+/*** encoded frame cache end***/
+
+/*** comfort noise begin***/
+int ms_comfort_noise_get_level(const int16_t *samples, int nsamples){
+	double en=0;
+	int i,level;
+	for(i=0;i<nsamples;++i) en+=(double)samples[i]*samples[i];
+	if (nsamples==0 || en==0) return MS_COMFORT_NOISE_MAX_LEVEL;
+	/*0 dBov is the power of a full scale square wave*/
+	level=(int)(-10*log10(en/((double)nsamples*32768.0*32768.0))+0.5);
+	if (level<0) level=0;
+	if (level>MS_COMFORT_NOISE_MAX_LEVEL) level=MS_COMFORT_NOISE_MAX_LEVEL;
+	return level;
+}
+
+void ms_comfort_noise_generate(int level, int16_t *samples, int nsamples, uint32_t *seed){
+	/*uniform noise in [-a,a] has a rms value of a/sqrt(3), a being relative to the full scale*/
+	float a=(float)(1.7320508*pow(10,-level/20.0));
+	uint32_t r=*seed;
+	int i;
+	if (a>1) a=1;
+	for(i=0;i<nsamples;++i){
+		r=r*1664525+1013904223;
+		samples[i]=(int16_t)(a*(int16_t)(r>>16));
+	}
+	*seed=r;
+}
+/*** comfort noise end***/
@@ -297,14 +297,19 @@ void ms_filter_process(MSFilter *f){
 	MSTimeSpec start,stop;
 	ms_debug("Executing process of filter %s:%p",f->desc->name,f);
 
-	if (f->stats)
+	if (f->stats || f->measure_time)
 		ms_get_cur_time(&start);
 
 	f->desc->process(f);
-	if (f->stats){
+	if (f->stats || f->measure_time){
+		uint64_t elapsed;
 		ms_get_cur_time(&stop);
-		f->stats->count++;
-		f->stats->elapsed+=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		elapsed=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		f->elapsed+=elapsed;
+		if (f->stats){
+			f->stats->count++;
+			f->stats->elapsed+=elapsed;
+		}
 	}
 
 }
@@ -314,14 +319,19 @@ void ms_filter_task_process(MSFilterTask *task){
 	MSFilter *f=task->f;
 	/*ms_message("Executing task of filter %s:%p",f->desc->name,f);*/
 
-	if (f->stats)
+	if (f->stats || f->measure_time)
 		ms_get_cur_time(&start);
 
 	task->taskfunc(f);
-	if (f->stats){
+	if (f->stats || f->measure_time){
+		uint64_t elapsed;
 		ms_get_cur_time(&stop);
-		f->stats->count++;
-		f->stats->elapsed+=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		elapsed=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		f->elapsed+=elapsed;
+		if (f->stats){
+			f->stats->count++;
+			f->stats->elapsed+=elapsed;
+		}
 	}
 	f->postponed_task--;
 }
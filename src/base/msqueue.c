@@ -25,10 +25,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msvideo.h"
 #include <string.h>
 
-#ifdef WIN32
-#include <malloc.h> /* for alloca */
-#endif
-
 MSQueue * ms_queue_new(struct _MSFilter *f1, int pin1, struct _MSFilter *f2, int pin2 ){
 	MSQueue *q=(MSQueue*)ms_new(MSQueue,1);
 	qinit(&q->q);
@@ -80,7 +76,8 @@ void ms_bufferizer_put_from_queue(MSBufferizer *obj, MSQueue *q){
 	}
 }
 
-int ms_bufferizer_read(MSBufferizer *obj, uint8_t *data, int datalen){
+/*copies datalen bytes into data if not NULL, and removes them from the bufferizer*/
+static int bufferizer_consume(MSBufferizer *obj, uint8_t *data, int datalen){
 	if (obj->size>=datalen){
 		int sz=0;
 		int cplen;
@@ -88,7 +85,7 @@ int ms_bufferizer_read(MSBufferizer *obj, uint8_t *data, int datalen){
 		/*we can return something */
 		while(sz<datalen){
 			cplen=MIN(m->b_wptr-m->b_rptr,datalen-sz);
-			memcpy(data+sz,m->b_rptr,cplen);
+			if (data) memcpy(data+sz,m->b_rptr,cplen);
 			sz+=cplen;
 			m->b_rptr+=cplen;
 			if (m->b_rptr==m->b_wptr){
@@ -109,9 +106,23 @@ int ms_bufferizer_read(MSBufferizer *obj, uint8_t *data, int datalen){
 	return 0;
 }
 
+int ms_bufferizer_read(MSBufferizer *obj, uint8_t *data, int datalen){
+	return bufferizer_consume(obj,data,datalen);
+}
+
 void ms_bufferizer_skip_bytes(MSBufferizer *obj, int bytes){
-	uint8_t *tmp=(uint8_t*)alloca(bytes);
-	ms_bufferizer_read(obj,tmp,bytes);
+	bufferizer_consume(obj,NULL,bytes);
+}
+
+bool_t ms_bufferizer_is_silent(MSBufferizer *obj, int datalen){
+	mblk_t *m;
+	int size=0;
+	if (obj->size<datalen) return FALSE;
+	for(m=qbegin(&obj->q);!qend(&obj->q,m) && size<datalen;m=qnext(&obj->q,m)){
+		if (!mblk_get_silence_flag(m)) return FALSE;
+		size+=msgdsize(m);
+	}
+	return TRUE;
 }
 
 void ms_bufferizer_flush(MSBufferizer *obj){
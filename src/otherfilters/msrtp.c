@@ -45,11 +45,13 @@ struct SenderData {
 	char relay_session_id[64];
 	int relay_session_id_size;
 	uint64_t last_rsi_time;
+	int cn_pt; /*payload type number for comfort noise, -1 if the remote party does not support it*/
 	char dtmf;
 	bool_t dtmf_start;
 	bool_t skip;
 	bool_t mute_mic;
 	bool_t use_task;
+	bool_t in_silence;
 };
 
 typedef struct SenderData SenderData;
@@ -93,6 +95,8 @@ static void sender_init(MSFilter * f)
 	d->last_sent_time=-1;
 	d->last_stun_sent_time = -1;
 	d->last_ts=0;
+	d->cn_pt=-1;
+	d->in_silence=FALSE;
 	d->use_task= tmp ? (!!atoi(tmp)) : FALSE;
 	if (d->use_task) ms_message("MSRtpSend will use tasks to send out packet at the beginning of ticks.");
 	f->data = d;
@@ -140,6 +144,7 @@ static int sender_set_session(MSFilter * f, void *arg)
 		d->rate = pt->clock_rate;
 		d->dtmf_duration=(default_dtmf_duration_ms*d->rate)/1000;
 		d->dtmf_ts_step=(20*d->rate)/1000;
+		d->cn_pt=rtp_profile_find_payload_number(rtp_session_get_profile(s),"CN",d->rate,1);
 		send_stun_packet(s);
 	} else {
 		ms_warning("Sending undefined payload type ?");
@@ -377,12 +382,17 @@ static void _sender_process(MSFilter * f)
 			}
 		}
 		if (im){
-			if (d->skip == FALSE && d->mute_mic==FALSE){
+			if (d->skip == FALSE && d->mute_mic==FALSE && (d->cn_pt!=-1 || !mblk_get_cn_flag(im))){
 				header = rtp_session_create_packet(s, 12, NULL, 0);
-				rtp_set_markbit(header, mblk_get_marker_info(im));
+				/*the first packet of a talkspurt is marked, so that the receiver can adapt its jitter buffer (RFC3551)*/
+				rtp_set_markbit(header, mblk_get_marker_info(im) || (d->in_silence && !mblk_get_silence_flag(im)));
+				if (mblk_get_cn_flag(im)) rtp_set_payload_type(header, d->cn_pt);
+				d->in_silence=mblk_get_silence_flag(im);
 				header->b_cont = im;
 				rtp_session_sendm_with_ts(s, header, timestamp);
 			}else{
+				/*comfort noise is dropped when the remote party does not support it*/
+				if (mblk_get_cn_flag(im)) d->in_silence=TRUE;
 				freemsg(im);
 			}
 		}
@@ -467,6 +477,7 @@ struct ReceiverData {
 	RtpSession *session;
 	int rate;
 	int nchannels;
+	int cn_pt; /*payload type number for comfort noise, -1 if not supported*/
 	bool_t starting;
 	bool_t reset_jb;
 };
@@ -479,6 +490,7 @@ static void receiver_init(MSFilter * f)
 	d->session = NULL;
 	d->rate = 8000;
 	d->nchannels = 1;
+	d->cn_pt = -1;
 	f->data = d;
 }
 
@@ -500,6 +512,7 @@ static int receiver_set_session(MSFilter * f, void *arg)
 											  (s));
 	if (pt != NULL) {
 		d->rate = pt->clock_rate;
+		d->cn_pt = rtp_profile_find_payload_number(rtp_session_get_profile(s), "CN", d->rate, 1);
 	} else {
 		ms_warning("Receiving undefined payload type %i ?",
 		    rtp_session_get_recv_payload_type(s));
@@ -583,6 +596,9 @@ static void receiver_process(MSFilter * f)
 		mblk_set_timestamp_info(m, rtp_get_timestamp(m));
 		mblk_set_marker_info(m, rtp_get_markbit(m));
 		mblk_set_cseq(m, rtp_get_seqnumber(m));
+		/*comfort noise packets are passed to the decoder, that turns them into pcm*/
+		if (d->cn_pt != -1 && rtp_get_payload_type(m) == d->cn_pt)
+			mblk_set_cn_flag(m, 1);
 		rtp_get_payload(m,&m->b_rptr);
 		ms_queue_put(f->outputs[0], m);
 	}
@@ -0,0 +1,273 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "asyncwriter.h"
+
+#if defined(__linux__) && !defined(ANDROID)
+#define USE_FALLOCATE
+#include <fcntl.h>
+#endif
+
+#define PREALLOC_SIZE (16*MS_ASYNC_WRITER_CHUNK_SIZE)
+
+typedef struct _WriteChunk{
+	struct _WriteChunk *next;
+	int offset; /*-1 to append*/
+	int len;
+	int size;
+	uint8_t *data;
+} WriteChunk;
+
+struct _MSAsyncWriter{
+	int fd;
+	WriteChunk *current; /*being filled by the owner*/
+	/*protected by the I/O lock*/
+	WriteChunk *first;
+	WriteChunk *last;
+	int pending;
+	bool_t closing;
+	bool_t closed;
+	/*only used by the I/O thread once the writer is created*/
+	off_t end;
+	off_t allocated;
+	bool_t prealloc_failed; /*not supported by the file system, or no space left: not tried again*/
+};
+
+typedef struct _AsyncIO{
+	ms_thread_t thread;
+	ms_mutex_t lock;
+	ms_cond_t cond; /*signaled when there is something to write*/
+	ms_cond_t done_cond; /*signaled when a file is closed*/
+	MSList *writers;
+	bool_t running;
+	bool_t thread_started;
+} AsyncIO;
+
+static AsyncIO async_io;
+static bool_t async_io_initialized=FALSE;
+
+static WriteChunk *write_chunk_new(int size, int offset){
+	WriteChunk *c=(WriteChunk*)ms_malloc(sizeof(WriteChunk)+size);
+	c->next=NULL;
+	c->offset=offset;
+	c->len=0;
+	c->size=size;
+	c->data=(uint8_t*)(c+1);
+	return c;
+}
+
+static void write_all(int fd, const uint8_t *data, int len){
+	while(len>0){
+		int err=write(fd,data,len);
+		if (err<=0){
+			ms_warning("MSAsyncWriter: fail to write %i bytes: %s",len,strerror(errno));
+			return;
+		}
+		data+=err;
+		len-=err;
+	}
+}
+
+/*the file is extended by large steps, which limits its fragmentation and the metadata updates*/
+static void writer_preallocate(MSAsyncWriter *w, int len){
+#ifdef USE_FALLOCATE
+	int err;
+	if (w->prealloc_failed || w->end+len<=w->allocated) return;
+	if ((err=posix_fallocate(w->fd,w->allocated,PREALLOC_SIZE))==0) w->allocated+=PREALLOC_SIZE;
+	else{
+		ms_message("MSAsyncWriter: cannot preallocate file space (%s), writing without it.",strerror(err));
+		w->prealloc_failed=TRUE;
+	}
+#endif
+}
+
+static void writer_do_io(MSAsyncWriter *w, WriteChunk *chunks){
+	WriteChunk *c,*next;
+	for(c=chunks;c!=NULL;c=next){
+		next=c->next;
+		if (c->offset>=0){
+			lseek(w->fd,c->offset,SEEK_SET);
+			write_all(w->fd,c->data,c->len);
+			lseek(w->fd,w->end,SEEK_SET);
+		}else{
+			writer_preallocate(w,c->len);
+			write_all(w->fd,c->data,c->len);
+			w->end+=c->len;
+		}
+		ms_free(c);
+	}
+}
+
+static void writer_do_close(MSAsyncWriter *w){
+#ifdef USE_FALLOCATE
+	/*the preallocated space beyond the data is not part of the file*/
+	if (w->allocated>w->end && ftruncate(w->fd,w->end)!=0)
+		ms_warning("MSAsyncWriter: cannot truncate file: %s",strerror(errno));
+#endif
+	close(w->fd);
+	w->fd=-1;
+}
+
+/*writes the chunks of one file at a time, without holding the lock, then moves to the next file*/
+static void *async_io_run(void *arg){
+	ms_mutex_lock(&async_io.lock);
+	while(async_io.running){
+		MSList *elem;
+		bool_t idle=TRUE;
+		for(elem=async_io.writers;elem!=NULL;elem=elem->next){
+			MSAsyncWriter *w=(MSAsyncWriter*)elem->data;
+			WriteChunk *chunks=w->first;
+			if (chunks!=NULL){
+				int len=0;
+				WriteChunk *c;
+				w->first=w->last=NULL;
+				for(c=chunks;c!=NULL;c=c->next) len+=c->len;
+				ms_mutex_unlock(&async_io.lock);
+				writer_do_io(w,chunks);
+				ms_mutex_lock(&async_io.lock);
+				w->pending-=len;
+				idle=FALSE;
+			}
+			if (w->closing && !w->closed && w->first==NULL){
+				ms_mutex_unlock(&async_io.lock);
+				writer_do_close(w);
+				ms_mutex_lock(&async_io.lock);
+				w->closed=TRUE;
+				ms_cond_broadcast(&async_io.done_cond);
+				idle=FALSE;
+			}
+		}
+		if (idle) ms_cond_wait(&async_io.cond,&async_io.lock);
+	}
+	ms_mutex_unlock(&async_io.lock);
+	return NULL;
+}
+
+void ms_async_writers_init(void){
+	if (async_io_initialized) return;
+	memset(&async_io,0,sizeof(async_io));
+	ms_mutex_init(&async_io.lock,NULL);
+	ms_cond_init(&async_io.cond,NULL);
+	ms_cond_init(&async_io.done_cond,NULL);
+	async_io_initialized=TRUE;
+}
+
+void ms_async_writers_uninit(void){
+	if (!async_io_initialized) return;
+	if (async_io.writers!=NULL) ms_warning("MSAsyncWriter: some files are still open.");
+	if (async_io.thread_started){
+		ms_mutex_lock(&async_io.lock);
+		async_io.running=FALSE;
+		ms_cond_signal(&async_io.cond);
+		ms_mutex_unlock(&async_io.lock);
+		ms_thread_join(async_io.thread,NULL);
+	}
+	ms_list_free(async_io.writers);
+	ms_cond_destroy(&async_io.cond);
+	ms_cond_destroy(&async_io.done_cond);
+	ms_mutex_destroy(&async_io.lock);
+	async_io_initialized=FALSE;
+}
+
+MSAsyncWriter *ms_async_writer_new(int fd){
+	MSAsyncWriter *w;
+	if (!async_io_initialized) return NULL;
+	w=ms_new0(MSAsyncWriter,1);
+	w->fd=fd;
+	w->end=w->allocated=lseek(fd,0,SEEK_CUR);
+	ms_mutex_lock(&async_io.lock);
+	/*the thread is started on first use, many applications never record anything*/
+	if (!async_io.thread_started){
+		async_io.running=TRUE;
+		async_io.thread_started=TRUE;
+		ms_thread_create(&async_io.thread,NULL,async_io_run,NULL);
+	}
+	async_io.writers=ms_list_append(async_io.writers,w);
+	ms_mutex_unlock(&async_io.lock);
+	return w;
+}
+
+/*returns the number of bytes dropped*/
+static int writer_queue(MSAsyncWriter *w, WriteChunk *c, bool_t droppable){
+	int dropped=0;
+	ms_mutex_lock(&async_io.lock);
+	if (droppable && w->pending+c->len>MS_ASYNC_WRITER_MAX_PENDING){
+		dropped=c->len;
+	}else{
+		if (w->last) w->last->next=c;
+		else w->first=c;
+		w->last=c;
+		w->pending+=c->len;
+		ms_cond_signal(&async_io.cond);
+	}
+	ms_mutex_unlock(&async_io.lock);
+	if (dropped>0) ms_free(c);
+	return dropped;
+}
+
+int ms_async_writer_write(MSAsyncWriter *w, const uint8_t *data, int len){
+	int dropped=0;
+	while(len>0){
+		int n;
+		if (w->current==NULL) w->current=write_chunk_new(MS_ASYNC_WRITER_CHUNK_SIZE,-1);
+		n=MIN(len,w->current->size-w->current->len);
+		memcpy(w->current->data+w->current->len,data,n);
+		w->current->len+=n;
+		data+=n;
+		len-=n;
+		if (w->current->len==w->current->size){
+			dropped+=writer_queue(w,w->current,TRUE);
+			w->current=NULL;
+		}
+	}
+	return dropped;
+}
+
+int ms_async_writer_flush(MSAsyncWriter *w){
+	int dropped;
+	if (w->current==NULL || w->current->len==0) return 0;
+	dropped=writer_queue(w,w->current,TRUE);
+	w->current=NULL;
+	return dropped;
+}
+
+void ms_async_writer_write_at(MSAsyncWriter *w, const uint8_t *data, int len, int offset){
+	WriteChunk *c=write_chunk_new(len,offset);
+	memcpy(c->data,data,len);
+	c->len=len;
+	writer_queue(w,c,FALSE);
+}
+
+void ms_async_writer_close(MSAsyncWriter *w){
+	if (w->current){
+		writer_queue(w,w->current,FALSE);
+		w->current=NULL;
+	}
+	ms_mutex_lock(&async_io.lock);
+	w->closing=TRUE;
+	ms_cond_signal(&async_io.cond);
+	while(!w->closed) ms_cond_wait(&async_io.done_cond,&async_io.lock);
+	async_io.writers=ms_list_remove(async_io.writers,w);
+	ms_mutex_unlock(&async_io.lock);
+	ms_free(w);
+}
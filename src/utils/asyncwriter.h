@@ -0,0 +1,60 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef asyncwriter_h
+#define asyncwriter_h
+
+#include "mediastreamer2/mscommon.h"
+
+/*
+ * Writes files from a single I/O thread shared by the whole process, so that the ticker threads never wait for
+ * the disk. Data is accumulated into large chunks, each written with a single system call, and the files are
+ * preallocated ahead of the writes where the system allows it.
+ * The amount of data queued per file is bounded: when the disk cannot keep up, whole chunks are dropped
+ * and reported to the caller instead of delaying it.
+ * A writer is used from one thread at a time, normally the ticker's, except for its creation and closing.
+ */
+
+#define MS_ASYNC_WRITER_CHUNK_SIZE 65536
+#define MS_ASYNC_WRITER_MAX_PENDING (32*MS_ASYNC_WRITER_CHUNK_SIZE)
+
+typedef struct _MSAsyncWriter MSAsyncWriter;
+
+/*called by ms_voip_init() and ms_voip_exit()*/
+void ms_async_writers_init(void);
+void ms_async_writers_uninit(void);
+
+/*takes ownership of fd, data being appended at its current offset. Returns NULL if the I/O thread is not available,
+ in which case the caller has to write by itself*/
+MSAsyncWriter *ms_async_writer_new(int fd);
+
+/*appends data, returns the number of bytes dropped because too much data was already queued*/
+int ms_async_writer_write(MSAsyncWriter *w, const uint8_t *data, int len);
+
+/*writes data at offset, after the data queued so far, without changing where the next data is appended.
+ It is never dropped, and is meant for headers*/
+void ms_async_writer_write_at(MSAsyncWriter *w, const uint8_t *data, int len, int offset);
+
+/*queues the data accumulated in the current chunk even if it is not full, returns the number of bytes dropped*/
+int ms_async_writer_flush(MSAsyncWriter *w);
+
+/*writes all the queued data, closes the file and destroys the writer. It waits for the I/O thread*/
+void ms_async_writer_close(MSAsyncWriter *w);
+
+#endif
@@ -0,0 +1,460 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msaudioconvert.h"
+
+/*same compile time selection as the audio kernels, see audiokernels.c*/
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+#define MS_AUDIO_CONVERT_X86
+#define MS_TARGET(arch) __attribute__((target(arch)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)) && (_MSC_VER >= 1700)
+#define MS_AUDIO_CONVERT_X86
+#define MS_TARGET(arch)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define MS_AUDIO_CONVERT_NEON
+#include <arm_neon.h>
+#ifdef ANDROID
+#include "cpu-features.h"
+#endif
+#endif
+
+typedef struct _AudioConverters{
+	const char *name;
+	void (*swap16)(int16_t *dst, const int16_t *src, int nsamples);
+	void (*s16_to_float)(float *dst, const int16_t *src, int nsamples, float scale);
+	void (*float_to_s16)(int16_t *dst, const float *src, int nsamples, float scale);
+	void (*interleave)(int16_t *dst, const int16_t *left, const int16_t *right, int nframes);
+	void (*deinterleave)(int16_t *left, int16_t *right, const int16_t *src, int nframes);
+	void (*downmix)(int16_t *dst, const int16_t *src, int nframes);
+	void (*upmix)(int16_t *dst, const int16_t *src, int nframes);
+} AudioConverters;
+
+
+/* portable implementation*/
+
+static void swap16_c(int16_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;++i){
+		uint16_t s=(uint16_t)src[i];
+		dst[i]=(int16_t)((s<<8)|(s>>8));
+	}
+}
+
+static void s16_to_float_c(float *dst, const int16_t *src, int nsamples, float scale){
+	int i;
+	for(i=0;i<nsamples;++i){
+		dst[i]=scale*(float)src[i];
+	}
+}
+
+static void float_to_s16_c(int16_t *dst, const float *src, int nsamples, float scale){
+	int i;
+	for(i=0;i<nsamples;++i){
+		float v=scale*src[i];
+		dst[i]=(int16_t)(v>32767.0f ? 32767.0f : (v<-32768.0f ? -32768.0f : v));
+	}
+}
+
+static void interleave_c(int16_t *dst, const int16_t *left, const int16_t *right, int nframes){
+	int i;
+	for(i=0;i<nframes;++i){
+		dst[2*i]=left[i];
+		dst[2*i+1]=right[i];
+	}
+}
+
+static void deinterleave_c(int16_t *left, int16_t *right, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i<nframes;++i){
+		left[i]=src[2*i];
+		right[i]=src[2*i+1];
+	}
+}
+
+static void downmix_c(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i<nframes;++i){
+		dst[i]=(int16_t)(((int32_t)src[2*i]+(int32_t)src[2*i+1])>>1);
+	}
+}
+
+static void upmix_c(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i<nframes;++i){
+		dst[2*i]=dst[2*i+1]=src[i];
+	}
+}
+
+static const AudioConverters generic_converters={
+	"generic",
+	swap16_c,
+	s16_to_float_c,
+	float_to_s16_c,
+	interleave_c,
+	deinterleave_c,
+	downmix_c,
+	upmix_c
+};
+
+
+#ifdef MS_AUDIO_CONVERT_X86
+
+/* SSE2 implementation, 8 samples or frames per iteration. The conversions are memory bound, AVX2 brings nothing.*/
+
+MS_TARGET("sse2") static void swap16_sse2(int16_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(src+i));
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_or_si128(_mm_slli_epi16(c,8),_mm_srli_epi16(c,8)));
+	}
+	swap16_c(dst+i,src+i,nsamples-i);
+}
+
+MS_TARGET("sse2") static void s16_to_float_sse2(float *dst, const int16_t *src, int nsamples, float scale){
+	int i;
+	__m128 vscale=_mm_set1_ps(scale);
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(src+i));
+		_mm_storeu_ps(dst+i,_mm_mul_ps(vscale,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16))));
+		_mm_storeu_ps(dst+i+4,_mm_mul_ps(vscale,_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16))));
+	}
+	s16_to_float_c(dst+i,src+i,nsamples-i,scale);
+}
+
+/*in place conversions work as the 16 bit output never goes past the floats already read*/
+MS_TARGET("sse2") static void float_to_s16_sse2(int16_t *dst, const float *src, int nsamples, float scale){
+	int i;
+	__m128 vscale=_mm_set1_ps(scale);
+	__m128 vmax=_mm_set1_ps(32767.0f);
+	__m128 vmin=_mm_set1_ps(-32768.0f);
+	for(i=0;i+8<=nsamples;i+=8){
+		/*clipped before the truncating conversion, which cannot represent values beyond 2^31*/
+		__m128 lo=_mm_max_ps(_mm_min_ps(_mm_mul_ps(vscale,_mm_loadu_ps(src+i)),vmax),vmin);
+		__m128 hi=_mm_max_ps(_mm_min_ps(_mm_mul_ps(vscale,_mm_loadu_ps(src+i+4)),vmax),vmin);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packs_epi32(_mm_cvttps_epi32(lo),_mm_cvttps_epi32(hi)));
+	}
+	float_to_s16_c(dst+i,src+i,nsamples-i,scale);
+}
+
+MS_TARGET("sse2") static void interleave_sse2(int16_t *dst, const int16_t *left, const int16_t *right, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		__m128i l=_mm_loadu_si128((const __m128i*)(left+i));
+		__m128i r=_mm_loadu_si128((const __m128i*)(right+i));
+		_mm_storeu_si128((__m128i*)(dst+2*i),_mm_unpacklo_epi16(l,r));
+		_mm_storeu_si128((__m128i*)(dst+2*i+8),_mm_unpackhi_epi16(l,r));
+	}
+	interleave_c(dst+2*i,left+i,right+i,nframes-i);
+}
+
+/*the left samples are the low halves of the 32 bit frames: they are sign extended in place, then packed*/
+MS_TARGET("sse2") static void deinterleave_sse2(int16_t *left, int16_t *right, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		__m128i a=_mm_loadu_si128((const __m128i*)(src+2*i));
+		__m128i b=_mm_loadu_si128((const __m128i*)(src+2*i+8));
+		__m128i l=_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a,16),16),_mm_srai_epi32(_mm_slli_epi32(b,16),16));
+		__m128i r=_mm_packs_epi32(_mm_srai_epi32(a,16),_mm_srai_epi32(b,16));
+		_mm_storeu_si128((__m128i*)(left+i),l);
+		_mm_storeu_si128((__m128i*)(right+i),r);
+	}
+	deinterleave_c(left+i,right+i,src+2*i,nframes-i);
+}
+
+/*_mm_madd_epi16() with ones adds the two channels of each frame in 32 bits*/
+MS_TARGET("sse2") static void downmix_sse2(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	__m128i ones=_mm_set1_epi16(1);
+	for(i=0;i+8<=nframes;i+=8){
+		__m128i a=_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(src+2*i)),ones);
+		__m128i b=_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(src+2*i+8)),ones);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packs_epi32(_mm_srai_epi32(a,1),_mm_srai_epi32(b,1)));
+	}
+	downmix_c(dst+i,src+2*i,nframes-i);
+}
+
+MS_TARGET("sse2") static void upmix_sse2(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(src+i));
+		_mm_storeu_si128((__m128i*)(dst+2*i),_mm_unpacklo_epi16(c,c));
+		_mm_storeu_si128((__m128i*)(dst+2*i+8),_mm_unpackhi_epi16(c,c));
+	}
+	upmix_c(dst+2*i,src+i,nframes-i);
+}
+
+static const AudioConverters sse2_converters={
+	"sse2",
+	swap16_sse2,
+	s16_to_float_sse2,
+	float_to_s16_sse2,
+	interleave_sse2,
+	deinterleave_sse2,
+	downmix_sse2,
+	upmix_sse2
+};
+
+static int cpu_has_sse2(void){
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs,1);
+	return (regs[3] & (1<<26))!=0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif /*MS_AUDIO_CONVERT_X86*/
+
+
+#ifdef MS_AUDIO_CONVERT_NEON
+
+static void swap16_neon(int16_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		vst1q_u8((uint8_t*)(dst+i),vrev16q_u8(vld1q_u8((const uint8_t*)(src+i))));
+	}
+	swap16_c(dst+i,src+i,nsamples-i);
+}
+
+static void s16_to_float_neon(float *dst, const int16_t *src, int nsamples, float scale){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		int16x8_t c=vld1q_s16(src+i);
+		vst1q_f32(dst+i,vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(c))),scale));
+		vst1q_f32(dst+i+4,vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(c))),scale));
+	}
+	s16_to_float_c(dst+i,src+i,nsamples-i,scale);
+}
+
+/*vcvtq_s32_f32 rounds toward zero and saturates, vqmovn_s32 saturates to 16 bits*/
+static void float_to_s16_neon(int16_t *dst, const float *src, int nsamples, float scale){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		int32x4_t lo=vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src+i),scale));
+		int32x4_t hi=vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src+i+4),scale));
+		vst1q_s16(dst+i,vcombine_s16(vqmovn_s32(lo),vqmovn_s32(hi)));
+	}
+	float_to_s16_c(dst+i,src+i,nsamples-i,scale);
+}
+
+static void interleave_neon(int16_t *dst, const int16_t *left, const int16_t *right, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		int16x8x2_t lr;
+		lr.val[0]=vld1q_s16(left+i);
+		lr.val[1]=vld1q_s16(right+i);
+		vst2q_s16(dst+2*i,lr);
+	}
+	interleave_c(dst+2*i,left+i,right+i,nframes-i);
+}
+
+static void deinterleave_neon(int16_t *left, int16_t *right, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		int16x8x2_t lr=vld2q_s16(src+2*i);
+		vst1q_s16(left+i,lr.val[0]);
+		vst1q_s16(right+i,lr.val[1]);
+	}
+	deinterleave_c(left+i,right+i,src+2*i,nframes-i);
+}
+
+/*vhaddq_s16 computes (a+b)>>1 without overflow*/
+static void downmix_neon(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		int16x8x2_t lr=vld2q_s16(src+2*i);
+		vst1q_s16(dst+i,vhaddq_s16(lr.val[0],lr.val[1]));
+	}
+	downmix_c(dst+i,src+2*i,nframes-i);
+}
+
+static void upmix_neon(int16_t *dst, const int16_t *src, int nframes){
+	int i;
+	for(i=0;i+8<=nframes;i+=8){
+		int16x8x2_t lr;
+		lr.val[0]=lr.val[1]=vld1q_s16(src+i);
+		vst2q_s16(dst+2*i,lr);
+	}
+	upmix_c(dst+2*i,src+i,nframes-i);
+}
+
+static const AudioConverters neon_converters={
+	"neon",
+	swap16_neon,
+	s16_to_float_neon,
+	float_to_s16_neon,
+	interleave_neon,
+	deinterleave_neon,
+	downmix_neon,
+	upmix_neon
+};
+
+static int cpu_has_neon(void){
+#ifdef ANDROID
+	return android_getCpuFamily()==ANDROID_CPU_FAMILY_ARM && (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)!=0;
+#else
+	return 1;
+#endif
+}
+
+#endif /*MS_AUDIO_CONVERT_NEON*/
+
+
+static const AudioConverters *select_converters(void){
+#ifdef MS_AUDIO_CONVERT_X86
+	if (cpu_has_sse2()) return &sse2_converters;
+#endif
+#ifdef MS_AUDIO_CONVERT_NEON
+	if (cpu_has_neon()) return &neon_converters;
+#endif
+	return &generic_converters;
+}
+
+/*the selection is idempotent, so a concurrent first call is harmless*/
+static const AudioConverters *selected_converters=NULL;
+
+static const AudioConverters *get_converters(void){
+	if (selected_converters==NULL){
+		selected_converters=select_converters();
+		ms_message("Using %s audio converters.",selected_converters->name);
+	}
+	return selected_converters;
+}
+
+void ms_audio_convert_swap16(int16_t *dst, const int16_t *src, int nsamples){
+	get_converters()->swap16(dst,src,nsamples);
+}
+
+void ms_audio_convert_ntoh16(int16_t *dst, const int16_t *src, int nsamples){
+#ifdef WORDS_BIGENDIAN
+	if (dst!=src) memcpy(dst,src,nsamples*sizeof(int16_t));
+#else
+	get_converters()->swap16(dst,src,nsamples);
+#endif
+}
+
+void ms_audio_convert_s16_to_float(float *dst, const int16_t *src, int nsamples, float scale){
+	get_converters()->s16_to_float(dst,src,nsamples,scale);
+}
+
+void ms_audio_convert_float_to_s16(int16_t *dst, const float *src, int nsamples, float scale){
+	get_converters()->float_to_s16(dst,src,nsamples,scale);
+}
+
+void ms_audio_convert_interleave(int16_t *dst, const int16_t *left, const int16_t *right, int nframes){
+	get_converters()->interleave(dst,left,right,nframes);
+}
+
+void ms_audio_convert_deinterleave(int16_t *left, int16_t *right, const int16_t *src, int nframes){
+	get_converters()->deinterleave(left,right,src,nframes);
+}
+
+void ms_audio_convert_downmix(int16_t *dst, const int16_t *src, int nframes){
+	get_converters()->downmix(dst,src,nframes);
+}
+
+void ms_audio_convert_upmix(int16_t *dst, const int16_t *src, int nframes){
+	get_converters()->upmix(dst,src,nframes);
+}
+
+mblk_t *ms_audio_convert_channels_msg(mblk_t *im, int in_nchannels, int out_nchannels){
+	mblk_t *om;
+	int nframes;
+
+	if (in_nchannels==out_nchannels) return im;
+	if (im->b_cont!=NULL) msgpullup(im,-1);
+	nframes=(int)((im->b_wptr-im->b_rptr)/(2*in_nchannels));
+	if (in_nchannels==2 && out_nchannels==1){
+		if (im->b_datap->db_ref==1){
+			/*the output is smaller than the input: in place*/
+			ms_audio_convert_downmix((int16_t*)im->b_rptr,(const int16_t*)im->b_rptr,nframes);
+			im->b_wptr=im->b_rptr+nframes*2;
+			return im;
+		}
+		om=allocb(nframes*2,0);
+		ms_audio_convert_downmix((int16_t*)om->b_wptr,(const int16_t*)im->b_rptr,nframes);
+		om->b_wptr+=nframes*2;
+	}else if (in_nchannels==1 && out_nchannels==2){
+		om=allocb(nframes*4,0);
+		ms_audio_convert_upmix((int16_t*)om->b_wptr,(const int16_t*)im->b_rptr,nframes);
+		om->b_wptr+=nframes*4;
+	}else{
+		ms_warning("ms_audio_convert_channels_msg(): unsupported conversion from %i to %i channels.",in_nchannels,out_nchannels);
+		return im;
+	}
+	mblk_meta_copy(im,om);
+	freemsg(im);
+	return om;
+}
+
+mblk_t *ms_audio_convert_ntoh16_msg(mblk_t *im){
+	mblk_t *om;
+	int nsamples;
+
+	if (im->b_cont!=NULL) msgpullup(im,-1);
+	nsamples=(int)((im->b_wptr-im->b_rptr)/2);
+	if (im->b_datap->db_ref==1){
+		ms_audio_convert_ntoh16((int16_t*)im->b_rptr,(const int16_t*)im->b_rptr,nsamples);
+		return im;
+	}
+	om=allocb(nsamples*2,0);
+	ms_audio_convert_ntoh16((int16_t*)om->b_wptr,(const int16_t*)im->b_rptr,nsamples);
+	om->b_wptr+=nsamples*2;
+	mblk_meta_copy(im,om);
+	freemsg(im);
+	return om;
+}
+
+mblk_t *ms_audio_convert_format_msg(mblk_t *im, MSSampleFormat in_format, MSSampleFormat out_format){
+	mblk_t *om;
+	int nsamples;
+
+	if (in_format==out_format) return im;
+	if (im->b_cont!=NULL) msgpullup(im,-1);
+	nsamples=(int)((im->b_wptr-im->b_rptr)/ms_sample_format_get_size(in_format));
+	if (in_format==MSSampleFormatFloat32){
+		if (im->b_datap->db_ref==1){
+			ms_audio_convert_float_to_s16((int16_t*)im->b_rptr,(const float*)im->b_rptr,nsamples,MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE);
+			im->b_wptr=im->b_rptr+nsamples*2;
+			return im;
+		}
+		om=allocb(nsamples*2,0);
+		ms_audio_convert_float_to_s16((int16_t*)om->b_wptr,(const float*)im->b_rptr,nsamples,MS_AUDIO_CONVERT_FLOAT_TO_S16_SCALE);
+		om->b_wptr+=nsamples*2;
+	}else{
+		om=allocb(nsamples*4,0);
+		ms_audio_convert_s16_to_float((float*)om->b_wptr,(const int16_t*)im->b_rptr,nsamples,MS_AUDIO_CONVERT_S16_TO_FLOAT_SCALE);
+		om->b_wptr+=nsamples*4;
+	}
+	mblk_meta_copy(im,om);
+	freemsg(im);
+	return om;
+}
@@ -0,0 +1,650 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msaudiokernels.h"
+
+/*
+ * x86 implementations are compiled with per-function target attributes so that the library itself
+ * does not require -msse2/-mavx2, and are selected at runtime according to cpuid.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+#define MS_AUDIO_KERNELS_X86
+#define MS_TARGET(arch) __attribute__((target(arch)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)) && (_MSC_VER >= 1700)
+#define MS_AUDIO_KERNELS_X86
+#define MS_TARGET(arch)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define MS_AUDIO_KERNELS_NEON
+#include <arm_neon.h>
+#ifdef ANDROID
+#include "cpu-features.h"
+#endif
+#endif
+
+
+/* portable implementation*/
+
+static inline int16_t clip16(int32_t s, int16_t limit){
+	if (s>limit) return limit;
+	if (s<-limit) return -limit;
+	return (int16_t)s;
+}
+
+static void accumulate_c(int32_t *sum, const int16_t *contrib, int nsamples){
+	int i;
+	for(i=0;i<nsamples;++i){
+		sum[i]+=contrib[i];
+	}
+}
+
+static void saturate_c(int16_t *out, const int32_t *sum, int nsamples, int16_t limit){
+	int i;
+	for(i=0;i<nsamples;++i){
+		out[i]=clip16(sum[i],limit);
+	}
+}
+
+static void saturate_minus_c(int16_t *out, const int32_t *sum, const int16_t *own, int nsamples, int16_t limit){
+	int i;
+	for(i=0;i<nsamples;++i){
+		out[i]=clip16(sum[i]-(int32_t)own[i],limit);
+	}
+}
+
+static void apply_gain_c(int16_t *samples, int nsamples, float gain){
+	int i;
+	for(i=0;i<nsamples;++i){
+		samples[i]=clip16((int32_t)(gain*(float)samples[i]),32767);
+	}
+}
+
+/*adds the measurements of the samples to levels*/
+static void add_levels_c(const int16_t *samples, int nsamples, MSAudioLevels *levels){
+	int i;
+	int64_t sum=0,sum_squares=0;
+	int peak=levels->peak;
+	for(i=0;i<nsamples;++i){
+		int s=samples[i];
+		sum+=s;
+		sum_squares+=s*s;
+		if (s<0) s=-s;
+		if (s>peak) peak=s;
+	}
+	levels->sum+=sum;
+	levels->sum_squares+=sum_squares;
+	levels->peak=peak;
+}
+
+static void reset_levels(MSAudioLevels *levels){
+	levels->sum=0;
+	levels->sum_squares=0;
+	levels->peak=0;
+}
+
+static void measure_c(const int16_t *samples, int nsamples, MSAudioLevels *levels){
+	reset_levels(levels);
+	add_levels_c(samples,nsamples,levels);
+}
+
+static void scale_c(int16_t *samples, int nsamples, int16_t offset, float gain){
+	int i;
+	for(i=0;i<nsamples;++i){
+		samples[i]=clip16((int32_t)(gain*(float)(samples[i]-offset)),32767);
+	}
+}
+
+static void measure_and_scale_c(int16_t *samples, int nsamples, int16_t offset, float gain, MSAudioLevels *levels){
+	if (levels) measure_c(samples,nsamples,levels);
+	scale_c(samples,nsamples,offset,gain);
+}
+
+static float dot_product_c(const float *a, const float *b, int n){
+	int i;
+	float acc=0;
+	for(i=0;i<n;++i){
+		acc+=a[i]*b[i];
+	}
+	return acc;
+}
+
+static const MSAudioKernels generic_kernels={
+	"generic",
+	accumulate_c,
+	saturate_c,
+	saturate_minus_c,
+	apply_gain_c,
+	measure_c,
+	measure_and_scale_c,
+	dot_product_c
+};
+
+
+#ifdef MS_AUDIO_KERNELS_X86
+
+/* SSE2 implementation, 8 samples per iteration*/
+
+MS_TARGET("sse2") static void accumulate_sse2(int32_t *sum, const int16_t *contrib, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(contrib+i));
+		/*sign extension of the 16 bit samples: interleave with themselves, then arithmetic shift*/
+		__m128i lo=_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16);
+		__m128i hi=_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16);
+		_mm_storeu_si128((__m128i*)(sum+i),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum+i)),lo));
+		_mm_storeu_si128((__m128i*)(sum+i+4),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum+i+4)),hi));
+	}
+	accumulate_c(sum+i,contrib+i,nsamples-i);
+}
+
+MS_TARGET("sse2") static void saturate_sse2(int16_t *out, const int32_t *sum, int nsamples, int16_t limit){
+	int i;
+	__m128i vmax=_mm_set1_epi16(limit);
+	__m128i vmin=_mm_set1_epi16(-limit);
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i lo=_mm_loadu_si128((const __m128i*)(sum+i));
+		__m128i hi=_mm_loadu_si128((const __m128i*)(sum+i+4));
+		__m128i r=_mm_packs_epi32(lo,hi);
+		r=_mm_max_epi16(_mm_min_epi16(r,vmax),vmin);
+		_mm_storeu_si128((__m128i*)(out+i),r);
+	}
+	saturate_c(out+i,sum+i,nsamples-i,limit);
+}
+
+MS_TARGET("sse2") static void saturate_minus_sse2(int16_t *out, const int32_t *sum, const int16_t *own, int nsamples, int16_t limit){
+	int i;
+	__m128i vmax=_mm_set1_epi16(limit);
+	__m128i vmin=_mm_set1_epi16(-limit);
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(own+i));
+		__m128i lo=_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(sum+i)),_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16));
+		__m128i hi=_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(sum+i+4)),_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16));
+		__m128i r=_mm_packs_epi32(lo,hi);
+		r=_mm_max_epi16(_mm_min_epi16(r,vmax),vmin);
+		_mm_storeu_si128((__m128i*)(out+i),r);
+	}
+	saturate_minus_c(out+i,sum+i,own+i,nsamples-i,limit);
+}
+
+MS_TARGET("sse2") static void apply_gain_sse2(int16_t *samples, int nsamples, float gain){
+	int i;
+	__m128 vgain=_mm_set1_ps(gain);
+	__m128i vmin=_mm_set1_epi16(-32767);
+	for(i=0;i+8<=nsamples;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(samples+i));
+		__m128 lo=_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16));
+		__m128 hi=_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16));
+		/*truncating conversion, like the C cast*/
+		__m128i r=_mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(lo,vgain)),_mm_cvttps_epi32(_mm_mul_ps(hi,vgain)));
+		_mm_storeu_si128((__m128i*)(samples+i),_mm_max_epi16(r,vmin));
+	}
+	apply_gain_c(samples+i,nsamples-i,gain);
+}
+
+/*
+ * Level measurement: the sums of pairs of samples computed by _mm_madd_epi16() are accumulated in 32 bits during
+ * MEASURE_BLOCK samples at most, so that they cannot overflow. The squares are accumulated in 64 bits, as a pair of
+ * squares can reach 2^31, which is read as unsigned.
+ */
+#define MEASURE_BLOCK 65536
+
+typedef struct _LevelsSse2{
+	__m128i sum;
+	__m128i sum_squares;
+	__m128i max;
+	__m128i min;
+} LevelsSse2;
+
+MS_TARGET("sse2") static inline void levels_sse2_init(LevelsSse2 *l){
+	l->sum=l->sum_squares=l->max=l->min=_mm_setzero_si128();
+}
+
+MS_TARGET("sse2") static inline void levels_sse2_add(LevelsSse2 *l, __m128i c){
+	__m128i sq=_mm_madd_epi16(c,c);
+	l->sum=_mm_add_epi32(l->sum,_mm_madd_epi16(c,_mm_set1_epi16(1)));
+	l->sum_squares=_mm_add_epi64(l->sum_squares,_mm_unpacklo_epi32(sq,_mm_setzero_si128()));
+	l->sum_squares=_mm_add_epi64(l->sum_squares,_mm_unpackhi_epi32(sq,_mm_setzero_si128()));
+	l->max=_mm_max_epi16(l->max,c);
+	l->min=_mm_min_epi16(l->min,c);
+}
+
+/*reduces the 32 bit partial sums, before they can overflow*/
+MS_TARGET("sse2") static inline void levels_sse2_flush_sum(LevelsSse2 *l, MSAudioLevels *levels){
+	int32_t tmp[4];
+	_mm_storeu_si128((__m128i*)tmp,l->sum);
+	levels->sum+=(int64_t)tmp[0]+tmp[1]+tmp[2]+tmp[3];
+	l->sum=_mm_setzero_si128();
+}
+
+MS_TARGET("sse2") static inline void levels_sse2_store(LevelsSse2 *l, MSAudioLevels *levels){
+	int64_t sq[2];
+	int16_t mx[8],mn[8];
+	int i;
+	levels_sse2_flush_sum(l,levels);
+	_mm_storeu_si128((__m128i*)sq,l->sum_squares);
+	levels->sum_squares+=sq[0]+sq[1];
+	_mm_storeu_si128((__m128i*)mx,l->max);
+	_mm_storeu_si128((__m128i*)mn,l->min);
+	for(i=0;i<8;++i){
+		if (mx[i]>levels->peak) levels->peak=mx[i];
+		if (-mn[i]>levels->peak) levels->peak=-mn[i];
+	}
+}
+
+MS_TARGET("sse2") static void measure_sse2(const int16_t *samples, int nsamples, MSAudioLevels *levels){
+	int i;
+	LevelsSse2 l;
+	reset_levels(levels);
+	levels_sse2_init(&l);
+	for(i=0;i+8<=nsamples;i+=8){
+		levels_sse2_add(&l,_mm_loadu_si128((const __m128i*)(samples+i)));
+		if ((i+8)%MEASURE_BLOCK==0) levels_sse2_flush_sum(&l,levels);
+	}
+	levels_sse2_store(&l,levels);
+	add_levels_c(samples+i,nsamples-i,levels);
+}
+
+MS_TARGET("sse2") static inline __m128i scale_sse2(__m128i c, __m128i voffset, __m128 vgain){
+	__m128i lo=_mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16),voffset);
+	__m128i hi=_mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16),voffset);
+	__m128i r=_mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo),vgain)),
+		_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi),vgain)));
+	return _mm_max_epi16(r,_mm_set1_epi16(-32767));
+}
+
+MS_TARGET("sse2") static void measure_and_scale_sse2(int16_t *samples, int nsamples, int16_t offset, float gain, MSAudioLevels *levels){
+	int i;
+	__m128i voffset=_mm_set1_epi32(offset);
+	__m128 vgain=_mm_set1_ps(gain);
+	if (levels){
+		LevelsSse2 l;
+		reset_levels(levels);
+		levels_sse2_init(&l);
+		for(i=0;i+8<=nsamples;i+=8){
+			__m128i c=_mm_loadu_si128((const __m128i*)(samples+i));
+			levels_sse2_add(&l,c);
+			if ((i+8)%MEASURE_BLOCK==0) levels_sse2_flush_sum(&l,levels);
+			_mm_storeu_si128((__m128i*)(samples+i),scale_sse2(c,voffset,vgain));
+		}
+		levels_sse2_store(&l,levels);
+		add_levels_c(samples+i,nsamples-i,levels);
+	}else{
+		for(i=0;i+8<=nsamples;i+=8){
+			__m128i c=_mm_loadu_si128((const __m128i*)(samples+i));
+			_mm_storeu_si128((__m128i*)(samples+i),scale_sse2(c,voffset,vgain));
+		}
+	}
+	scale_c(samples+i,nsamples-i,offset,gain);
+}
+
+MS_TARGET("sse2") static float dot_product_sse2(const float *a, const float *b, int n){
+	int i;
+	float tmp[4];
+	__m128 acc0=_mm_setzero_ps(),acc1=_mm_setzero_ps();
+	for(i=0;i+8<=n;i+=8){
+		acc0=_mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+		acc1=_mm_add_ps(acc1,_mm_mul_ps(_mm_loadu_ps(a+i+4),_mm_loadu_ps(b+i+4)));
+	}
+	_mm_storeu_ps(tmp,_mm_add_ps(acc0,acc1));
+	return tmp[0]+tmp[1]+tmp[2]+tmp[3]+dot_product_c(a+i,b+i,n-i);
+}
+
+static const MSAudioKernels sse2_kernels={
+	"sse2",
+	accumulate_sse2,
+	saturate_sse2,
+	saturate_minus_sse2,
+	apply_gain_sse2,
+	measure_sse2,
+	measure_and_scale_sse2,
+	dot_product_sse2
+};
+
+/* AVX2 implementation, 16 samples per iteration.
+ The remaining samples are processed by the SSE2 version, after clearing the upper part of the ymm registers
+ to avoid the penalty of mixing AVX and legacy SSE instructions.*/
+
+MS_TARGET("avx2") static void accumulate_avx2(int32_t *sum, const int16_t *contrib, int nsamples){
+	int i;
+	for(i=0;i+16<=nsamples;i+=16){
+		__m256i lo=_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i)));
+		__m256i hi=_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i+8)));
+		_mm256_storeu_si256((__m256i*)(sum+i),_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum+i)),lo));
+		_mm256_storeu_si256((__m256i*)(sum+i+8),_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum+i+8)),hi));
+	}
+	_mm256_zeroupper();
+	accumulate_sse2(sum+i,contrib+i,nsamples-i);
+}
+
+/*_mm256_packs_epi32 works on 128 bit lanes, the result needs to be put back in order*/
+#define PACK_ORDERED_AVX2(lo,hi) _mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xd8)
+
+MS_TARGET("avx2") static void saturate_avx2(int16_t *out, const int32_t *sum, int nsamples, int16_t limit){
+	int i;
+	__m256i vmax=_mm256_set1_epi16(limit);
+	__m256i vmin=_mm256_set1_epi16(-limit);
+	for(i=0;i+16<=nsamples;i+=16){
+		__m256i lo=_mm256_loadu_si256((const __m256i*)(sum+i));
+		__m256i hi=_mm256_loadu_si256((const __m256i*)(sum+i+8));
+		__m256i r=PACK_ORDERED_AVX2(lo,hi);
+		r=_mm256_max_epi16(_mm256_min_epi16(r,vmax),vmin);
+		_mm256_storeu_si256((__m256i*)(out+i),r);
+	}
+	_mm256_zeroupper();
+	saturate_sse2(out+i,sum+i,nsamples-i,limit);
+}
+
+MS_TARGET("avx2") static void saturate_minus_avx2(int16_t *out, const int32_t *sum, const int16_t *own, int nsamples, int16_t limit){
+	int i;
+	__m256i vmax=_mm256_set1_epi16(limit);
+	__m256i vmin=_mm256_set1_epi16(-limit);
+	for(i=0;i+16<=nsamples;i+=16){
+		__m256i lo=_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(sum+i)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own+i))));
+		__m256i hi=_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(sum+i+8)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own+i+8))));
+		__m256i r=PACK_ORDERED_AVX2(lo,hi);
+		r=_mm256_max_epi16(_mm256_min_epi16(r,vmax),vmin);
+		_mm256_storeu_si256((__m256i*)(out+i),r);
+	}
+	_mm256_zeroupper();
+	saturate_minus_sse2(out+i,sum+i,own+i,nsamples-i,limit);
+}
+
+MS_TARGET("avx2") static void apply_gain_avx2(int16_t *samples, int nsamples, float gain){
+	int i;
+	__m256 vgain=_mm256_set1_ps(gain);
+	__m256i vmin=_mm256_set1_epi16(-32767);
+	for(i=0;i+16<=nsamples;i+=16){
+		__m256 lo=_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples+i))));
+		__m256 hi=_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples+i+8))));
+		__m256i r=PACK_ORDERED_AVX2(_mm256_cvttps_epi32(_mm256_mul_ps(lo,vgain)),_mm256_cvttps_epi32(_mm256_mul_ps(hi,vgain)));
+		_mm256_storeu_si256((__m256i*)(samples+i),_mm256_max_epi16(r,vmin));
+	}
+	_mm256_zeroupper();
+	apply_gain_sse2(samples+i,nsamples-i,gain);
+}
+
+MS_TARGET("avx2") static float dot_product_avx2(const float *a, const float *b, int n){
+	int i;
+	float tmp[8];
+	__m256 acc0=_mm256_setzero_ps(),acc1=_mm256_setzero_ps();
+	for(i=0;i+16<=n;i+=16){
+		acc0=_mm256_add_ps(acc0,_mm256_mul_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i)));
+		acc1=_mm256_add_ps(acc1,_mm256_mul_ps(_mm256_loadu_ps(a+i+8),_mm256_loadu_ps(b+i+8)));
+	}
+	_mm256_storeu_ps(tmp,_mm256_add_ps(acc0,acc1));
+	_mm256_zeroupper();
+	return tmp[0]+tmp[1]+tmp[2]+tmp[3]+tmp[4]+tmp[5]+tmp[6]+tmp[7]+dot_product_sse2(a+i,b+i,n-i);
+}
+
+/*level measurement is memory bound on the 10 to 20 ms blocks it is used for: the SSE2 version is used*/
+static const MSAudioKernels avx2_kernels={
+	"avx2",
+	accumulate_avx2,
+	saturate_avx2,
+	saturate_minus_avx2,
+	apply_gain_avx2,
+	measure_sse2,
+	measure_and_scale_sse2,
+	dot_product_avx2
+};
+
+static int cpu_has_sse2(void){
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs,1);
+	return (regs[3] & (1<<26))!=0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int cpu_has_avx2(void){
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs,0);
+	if (regs[0]<7) return 0;
+	__cpuid(regs,1);
+	/*osxsave and avx, then check that the os saves the ymm registers*/
+	if ((regs[2] & (1<<27))==0 || (regs[2] & (1<<28))==0) return 0;
+	if ((_xgetbv(0) & 6)!=6) return 0;
+	__cpuidex(regs,7,0);
+	return (regs[1] & (1<<5))!=0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif /*MS_AUDIO_KERNELS_X86*/
+
+
+#ifdef MS_AUDIO_KERNELS_NEON
+
+static void accumulate_neon(int32_t *sum, const int16_t *contrib, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		int16x8_t c=vld1q_s16(contrib+i);
+		vst1q_s32(sum+i,vaddw_s16(vld1q_s32(sum+i),vget_low_s16(c)));
+		vst1q_s32(sum+i+4,vaddw_s16(vld1q_s32(sum+i+4),vget_high_s16(c)));
+	}
+	accumulate_c(sum+i,contrib+i,nsamples-i);
+}
+
+static void saturate_neon(int16_t *out, const int32_t *sum, int nsamples, int16_t limit){
+	int i;
+	int16x8_t vmax=vdupq_n_s16(limit);
+	int16x8_t vmin=vdupq_n_s16(-limit);
+	for(i=0;i+8<=nsamples;i+=8){
+		int16x8_t r=vcombine_s16(vqmovn_s32(vld1q_s32(sum+i)),vqmovn_s32(vld1q_s32(sum+i+4)));
+		vst1q_s16(out+i,vmaxq_s16(vminq_s16(r,vmax),vmin));
+	}
+	saturate_c(out+i,sum+i,nsamples-i,limit);
+}
+
+static void saturate_minus_neon(int16_t *out, const int32_t *sum, const int16_t *own, int nsamples, int16_t limit){
+	int i;
+	int16x8_t vmax=vdupq_n_s16(limit);
+	int16x8_t vmin=vdupq_n_s16(-limit);
+	for(i=0;i+8<=nsamples;i+=8){
+		int16x8_t c=vld1q_s16(own+i);
+		int32x4_t lo=vsubw_s16(vld1q_s32(sum+i),vget_low_s16(c));
+		int32x4_t hi=vsubw_s16(vld1q_s32(sum+i+4),vget_high_s16(c));
+		int16x8_t r=vcombine_s16(vqmovn_s32(lo),vqmovn_s32(hi));
+		vst1q_s16(out+i,vmaxq_s16(vminq_s16(r,vmax),vmin));
+	}
+	saturate_minus_c(out+i,sum+i,own+i,nsamples-i,limit);
+}
+
+static void apply_gain_neon(int16_t *samples, int nsamples, float gain){
+	int i;
+	int16x8_t vmin=vdupq_n_s16(-32767);
+	for(i=0;i+8<=nsamples;i+=8){
+		int16x8_t c=vld1q_s16(samples+i);
+		/*vcvtq_s32_f32 rounds toward zero, like the C cast*/
+		int32x4_t lo=vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(c))),gain));
+		int32x4_t hi=vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(c))),gain));
+		vst1q_s16(samples+i,vmaxq_s16(vcombine_s16(vqmovn_s32(lo),vqmovn_s32(hi)),vmin));
+	}
+	apply_gain_c(samples+i,nsamples-i,gain);
+}
+
+/*
+ * Level measurement: pairs of samples are accumulated in 32 bits with vpadalq_s16() during MEASURE_BLOCK samples
+ * at most, squares are accumulated in 64 bits with vpadalq_s32().
+ */
+#define MEASURE_BLOCK 65536
+
+typedef struct _LevelsNeon{
+	int32x4_t sum;
+	int64x2_t sum_squares;
+	int16x8_t max;
+	int16x8_t min;
+} LevelsNeon;
+
+static inline void levels_neon_init(LevelsNeon *l){
+	l->sum=vdupq_n_s32(0);
+	l->sum_squares=vdupq_n_s64(0);
+	l->max=l->min=vdupq_n_s16(0);
+}
+
+static inline void levels_neon_add(LevelsNeon *l, int16x8_t c){
+	l->sum=vpadalq_s16(l->sum,c);
+	l->sum_squares=vpadalq_s32(l->sum_squares,vmull_s16(vget_low_s16(c),vget_low_s16(c)));
+	l->sum_squares=vpadalq_s32(l->sum_squares,vmull_s16(vget_high_s16(c),vget_high_s16(c)));
+	l->max=vmaxq_s16(l->max,c);
+	l->min=vminq_s16(l->min,c);
+}
+
+static inline void levels_neon_flush_sum(LevelsNeon *l, MSAudioLevels *levels){
+	int32_t tmp[4];
+	vst1q_s32(tmp,l->sum);
+	levels->sum+=(int64_t)tmp[0]+tmp[1]+tmp[2]+tmp[3];
+	l->sum=vdupq_n_s32(0);
+}
+
+static inline void levels_neon_store(LevelsNeon *l, MSAudioLevels *levels){
+	int64_t sq[2];
+	int16_t mx[8],mn[8];
+	int i;
+	levels_neon_flush_sum(l,levels);
+	vst1q_s64(sq,l->sum_squares);
+	levels->sum_squares+=sq[0]+sq[1];
+	vst1q_s16(mx,l->max);
+	vst1q_s16(mn,l->min);
+	for(i=0;i<8;++i){
+		if (mx[i]>levels->peak) levels->peak=mx[i];
+		if (-mn[i]>levels->peak) levels->peak=-mn[i];
+	}
+}
+
+static void measure_neon(const int16_t *samples, int nsamples, MSAudioLevels *levels){
+	int i;
+	LevelsNeon l;
+	reset_levels(levels);
+	levels_neon_init(&l);
+	for(i=0;i+8<=nsamples;i+=8){
+		levels_neon_add(&l,vld1q_s16(samples+i));
+		if ((i+8)%MEASURE_BLOCK==0) levels_neon_flush_sum(&l,levels);
+	}
+	levels_neon_store(&l,levels);
+	add_levels_c(samples+i,nsamples-i,levels);
+}
+
+static inline int16x8_t scale_neon(int16x8_t c, int32x4_t voffset, float gain){
+	int32x4_t lo=vsubq_s32(vmovl_s16(vget_low_s16(c)),voffset);
+	int32x4_t hi=vsubq_s32(vmovl_s16(vget_high_s16(c)),voffset);
+	lo=vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(lo),gain));
+	hi=vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(hi),gain));
+	return vmaxq_s16(vcombine_s16(vqmovn_s32(lo),vqmovn_s32(hi)),vdupq_n_s16(-32767));
+}
+
+static void measure_and_scale_neon(int16_t *samples, int nsamples, int16_t offset, float gain, MSAudioLevels *levels){
+	int i;
+	int32x4_t voffset=vdupq_n_s32(offset);
+	if (levels){
+		LevelsNeon l;
+		reset_levels(levels);
+		levels_neon_init(&l);
+		for(i=0;i+8<=nsamples;i+=8){
+			int16x8_t c=vld1q_s16(samples+i);
+			levels_neon_add(&l,c);
+			if ((i+8)%MEASURE_BLOCK==0) levels_neon_flush_sum(&l,levels);
+			vst1q_s16(samples+i,scale_neon(c,voffset,gain));
+		}
+		levels_neon_store(&l,levels);
+		add_levels_c(samples+i,nsamples-i,levels);
+	}else{
+		for(i=0;i+8<=nsamples;i+=8){
+			vst1q_s16(samples+i,scale_neon(vld1q_s16(samples+i),voffset,gain));
+		}
+	}
+	scale_c(samples+i,nsamples-i,offset,gain);
+}
+
+static float dot_product_neon(const float *a, const float *b, int n){
+	int i;
+	float tmp[4];
+	float32x4_t acc0=vdupq_n_f32(0),acc1=vdupq_n_f32(0);
+	for(i=0;i+8<=n;i+=8){
+		acc0=vmlaq_f32(acc0,vld1q_f32(a+i),vld1q_f32(b+i));
+		acc1=vmlaq_f32(acc1,vld1q_f32(a+i+4),vld1q_f32(b+i+4));
+	}
+	vst1q_f32(tmp,vaddq_f32(acc0,acc1));
+	return tmp[0]+tmp[1]+tmp[2]+tmp[3]+dot_product_c(a+i,b+i,n-i);
+}
+
+static const MSAudioKernels neon_kernels={
+	"neon",
+	accumulate_neon,
+	saturate_neon,
+	saturate_minus_neon,
+	apply_gain_neon,
+	measure_neon,
+	measure_and_scale_neon,
+	dot_product_neon
+};
+
+static int cpu_has_neon(void){
+#ifdef ANDROID
+	return android_getCpuFamily()==ANDROID_CPU_FAMILY_ARM && (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)!=0;
+#else
+	return 1;
+#endif
+}
+
+#endif /*MS_AUDIO_KERNELS_NEON*/
+
+
+static const MSAudioKernels *select_kernels(void){
+#ifdef MS_AUDIO_KERNELS_X86
+	if (cpu_has_avx2()) return &avx2_kernels;
+	if (cpu_has_sse2()) return &sse2_kernels;
+#endif
+#ifdef MS_AUDIO_KERNELS_NEON
+	if (cpu_has_neon()) return &neon_kernels;
+#endif
+	return &generic_kernels;
+}
+
+/*the selection is idempotent, so a concurrent first call is harmless*/
+static const MSAudioKernels *selected_kernels=NULL;
+
+const MSAudioKernels *ms_audio_kernels_get(void){
+	if (selected_kernels==NULL){
+		selected_kernels=select_kernels();
+		ms_message("Using %s audio kernels.",selected_kernels->name);
+	}
+	return selected_kernels;
+}
+
+const MSAudioKernels *ms_audio_kernels_get_generic(void){
+	return &generic_kernels;
+}
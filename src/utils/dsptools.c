@@ -339,7 +339,7 @@ struct kiss_config {
    int N;
 };
 
-void *ms_fft_init(int size)
+static void *kiss_init(int size)
 {
 	struct kiss_config *table;
 	table = (struct kiss_config*)ms_malloc(sizeof(struct kiss_config));
@@ -349,7 +349,7 @@ void *ms_fft_init(int size)
 	return table;
 }
 
-void ms_fft_destroy(void *table)
+static void kiss_destroy(void *table)
 {
 	struct kiss_config *t = (struct kiss_config *)table;
 	kiss_fftr_free(t->forward);
@@ -359,19 +359,20 @@ void ms_fft_destroy(void *table)
 
 #ifdef MS_FIXED_POINT
 
-void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out)
+static void kiss_forward(void *table, const ms_word16_t *in, ms_word16_t *out)
 {
 	int shift;
 	struct kiss_config *t = (struct kiss_config *)table;
-	shift = maximize_range(in, in, 32000, t->N);
+	/*the input is normalized in place and restored afterwards*/
+	shift = maximize_range((ms_word16_t*)in, (ms_word16_t*)in, 32000, t->N);
 	kiss_fftr2(t->forward, in, out);
-	renorm_range(in, in, shift, t->N);
+	renorm_range((ms_word16_t*)in, (ms_word16_t*)in, shift, t->N);
 	renorm_range(out, out, shift, t->N);
 }
 
 #else
 
-void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out)
+static void kiss_forward(void *table, const ms_word16_t *in, ms_word16_t *out)
 {
 	int i;
 	float scale;
@@ -383,8 +384,67 @@ void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out)
 }
 #endif
 
-void ms_ifft(void *table, ms_word16_t *in, ms_word16_t *out)
+static void kiss_backward(void *table, const ms_word16_t *in, ms_word16_t *out)
 {
 	struct kiss_config *t = (struct kiss_config *)table;
 	kiss_fftri2(t->backward, in, out);
 }
+
+static MSFFTBackend kiss_backend={
+	"kiss_fft",
+	kiss_init,
+	kiss_destroy,
+	kiss_forward,
+	kiss_backward
+};
+
+const MSFFTBackend *ms_fft_get_kiss_backend(void)
+{
+	return &kiss_backend;
+}
+
+static const MSFFTBackend *forced_backend = NULL;
+
+void ms_fft_set_backend(const MSFFTBackend *backend)
+{
+	forced_backend = backend;
+}
+
+typedef struct _MSFFT {
+	const MSFFTBackend *backend;
+	void *ctx;
+} MSFFT;
+
+void *ms_fft_init(int size)
+{
+	MSFFT *fft = ms_new0(MSFFT,1);
+	const MSFFTBackend *backend = forced_backend ? forced_backend : ms_fft_get_native_backend();
+	if (backend) {
+		fft->backend = backend;
+		fft->ctx = backend->init(size);
+	}
+	if (fft->ctx == NULL) {
+		fft->backend = &kiss_backend;
+		fft->ctx = kiss_backend.init(size);
+	}
+	return fft;
+}
+
+void ms_fft_destroy(void *table)
+{
+	MSFFT *fft = (MSFFT *)table;
+	fft->backend->destroy(fft->ctx);
+	ms_free(fft);
+}
+
+void ms_fft(void *table, ms_word16_t *in, ms_word16_t *out)
+{
+	MSFFT *fft = (MSFFT *)table;
+	fft->backend->forward(fft->ctx, in, out);
+}
+
+void ms_ifft(void *table, ms_word16_t *in, ms_word16_t *out)
+{
+	MSFFT *fft = (MSFFT *)table;
+	fft->backend->backward(fft->ctx, in, out);
+}
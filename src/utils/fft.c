@@ -0,0 +1,425 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/dsptools.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * Native real FFT for power of two sizes, in floating point builds only.
+ * A real transform of size n is computed as a complex transform of size m=n/2 over the even/odd samples
+ * taken as real/imaginary parts, followed by a split pass that separates the two interleaved spectra.
+ * The complex transform is a Stockham autosort FFT: radix-4 stages, plus one radix-2 stage when log2(m) is odd.
+ * Each stage reads one buffer and writes the other, with contiguous accesses and no bit reversal pass.
+ *
+ * Plans (twiddle tables) are read-only once computed: they are shared by all the users of the same size, and by
+ * both directions. Each handle only owns its work buffers.
+ */
+
+#ifndef MS_FIXED_POINT
+
+#define FFT_MIN_SIZE 16
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_SIMD
+typedef __m128 v4f;
+#define V_LOAD(p)		_mm_loadu_ps(p)
+#define V_STORE(p,v)		_mm_storeu_ps(p,v)
+#define V_STORE_LO(p,v)		_mm_storel_pi((__m64*)(p),v)
+#define V_STORE_HI(p,v)		_mm_storeh_pi((__m64*)(p),v)
+#define V_LOAD_CPLX(p)		_mm_castpd_ps(_mm_load1_pd((const double*)(p)))
+#define V_SET(a,b,c,d)		_mm_setr_ps(a,b,c,d)
+#define V_ADD			_mm_add_ps
+#define V_SUB			_mm_sub_ps
+#define V_MUL			_mm_mul_ps
+#define V_SWAP(v)		_mm_shuffle_ps(v,v,_MM_SHUFFLE(2,3,0,1))
+#define V_DUP_RE(v)		_mm_shuffle_ps(v,v,_MM_SHUFFLE(2,2,0,0))
+#define V_DUP_IM(v)		_mm_shuffle_ps(v,v,_MM_SHUFFLE(3,3,1,1))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FFT_SIMD
+typedef float32x4_t v4f;
+#define V_LOAD(p)		vld1q_f32(p)
+#define V_STORE(p,v)		vst1q_f32(p,v)
+#define V_STORE_LO(p,v)		vst1_f32(p,vget_low_f32(v))
+#define V_STORE_HI(p,v)		vst1_f32(p,vget_high_f32(v))
+#define V_LOAD_CPLX(p)		vcombine_f32(vld1_f32(p),vld1_f32(p))
+static inline v4f v_set(float a, float b, float c, float d){
+	float tmp[4]={a,b,c,d};
+	return vld1q_f32(tmp);
+}
+#define V_SET(a,b,c,d)		v_set(a,b,c,d)
+#define V_ADD			vaddq_f32
+#define V_SUB			vsubq_f32
+#define V_MUL			vmulq_f32
+#define V_SWAP(v)		vrev64q_f32(v)
+#define V_DUP_RE(v)		vtrnq_f32(v,v).val[0]
+#define V_DUP_IM(v)		vtrnq_f32(v,v).val[1]
+#endif
+
+#ifdef FFT_SIMD
+/*
+ * Two interleaved complex numbers per vector.
+ * sg is (-1,1,-1,1) for the forward transform, (1,-1,1,-1) for the backward one: v_cmul() then multiplies by w
+ * or by its conjugate, and v_mulj() multiplies by j or by -j.
+ */
+static inline v4f v_cmul(v4f a, v4f w, v4f sg){
+	return V_ADD(V_MUL(a,V_DUP_RE(w)),V_MUL(V_MUL(V_SWAP(a),V_DUP_IM(w)),sg));
+}
+
+static inline v4f v_mulj(v4f a, v4f sg){
+	return V_MUL(V_SWAP(a),sg);
+}
+#endif
+
+typedef struct _FFTPlan{
+	int n; /*real size*/
+	int m; /*complex size, n/2*/
+	float *twiddles; /*for each radix-4 stage of length len: w^p, w^2p, w^3p for p in [0,len/4), w=exp(-2*i*pi/len)*/
+	float *split; /*exp(-2*i*pi*k/n) for k in [0,m/2]*/
+	int refcount;
+} FFTPlan;
+
+typedef struct _NativeFFT{
+	FFTPlan *plan;
+	float *work[2];
+} NativeFFT;
+
+static MSList *plans=NULL;
+static ms_mutex_t plans_lock;
+static bool_t plans_initialized=FALSE;
+
+static FFTPlan *fft_plan_new(int n){
+	FFTPlan *plan=ms_new0(FFTPlan,1);
+	int len,p,k,ntwiddles=0;
+	float *tw;
+
+	plan->n=n;
+	plan->m=n/2;
+	for(len=plan->m;len>=4;len/=4) ntwiddles+=3*(len/4);
+	plan->twiddles=ms_new(float,2*ntwiddles+2);
+	tw=plan->twiddles;
+	for(len=plan->m;len>=4;len/=4){
+		int n1=len/4;
+		for(k=1;k<=3;++k){
+			for(p=0;p<n1;++p){
+				double theta=-2*M_PI*k*p/len;
+				*tw++=(float)cos(theta);
+				*tw++=(float)sin(theta);
+			}
+		}
+	}
+	plan->split=ms_new(float,2*(plan->m/2+1));
+	for(k=0;k<=plan->m/2;++k){
+		double theta=-2*M_PI*k/n;
+		plan->split[2*k]=(float)cos(theta);
+		plan->split[2*k+1]=(float)sin(theta);
+	}
+	ms_message("MSFFT: new plan for size %i",n);
+	return plan;
+}
+
+static void fft_plan_destroy(FFTPlan *plan){
+	ms_free(plan->twiddles);
+	ms_free(plan->split);
+	ms_free(plan);
+}
+
+void ms_fft_plans_init(void){
+	if (plans_initialized) return;
+	ms_mutex_init(&plans_lock,NULL);
+	plans_initialized=TRUE;
+}
+
+void ms_fft_plans_uninit(void){
+	MSList *elem;
+	if (!plans_initialized) return;
+	for(elem=plans;elem!=NULL;elem=elem->next){
+		FFTPlan *plan=(FFTPlan*)elem->data;
+		if (plan->refcount>0) ms_warning("MSFFT: plan for size %i still in use.",plan->n);
+		else fft_plan_destroy(plan);
+	}
+	plans=ms_list_free(plans);
+	ms_mutex_destroy(&plans_lock);
+	plans_initialized=FALSE;
+}
+
+/*plans are kept in the cache when no longer used, as the same sizes are requested again and again*/
+static FFTPlan *fft_plan_get(int n){
+	FFTPlan *plan=NULL;
+	MSList *elem;
+	if (!plans_initialized){
+		plan=fft_plan_new(n);
+		plan->refcount=1;
+		return plan;
+	}
+	ms_mutex_lock(&plans_lock);
+	for(elem=plans;elem!=NULL;elem=elem->next){
+		FFTPlan *it=(FFTPlan*)elem->data;
+		if (it->n==n){
+			plan=it;
+			break;
+		}
+	}
+	if (plan==NULL){
+		plan=fft_plan_new(n);
+		plans=ms_list_append(plans,plan);
+	}
+	plan->refcount++;
+	ms_mutex_unlock(&plans_lock);
+	return plan;
+}
+
+/*plans no longer in the cache, because created without it or left in use by ms_fft_plans_uninit(), are destroyed with
+ their last user*/
+static void fft_plan_release(FFTPlan *plan){
+	if (!plans_initialized){
+		if (--plan->refcount==0) fft_plan_destroy(plan);
+		return;
+	}
+	ms_mutex_lock(&plans_lock);
+	if (--plan->refcount==0 && ms_list_find(plans,plan)==NULL) fft_plan_destroy(plan);
+	ms_mutex_unlock(&plans_lock);
+}
+
+/*
+ * One radix-4 stage: x and y are made of len groups of s complex values, the group p+k*len/4 of x giving
+ * the groups 4*p+k of y.
+ */
+static void fft_radix4_stage(int len, int s, const float *tw, const float *x, float *y, int inverse){
+	int n1=len/4;
+	const float *tw1=tw, *tw2=tw+2*n1, *tw3=tw+4*n1;
+	float sg=inverse ? -1 : 1;
+	int p=0,q;
+#ifdef FFT_SIMD
+	v4f vsg=inverse ? V_SET(1,-1,1,-1) : V_SET(-1,1,-1,1);
+	if (s==1){
+		/*first stage: two consecutive values of p at once, each with its own twiddles*/
+		for(;p+1<n1;p+=2){
+			v4f a=V_LOAD(x+2*p), b=V_LOAD(x+2*(p+n1)), c=V_LOAD(x+2*(p+2*n1)), d=V_LOAD(x+2*(p+3*n1));
+			v4f apc=V_ADD(a,c), amc=V_SUB(a,c), bpd=V_ADD(b,d), jbmd=v_mulj(V_SUB(b,d),vsg);
+			v4f y0=V_ADD(apc,bpd);
+			v4f y1=v_cmul(V_SUB(amc,jbmd),V_LOAD(tw1+2*p),vsg);
+			v4f y2=v_cmul(V_SUB(apc,bpd),V_LOAD(tw2+2*p),vsg);
+			v4f y3=v_cmul(V_ADD(amc,jbmd),V_LOAD(tw3+2*p),vsg);
+			float *out=y+8*p;
+			V_STORE_LO(out,y0); V_STORE_LO(out+2,y1); V_STORE_LO(out+4,y2); V_STORE_LO(out+6,y3);
+			V_STORE_HI(out+8,y0); V_STORE_HI(out+10,y1); V_STORE_HI(out+12,y2); V_STORE_HI(out+14,y3);
+		}
+	}else{
+		/*the s values of a group share the same twiddles*/
+		for(;p<n1;++p){
+			v4f w1=V_LOAD_CPLX(tw1+2*p), w2=V_LOAD_CPLX(tw2+2*p), w3=V_LOAD_CPLX(tw3+2*p);
+			const float *in=x+2*s*p;
+			float *out=y+8*s*p;
+			for(q=0;q+1<s;q+=2){
+				v4f a=V_LOAD(in+2*q), b=V_LOAD(in+2*(q+s*n1)), c=V_LOAD(in+2*(q+2*s*n1)), d=V_LOAD(in+2*(q+3*s*n1));
+				v4f apc=V_ADD(a,c), amc=V_SUB(a,c), bpd=V_ADD(b,d), jbmd=v_mulj(V_SUB(b,d),vsg);
+				V_STORE(out+2*q,V_ADD(apc,bpd));
+				V_STORE(out+2*(q+s),v_cmul(V_SUB(amc,jbmd),w1,vsg));
+				V_STORE(out+2*(q+2*s),v_cmul(V_SUB(apc,bpd),w2,vsg));
+				V_STORE(out+2*(q+3*s),v_cmul(V_ADD(amc,jbmd),w3,vsg));
+			}
+		}
+		return;
+	}
+#endif
+	for(;p<n1;++p){
+		float w1r=tw1[2*p], w1i=sg*tw1[2*p+1];
+		float w2r=tw2[2*p], w2i=sg*tw2[2*p+1];
+		float w3r=tw3[2*p], w3i=sg*tw3[2*p+1];
+		for(q=0;q<s;++q){
+			const float *a=x+2*(q+s*p), *b=a+2*s*n1, *c=b+2*s*n1, *d=c+2*s*n1;
+			float *out=y+2*(q+4*s*p);
+			float apcr=a[0]+c[0], apci=a[1]+c[1], amcr=a[0]-c[0], amci=a[1]-c[1];
+			float bpdr=b[0]+d[0], bpdi=b[1]+d[1];
+			/*j*(b-d), or -j*(b-d) for the backward transform*/
+			float jbmdr=-sg*(b[1]-d[1]), jbmdi=sg*(b[0]-d[0]);
+			float tr,ti;
+			out[0]=apcr+bpdr;
+			out[1]=apci+bpdi;
+			tr=amcr-jbmdr; ti=amci-jbmdi;
+			out[2*s]=tr*w1r-ti*w1i;
+			out[2*s+1]=tr*w1i+ti*w1r;
+			tr=apcr-bpdr; ti=apci-bpdi;
+			out[4*s]=tr*w2r-ti*w2i;
+			out[4*s+1]=tr*w2i+ti*w2r;
+			tr=amcr+jbmdr; ti=amci+jbmdi;
+			out[6*s]=tr*w3r-ti*w3i;
+			out[6*s+1]=tr*w3i+ti*w3r;
+		}
+	}
+}
+
+/*last stage when log2(m) is odd: a single group of two values of s complex numbers*/
+static void fft_radix2_stage(int s, const float *x, float *y){
+	int q=0;
+#ifdef FFT_SIMD
+	for(;q+1<s;q+=2){
+		v4f a=V_LOAD(x+2*q), b=V_LOAD(x+2*(q+s));
+		V_STORE(y+2*q,V_ADD(a,b));
+		V_STORE(y+2*(q+s),V_SUB(a,b));
+	}
+#endif
+	for(;q<s;++q){
+		float ar=x[2*q], ai=x[2*q+1], br=x[2*(q+s)], bi=x[2*(q+s)+1];
+		y[2*q]=ar+br;
+		y[2*q+1]=ai+bi;
+		y[2*(q+s)]=ar-br;
+		y[2*(q+s)+1]=ai-bi;
+	}
+}
+
+/*
+ * Unscaled complex transform of size m. The stages alternate between the two work buffers, the last one writing
+ * into dest if not NULL. Returns the buffer holding the result. in is only read by the first stage.
+ */
+static float *fft_complex(NativeFFT *obj, const float *in, float *dest, int inverse){
+	const FFTPlan *plan=obj->plan;
+	const float *tw=plan->twiddles;
+	const float *src=in;
+	float *dst=NULL;
+	int len=plan->m, s=1;
+
+	while(len>1){
+		bool_t last=(len==2 || len==4);
+		if (last && dest) dst=dest;
+		else dst=(src==obj->work[0]) ? obj->work[1] : obj->work[0];
+		if (len>=4){
+			fft_radix4_stage(len,s,tw,src,dst,inverse);
+			tw+=6*(len/4);
+			len/=4;
+			s*=4;
+		}else{
+			fft_radix2_stage(s,src,dst);
+			len=1;
+		}
+		src=dst;
+	}
+	return dst;
+}
+
+static void *native_fft_init(int size){
+	NativeFFT *obj;
+	if (size<FFT_MIN_SIZE || (size & (size-1))!=0) return NULL;
+	obj=ms_new0(NativeFFT,1);
+	obj->plan=fft_plan_get(size);
+	obj->work[0]=ms_new(float,size);
+	obj->work[1]=ms_new(float,size);
+	return obj;
+}
+
+static void native_fft_destroy(void *ctx){
+	NativeFFT *obj=(NativeFFT*)ctx;
+	fft_plan_release(obj->plan);
+	ms_free(obj->work[0]);
+	ms_free(obj->work[1]);
+	ms_free(obj);
+}
+
+/*
+ * With z[k]=x[2k]+i*x[2k+1] and Z its transform, the spectra of the even and odd samples are
+ * E[k]=(Z[k]+conj(Z[m-k]))/2 and O[k]=(Z[k]-conj(Z[m-k]))/(2i), and X[k]=E[k]+exp(-2*i*pi*k/n)*O[k].
+ * X[m-k] is then conj(E[k]-exp(-2*i*pi*k/n)*O[k]), so both halves are computed in the same iteration.
+ */
+static void native_fft_forward(void *ctx, const ms_word16_t *in, ms_word16_t *out){
+	NativeFFT *obj=(NativeFFT*)ctx;
+	int n=obj->plan->n, m=obj->plan->m;
+	const float *w=obj->plan->split;
+	const float *z=fft_complex(obj,in,NULL,FALSE);
+	float scale=1.0f/n, hscale=0.5f/n;
+	int k;
+
+	out[0]=(z[0]+z[1])*scale;
+	out[n-1]=(z[0]-z[1])*scale;
+	for(k=1;k<=m/2;++k){
+		int j=m-k;
+		float er=z[2*k]+z[2*j], ei=z[2*k+1]-z[2*j+1];
+		float o_r=z[2*k+1]+z[2*j+1], o_i=z[2*j]-z[2*k];
+		float tr=o_r*w[2*k]-o_i*w[2*k+1], ti=o_r*w[2*k+1]+o_i*w[2*k];
+		out[2*k-1]=(er+tr)*hscale;
+		out[2*k]=(ei+ti)*hscale;
+		if (j!=k){
+			out[2*j-1]=(er-tr)*hscale;
+			out[2*j]=(ti-ei)*hscale;
+		}
+	}
+}
+
+/*inverse of the split pass above, scaled by two so that the result matches the unscaled kiss_fftri()*/
+static void native_fft_backward(void *ctx, const ms_word16_t *in, ms_word16_t *out){
+	NativeFFT *obj=(NativeFFT*)ctx;
+	int n=obj->plan->n, m=obj->plan->m;
+	const float *w=obj->plan->split;
+	float *z=obj->work[0];
+	int k;
+
+	z[0]=in[0]+in[n-1];
+	z[1]=in[0]-in[n-1];
+	for(k=1;k<=m/2;++k){
+		int j=m-k;
+		float er=in[2*k-1]+in[2*j-1], ei=in[2*k]-in[2*j];
+		float dr=in[2*k-1]-in[2*j-1], di=in[2*k]+in[2*j];
+		/*2*O[k]: the difference multiplied by conj(exp(-2*i*pi*k/n))*/
+		float o_r=dr*w[2*k]+di*w[2*k+1], o_i=di*w[2*k]-dr*w[2*k+1];
+		z[2*k]=er-o_i;
+		z[2*k+1]=ei+o_r;
+		if (j!=k){
+			z[2*j]=er+o_i;
+			z[2*j+1]=o_r-ei;
+		}
+	}
+	fft_complex(obj,z,out,TRUE);
+}
+
+static MSFFTBackend native_backend={
+	"native",
+	native_fft_init,
+	native_fft_destroy,
+	native_fft_forward,
+	native_fft_backward
+};
+
+const MSFFTBackend *ms_fft_get_native_backend(void){
+	return &native_backend;
+}
+
+#else
+
+void ms_fft_plans_init(void){
+}
+
+void ms_fft_plans_uninit(void){
+}
+
+/*there is no native fixed point implementation: kiss_fft is always used*/
+const MSFFTBackend *ms_fft_get_native_backend(void){
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "filecache.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifndef WIN32
+#define USE_MMAP
+#include <sys/mman.h>
+#endif
+
+typedef struct _CachedFile{
+	char *path;
+	uint8_t *data;
+	int size;
+	time_t mtime;
+	int refcount; /*number of messages handed out and not freed yet*/
+	bool_t mapped; /*otherwise the data was read in memory*/
+	bool_t stale; /*the file was modified, the entry is no longer returned*/
+} CachedFile;
+
+/*the list is ordered from the least to the most recently requested file*/
+static MSList *cached_files=NULL;
+static int unused_size=0;
+static ms_mutex_t cache_lock;
+static bool_t cache_initialized=FALSE;
+
+static uint8_t *read_file(int fd, int size){
+	uint8_t *data=(uint8_t*)ms_malloc(size);
+	int pos=0;
+	while(pos<size){
+		int err=read(fd,data+pos,size-pos);
+		if (err<=0){
+			ms_free(data);
+			return NULL;
+		}
+		pos+=err;
+	}
+	return data;
+}
+
+static CachedFile *cached_file_new(const char *path, const struct stat *st){
+	CachedFile *cf;
+	uint8_t *data=NULL;
+	bool_t mapped=FALSE;
+	int fd=open(path,O_RDONLY|O_BINARY);
+	if (fd==-1) return NULL;
+#ifdef USE_MMAP
+	data=(uint8_t*)mmap(NULL,st->st_size,PROT_READ,MAP_SHARED,fd,0);
+	if (data==(uint8_t*)MAP_FAILED) data=NULL;
+	else mapped=TRUE;
+#endif
+	if (data==NULL) data=read_file(fd,st->st_size);
+	close(fd);
+	if (data==NULL){
+		ms_warning("MSFileCache: cannot load %s",path);
+		return NULL;
+	}
+	cf=ms_new0(CachedFile,1);
+	cf->path=ms_strdup(path);
+	cf->data=data;
+	cf->size=st->st_size;
+	cf->mtime=st->st_mtime;
+	cf->mapped=mapped;
+	return cf;
+}
+
+static void cached_file_destroy(CachedFile *cf){
+#ifdef USE_MMAP
+	if (cf->mapped) munmap(cf->data,cf->size);
+	else
+#endif
+	ms_free(cf->data);
+	ms_free(cf->path);
+	ms_free(cf);
+}
+
+/*unmaps the least recently used files until the unused ones fit in the budget*/
+static void cache_trim(void){
+	MSList *elem=cached_files;
+	while(elem!=NULL && unused_size>MS_FILE_CACHE_MAX_UNUSED_SIZE){
+		CachedFile *cf=(CachedFile*)elem->data;
+		MSList *next=elem->next;
+		if (cf->refcount==0){
+			unused_size-=cf->size;
+			cached_files=ms_list_remove_link(cached_files,elem);
+			cached_file_destroy(cf);
+		}
+		elem=next;
+	}
+}
+
+static void cached_file_release(void *base){
+	MSList *elem;
+	if (!cache_initialized) return;
+	ms_mutex_lock(&cache_lock);
+	for(elem=cached_files;elem!=NULL;elem=elem->next){
+		CachedFile *cf=(CachedFile*)elem->data;
+		if (cf->data!=base) continue;
+		cf->refcount--;
+		if (cf->refcount==0){
+			if (cf->stale){
+				cached_files=ms_list_remove_link(cached_files,elem);
+				cached_file_destroy(cf);
+			}else{
+				unused_size+=cf->size;
+				cache_trim();
+			}
+		}
+		break;
+	}
+	ms_mutex_unlock(&cache_lock);
+}
+
+void ms_file_cache_init(void){
+	if (cache_initialized) return;
+	ms_mutex_init(&cache_lock,NULL);
+	cache_initialized=TRUE;
+}
+
+void ms_file_cache_uninit(void){
+	MSList *elem;
+	if (!cache_initialized) return;
+	for(elem=cached_files;elem!=NULL;elem=elem->next){
+		CachedFile *cf=(CachedFile*)elem->data;
+		if (cf->refcount>0) ms_warning("MSFileCache: %s still in use.",cf->path);
+		else cached_file_destroy(cf);
+	}
+	cached_files=ms_list_free(cached_files);
+	unused_size=0;
+	ms_mutex_destroy(&cache_lock);
+	cache_initialized=FALSE;
+}
+
+mblk_t *ms_file_cache_get(const char *path){
+	struct stat st;
+	CachedFile *cf=NULL;
+	MSList *elem;
+	mblk_t *m;
+
+	if (!cache_initialized) return NULL;
+	/*a single system call to detect modifications, instead of opening and reading the file*/
+	if (stat(path,&st)!=0 || st.st_size==0 || st.st_size>MS_FILE_CACHE_MAX_FILE_SIZE) return NULL;
+	ms_mutex_lock(&cache_lock);
+	for(elem=cached_files;elem!=NULL;elem=elem->next){
+		CachedFile *it=(CachedFile*)elem->data;
+		if (it->stale || strcmp(it->path,path)!=0) continue;
+		if (it->size==st.st_size && it->mtime==st.st_mtime){
+			cf=it;
+			cached_files=ms_list_remove_link(cached_files,elem);
+		}else{
+			ms_message("MSFileCache: %s was modified, loading it again.",path);
+			it->stale=TRUE;
+			if (it->refcount==0){
+				unused_size-=it->size;
+				cached_files=ms_list_remove_link(cached_files,elem);
+				cached_file_destroy(it);
+			}
+		}
+		break;
+	}
+	if (cf==NULL){
+		/*loaded under the lock so that concurrent requests of the same prompt load it only once*/
+		cf=cached_file_new(path,&st);
+		if (cf==NULL){
+			ms_mutex_unlock(&cache_lock);
+			return NULL;
+		}
+	}else if (cf->refcount==0){
+		unused_size-=cf->size;
+	}
+	cached_files=ms_list_append(cached_files,cf);
+	cf->refcount++;
+	ms_mutex_unlock(&cache_lock);
+
+	m=esballoc(cf->data,cf->size,0,cached_file_release);
+	m->b_wptr+=cf->size;
+	return m;
+}
@@ -0,0 +1,47 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef filecache_h
+#define filecache_h
+
+#include "mediastreamer2/mscommon.h"
+
+/*
+ * Process-wide cache of read-only files, memory mapped where the system allows it, otherwise loaded in memory.
+ * It is meant for the prompts and tones played again and again by many players at once: each file is mapped once,
+ * and its content is handed out as messages pointing directly to the mapping.
+ * A file is checked for modification at each request, and a modified file is mapped again. The files no longer
+ * used remain cached up to MS_FILE_CACHE_MAX_UNUSED_SIZE bytes, the least recently used being unmapped first.
+ */
+
+/*larger files are not cached, they are better read progressively*/
+#define MS_FILE_CACHE_MAX_FILE_SIZE (16*1024*1024)
+#define MS_FILE_CACHE_MAX_UNUSED_SIZE (64*1024*1024)
+
+/*called by ms_voip_init() and ms_voip_exit()*/
+void ms_file_cache_init(void);
+void ms_file_cache_uninit(void);
+
+/*returns a message covering the whole content of the file, or NULL if the file cannot be cached, in which case the
+ caller has to read it by itself. The content is shared: the message and its duplicates are read-only.
+ The file remains mapped until the message and all its duplicates are freed. As the reference count of the
+ duplicates is not atomic, they must not be handed to other threads: copy the data out instead*/
+mblk_t *ms_file_cache_get(const char *path);
+
+#endif
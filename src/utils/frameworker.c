@@ -0,0 +1,245 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "frameworker.h"
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#define memory_barrier() MemoryBarrier()
+#else
+#define memory_barrier() __sync_synchronize()
+#endif
+
+/*
+ * Single producer/single consumer ring: head is only written by the producer, tail by the consumer.
+ * The barriers order the accesses to a slot with respect to the publication of the index.
+ */
+typedef struct _FrameRing{
+	mblk_t *slots[MS_FRAME_WORKER_MAX_PENDING];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+}FrameRing;
+
+static bool_t frame_ring_put(FrameRing *r, mblk_t *m){
+	unsigned int head=r->head;
+	if (head-r->tail==MS_FRAME_WORKER_MAX_PENDING) return FALSE;
+	r->slots[head%MS_FRAME_WORKER_MAX_PENDING]=m;
+	memory_barrier();
+	r->head=head+1;
+	return TRUE;
+}
+
+static mblk_t *frame_ring_get(FrameRing *r){
+	unsigned int tail=r->tail;
+	mblk_t *m;
+	if (tail==r->head) return NULL;
+	memory_barrier();
+	m=r->slots[tail%MS_FRAME_WORKER_MAX_PENDING];
+	memory_barrier();
+	r->tail=tail+1;
+	return m;
+}
+
+static bool_t frame_ring_empty(FrameRing *r){
+	return r->tail==r->head;
+}
+
+static void frame_ring_flush(FrameRing *r){
+	mblk_t *m;
+	while((m=frame_ring_get(r))!=NULL) freemsg(m);
+}
+
+struct _MSFrameWorker{
+	FrameRing jobs;
+	FrameRing results;
+	MSFrameWorkerFunc func;
+	void *data;
+	ms_thread_t thread;
+	/*only used to sleep when a ring is empty and to be woken up, and to sample the load*/
+	ms_mutex_t lock;
+	ms_cond_t job_cond;
+	ms_cond_t result_cond;
+	volatile bool_t worker_waiting;
+	volatile bool_t owner_waiting;
+	volatile bool_t running;
+	volatile uint32_t busy_us; /*written by the worker only, wraps around*/
+	uint32_t last_busy_us; /*protected by the lock, as the load may be requested from any thread*/
+	uint64_t last_load_time;
+	int pending;
+};
+
+static uint64_t get_time_us(void){
+	MSTimeSpec ts;
+	ms_get_cur_time(&ts);
+	return (ts.tv_sec*1000000LL)+(ts.tv_nsec/1000);
+}
+
+/*
+ * The waiting side raises its flag before checking the ring one last time, the other side publishes in the ring
+ * before checking the flag: with the barriers in-between, at least one of them sees the other.
+ */
+static void wake_up(MSFrameWorker *w, volatile bool_t *waiting, ms_cond_t *cond){
+	memory_barrier();
+	if (*waiting){
+		ms_mutex_lock(&w->lock);
+		ms_cond_signal(cond);
+		ms_mutex_unlock(&w->lock);
+	}
+}
+
+static void wait_for(MSFrameWorker *w, volatile bool_t *waiting, ms_cond_t *cond, FrameRing *r){
+	ms_mutex_lock(&w->lock);
+	*waiting=TRUE;
+	memory_barrier();
+	if (w->running && frame_ring_empty(r)) ms_cond_wait(cond,&w->lock);
+	*waiting=FALSE;
+	ms_mutex_unlock(&w->lock);
+}
+
+static void *frame_worker_run(void *arg){
+	MSFrameWorker *w=(MSFrameWorker*)arg;
+	while(w->running){
+		mblk_t *job=frame_ring_get(&w->jobs);
+		mblk_t *result;
+		uint64_t start;
+		if (job==NULL){
+			wait_for(w,&w->worker_waiting,&w->job_cond,&w->jobs);
+			continue;
+		}
+		start=get_time_us();
+		result=w->func(w->data,job);
+		w->busy_us+=(uint32_t)(get_time_us()-start);
+		/*cannot be full: there are never more than MS_FRAME_WORKER_MAX_PENDING jobs and results altogether*/
+		frame_ring_put(&w->results,result);
+		wake_up(w,&w->owner_waiting,&w->result_cond);
+	}
+	return NULL;
+}
+
+MSFrameWorker *ms_frame_worker_new(MSFrameWorkerFunc func, void *data){
+	MSFrameWorker *w=ms_new0(MSFrameWorker,1);
+	w->func=func;
+	w->data=data;
+	ms_mutex_init(&w->lock,NULL);
+	ms_cond_init(&w->job_cond,NULL);
+	ms_cond_init(&w->result_cond,NULL);
+	w->running=TRUE;
+	w->last_load_time=get_time_us();
+	ms_thread_create(&w->thread,NULL,frame_worker_run,w);
+	return w;
+}
+
+void ms_frame_worker_destroy(MSFrameWorker *w){
+	ms_mutex_lock(&w->lock);
+	w->running=FALSE;
+	ms_cond_signal(&w->job_cond);
+	ms_mutex_unlock(&w->lock);
+	ms_thread_join(w->thread,NULL);
+	frame_ring_flush(&w->jobs);
+	frame_ring_flush(&w->results);
+	ms_cond_destroy(&w->job_cond);
+	ms_cond_destroy(&w->result_cond);
+	ms_mutex_destroy(&w->lock);
+	ms_free(w);
+}
+
+int ms_frame_worker_submit(MSFrameWorker *w, mblk_t *job){
+	if (w->pending>=MS_FRAME_WORKER_MAX_PENDING) return -1;
+	frame_ring_put(&w->jobs,job);
+	w->pending++;
+	wake_up(w,&w->worker_waiting,&w->job_cond);
+	return 0;
+}
+
+mblk_t *ms_frame_worker_get(MSFrameWorker *w, bool_t wait){
+	mblk_t *m;
+	if (w->pending==0) return NULL;
+	while((m=frame_ring_get(&w->results))==NULL){
+		if (!wait) return NULL;
+		wait_for(w,&w->owner_waiting,&w->result_cond,&w->results);
+	}
+	w->pending--;
+	return m;
+}
+
+int ms_frame_worker_get_pending(MSFrameWorker *w){
+	return w->pending;
+}
+
+float ms_frame_worker_get_load(MSFrameWorker *w){
+	uint64_t now;
+	uint32_t busy;
+	float load=0;
+	ms_mutex_lock(&w->lock);
+	now=get_time_us();
+	busy=w->busy_us;
+	if (now>w->last_load_time)
+		load=100.0f*(float)(uint32_t)(busy-w->last_busy_us)/(float)(now-w->last_load_time);
+	w->last_busy_us=busy;
+	w->last_load_time=now;
+	ms_mutex_unlock(&w->lock);
+	return load;
+}
+
+void ms_frame_runner_init(MSFrameRunner *r, MSFrameWorkerFunc func, void *data){
+	r->func=func;
+	r->data=data;
+	r->worker=NULL;
+	r->depth=0;
+}
+
+void ms_frame_runner_start_async(MSFrameRunner *r, int depth){
+	if (r->worker!=NULL) return;
+	r->depth=MIN(depth,MS_FRAME_WORKER_MAX_PENDING-1);
+	r->worker=ms_frame_worker_new(r->func,r->data);
+}
+
+void ms_frame_runner_stop(MSFrameRunner *r){
+	if (r->worker==NULL) return;
+	ms_frame_worker_destroy(r->worker);
+	r->worker=NULL;
+	r->depth=0;
+}
+
+void ms_frame_runner_submit(MSFrameRunner *r, mblk_t *job, MSQueue *results){
+	if (r->worker==NULL){
+		ms_queue_put(results,r->func(r->data,job));
+		return;
+	}
+	while(ms_frame_worker_submit(r->worker,job)!=0){
+		/*the worker is far behind, wait for it*/
+		ms_queue_put(results,ms_frame_worker_get(r->worker,TRUE));
+	}
+}
+
+void ms_frame_runner_collect(MSFrameRunner *r, MSQueue *results, bool_t flush){
+	int keep=flush ? 0 : r->depth;
+	if (r->worker==NULL) return;
+	while(ms_frame_worker_get_pending(r->worker)>keep){
+		ms_queue_put(results,ms_frame_worker_get(r->worker,TRUE));
+	}
+}
+
+float ms_frame_runner_get_load(MSFrameRunner *r){
+	return r->worker ? ms_frame_worker_get_load(r->worker) : 0;
+}
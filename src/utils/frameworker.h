@@ -0,0 +1,87 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef frameworker_h
+#define frameworker_h
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
+
+/*
+ * Runs a processing function on frames in a dedicated thread, so that filters can take expensive processing off
+ * the ticker thread. Jobs and results go through lock-free single producer/single consumer rings: submitting a job
+ * and getting a result never block, except when explicitly waiting for a result.
+ * Results are returned in the order of the jobs. All the functions but the processing one are called from the
+ * same thread, normally the ticker's.
+ */
+
+#define MS_FRAME_WORKER_MAX_PENDING 64
+
+typedef struct _MSFrameWorker MSFrameWorker;
+
+/*takes ownership of the job, returns the result*/
+typedef mblk_t *(*MSFrameWorkerFunc)(void *data, mblk_t *job);
+
+MSFrameWorker *ms_frame_worker_new(MSFrameWorkerFunc func, void *data);
+
+/*stops the thread, pending jobs and results are dropped*/
+void ms_frame_worker_destroy(MSFrameWorker *w);
+
+/*returns -1 if MS_FRAME_WORKER_MAX_PENDING jobs are already pending, in which case the job is not consumed*/
+int ms_frame_worker_submit(MSFrameWorker *w, mblk_t *job);
+
+/*returns the oldest result, or NULL if it is not ready and wait is FALSE, or if nothing is pending*/
+mblk_t *ms_frame_worker_get(MSFrameWorker *w, bool_t wait);
+
+/*number of jobs submitted whose result was not retrieved yet*/
+int ms_frame_worker_get_pending(MSFrameWorker *w);
+
+/*percentage of time spent in the processing function since the previous call, may be called from any thread*/
+float ms_frame_worker_get_load(MSFrameWorker *w);
+
+/*
+ * Runs the processing function of a filter either inline, or through a MSFrameWorker once started asynchronously,
+ * so that the filter does not have to care: it submits its jobs and collects the results at each tick.
+ */
+typedef struct _MSFrameRunner{
+	MSFrameWorkerFunc func;
+	void *data;
+	MSFrameWorker *worker; /*NULL when running inline*/
+	int depth; /*results left in the worker at each tick*/
+}MSFrameRunner;
+
+void ms_frame_runner_init(MSFrameRunner *r, MSFrameWorkerFunc func, void *data);
+
+/*starts the worker thread. depth results are left in it at each ms_frame_runner_collect(), which delays them by as
+ many jobs*/
+void ms_frame_runner_start_async(MSFrameRunner *r, int depth);
+
+/*goes back to inline processing, pending jobs and results are dropped*/
+void ms_frame_runner_stop(MSFrameRunner *r);
+
+/*the result is put in the queue right away when running inline, otherwise by a later call*/
+void ms_frame_runner_submit(MSFrameRunner *r, mblk_t *job, MSQueue *results);
+
+/*puts the results in the queue, but the last depth ones unless flush is TRUE*/
+void ms_frame_runner_collect(MSFrameRunner *r, MSQueue *results, bool_t flush);
+
+/*load of the worker thread as ms_frame_worker_get_load(), 0 when running inline*/
+float ms_frame_runner_get_load(MSFrameRunner *r);
+
+#endif
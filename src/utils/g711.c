@@ -0,0 +1,223 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/msqueue.h"
+#include "mediastreamer2/mscodecutils.h"
+#include "g711common.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define G711_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define G711_NEON
+#endif
+
+/*
+ * The A-law code of a sample only depends on its sign and on the 12 most significant bits of its magnitude.
+ * The mu-law code depends on the sign and on magnitude>>2, because of the 0x84 bias.
+ * Both encoding tables are small enough (8 KB and 16 KB) to stay in the L1 cache.
+ */
+#define ALAW_ENC_BITS 12
+#define ULAW_ENC_BITS 13
+
+static uint8_t alaw_enc_table[2<<ALAW_ENC_BITS];
+static uint8_t ulaw_enc_table[2<<ULAW_ENC_BITS];
+static int16_t alaw_dec_table[256];
+static int16_t ulaw_dec_table[256];
+static bool_t tables_ready=FALSE;
+
+void g711_init_tables(void){
+	int i;
+	if (tables_ready) return;
+	/*the low bit of negative samples is set so that zero magnitude still gives a negative sample*/
+	for(i=0;i<(1<<ALAW_ENC_BITS);++i){
+		alaw_enc_table[i]=s16_to_alaw(i<<3);
+		alaw_enc_table[i|(1<<ALAW_ENC_BITS)]=s16_to_alaw(-((i<<3)|1));
+	}
+	for(i=0;i<(1<<ULAW_ENC_BITS);++i){
+		ulaw_enc_table[i]=s16_to_ulaw(i<<2);
+		ulaw_enc_table[i|(1<<ULAW_ENC_BITS)]=s16_to_ulaw(-((i<<2)|1));
+	}
+	for(i=0;i<256;++i){
+		alaw_dec_table[i]=(int16_t)alaw_to_s16((unsigned char)i);
+		ulaw_dec_table[i]=(int16_t)ulaw_to_s16((unsigned char)i);
+	}
+	/*filling the tables is idempotent, so a concurrent first call is harmless*/
+	tables_ready=TRUE;
+}
+
+/*index made of the sign bit and of the magnitude shifted right by shift, -32768 being clamped to -32767*/
+static inline int g711_index(int16_t sample, int shift, int bits){
+	int neg=sample>>15; /*0 or -1*/
+	int mag=(sample^neg)-neg;
+	mag-=mag>>15; /*branchless clamp of 32768*/
+	return (mag>>shift)|((neg&1)<<bits);
+}
+
+/*computes the table indexes of 8 samples at once, the lookups themselves remain scalar*/
+static inline void g711_index8(const int16_t *in, uint16_t *idx, int shift, int bits){
+#if defined(G711_SSE2)
+	__m128i s=_mm_loadu_si128((const __m128i*)in);
+	__m128i neg=_mm_srai_epi16(s,15);
+	__m128i mag=_mm_sub_epi16(_mm_xor_si128(s,neg),neg);
+	mag=_mm_sub_epi16(mag,_mm_srli_epi16(mag,15));
+	_mm_storeu_si128((__m128i*)idx,_mm_or_si128(_mm_srl_epi16(mag,_mm_cvtsi32_si128(shift)),
+		_mm_and_si128(neg,_mm_set1_epi16((short)(1<<bits)))));
+#elif defined(G711_NEON)
+	int16x8_t s=vld1q_s16(in);
+	uint16x8_t neg=vreinterpretq_u16_s16(vshrq_n_s16(s,15));
+	uint16x8_t mag=vreinterpretq_u16_s16(vqabsq_s16(s)); /*saturating: -32768 gives 32767*/
+	vst1q_u16(idx,vorrq_u16(vshlq_u16(mag,vdupq_n_s16((int16_t)-shift)),vandq_u16(neg,vdupq_n_u16((uint16_t)(1<<bits)))));
+#else
+	int i;
+	for(i=0;i<8;++i) idx[i]=(uint16_t)g711_index(in[i],shift,bits);
+#endif
+}
+
+static inline void g711_encode_buf(const uint8_t *table, int shift, int bits, const int16_t *in, uint8_t *out, int nsamples){
+	uint16_t idx[8];
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		g711_index8(in+i,idx,shift,bits);
+		out[i]=table[idx[0]];
+		out[i+1]=table[idx[1]];
+		out[i+2]=table[idx[2]];
+		out[i+3]=table[idx[3]];
+		out[i+4]=table[idx[4]];
+		out[i+5]=table[idx[5]];
+		out[i+6]=table[idx[6]];
+		out[i+7]=table[idx[7]];
+	}
+	for(;i<nsamples;++i){
+		out[i]=table[g711_index(in[i],shift,bits)];
+	}
+}
+
+void s16_to_alaw_buf(const int16_t *in, uint8_t *out, int nsamples){
+	g711_encode_buf(alaw_enc_table,3,ALAW_ENC_BITS,in,out,nsamples);
+}
+
+void s16_to_ulaw_buf(const int16_t *in, uint8_t *out, int nsamples){
+	g711_encode_buf(ulaw_enc_table,2,ULAW_ENC_BITS,in,out,nsamples);
+}
+
+static inline void g711_decode_buf(const int16_t *table, const uint8_t *in, int16_t *out, int nsamples){
+	int i;
+	for(i=0;i+4<=nsamples;i+=4){
+		out[i]=table[in[i]];
+		out[i+1]=table[in[i+1]];
+		out[i+2]=table[in[i+2]];
+		out[i+3]=table[in[i+3]];
+	}
+	for(;i<nsamples;++i){
+		out[i]=table[in[i]];
+	}
+}
+
+void alaw_to_s16_buf(const uint8_t *in, int16_t *out, int nsamples){
+	g711_decode_buf(alaw_dec_table,in,out,nsamples);
+}
+
+void ulaw_to_s16_buf(const uint8_t *in, int16_t *out, int nsamples){
+	g711_decode_buf(ulaw_dec_table,in,out,nsamples);
+}
+
+void g711_encode_from_bufferizer(MSBufferizer *bz, uint8_t *out, int nsamples, void (*encode)(const int16_t *, uint8_t *, int)){
+	int remaining=nsamples*2;
+	mblk_t *q,*m;
+	int16_t odd;
+	bool_t has_odd=FALSE;
+
+	for(q=qbegin(&bz->q);!qend(&bz->q,q) && remaining>0;q=qnext(&bz->q,q)){
+		for(m=q;m!=NULL && remaining>0;m=m->b_cont){
+			const uint8_t *p=m->b_rptr;
+			int len=MIN((int)(m->b_wptr-m->b_rptr),remaining);
+			if (len==0) continue;
+			remaining-=len;
+			if (has_odd){
+				/*a sample split across two blocks*/
+				((uint8_t*)&odd)[1]=*p++;
+				len--;
+				encode(&odd,out++,1);
+				has_odd=FALSE;
+			}
+			if (((intptr_t)p)&1){
+				/*misaligned block, should not happen with audio*/
+				while(len>=2){
+					int16_t s;
+					memcpy(&s,p,2);
+					encode(&s,out++,1);
+					p+=2;
+					len-=2;
+				}
+			}else{
+				encode((const int16_t*)p,out,len/2);
+				out+=len/2;
+				p+=len&~1;
+				len&=1;
+			}
+			if (len){
+				((uint8_t*)&odd)[0]=*p;
+				has_odd=TRUE;
+			}
+		}
+	}
+	ms_bufferizer_skip_bytes(bz,nsamples*2);
+}
+
+#define G711_CN_LEVEL_CHANGE 3 /*in dB*/
+#define G711_CN_REFRESH_SAMPLES 8000 /*one second*/
+#define G711_CN_FRAME_SAMPLES 160
+
+void g711_dtx_reset(G711Dtx *dtx){
+	dtx->level=-1;
+	dtx->samples_since_update=0;
+}
+
+mblk_t *g711_dtx_process(G711Dtx *dtx, MSBufferizer *bz, int nsamples){
+	int16_t pcm[G711_MAX_FRAME_SAMPLES];
+	int level;
+	mblk_t *o;
+
+	ms_bufferizer_read(bz,(uint8_t*)pcm,nsamples*2);
+	level=ms_comfort_noise_get_level(pcm,nsamples);
+	dtx->samples_since_update+=nsamples;
+	if (dtx->level!=-1 && abs(level-dtx->level)<G711_CN_LEVEL_CHANGE && dtx->samples_since_update<G711_CN_REFRESH_SAMPLES)
+		return NULL;
+	dtx->level=level;
+	dtx->samples_since_update=0;
+	o=allocb(1,0);
+	*o->b_wptr++=(uint8_t)level;
+	mblk_set_cn_flag(o,1);
+	mblk_set_silence_flag(o,1);
+	return o;
+}
+
+mblk_t *g711_decode_cn(mblk_t *m){
+	int level=(m->b_wptr>m->b_rptr) ? (m->b_rptr[0] & 0x7f) : MS_COMFORT_NOISE_MAX_LEVEL;
+	uint32_t seed=mblk_get_timestamp_info(m);
+	mblk_t *o=allocb(G711_CN_FRAME_SAMPLES*2,0);
+	mblk_meta_copy(m,o);
+	mblk_set_cn_flag(o,0);
+	mblk_set_silence_flag(o,1);
+	ms_comfort_noise_generate(level,(int16_t*)o->b_wptr,G711_CN_FRAME_SAMPLES,&seed);
+	o->b_wptr+=G711_CN_FRAME_SAMPLES*2;
+	return o;
+}
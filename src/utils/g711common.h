@@ -170,3 +170,40 @@ static inline int ulaw_to_s16(unsigned char u_val)
 
 	return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
 }
+
+/*
+ * Table driven conversions of whole buffers, giving exactly the same results as the functions above.
+ * g711_init_tables() must be called once before using them.
+ */
+void g711_init_tables(void);
+void s16_to_alaw_buf(const int16_t *in, uint8_t *out, int nsamples);
+void alaw_to_s16_buf(const uint8_t *in, int16_t *out, int nsamples);
+void s16_to_ulaw_buf(const int16_t *in, uint8_t *out, int nsamples);
+void ulaw_to_s16_buf(const uint8_t *in, int16_t *out, int nsamples);
+
+/*
+ * Encodes nsamples samples directly from the blocks queued in the bufferizer, without copying them first,
+ * and removes them from the bufferizer.
+ */
+void g711_encode_from_bufferizer(MSBufferizer *bz, uint8_t *out, int nsamples, void (*encode)(const int16_t *, uint8_t *, int));
+
+/*
+ * Discontinuous transmission. G.711 has no silence frames of its own: a frame marked as silence is replaced by a
+ * comfort noise payload (RFC3389) when the silence begins, when the noise level changes, and at regular intervals.
+ * Other frames of silence are not transmitted.
+ */
+#define G711_MAX_FRAME_SAMPLES (14*160)
+
+typedef struct _G711Dtx{
+	int level; /*level of the last comfort noise payload, -1 while speech is transmitted*/
+	int samples_since_update;
+} G711Dtx;
+
+void g711_dtx_reset(G711Dtx *dtx);
+
+/*removes a frame of silence of at most G711_MAX_FRAME_SAMPLES from the bufferizer, returns the comfort noise payload to send
+ or NULL*/
+mblk_t *g711_dtx_process(G711Dtx *dtx, MSBufferizer *bz, int nsamples);
+
+/*turns a comfort noise payload into a frame of noise marked as silence, that a PLC filter extends until speech comes back*/
+mblk_t *g711_decode_cn(mblk_t *m);
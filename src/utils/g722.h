@@ -133,6 +133,9 @@ struct g722_decode_state {
 
 typedef struct g722_decode_state g722_decode_state_t;
 
+/* Number of QMF output pairs processed at once by the block functions, 20 ms at 16 kHz */
+#define G722_BLOCK_PAIRS 160
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -145,6 +148,18 @@ struct g722_decode_state *g722_decode_init(struct g722_decode_state *s, int rate
 int g722_decode_release(struct g722_decode_state *s);
 int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len);
 
+/* Same output as g722_encode() on the samples halved, as the codec expects 15 bit samples,
+   with the transmit QMF run on whole blocks of samples. */
+int g722_encode_block(struct g722_encode_state *s, uint8_t g722_data[], const int16_t amp[], int len);
+/* Same output as g722_decode() followed by the doubling of the samples, with the receive QMF run on
+   whole blocks of samples. */
+int g722_decode_block(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len);
+
+/* The QMF taps of the npairs windows of 24 samples starting at x, x+2, x+4...: for each window w,
+   sum is the sum of w[2i]*qmf_coeffs[i] + w[2i+1]*qmf_coeffs[11-i], and diff the sum of
+   w[2i+1]*qmf_coeffs[11-i] - w[2i]*qmf_coeffs[i]. Uses SIMD instructions when available, see g722_qmf.c. */
+void g722_qmf(int sum[], int diff[], const int16_t x[], int npairs);
+
 #ifdef __cplusplus
 }
 #endif
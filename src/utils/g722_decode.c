@@ -183,183 +183,201 @@ int g722_decode_release(struct g722_decode_state *s)
 }
 /*- End of function --------------------------------------------------------*/
 
-int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len)
+static const int wl[8] = {-60, -30, 58, 172, 334, 538, 1198, 3042 };
+static const int rl42[16] = {0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3,  2, 1, 0 };
+static const int ilb[32] =
 {
-    static const int wl[8] = {-60, -30, 58, 172, 334, 538, 1198, 3042 };
-    static const int rl42[16] = {0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3,  2, 1, 0 };
-    static const int ilb[32] =
-    {
-        2048, 2093, 2139, 2186, 2233, 2282, 2332,
-        2383, 2435, 2489, 2543, 2599, 2656, 2714,
-        2774, 2834, 2896, 2960, 3025, 3091, 3158,
-        3228, 3298, 3371, 3444, 3520, 3597, 3676,
-        3756, 3838, 3922, 4008
-    };
-    static const int wh[3] = {0, -214, 798};
-    static const int rh2[4] = {2, 1, 2, 1};
-    static const int qm2[4] = {-7408, -1616,  7408,   1616};
-    static const int qm4[16] = 
-    {
-              0, -20456, -12896,  -8968, 
-          -6288,  -4240,  -2584,  -1200,
-          20456,  12896,   8968,   6288,
-           4240,   2584,   1200,      0
-    };
-    static const int qm5[32] =
-    {
-           -280,   -280, -23352, -17560,
-         -14120, -11664,  -9752,  -8184,
-          -6864,  -5712,  -4696,  -3784,
-          -2960,  -2208,  -1520,   -880,
-          23352,  17560,  14120,  11664,
-           9752,   8184,   6864,   5712,
-           4696,   3784,   2960,   2208,
-           1520,    880,    280,   -280
-    };
-    static const int qm6[64] =
+    2048, 2093, 2139, 2186, 2233, 2282, 2332,
+    2383, 2435, 2489, 2543, 2599, 2656, 2714,
+    2774, 2834, 2896, 2960, 3025, 3091, 3158,
+    3228, 3298, 3371, 3444, 3520, 3597, 3676,
+    3756, 3838, 3922, 4008
+};
+static const int wh[3] = {0, -214, 798};
+static const int rh2[4] = {2, 1, 2, 1};
+static const int qm2[4] = {-7408, -1616,  7408,   1616};
+static const int qm4[16] = 
+{
+          0, -20456, -12896,  -8968, 
+      -6288,  -4240,  -2584,  -1200,
+      20456,  12896,   8968,   6288,
+       4240,   2584,   1200,      0
+};
+static const int qm5[32] =
+{
+       -280,   -280, -23352, -17560,
+     -14120, -11664,  -9752,  -8184,
+      -6864,  -5712,  -4696,  -3784,
+      -2960,  -2208,  -1520,   -880,
+      23352,  17560,  14120,  11664,
+       9752,   8184,   6864,   5712,
+       4696,   3784,   2960,   2208,
+       1520,    880,    280,   -280
+};
+static const int qm6[64] =
+{
+       -136,   -136,   -136,   -136,
+     -24808, -21904, -19008, -16704,
+     -14984, -13512, -12280, -11192,
+     -10232,  -9360,  -8576,  -7856,
+      -7192,  -6576,  -6000,  -5456,
+      -4944,  -4464,  -4008,  -3576,
+      -3168,  -2776,  -2400,  -2032,
+      -1688,  -1360,  -1040,   -728,
+      24808,  21904,  19008,  16704,
+      14984,  13512,  12280,  11192,
+      10232,   9360,   8576,   7856,
+       7192,   6576,   6000,   5456,
+       4944,   4464,   4008,   3576,
+       3168,   2776,   2400,   2032,
+       1688,   1360,   1040,    728,
+        432,    136,   -432,   -136
+};
+static const int qmf_coeffs[12] =
+{
+       3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
+};
+
+static int get_code(struct g722_decode_state *s, const uint8_t g722_data[], int *j)
+{
+    int code;
+
+    if (s->packed)
     {
-           -136,   -136,   -136,   -136,
-         -24808, -21904, -19008, -16704,
-         -14984, -13512, -12280, -11192,
-         -10232,  -9360,  -8576,  -7856,
-          -7192,  -6576,  -6000,  -5456,
-          -4944,  -4464,  -4008,  -3576,
-          -3168,  -2776,  -2400,  -2032,
-          -1688,  -1360,  -1040,   -728,
-          24808,  21904,  19008,  16704,
-          14984,  13512,  12280,  11192,
-          10232,   9360,   8576,   7856,
-           7192,   6576,   6000,   5456,
-           4944,   4464,   4008,   3576,
-           3168,   2776,   2400,   2032,
-           1688,   1360,   1040,    728,
-            432,    136,   -432,   -136
-    };
-    static const int qmf_coeffs[12] =
+        /* Unpack the code bits */
+        if (s->in_bits < s->bits_per_sample)
+        {
+            s->in_buffer |= (g722_data[(*j)++] << s->in_bits);
+            s->in_bits += 8;
+        }
+        code = s->in_buffer & ((1 << s->bits_per_sample) - 1);
+        s->in_buffer >>= s->bits_per_sample;
+        s->in_bits -= s->bits_per_sample;
+    }
+    else
     {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
+        code = g722_data[(*j)++];
+    }
+    return code;
+}
+/*- End of function --------------------------------------------------------*/
 
+/* Runs the ADPCM decoder on a code, giving a pair of band samples for the QMF */
+static void decode_sample(struct g722_decode_state *s, int code, int *rlowp, int *rhighp)
+{
     int dlowt;
     int rlow;
     int ihigh;
     int dhigh;
     int rhigh;
-    int xout1;
-    int xout2;
     int wd1;
     int wd2;
     int wd3;
-    int code;
-    int outlen;
-    int i;
-    int j;
 
-    outlen = 0;
     rhigh = 0;
-    for (j = 0;  j < len;  )
+    switch (s->bits_per_sample)
     {
-        if (s->packed)
-        {
-            /* Unpack the code bits */
-            if (s->in_bits < s->bits_per_sample)
-            {
-                s->in_buffer |= (g722_data[j++] << s->in_bits);
-                s->in_bits += 8;
-            }
-            code = s->in_buffer & ((1 << s->bits_per_sample) - 1);
-            s->in_buffer >>= s->bits_per_sample;
-            s->in_bits -= s->bits_per_sample;
-        }
-        else
-        {
-            code = g722_data[j++];
-        }
-
-        switch (s->bits_per_sample)
-        {
-        default:
-        case 8:
-            wd1 = code & 0x3F;
-            ihigh = (code >> 6) & 0x03;
-            wd2 = qm6[wd1];
-            wd1 >>= 2;
-            break;
-        case 7:
-            wd1 = code & 0x1F;
-            ihigh = (code >> 5) & 0x03;
-            wd2 = qm5[wd1];
-            wd1 >>= 1;
-            break;
-        case 6:
-            wd1 = code & 0x0F;
-            ihigh = (code >> 4) & 0x03;
-            wd2 = qm4[wd1];
-            break;
-        }
-        /* Block 5L, LOW BAND INVQBL */
-        wd2 = (s->band[0].det*wd2) >> 15;
-        /* Block 5L, RECONS */
-        rlow = s->band[0].s + wd2;
-        /* Block 6L, LIMIT */
-        if (rlow > 16383)
-            rlow = 16383;
-        else if (rlow < -16384)
-            rlow = -16384;
-
-        /* Block 2L, INVQAL */
+    default:
+    case 8:
+        wd1 = code & 0x3F;
+        ihigh = (code >> 6) & 0x03;
+        wd2 = qm6[wd1];
+        wd1 >>= 2;
+        break;
+    case 7:
+        wd1 = code & 0x1F;
+        ihigh = (code >> 5) & 0x03;
+        wd2 = qm5[wd1];
+        wd1 >>= 1;
+        break;
+    case 6:
+        wd1 = code & 0x0F;
+        ihigh = (code >> 4) & 0x03;
         wd2 = qm4[wd1];
-        dlowt = (s->band[0].det*wd2) >> 15;
+        break;
+    }
+    /* Block 5L, LOW BAND INVQBL */
+    wd2 = (s->band[0].det*wd2) >> 15;
+    /* Block 5L, RECONS */
+    rlow = s->band[0].s + wd2;
+    /* Block 6L, LIMIT */
+    if (rlow > 16383)
+        rlow = 16383;
+    else if (rlow < -16384)
+        rlow = -16384;
+
+    /* Block 2L, INVQAL */
+    wd2 = qm4[wd1];
+    dlowt = (s->band[0].det*wd2) >> 15;
+
+    /* Block 3L, LOGSCL */
+    wd2 = rl42[wd1];
+    wd1 = (s->band[0].nb*127) >> 7;
+    wd1 += wl[wd2];
+    if (wd1 < 0)
+        wd1 = 0;
+    else if (wd1 > 18432)
+        wd1 = 18432;
+    s->band[0].nb = wd1;
+        
+    /* Block 3L, SCALEL */
+    wd1 = (s->band[0].nb >> 6) & 31;
+    wd2 = 8 - (s->band[0].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[0].det = wd3 << 2;
 
-        /* Block 3L, LOGSCL */
-        wd2 = rl42[wd1];
-        wd1 = (s->band[0].nb*127) >> 7;
-        wd1 += wl[wd2];
+    block4(s, 0, dlowt);
+    
+    if (!s->eight_k)
+    {
+        /* Block 2H, INVQAH */
+        wd2 = qm2[ihigh];
+        dhigh = (s->band[1].det*wd2) >> 15;
+        /* Block 5H, RECONS */
+        rhigh = dhigh + s->band[1].s;
+        /* Block 6H, LIMIT */
+        if (rhigh > 16383)
+            rhigh = 16383;
+        else if (rhigh < -16384)
+            rhigh = -16384;
+
+        /* Block 2H, INVQAH */
+        wd2 = rh2[ihigh];
+        wd1 = (s->band[1].nb*127) >> 7;
+        wd1 += wh[wd2];
         if (wd1 < 0)
             wd1 = 0;
-        else if (wd1 > 18432)
-            wd1 = 18432;
-        s->band[0].nb = wd1;
-            
-        /* Block 3L, SCALEL */
-        wd1 = (s->band[0].nb >> 6) & 31;
-        wd2 = 8 - (s->band[0].nb >> 11);
+        else if (wd1 > 22528)
+            wd1 = 22528;
+        s->band[1].nb = wd1;
+        
+        /* Block 3H, SCALEH */
+        wd1 = (s->band[1].nb >> 6) & 31;
+        wd2 = 10 - (s->band[1].nb >> 11);
         wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-        s->band[0].det = wd3 << 2;
+        s->band[1].det = wd3 << 2;
 
-        block4(s, 0, dlowt);
-        
-        if (!s->eight_k)
-        {
-            /* Block 2H, INVQAH */
-            wd2 = qm2[ihigh];
-            dhigh = (s->band[1].det*wd2) >> 15;
-            /* Block 5H, RECONS */
-            rhigh = dhigh + s->band[1].s;
-            /* Block 6H, LIMIT */
-            if (rhigh > 16383)
-                rhigh = 16383;
-            else if (rhigh < -16384)
-                rhigh = -16384;
-
-            /* Block 2H, INVQAH */
-            wd2 = rh2[ihigh];
-            wd1 = (s->band[1].nb*127) >> 7;
-            wd1 += wh[wd2];
-            if (wd1 < 0)
-                wd1 = 0;
-            else if (wd1 > 22528)
-                wd1 = 22528;
-            s->band[1].nb = wd1;
-            
-            /* Block 3H, SCALEH */
-            wd1 = (s->band[1].nb >> 6) & 31;
-            wd2 = 10 - (s->band[1].nb >> 11);
-            wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-            s->band[1].det = wd3 << 2;
-
-            block4(s, 1, dhigh);
-        }
+        block4(s, 1, dhigh);
+    }
+    *rlowp = rlow;
+    *rhighp = rhigh;
+}
+/*- End of function --------------------------------------------------------*/
+
+int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len)
+{
+    int rlow;
+    int rhigh;
+    int xout1;
+    int xout2;
+    int outlen;
+    int i;
+    int j;
+
+    outlen = 0;
+    for (j = 0;  j < len;  )
+    {
+        decode_sample(s, get_code(s, g722_data, &j), &rlow, &rhigh);
 
         if (s->itu_test_mode)
         {
@@ -395,4 +413,52 @@ int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_d
     return outlen;
 }
 /*- End of function --------------------------------------------------------*/
+
+int g722_decode_block(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len)
+{
+    int16_t x[22 + 2*G722_BLOCK_PAIRS];
+    int sum[G722_BLOCK_PAIRS];
+    int diff[G722_BLOCK_PAIRS];
+    int rlow;
+    int rhigh;
+    int outlen;
+    int npairs;
+    int i;
+    int j;
+
+    if (s->itu_test_mode  ||  s->eight_k)
+    {
+        /* Nothing to batch, the output is only doubled */
+        outlen = g722_decode(s, amp, g722_data, len);
+        for (i = 0;  i < outlen;  i++)
+            amp[i] = (int16_t) (amp[i] << 1);
+        return outlen;
+    }
+
+    outlen = 0;
+    for (j = 0;  j < len;  )
+    {
+        /* Decode the band samples of a batch after the QMF history, then run the receive QMF on all of them at once */
+        for (i = 0;  i < 22;  i++)
+            x[i] = (int16_t) s->x[i + 2];
+        for (npairs = 0;  npairs < G722_BLOCK_PAIRS  &&  j < len;  npairs++)
+        {
+            decode_sample(s, get_code(s, g722_data, &j), &rlow, &rhigh);
+            x[22 + 2*npairs] = (int16_t) (rlow + rhigh);
+            x[23 + 2*npairs] = (int16_t) (rlow - rhigh);
+        }
+        g722_qmf(sum, diff, x, npairs);
+        for (i = 0;  i < 24;  i++)
+            s->x[i] = x[2*npairs - 2 + i];
+
+        for (i = 0;  i < npairs;  i++)
+        {
+            /* (sum + diff)/2 and (sum - diff)/2 are the two polyphase outputs, exactly */
+            amp[outlen++] = (int16_t) (((int16_t) (((sum[i] + diff[i]) >> 1) >> 12)) << 1);
+            amp[outlen++] = (int16_t) (((int16_t) (((sum[i] - diff[i]) >> 1) >> 12)) << 1);
+        }
+    }
+    return outlen;
+}
+/*- End of function --------------------------------------------------------*/
 /*- End of file ------------------------------------------------------------*/
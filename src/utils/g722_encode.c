@@ -182,65 +182,85 @@ int g722_encode_release(struct g722_encode_state *s)
 }
 /*- End of function --------------------------------------------------------*/
 
-int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t amp[], int len)
+/* The two last entries are unused, they are set above the others to keep the table sorted */
+static const int q6[32] =
 {
-    static const int q6[32] =
-    {
-           0,   35,   72,  110,  150,  190,  233,  276,
-         323,  370,  422,  473,  530,  587,  650,  714,
-         786,  858,  940, 1023, 1121, 1219, 1339, 1458,
-        1612, 1765, 1980, 2195, 2557, 2919,    0,    0
-    };
-    static const int iln[32] =
-    {
-         0, 63, 62, 31, 30, 29, 28, 27,
-        26, 25, 24, 23, 22, 21, 20, 19,
-        18, 17, 16, 15, 14, 13, 12, 11,
-        10,  9,  8,  7,  6,  5,  4,  0
-    };
-    static const int ilp[32] =
-    {
-         0, 61, 60, 59, 58, 57, 56, 55,
-        54, 53, 52, 51, 50, 49, 48, 47,
-        46, 45, 44, 43, 42, 41, 40, 39,
-        38, 37, 36, 35, 34, 33, 32,  0
-    };
-    static const int wl[8] =
-    {
-        -60, -30, 58, 172, 334, 538, 1198, 3042
-    };
-    static const int rl42[16] =
-    {
-        0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3, 2, 1, 0
-    };
-    static const int ilb[32] =
-    {
-        2048, 2093, 2139, 2186, 2233, 2282, 2332,
-        2383, 2435, 2489, 2543, 2599, 2656, 2714,
-        2774, 2834, 2896, 2960, 3025, 3091, 3158,
-        3228, 3298, 3371, 3444, 3520, 3597, 3676,
-        3756, 3838, 3922, 4008
-    };
-    static const int qm4[16] =
-    {
-             0, -20456, -12896, -8968,
-         -6288,  -4240,  -2584, -1200,
-         20456,  12896,   8968,  6288,
-          4240,   2584,   1200,     0
-    };
-    static const int qm2[4] =
-    {
-        -7408,  -1616,   7408,   1616
-    };
-    static const int qmf_coeffs[12] =
-    {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
-    static const int ihn[3] = {0, 1, 0};
-    static const int ihp[3] = {0, 3, 2};
-    static const int wh[3] = {0, -214, 798};
-    static const int rh2[4] = {2, 1, 2, 1};
+       0,   35,   72,  110,  150,  190,  233,  276,
+     323,  370,  422,  473,  530,  587,  650,  714,
+     786,  858,  940, 1023, 1121, 1219, 1339, 1458,
+    1612, 1765, 1980, 2195, 2557, 2919, 32767, 32767
+};
+static const int iln[32] =
+{
+     0, 63, 62, 31, 30, 29, 28, 27,
+    26, 25, 24, 23, 22, 21, 20, 19,
+    18, 17, 16, 15, 14, 13, 12, 11,
+    10,  9,  8,  7,  6,  5,  4,  0
+};
+static const int ilp[32] =
+{
+     0, 61, 60, 59, 58, 57, 56, 55,
+    54, 53, 52, 51, 50, 49, 48, 47,
+    46, 45, 44, 43, 42, 41, 40, 39,
+    38, 37, 36, 35, 34, 33, 32,  0
+};
+static const int wl[8] =
+{
+    -60, -30, 58, 172, 334, 538, 1198, 3042
+};
+static const int rl42[16] =
+{
+    0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3, 2, 1, 0
+};
+static const int ilb[32] =
+{
+    2048, 2093, 2139, 2186, 2233, 2282, 2332,
+    2383, 2435, 2489, 2543, 2599, 2656, 2714,
+    2774, 2834, 2896, 2960, 3025, 3091, 3158,
+    3228, 3298, 3371, 3444, 3520, 3597, 3676,
+    3756, 3838, 3922, 4008
+};
+static const int qm4[16] =
+{
+         0, -20456, -12896, -8968,
+     -6288,  -4240,  -2584, -1200,
+     20456,  12896,   8968,  6288,
+      4240,   2584,   1200,     0
+};
+static const int qm2[4] =
+{
+    -7408,  -1616,   7408,   1616
+};
+static const int qmf_coeffs[12] =
+{
+       3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
+};
+static const int ihn[3] = {0, 1, 0};
+static const int ihp[3] = {0, 3, 2};
+static const int wh[3] = {0, -214, 798};
+static const int rh2[4] = {2, 1, 2, 1};
+
+/* Block 1L, QUANTL: the index of the first threshold above wd, 30 if there is none.
+   The thresholds grow with the index, so a branchless binary search gives the same
+   result as a linear scan. */
+static int quantl(int wd, int det)
+{
+    int i;
 
+    i = 0;
+    i += (((q6[i + 16]*det) >> 12) <= wd)  ?  16  :  0;
+    i += (((q6[i + 8]*det) >> 12) <= wd)  ?  8  :  0;
+    i += (((q6[i + 4]*det) >> 12) <= wd)  ?  4  :  0;
+    i += (((q6[i + 2]*det) >> 12) <= wd)  ?  2  :  0;
+    i += (((q6[i + 1]*det) >> 12) <= wd)  ?  1  :  0;
+    /* i is now the index of the last threshold not above wd */
+    return (i < 29)  ?  i + 1  :  30;
+}
+/*- End of function --------------------------------------------------------*/
+
+/* Runs the ADPCM encoder on a pair of band samples from the QMF, and returns the code */
+static int encode_sample(struct g722_encode_state *s, int xlow, int xhigh)
+{
     int dlow;
     int dhigh;
     int el;
@@ -253,6 +273,103 @@ int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t
     int wd3;
     int eh;
     int mih;
+    int i;
+    int ihigh;
+    int ilow;
+
+    /* Block 1L, SUBTRA */
+    el = saturate(xlow - s->band[0].s);
+
+    /* Block 1L, QUANTL */
+    wd = (el >= 0)  ?  el  :  -(el + 1);
+    i = quantl(wd, s->band[0].det);
+    ilow = (el < 0)  ?  iln[i]  :  ilp[i];
+
+    /* Block 2L, INVQAL */
+    ril = ilow >> 2;
+    wd2 = qm4[ril];
+    dlow = (s->band[0].det*wd2) >> 15;
+
+    /* Block 3L, LOGSCL */
+    il4 = rl42[ril];
+    wd = (s->band[0].nb*127) >> 7;
+    s->band[0].nb = wd + wl[il4];
+    if (s->band[0].nb < 0)
+        s->band[0].nb = 0;
+    else if (s->band[0].nb > 18432)
+        s->band[0].nb = 18432;
+
+    /* Block 3L, SCALEL */
+    wd1 = (s->band[0].nb >> 6) & 31;
+    wd2 = 8 - (s->band[0].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[0].det = wd3 << 2;
+
+    block4(s, 0, dlow);
+    
+    if (s->eight_k)
+    {
+        /* Just leave the high bits as zero */
+        return (0xC0 | ilow) >> (8 - s->bits_per_sample);
+    }
+
+    /* Block 1H, SUBTRA */
+    eh = saturate(xhigh - s->band[1].s);
+
+    /* Block 1H, QUANTH */
+    wd = (eh >= 0)  ?  eh  :  -(eh + 1);
+    wd1 = (564*s->band[1].det) >> 12;
+    mih = (wd >= wd1)  ?  2  :  1;
+    ihigh = (eh < 0)  ?  ihn[mih]  :  ihp[mih];
+
+    /* Block 2H, INVQAH */
+    wd2 = qm2[ihigh];
+    dhigh = (s->band[1].det*wd2) >> 15;
+
+    /* Block 3H, LOGSCH */
+    ih2 = rh2[ihigh];
+    wd = (s->band[1].nb*127) >> 7;
+    s->band[1].nb = wd + wh[ih2];
+    if (s->band[1].nb < 0)
+        s->band[1].nb = 0;
+    else if (s->band[1].nb > 22528)
+        s->band[1].nb = 22528;
+
+    /* Block 3H, SCALEH */
+    wd1 = (s->band[1].nb >> 6) & 31;
+    wd2 = 10 - (s->band[1].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[1].det = wd3 << 2;
+
+    block4(s, 1, dhigh);
+    return ((ihigh << 6) | ilow) >> (8 - s->bits_per_sample);
+}
+/*- End of function --------------------------------------------------------*/
+
+static int put_code(struct g722_encode_state *s, uint8_t g722_data[], int g722_bytes, int code)
+{
+    if (s->packed)
+    {
+        /* Pack the code bits */
+        s->out_buffer |= (code << s->out_bits);
+        s->out_bits += s->bits_per_sample;
+        if (s->out_bits >= 8)
+        {
+            g722_data[g722_bytes++] = (uint8_t) (s->out_buffer & 0xFF);
+            s->out_bits -= 8;
+            s->out_buffer >>= 8;
+        }
+    }
+    else
+    {
+        g722_data[g722_bytes++] = (uint8_t) code;
+    }
+    return g722_bytes;
+}
+/*- End of function --------------------------------------------------------*/
+
+int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t amp[], int len)
+{
     int i;
     int j;
     /* Low and high band PCM from the QMF */
@@ -262,9 +379,6 @@ int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t
     /* Even and odd tap accumulators */
     int sumeven;
     int sumodd;
-    int ihigh;
-    int ilow;
-    int code;
 
     g722_bytes = 0;
     xhigh = 0;
@@ -302,97 +416,53 @@ int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t
                 xhigh = (sumeven - sumodd) >> 13;
             }
         }
-        /* Block 1L, SUBTRA */
-        el = saturate(xlow - s->band[0].s);
+        g722_bytes = put_code(s, g722_data, g722_bytes, encode_sample(s, xlow, xhigh));
+    }
+    return g722_bytes;
+}
+/*- End of function --------------------------------------------------------*/
 
-        /* Block 1L, QUANTL */
-        wd = (el >= 0)  ?  el  :  -(el + 1);
+int g722_encode_block(struct g722_encode_state *s, uint8_t g722_data[], const int16_t amp[], int len)
+{
+    int16_t x[22 + 2*G722_BLOCK_PAIRS];
+    int sum[G722_BLOCK_PAIRS];
+    int diff[G722_BLOCK_PAIRS];
+    int g722_bytes;
+    int npairs;
+    int n;
+    int i;
+    int j;
 
-        for (i = 1;  i < 30;  i++)
-        {
-            wd1 = (q6[i]*s->band[0].det) >> 12;
-            if (wd < wd1)
-                break;
-        }
-        ilow = (el < 0)  ?  iln[i]  :  ilp[i];
-
-        /* Block 2L, INVQAL */
-        ril = ilow >> 2;
-        wd2 = qm4[ril];
-        dlow = (s->band[0].det*wd2) >> 15;
-
-        /* Block 3L, LOGSCL */
-        il4 = rl42[ril];
-        wd = (s->band[0].nb*127) >> 7;
-        s->band[0].nb = wd + wl[il4];
-        if (s->band[0].nb < 0)
-            s->band[0].nb = 0;
-        else if (s->band[0].nb > 18432)
-            s->band[0].nb = 18432;
-
-        /* Block 3L, SCALEL */
-        wd1 = (s->band[0].nb >> 6) & 31;
-        wd2 = 8 - (s->band[0].nb >> 11);
-        wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-        s->band[0].det = wd3 << 2;
-
-        block4(s, 0, dlow);
-        
-        if (s->eight_k)
-        {
-            /* Just leave the high bits as zero */
-            code = (0xC0 | ilow) >> (8 - s->bits_per_sample);
-        }
-        else
+    g722_bytes = 0;
+    if (s->itu_test_mode  ||  s->eight_k  ||  (len & 1))
+    {
+        /* Nothing to batch, the input is only halved */
+        for (j = 0;  j < len;  j += n)
         {
-            /* Block 1H, SUBTRA */
-            eh = saturate(xhigh - s->band[1].s);
-
-            /* Block 1H, QUANTH */
-            wd = (eh >= 0)  ?  eh  :  -(eh + 1);
-            wd1 = (564*s->band[1].det) >> 12;
-            mih = (wd >= wd1)  ?  2  :  1;
-            ihigh = (eh < 0)  ?  ihn[mih]  :  ihp[mih];
-
-            /* Block 2H, INVQAH */
-            wd2 = qm2[ihigh];
-            dhigh = (s->band[1].det*wd2) >> 15;
-
-            /* Block 3H, LOGSCH */
-            ih2 = rh2[ihigh];
-            wd = (s->band[1].nb*127) >> 7;
-            s->band[1].nb = wd + wh[ih2];
-            if (s->band[1].nb < 0)
-                s->band[1].nb = 0;
-            else if (s->band[1].nb > 22528)
-                s->band[1].nb = 22528;
-
-            /* Block 3H, SCALEH */
-            wd1 = (s->band[1].nb >> 6) & 31;
-            wd2 = 10 - (s->band[1].nb >> 11);
-            wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-            s->band[1].det = wd3 << 2;
-
-            block4(s, 1, dhigh);
-            code = ((ihigh << 6) | ilow) >> (8 - s->bits_per_sample);
+            n = (len - j < 2*G722_BLOCK_PAIRS)  ?  len - j  :  2*G722_BLOCK_PAIRS;
+            for (i = 0;  i < n;  i++)
+                x[i] = amp[j + i] >> 1;
+            g722_bytes += g722_encode(s, g722_data + g722_bytes, x, n);
         }
+        return g722_bytes;
+    }
 
-        if (s->packed)
-        {
-            /* Pack the code bits */
-            s->out_buffer |= (code << s->out_bits);
-            s->out_bits += s->bits_per_sample;
-            if (s->out_bits >= 8)
-            {
-                g722_data[g722_bytes++] = (uint8_t) (s->out_buffer & 0xFF);
-                s->out_bits -= 8;
-                s->out_buffer >>= 8;
-            }
-        }
-        else
-        {
-            g722_data[g722_bytes++] = (uint8_t) code;
-        }
+    for (j = 0;  j < len;  j += 2*npairs)
+    {
+        npairs = (len - j)/2;
+        if (npairs > G722_BLOCK_PAIRS)
+            npairs = G722_BLOCK_PAIRS;
+        /* The QMF history followed by the new samples, then the transmit QMF on all of them at once */
+        for (i = 0;  i < 22;  i++)
+            x[i] = (int16_t) s->x[i + 2];
+        for (i = 0;  i < 2*npairs;  i++)
+            x[22 + i] = amp[j + i] >> 1;
+        g722_qmf(sum, diff, x, npairs);
+        for (i = 0;  i < 24;  i++)
+            s->x[i] = x[2*npairs - 2 + i];
+
+        for (i = 0;  i < npairs;  i++)
+            g722_bytes = put_code(s, g722_data, g722_bytes, encode_sample(s, sum[i] >> 13, diff[i] >> 13));
     }
     return g722_bytes;
 }
@@ -0,0 +1,192 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/mscommon.h"
+#include "g722.h"
+
+/*same compile time selection as the audio kernels, see audiokernels.c*/
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+#define G722_QMF_X86
+#define MS_TARGET(arch) __attribute__((target(arch)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)) && (_MSC_VER >= 1700)
+#define G722_QMF_X86
+#define MS_TARGET(arch)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define G722_QMF_NEON
+#include <arm_neon.h>
+#ifdef ANDROID
+#include "cpu-features.h"
+#endif
+#endif
+
+/*
+ * The 24 taps of a window, as used for the sum: the QMF coefficients on the even samples,
+ * and reversed on the odd ones. The taps of the difference are the same with the even ones negated.
+ * All the computations are exact, so every implementation gives the output of the reference code.
+ */
+static const int16_t sum_taps[24]={
+	3, -11, -11, 53, 12, -156, 32, 362, -210, -805, 951, 3876,
+	3876, 951, -805, -210, 362, 32, -156, 12, 53, -11, -11, 3
+};
+
+static const int16_t diff_taps[24]={
+	-3, -11, 11, 53, -12, -156, -32, 362, 210, -805, -951, 3876,
+	-3876, 951, 805, -210, -362, 32, 156, 12, -53, -11, 11, 3
+};
+
+static void qmf_c(int sum[], int diff[], const int16_t x[], int npairs){
+	int k,i;
+	for(k=0;k<npairs;++k){
+		const int16_t *w=x+2*k;
+		int s=0,d=0;
+		for(i=0;i<24;++i){
+			s+=w[i]*sum_taps[i];
+			d+=w[i]*diff_taps[i];
+		}
+		sum[k]=s;
+		diff[k]=d;
+	}
+}
+
+
+#ifdef G722_QMF_X86
+
+/* SSE2 implementation, 4 windows per iteration: 3 pmaddwd per window and tap set, then the partial sums of
+ the 4 windows are transposed and added together.*/
+
+MS_TARGET("sse2") static inline __m128i window_sse2(const int16_t *w, const __m128i taps[3]){
+	__m128i acc=_mm_madd_epi16(_mm_loadu_si128((const __m128i*)w),taps[0]);
+	acc=_mm_add_epi32(acc,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(w+8)),taps[1]));
+	return _mm_add_epi32(acc,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(w+16)),taps[2]));
+}
+
+/*returns the horizontal sums of a, b, c and d*/
+MS_TARGET("sse2") static inline __m128i hsum4_sse2(__m128i a, __m128i b, __m128i c, __m128i d){
+	__m128i ab=_mm_add_epi32(_mm_unpacklo_epi32(a,b),_mm_unpackhi_epi32(a,b));
+	__m128i cd=_mm_add_epi32(_mm_unpacklo_epi32(c,d),_mm_unpackhi_epi32(c,d));
+	return _mm_add_epi32(_mm_unpacklo_epi64(ab,cd),_mm_unpackhi_epi64(ab,cd));
+}
+
+MS_TARGET("sse2") static void qmf_sse2(int sum[], int diff[], const int16_t x[], int npairs){
+	__m128i st[3],dt[3];
+	int k,i;
+	for(i=0;i<3;++i){
+		st[i]=_mm_loadu_si128((const __m128i*)(sum_taps+8*i));
+		dt[i]=_mm_loadu_si128((const __m128i*)(diff_taps+8*i));
+	}
+	for(k=0;k+4<=npairs;k+=4){
+		const int16_t *w=x+2*k;
+		_mm_storeu_si128((__m128i*)(sum+k),hsum4_sse2(window_sse2(w,st),window_sse2(w+2,st),
+			window_sse2(w+4,st),window_sse2(w+6,st)));
+		_mm_storeu_si128((__m128i*)(diff+k),hsum4_sse2(window_sse2(w,dt),window_sse2(w+2,dt),
+			window_sse2(w+4,dt),window_sse2(w+6,dt)));
+	}
+	qmf_c(sum+k,diff+k,x+2*k,npairs-k);
+}
+
+static int cpu_has_sse2(void){
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs,1);
+	return (regs[3] & (1<<26))!=0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif /*G722_QMF_X86*/
+
+
+#ifdef G722_QMF_NEON
+
+/* NEON implementation, 2 windows per iteration, their partial sums being added pairwise.*/
+
+static inline int32x2_t window_neon(const int16_t *w, const int16x8_t taps[3]){
+	int16x8_t a0=vld1q_s16(w),a1=vld1q_s16(w+8),a2=vld1q_s16(w+16);
+	int32x4_t acc=vmull_s16(vget_low_s16(a0),vget_low_s16(taps[0]));
+	acc=vmlal_s16(acc,vget_high_s16(a0),vget_high_s16(taps[0]));
+	acc=vmlal_s16(acc,vget_low_s16(a1),vget_low_s16(taps[1]));
+	acc=vmlal_s16(acc,vget_high_s16(a1),vget_high_s16(taps[1]));
+	acc=vmlal_s16(acc,vget_low_s16(a2),vget_low_s16(taps[2]));
+	acc=vmlal_s16(acc,vget_high_s16(a2),vget_high_s16(taps[2]));
+	return vpadd_s32(vget_low_s32(acc),vget_high_s32(acc));
+}
+
+static void qmf_neon(int sum[], int diff[], const int16_t x[], int npairs){
+	int16x8_t st[3],dt[3];
+	int k,i;
+	for(i=0;i<3;++i){
+		st[i]=vld1q_s16(sum_taps+8*i);
+		dt[i]=vld1q_s16(diff_taps+8*i);
+	}
+	for(k=0;k+2<=npairs;k+=2){
+		const int16_t *w=x+2*k;
+		vst1_s32(sum+k,vpadd_s32(window_neon(w,st),window_neon(w+2,st)));
+		vst1_s32(diff+k,vpadd_s32(window_neon(w,dt),window_neon(w+2,dt)));
+	}
+	qmf_c(sum+k,diff+k,x+2*k,npairs-k);
+}
+
+static int cpu_has_neon(void){
+#ifdef ANDROID
+	return android_getCpuFamily()==ANDROID_CPU_FAMILY_ARM && (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)!=0;
+#else
+	return 1;
+#endif
+}
+
+#endif /*G722_QMF_NEON*/
+
+
+typedef void (*QmfFunc)(int sum[], int diff[], const int16_t x[], int npairs);
+
+/*the selection is idempotent, so a concurrent first call is harmless*/
+static QmfFunc selected_qmf=NULL;
+
+static QmfFunc select_qmf(void){
+#ifdef G722_QMF_X86
+	if (cpu_has_sse2()){
+		ms_message("Using SSE2 G.722 QMF.");
+		return qmf_sse2;
+	}
+#endif
+#ifdef G722_QMF_NEON
+	if (cpu_has_neon()){
+		ms_message("Using NEON G.722 QMF.");
+		return qmf_neon;
+	}
+#endif
+	return qmf_c;
+}
+
+void g722_qmf(int sum[], int diff[], const int16_t x[], int npairs){
+	if (selected_qmf==NULL) selected_qmf=select_qmf();
+	selected_qmf(sum,diff,x,npairs);
+}
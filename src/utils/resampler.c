@@ -0,0 +1,354 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msresampler.h"
+#include "mediastreamer2/msaudiokernels.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * The output rate is in_rate*num/den, num/den being irreducible. Output sample j is at position j*den/num
+ * in the input signal: it is computed with the phase (j*den)%num of the filter, which is a windowed sinc.
+ * When num is small (all usual conversions: 8k<->16k<->48k, 44.1k<->48k), there is one precomputed phase for each
+ * possible position. Otherwise a fixed number of phases is computed, and positions in-between are interpolated.
+ */
+#define MAX_EXACT_PHASES 1024
+#define INTERPOLATED_PHASES 256
+
+typedef struct _ResamplerTable{
+	int in_rate;
+	int out_rate;
+	MSResamplerQuality quality;
+	int num;
+	int den;
+	int nphases;
+	bool_t interpolated;
+	int ntaps;
+	float *coefs; /*nphases+1 phases of ntaps coefficients, in reverse order so that they apply to contiguous input*/
+	int refcount;
+} ResamplerTable;
+
+struct _MSResampler{
+	ResamplerTable *table;
+	const MSAudioKernels *kernels;
+	int nchannels;
+	float *buf; /*one history buffer per channel*/
+	int bufsize; /*allocated size of each channel buffer*/
+	int nbuffered; /*number of samples in each channel buffer*/
+	int pos; /*index of the newest input sample used by the next output sample*/
+	int frac; /*fractional part of the next output position, in 1/num of input sample*/
+	float *fin; /*conversion buffers for the 16 bit interface*/
+	float *fout;
+	int finsize;
+	int foutsize;
+};
+
+static ms_mutex_t tables_lock;
+static bool_t tables_initialized=FALSE;
+static MSList *tables=NULL;
+
+static int gcd(int a, int b){
+	while(b!=0){
+		int t=a%b;
+		a=b;
+		b=t;
+	}
+	return a;
+}
+
+/*zeroth order modified Bessel function, for the Kaiser window*/
+static double bessel_i0(double x){
+	double sum=1,term=1;
+	int k;
+	for(k=1;k<50;++k){
+		term*=(x/(2*k))*(x/(2*k));
+		sum+=term;
+		if (term<sum*1e-12) break;
+	}
+	return sum;
+}
+
+static void quality_params(MSResamplerQuality quality, int *taps, double *rolloff, double *beta){
+	switch(quality){
+		case MSResamplerQualityLow:
+			*taps=16; *rolloff=0.80; *beta=5;
+		break;
+		case MSResamplerQualityHigh:
+			*taps=64; *rolloff=0.94; *beta=9;
+		break;
+		case MSResamplerQualityVoip:
+		default:
+			*taps=32; *rolloff=0.90; *beta=7;
+		break;
+	}
+}
+
+static ResamplerTable *resampler_table_new(int in_rate, int out_rate, MSResamplerQuality quality){
+	ResamplerTable *t=ms_new0(ResamplerTable,1);
+	int g=gcd(in_rate,out_rate);
+	int taps,p,k;
+	double rolloff,beta,cutoff,center;
+
+	t->in_rate=in_rate;
+	t->out_rate=out_rate;
+	t->quality=quality;
+	t->num=out_rate/g;
+	t->den=in_rate/g;
+	t->interpolated=(t->num>MAX_EXACT_PHASES);
+	t->nphases=t->interpolated ? INTERPOLATED_PHASES : t->num;
+	quality_params(quality,&taps,&rolloff,&beta);
+	/*when downsampling the filter must be longer, as its cutoff frequency is lower relatively to the input rate*/
+	t->ntaps=(int)ceil((double)taps*in_rate/MIN(in_rate,out_rate));
+	t->ntaps=(t->ntaps+7)&~7;
+	/*cutoff in cycles per input sample*/
+	cutoff=rolloff*0.5*MIN(in_rate,out_rate)/in_rate;
+	center=t->ntaps/2.0;
+	t->coefs=ms_new(float,(t->nphases+1)*t->ntaps);
+	for(p=0;p<=t->nphases;++p){
+		float *phase=t->coefs+p*t->ntaps;
+		double sum=0;
+		for(k=0;k<t->ntaps;++k){
+			double x=k+(double)p/t->nphases-center;
+			double w=1-(2*x/t->ntaps)*(2*x/t->ntaps);
+			double h=(x==0) ? 2*cutoff : sin(2*M_PI*cutoff*x)/(M_PI*x);
+			h*=(w>0) ? bessel_i0(beta*sqrt(w))/bessel_i0(beta) : 0;
+			phase[t->ntaps-1-k]=(float)h;
+			sum+=h;
+		}
+		/*unity gain for each phase*/
+		for(k=0;k<t->ntaps;++k) phase[k]=(float)(phase[k]/sum);
+	}
+	ms_message("MSResampler: new table %i->%i Hz, %i phases%s of %i taps",in_rate,out_rate,t->nphases,
+		t->interpolated ? " (interpolated)" : "",t->ntaps);
+	return t;
+}
+
+static void resampler_table_destroy(ResamplerTable *t){
+	ms_free(t->coefs);
+	ms_free(t);
+}
+
+void ms_resampler_tables_init(void){
+	if (tables_initialized) return;
+	ms_mutex_init(&tables_lock,NULL);
+	tables_initialized=TRUE;
+}
+
+void ms_resampler_tables_uninit(void){
+	MSList *elem;
+	if (!tables_initialized) return;
+	for(elem=tables;elem!=NULL;elem=elem->next){
+		ResamplerTable *t=(ResamplerTable*)elem->data;
+		if (t->refcount>0) ms_warning("MSResampler: table %i->%i Hz still in use.",t->in_rate,t->out_rate);
+		else resampler_table_destroy(t);
+	}
+	tables=ms_list_free(tables);
+	ms_mutex_destroy(&tables_lock);
+	tables_initialized=FALSE;
+}
+
+/*tables are kept in the cache when no longer used, as they are likely to be needed again for the next call*/
+static ResamplerTable *resampler_table_get(int in_rate, int out_rate, MSResamplerQuality quality){
+	ResamplerTable *t=NULL;
+	MSList *elem;
+	if (!tables_initialized){
+		t=resampler_table_new(in_rate,out_rate,quality);
+		t->refcount=1;
+		return t;
+	}
+	ms_mutex_lock(&tables_lock);
+	for(elem=tables;elem!=NULL;elem=elem->next){
+		ResamplerTable *it=(ResamplerTable*)elem->data;
+		if (it->in_rate==in_rate && it->out_rate==out_rate && it->quality==quality){
+			t=it;
+			break;
+		}
+	}
+	if (t==NULL){
+		t=resampler_table_new(in_rate,out_rate,quality);
+		tables=ms_list_append(tables,t);
+	}
+	t->refcount++;
+	ms_mutex_unlock(&tables_lock);
+	return t;
+}
+
+/*tables no longer in the cache, because created without it or left in use by ms_resampler_tables_uninit(), are destroyed
+ with their last user*/
+static void resampler_table_release(ResamplerTable *t){
+	if (!tables_initialized){
+		if (--t->refcount==0) resampler_table_destroy(t);
+		return;
+	}
+	ms_mutex_lock(&tables_lock);
+	if (--t->refcount==0 && ms_list_find(tables,t)==NULL) resampler_table_destroy(t);
+	ms_mutex_unlock(&tables_lock);
+}
+
+MSResampler *ms_resampler_new(int in_rate, int out_rate, int nchannels, MSResamplerQuality quality){
+	MSResampler *obj;
+	if (in_rate<=0 || out_rate<=0 || nchannels<=0){
+		ms_error("ms_resampler_new(): invalid parameters %i->%i Hz, %i channels",in_rate,out_rate,nchannels);
+		return NULL;
+	}
+	obj=ms_new0(MSResampler,1);
+	obj->table=resampler_table_get(in_rate,out_rate,quality);
+	obj->kernels=ms_audio_kernels_get();
+	obj->nchannels=nchannels;
+	ms_resampler_reset(obj);
+	return obj;
+}
+
+void ms_resampler_destroy(MSResampler *obj){
+	resampler_table_release(obj->table);
+	if (obj->buf) ms_free(obj->buf);
+	if (obj->fin) ms_free(obj->fin);
+	if (obj->fout) ms_free(obj->fout);
+	ms_free(obj);
+}
+
+static void resampler_reserve(MSResampler *obj, int nsamples){
+	int c;
+	int size=obj->nbuffered+nsamples;
+	float *buf;
+	if (size<=obj->bufsize) return;
+	size=MAX(size,obj->table->ntaps*2);
+	buf=ms_new0(float,size*obj->nchannels);
+	if (obj->buf){
+		for(c=0;c<obj->nchannels;++c)
+			memcpy(buf+c*size,obj->buf+c*obj->bufsize,obj->nbuffered*sizeof(float));
+		ms_free(obj->buf);
+	}
+	obj->buf=buf;
+	obj->bufsize=size;
+}
+
+void ms_resampler_reset(MSResampler *obj){
+	int c;
+	/*the history starts with silence*/
+	obj->nbuffered=0;
+	resampler_reserve(obj,obj->table->ntaps-1);
+	for(c=0;c<obj->nchannels;++c)
+		memset(obj->buf+c*obj->bufsize,0,(obj->table->ntaps-1)*sizeof(float));
+	obj->nbuffered=obj->table->ntaps-1;
+	obj->pos=obj->nbuffered;
+	obj->frac=0;
+}
+
+int ms_resampler_get_max_output(MSResampler *obj, int nframes){
+	ResamplerTable *t=obj->table;
+	return (int)((((int64_t)nframes+(obj->nbuffered-obj->pos))*t->num+t->num-obj->frac)/t->den)+2;
+}
+
+static float resampler_output(MSResampler *obj, const float *x){
+	ResamplerTable *t=obj->table;
+	int ntaps=t->ntaps;
+	if (!t->interpolated){
+		return obj->kernels->dot_product(t->coefs+obj->frac*ntaps,x,ntaps);
+	}else{
+		int64_t p=(int64_t)obj->frac*t->nphases;
+		int i=(int)(p/t->num);
+		float a=(float)(p%t->num)/(float)t->num;
+		float y0=obj->kernels->dot_product(t->coefs+i*ntaps,x,ntaps);
+		float y1=obj->kernels->dot_product(t->coefs+(i+1)*ntaps,x,ntaps);
+		return y0+a*(y1-y0);
+	}
+}
+
+int ms_resampler_process_float(MSResampler *obj, const float *in, int nframes, float *out, int max_out){
+	ResamplerTable *t=obj->table;
+	int nch=obj->nchannels;
+	int step=t->den/t->num,step_frac=t->den%t->num;
+	int c,i,nout=0,drop;
+
+	resampler_reserve(obj,nframes);
+	for(c=0;c<nch;++c){
+		float *buf=obj->buf+c*obj->bufsize+obj->nbuffered;
+		for(i=0;i<nframes;++i) buf[i]=in[i*nch+c];
+	}
+	obj->nbuffered+=nframes;
+
+	if (nch==1){
+		while(obj->pos<obj->nbuffered && nout<max_out){
+			out[nout++]=resampler_output(obj,obj->buf+obj->pos-t->ntaps+1);
+			obj->pos+=step;
+			obj->frac+=step_frac;
+			if (obj->frac>=t->num){
+				obj->frac-=t->num;
+				obj->pos++;
+			}
+		}
+	}else{
+		while(obj->pos<obj->nbuffered && nout<max_out){
+			for(c=0;c<nch;++c)
+				out[nout*nch+c]=resampler_output(obj,obj->buf+c*obj->bufsize+obj->pos-t->ntaps+1);
+			nout++;
+			obj->pos+=step;
+			obj->frac+=step_frac;
+			if (obj->frac>=t->num){
+				obj->frac-=t->num;
+				obj->pos++;
+			}
+		}
+	}
+	/*only keep the history needed by the next output sample*/
+	drop=MIN(obj->pos,obj->nbuffered)-(t->ntaps-1);
+	if (drop>0){
+		for(c=0;c<nch;++c){
+			float *buf=obj->buf+c*obj->bufsize;
+			memmove(buf,buf+drop,(obj->nbuffered-drop)*sizeof(float));
+		}
+		obj->nbuffered-=drop;
+		obj->pos-=drop;
+	}
+	return nout;
+}
+
+static int16_t float_to_s16(float x){
+	if (x>=32767.0f) return 32767;
+	if (x<=-32768.0f) return -32768;
+	return (int16_t)(x>=0 ? x+0.5f : x-0.5f);
+}
+
+int ms_resampler_process(MSResampler *obj, const int16_t *in, int nframes, int16_t *out, int max_out){
+	int i,nout;
+	int nin=nframes*obj->nchannels;
+	if (nin>obj->finsize){
+		if (obj->fin) ms_free(obj->fin);
+		obj->fin=ms_new(float,nin);
+		obj->finsize=nin;
+	}
+	if (max_out*obj->nchannels>obj->foutsize){
+		if (obj->fout) ms_free(obj->fout);
+		obj->foutsize=max_out*obj->nchannels;
+		obj->fout=ms_new(float,obj->foutsize);
+	}
+	for(i=0;i<nin;++i) obj->fin[i]=in[i];
+	nout=ms_resampler_process_float(obj,obj->fin,nframes,obj->fout,max_out);
+	for(i=0;i<nout*obj->nchannels;++i) out[i]=float_to_s16(obj->fout[i]);
+	return nout;
+}
@@ -76,6 +76,7 @@ typedef struct EncState {
 	long long frame_count;
 	unsigned int mtu;
 	float fps;
+	int cpu_used;
 	VideoStarter starter;
 	bool_t req_vfu;
 	bool_t ready;
@@ -119,6 +120,7 @@ static void enc_init(MSFilter *f) {
 	s->cfg.g_error_resilient = 1;
 	s->cfg.g_lag_in_frames = 0;
 	s->mtu=ms_get_payload_max_size()-1;/*-1 for the vp8 payload header*/
+	s->cpu_used=10;
 
 	f->data = s;
 }
@@ -147,7 +149,7 @@ static void enc_preprocess(MSFilter *f) {
 		ms_error("vpx_codec_enc_init failed: %s (%s)n", vpx_codec_err_to_string(res), vpx_codec_error_detail(&s->codec));
 	}
 	/*cpu/quality tradeoff: positive values decrease CPU usage at the expense of quality*/
-	vpx_codec_control(&s->codec, VP8E_SET_CPUUSED, (s->cfg.g_threads > 1) ? 10 : 10); 
+	vpx_codec_control(&s->codec, VP8E_SET_CPUUSED, s->cpu_used);
 	vpx_codec_control(&s->codec, VP8E_SET_STATIC_THRESHOLD, 0);
 	vpx_codec_control(&s->codec, VP8E_SET_ENABLEAUTOALTREF, 1);
 	if (s->cfg.g_threads > 1) {
@@ -234,6 +236,24 @@ static void enc_postprocess(MSFilter *f) {
 	s->ready=FALSE;
 }
 
+/*complexity 10 is cpu_used 6, the slowest setting usable in realtime, and each step down speeds up the encoder*/
+static int enc_set_complexity(MSFilter *f, void *data){
+	EncState *s=(EncState*)f->data;
+	int complexity=*(int*)data;
+	if (complexity<0 || complexity>10) return -1;
+	ms_filter_lock(f);
+	s->cpu_used=16-complexity;
+	if (s->ready) vpx_codec_control(&s->codec, VP8E_SET_CPUUSED, s->cpu_used);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int enc_get_complexity(MSFilter *f, void *data){
+	EncState *s=(EncState*)f->data;
+	*(int*)data=16-s->cpu_used;
+	return 0;
+}
+
 static int enc_set_vsize(MSFilter *f, void*data){
 	MSVideoSize *vs=(MSVideoSize*)data;
 	EncState *s=(EncState*)f->data;
@@ -355,6 +375,8 @@ static MSFilterMethod enc_methods[]={
 	{	MS_FILTER_SET_MTU,        enc_set_mtu	},
 	{	MS_FILTER_REQ_VFU,        enc_req_vfu	},
 	{	MS_VIDEO_ENCODER_REQ_VFU, enc_req_vfu	},
+	{	MS_FILTER_SET_COMPLEXITY, enc_set_complexity	},
+	{	MS_FILTER_GET_COMPLEXITY, enc_get_complexity	},
 	{	0			, NULL }
 };
 
@@ -20,13 +20,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/msconference.h"
 #include "mediastreamer2/msaudiomixer.h"
+#include "mediastreamer2/msaudiorelay.h"
+#include "mediastreamer2/mscodecutils.h"
 #include "private.h"
 
 struct _MSAudioConference{
 	MSTicker *ticker;
 	MSFilter *mixer;
+	MSFilter *relay; /*replaces the mixer in relay mode*/
+	MSEncodedFrameCache *frame_cache; /*shared by the encoders of members that only listen*/
 	MSAudioConferenceParams params;
 	int nmembers;
+	/*the codec all members of a relay conference must use, taken from the first member*/
+	char relay_codec[32];
+	int relay_rate;
+	int relay_channels;
 };
 
 struct _MSAudioEndpoint{
@@ -42,6 +50,7 @@ struct _MSAudioEndpoint{
 	MSFilter *player; /* not used at the moment, but we need it so that there is a source connected to the mixer*/
 	int pin;
 	int samplerate;
+	bool_t is_remote;
 };
 
 
@@ -53,6 +62,7 @@ MSAudioConference * ms_audio_conference_new(const MSAudioConferenceParams *param
 	ms_ticker_set_name(obj->ticker,"Audio conference MSTicker");
 	ms_ticker_set_priority(obj->ticker,__ms_get_default_prio(FALSE));
 	obj->mixer=ms_filter_new(MS_AUDIO_MIXER_ID);
+	obj->frame_cache=ms_encoded_frame_cache_new();
 	obj->params=*params;
 	ms_filter_call_method(obj->mixer,MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE,&tmp);
 	ms_filter_call_method(obj->mixer,MS_FILTER_SET_SAMPLE_RATE,&obj->params.samplerate);
@@ -63,6 +73,26 @@ const MSAudioConferenceParams *ms_audio_conference_get_params(MSAudioConference
 	return &obj->params;
 }
 
+int ms_audio_conference_enable_relay(MSAudioConference *obj, bool_t enabled){
+	if (obj->nmembers>0){
+		ms_error("The relay mode of a conference cannot be changed while it has members.");
+		return -1;
+	}
+	if (enabled && obj->relay==NULL){
+		obj->relay=ms_filter_new(MS_AUDIO_RELAY_ID);
+	}else if (!enabled && obj->relay!=NULL){
+		ms_filter_destroy(obj->relay);
+		obj->relay=NULL;
+	}
+	obj->relay_codec[0]='\0';
+	return 0;
+}
+
+/*the filter run by the conference ticker*/
+static MSFilter *conference_filter(MSAudioConference *obj){
+	return obj->relay ? obj->relay : obj->mixer;
+}
+
 static MSCPoint just_before(MSFilter *f){
 	MSQueue *q;
 	MSCPoint pnull={0};
@@ -90,6 +120,7 @@ static void cut_audio_stream_graph(MSAudioEndpoint *ep, bool_t is_remote){
 	ms_ticker_detach(st->ms.ticker,st->soundread);
 	if (!st->ec) ms_ticker_detach(st->ms.ticker,st->soundwrite);
 
+	ep->is_remote=is_remote;
 	ep->in_cut_point_prev.pin=0;
 	if (is_remote){
 		/*we would like to keep the volrecv (MSVolume filter) in the graph to measure the output level*/
@@ -140,16 +171,28 @@ static int find_free_pin(MSFilter *mixer){
 static void plumb_to_conf(MSAudioEndpoint *ep){
 	MSAudioConference *conf=ep->conference;
 	int in_rate=ep->samplerate,out_rate=ep->samplerate;
+	int mixer_rate;
 	
 	if (ep->samplerate!=-1){
 		out_rate=in_rate=ep->samplerate;
 	}else in_rate=out_rate=conf->params.samplerate;
+	mixer_rate=conf->params.samplerate;
 	
 	if (ep->recorder){
 		ms_filter_call_method(ep->recorder,MS_FILTER_SET_SAMPLE_RATE,&conf->params.samplerate);
 	}
 	
 	ep->pin=find_free_pin(conf->mixer);
+
+	if (ep->mixer_out.filter && out_rate!=conf->params.samplerate){
+		/*let the mixer output at the endpoint rate: the mix is then resampled once for all the members using that rate*/
+		MSAudioMixerCtl ctl={0};
+		ctl.pin=ep->pin;
+		ctl.param.rate=out_rate;
+		if (ms_filter_call_method(conf->mixer,MS_AUDIO_MIXER_SET_OUTPUT_RATE,&ctl)==0){
+			mixer_rate=out_rate;
+		}
+	}
 	
 	if (ep->mixer_in.filter){
 		ms_filter_link(ep->mixer_in.filter,ep->mixer_in.pin,ep->in_resampler,0);
@@ -162,23 +205,108 @@ static void plumb_to_conf(MSAudioEndpoint *ep){
 
 	/*configure resamplers*/
 	ms_filter_call_method(ep->in_resampler,MS_FILTER_SET_OUTPUT_SAMPLE_RATE,&conf->params.samplerate);
-	ms_filter_call_method(ep->out_resampler,MS_FILTER_SET_SAMPLE_RATE,&conf->params.samplerate);
+	ms_filter_call_method(ep->out_resampler,MS_FILTER_SET_SAMPLE_RATE,&mixer_rate);
 	ms_filter_call_method(ep->in_resampler,MS_FILTER_SET_SAMPLE_RATE,&in_rate);
 	ms_filter_call_method(ep->out_resampler,MS_FILTER_SET_OUTPUT_SAMPLE_RATE,&out_rate);
-	
+
+	/*members that do not speak receive the same mix: stateless encoders can encode it only once. The other outputs
+	 (local sound card path, recorder) modify the mix in place or pass it to another thread: they get their own copy*/
+	if (ep->mixer_out.filter && !(ep->st && ep->mixer_out.filter==ep->st->ms.encoder)){
+		MSAudioMixerCtl ctl={0};
+		ctl.pin=ep->pin;
+		ctl.param.shared=FALSE;
+		ms_filter_call_method(conf->mixer,MS_AUDIO_MIXER_SET_SHARED_OUTPUT,&ctl);
+	}
+	if (ep->st && ep->mixer_out.filter==ep->st->ms.encoder && ms_filter_has_method(ep->st->ms.encoder,MS_AUDIO_ENCODER_SET_FRAME_CACHE)){
+		ms_filter_call_method(ep->st->ms.encoder,MS_AUDIO_ENCODER_SET_FRAME_CACHE,conf->frame_cache);
+	}
+}
+
+static PayloadType *endpoint_get_payload_type(MSAudioEndpoint *ep){
+	RtpSession *session=ep->st->ms.session;
+	return rtp_profile_get_payload(rtp_session_get_profile(session),rtp_session_get_send_payload_type(session));
+}
+
+/*in relay mode the decoded graph of the stream is not used: it is linked back as it was before
+ cut_audio_stream_graph(), and cut between the codecs and the rtp filters instead*/
+static void plumb_to_relay(MSAudioEndpoint *ep){
+	MSAudioConference *conf=ep->conference;
+	AudioStream *st=ep->st;
+
+	ep->pin=find_free_pin(conf->relay);
+	ms_filter_link(ep->in_cut_point_prev.filter,ep->in_cut_point_prev.pin,ep->in_cut_point.filter,ep->in_cut_point.pin);
+	ms_filter_link(ep->out_cut_point.filter,ep->out_cut_point.pin,st->ms.encoder,0);
+	ms_filter_unlink(st->ms.rtprecv,0,st->ms.decoder,0);
+	ms_filter_unlink(st->ms.encoder,0,st->ms.rtpsend,0);
+	if (ep->is_remote){
+		/*the packets received from the member are forwarded to the others, and it is sent theirs*/
+		ms_filter_link(st->ms.rtprecv,0,conf->relay,ep->pin);
+		ms_filter_link(conf->relay,ep->pin,st->ms.rtpsend,0);
+	}else{
+		/*the local member is encoded like a remote one, and decodes what is forwarded to it*/
+		ms_filter_link(st->ms.encoder,0,conf->relay,ep->pin);
+		ms_filter_link(conf->relay,ep->pin,st->ms.decoder,0);
+	}
+}
+
+static void unplumb_from_relay(MSAudioEndpoint *ep){
+	MSAudioConference *conf=ep->conference;
+	AudioStream *st=ep->st;
+
+	if (ep->is_remote){
+		ms_filter_unlink(st->ms.rtprecv,0,conf->relay,ep->pin);
+		ms_filter_unlink(conf->relay,ep->pin,st->ms.rtpsend,0);
+	}else{
+		ms_filter_unlink(st->ms.encoder,0,conf->relay,ep->pin);
+		ms_filter_unlink(conf->relay,ep->pin,st->ms.decoder,0);
+	}
+	ms_filter_link(st->ms.rtprecv,0,st->ms.decoder,0);
+	ms_filter_link(st->ms.encoder,0,st->ms.rtpsend,0);
+	ms_filter_unlink(ep->in_cut_point_prev.filter,ep->in_cut_point_prev.pin,ep->in_cut_point.filter,ep->in_cut_point.pin);
+	ms_filter_unlink(ep->out_cut_point.filter,ep->out_cut_point.pin,st->ms.encoder,0);
+}
+
+/*packets can only be forwarded between members using the same codec*/
+static bool_t relay_accepts(MSAudioConference *obj, MSAudioEndpoint *ep){
+	PayloadType *pt;
+	if (ep->st==NULL){
+		ms_error("Recorder endpoints cannot be members of a relay conference.");
+		return FALSE;
+	}
+	pt=endpoint_get_payload_type(ep);
+	if (pt==NULL){
+		ms_error("Cannot relay a stream whose payload type is unknown.");
+		return FALSE;
+	}
+	if (obj->relay_codec[0]=='\0'){
+		strncpy(obj->relay_codec,pt->mime_type,sizeof(obj->relay_codec)-1);
+		obj->relay_rate=pt->clock_rate;
+		obj->relay_channels=pt->channels;
+		ms_filter_call_method(obj->relay,MS_AUDIO_RELAY_SET_CODEC,(void*)pt->mime_type);
+		ms_filter_call_method(obj->relay,MS_FILTER_SET_SAMPLE_RATE,&pt->clock_rate);
+		return TRUE;
+	}
+	if (strcasecmp(pt->mime_type,obj->relay_codec)!=0 || pt->clock_rate!=obj->relay_rate || pt->channels!=obj->relay_channels){
+		ms_error("Cannot relay %s/%i to members using %s/%i.",pt->mime_type,pt->clock_rate,obj->relay_codec,obj->relay_rate);
+		return FALSE;
+	}
+	return TRUE;
 }
 
 void ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep){
+	if (obj->relay && !relay_accepts(obj,ep)) return;
 	/* now connect to the mixer */
 	ep->conference=obj;
-	if (obj->nmembers>0) ms_ticker_detach(obj->ticker,obj->mixer);
-	plumb_to_conf(ep);
-	ms_ticker_attach(obj->ticker,obj->mixer);
+	if (obj->nmembers>0) ms_ticker_detach(obj->ticker,conference_filter(obj));
+	if (obj->relay) plumb_to_relay(ep);
+	else plumb_to_conf(ep);
+	ms_ticker_attach(obj->ticker,conference_filter(obj));
 	obj->nmembers++;
 }
 
 static void unplumb_from_conf(MSAudioEndpoint *ep){
 	MSAudioConference *conf=ep->conference;
+	MSAudioMixerCtl ctl={0};
 	
 	if (ep->mixer_in.filter){
 		ms_filter_unlink(ep->mixer_in.filter,ep->mixer_in.pin,ep->in_resampler,0);
@@ -187,22 +315,40 @@ static void unplumb_from_conf(MSAudioEndpoint *ep){
 	if (ep->mixer_out.filter){
 		ms_filter_unlink(conf->mixer,ep->pin,ep->out_resampler,0);
 		ms_filter_unlink(ep->out_resampler,0,ep->mixer_out.filter,ep->mixer_out.pin);
+		/*the pin may be reused by a member at another rate*/
+		ctl.pin=ep->pin;
+		ctl.param.rate=0;
+		ms_filter_call_method(conf->mixer,MS_AUDIO_MIXER_SET_OUTPUT_RATE,&ctl);
+		ctl.param.shared=TRUE;
+		ms_filter_call_method(conf->mixer,MS_AUDIO_MIXER_SET_SHARED_OUTPUT,&ctl);
+	}
+	if (ep->st && ep->mixer_out.filter==ep->st->ms.encoder && ms_filter_has_method(ep->st->ms.encoder,MS_AUDIO_ENCODER_SET_FRAME_CACHE)){
+		ms_filter_call_method(ep->st->ms.encoder,MS_AUDIO_ENCODER_SET_FRAME_CACHE,NULL);
 	}
 }
 
 void ms_audio_conference_remove_member(MSAudioConference *obj, MSAudioEndpoint *ep){
-	ms_ticker_detach(obj->ticker,obj->mixer);
-	unplumb_from_conf(ep);
+	if (ep->conference!=obj) return; /*it was refused by the relay*/
+	ms_ticker_detach(obj->ticker,conference_filter(obj));
+	if (obj->relay) unplumb_from_relay(ep);
+	else unplumb_from_conf(ep);
 	ep->conference=NULL;
 	obj->nmembers--;
-	if (obj->nmembers>0) ms_ticker_attach(obj->ticker,obj->mixer);
+	if (obj->nmembers>0) ms_ticker_attach(obj->ticker,conference_filter(obj));
+	else obj->relay_codec[0]='\0';
 }
 
 void ms_audio_conference_mute_member(MSAudioConference *obj, MSAudioEndpoint *ep, bool_t muted){
 	MSAudioMixerCtl ctl={0};
 	ctl.pin=ep->pin;
 	ctl.param.active=!muted;
-	ms_filter_call_method(ep->conference->mixer, MS_AUDIO_MIXER_SET_ACTIVE, &ctl);
+	if (obj->relay) ms_filter_call_method(obj->relay, MS_AUDIO_RELAY_SET_ACTIVE, &ctl);
+	else ms_filter_call_method(ep->conference->mixer, MS_AUDIO_MIXER_SET_ACTIVE, &ctl);
+}
+
+void ms_audio_conference_set_max_speakers(MSAudioConference *obj, int max_speakers){
+	if (obj->relay) ms_warning("A relay conference forwards a single speaker to each member, max_speakers has no effect.");
+	ms_filter_call_method(obj->mixer,MS_AUDIO_MIXER_SET_MAX_SPEAKERS,&max_speakers);
 }
 
 int ms_audio_conference_get_size(MSAudioConference *obj){
@@ -213,6 +359,8 @@ int ms_audio_conference_get_size(MSAudioConference *obj){
 void ms_audio_conference_destroy(MSAudioConference *obj){
 	ms_ticker_destroy(obj->ticker);
 	ms_filter_destroy(obj->mixer);
+	if (obj->relay) ms_filter_destroy(obj->relay);
+	ms_encoded_frame_cache_destroy(obj->frame_cache);
 	ms_free(obj);
 }
 
@@ -34,6 +34,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mstee.h"
 #include "mediastreamer2/msaudiomixer.h"
 #include "mediastreamer2/mscodecutils.h"
+#include "mediastreamer2/msaudioconvert.h"
+#include "mediastreamer2/mspayloadrec.h"
 #include "private.h"
 
 #ifdef INET6
@@ -63,6 +65,9 @@ static void audio_stream_free(AudioStream *stream) {
 	if (stream->recorder) ms_filter_destroy(stream->recorder);
 	if (stream->recorder_mixer) ms_filter_destroy(stream->recorder_mixer);
 	if (stream->recorder_file) ms_free(stream->recorder_file);
+	if (stream->payload_tee) ms_filter_destroy(stream->payload_tee);
+	if (stream->payload_recorder) ms_filter_destroy(stream->payload_recorder);
+	if (stream->payload_recorder_file) ms_free(stream->payload_recorder_file);
 	ms_free(stream);
 }
 
@@ -104,6 +109,45 @@ static void audio_stream_configure_resampler(MSFilter *resampler,MSFilter *from,
 	           from->desc->name, to->desc->name, from_rate, to_rate, from_channels, to_channels);
 }
 
+static bool_t set_sample_format(MSFilter *f, MSSampleFormat format){
+	int tmp=format;
+	return ms_filter_call_method(f,MS_FILTER_SET_SAMPLE_FORMAT,&tmp)==0;
+}
+
+static void set_output_sample_format(MSFilter *f, MSSampleFormat format){
+	int tmp=format;
+	ms_filter_call_method(f,MS_FILTER_SET_OUTPUT_SAMPLE_FORMAT,&tmp);
+}
+
+/*
+ * Float samples flow between the codec and the MSVolume filters, which convert from and to the 16 bit samples of the
+ * echo canceller and the sound card, provided that all the filters in-between support them.
+ */
+static void audio_stream_setup_sample_formats(AudioStream *stream){
+	if (!stream->use_float) return;
+	if (stream->recorder_mixer!=NULL){
+		ms_message("Float samples not used because of the mixed recording.");
+		return;
+	}
+	if (stream->volsend && set_sample_format(stream->ms.encoder,MSSampleFormatFloat32)){
+		if (stream->dtmfgen_rtp==NULL || set_sample_format(stream->dtmfgen_rtp,MSSampleFormatFloat32)){
+			set_output_sample_format(stream->volsend,MSSampleFormatFloat32);
+			ms_message("Float samples used from the MSVolume to the %s encoder.",stream->ms.encoder->desc->name);
+		}else set_sample_format(stream->ms.encoder,MSSampleFormatS16);
+	}
+	/*the generic plc only works on 16 bit samples*/
+	if (stream->volrecv && stream->plc==NULL && set_sample_format(stream->ms.decoder,MSSampleFormatFloat32)){
+		if (stream->dtmfgen==NULL || set_sample_format(stream->dtmfgen,MSSampleFormatFloat32)){
+			set_sample_format(stream->volrecv,MSSampleFormatFloat32);
+			/*the equalizer goes after the MSVolume, it converts back if it can take floats*/
+			if (stream->equalizer && set_sample_format(stream->equalizer,MSSampleFormatFloat32)){
+				set_output_sample_format(stream->equalizer,MSSampleFormatS16);
+			}else set_output_sample_format(stream->volrecv,MSSampleFormatS16);
+			ms_message("Float samples used from the %s decoder.",stream->ms.decoder->desc->name);
+		}else set_sample_format(stream->ms.decoder,MSSampleFormatS16);
+	}
+}
+
 static void audio_stream_process_rtcp(AudioStream *stream, mblk_t *m){
 	do{
 		const report_block_t *rb=NULL;
@@ -316,6 +360,7 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		stream->volrecv=NULL;
 	audio_stream_enable_echo_limiter(stream,stream->el_type);
 	audio_stream_enable_noise_gate(stream,stream->use_ng);
+	audio_stream_enable_dtx(stream,stream->use_dtx);
 
 	if (stream->use_agc){
 		int tmp=1;
@@ -382,6 +427,21 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		
 	}
 
+	if (stream->features & AUDIO_STREAM_FEATURE_PAYLOAD_RECORDING){
+		MSFilter *recorder=ms_filter_new(MS_PAYLOAD_REC_ID);
+		if (ms_filter_call_method(recorder,MS_PAYLOAD_REC_SET_CODEC,(void*)pt->mime_type)==0){
+			int pin=1;
+			stream->payload_recorder=recorder;
+			stream->payload_tee=ms_filter_new(MS_TEE_ID);
+			ms_filter_call_method(stream->payload_tee,MS_TEE_MUTE,&pin);
+			ms_filter_call_method(recorder,MS_FILTER_SET_SAMPLE_RATE,&pt->clock_rate);
+			ms_filter_call_method(recorder,MS_FILTER_SET_NCHANNELS,&pt->channels);
+		}else{
+			ms_warning("%s payloads cannot be recorded without decoding.",pt->mime_type);
+			ms_filter_destroy(recorder);
+		}
+	}
+
 	/* give the encoder/decoder some parameters*/
 	ms_filter_call_method(stream->ms.encoder,MS_FILTER_SET_SAMPLE_RATE,&sample_rate);
 	ms_message("Payload's bitrate is %i",pt->normal_bitrate);
@@ -390,6 +450,11 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		ms_filter_call_method(stream->ms.encoder,MS_FILTER_SET_BITRATE,&pt->normal_bitrate);
 	}
 	ms_filter_call_method(stream->ms.encoder,MS_FILTER_SET_NCHANNELS,&pt->channels);
+	if (ms_filter_has_method(stream->ms.encoder,MS_AUDIO_ENCODER_ENABLE_CN)){
+		/*without a CN payload type, silence could only be dropped by the rtp sender: it is better sent as is*/
+		bool_t cn=rtp_profile_find_payload_number(profile,"CN",pt->clock_rate,1)!=-1;
+		ms_filter_call_method(stream->ms.encoder,MS_AUDIO_ENCODER_ENABLE_CN,&cn);
+	}
 	ms_filter_call_method(stream->ms.decoder,MS_FILTER_SET_SAMPLE_RATE,&sample_rate);
 	ms_filter_call_method(stream->ms.decoder,MS_FILTER_SET_NCHANNELS,&pt->channels);
 
@@ -412,6 +477,7 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		if(stream->equalizer) {
 			tmp=stream->eq_active;
 			ms_filter_call_method(stream->equalizer,MS_EQUALIZER_SET_ACTIVE,&tmp);
+			ms_filter_call_method(stream->equalizer,MS_FILTER_SET_SAMPLE_RATE,&sample_rate);
 		}
 	}else
 		stream->equalizer=NULL;
@@ -454,6 +520,8 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		stream->plc = NULL;
 	}
 
+	audio_stream_setup_sample_formats(stream);
+
 	/* create ticker */
 	if (stream->ms.ticker==NULL) start_ticker(&stream->ms);
 	else{
@@ -483,6 +551,8 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 	/*receiving graph*/
 	ms_connection_helper_start(&h);
 	ms_connection_helper_link(&h,stream->ms.rtprecv,-1,0);
+	if (stream->payload_tee)
+		ms_connection_helper_link(&h,stream->payload_tee,0,0);
 	ms_connection_helper_link(&h,stream->ms.decoder,0,0);
 	if (stream->plc)
 		ms_connection_helper_link(&h,stream->plc,0,0);
@@ -506,6 +576,8 @@ int audio_stream_start_full(AudioStream *stream, RtpProfile *profile, const char
 		ms_filter_link(stream->recv_tee,1,stream->recorder_mixer,1);
 		ms_filter_link(stream->recorder_mixer,0,stream->recorder,0);
 	}
+	if (stream->payload_recorder)
+		ms_filter_link(stream->payload_tee,1,stream->payload_recorder,0);
 	
 	/*to make sure all preprocess are done before befre processing audio*/
 	ms_ticker_attach_multiple(stream->ms.ticker
@@ -634,6 +706,48 @@ int audio_stream_mixed_record_stop(AudioStream *st){
 	return 0;
 }
 
+int audio_stream_payload_record_open(AudioStream *st, const char *filename){
+	if (!(st->features & AUDIO_STREAM_FEATURE_PAYLOAD_RECORDING)){
+		if (audio_stream_started(st)){
+			ms_error("Too late - you cannot request a payload recording when the stream is running because it did not have AUDIO_STREAM_FEATURE_PAYLOAD_RECORDING feature.");
+			return -1;
+		}else{
+			st->features|=AUDIO_STREAM_FEATURE_PAYLOAD_RECORDING;
+		}
+	}
+	if (st->payload_recorder_file){
+		audio_stream_payload_record_stop(st);
+		ms_free(st->payload_recorder_file);
+	}
+	st->payload_recorder_file=filename ? ms_strdup(filename) : NULL;
+	return 0;
+}
+
+int audio_stream_payload_record_start(AudioStream *st){
+	if (st->payload_recorder && st->payload_recorder_file){
+		int pin=1;
+		MSRecorderState state;
+		ms_filter_call_method(st->payload_recorder,MS_RECORDER_GET_STATE,&state);
+		if (state==MSRecorderClosed){
+			if (ms_filter_call_method(st->payload_recorder,MS_RECORDER_OPEN,st->payload_recorder_file)==-1)
+				return -1;
+		}
+		ms_filter_call_method_noarg(st->payload_recorder,MS_RECORDER_START);
+		ms_filter_call_method(st->payload_tee,MS_TEE_UNMUTE,&pin);
+		return 0;
+	}
+	return -1;
+}
+
+int audio_stream_payload_record_stop(AudioStream *st){
+	if (st->payload_recorder && st->payload_recorder_file){
+		int pin=1;
+		ms_filter_call_method(st->payload_tee,MS_TEE_MUTE,&pin);
+		ms_filter_call_method_noarg(st->payload_recorder,MS_RECORDER_CLOSE);
+	}
+	return 0;
+}
+
 uint32_t audio_stream_get_features(AudioStream *st){
 	return st->features;
 }
@@ -671,6 +785,8 @@ AudioStream *audio_stream_new(int loc_rtp_port, int loc_rtcp_port, bool_t ipv6){
 	stream->use_gc=FALSE;
 	stream->use_agc=FALSE;
 	stream->use_ng=FALSE;
+	stream->use_dtx=FALSE;
+	stream->use_float=FALSE;
 	stream->features=AUDIO_STREAM_FEATURE_ALL;
 	return stream;
 }
@@ -701,6 +817,19 @@ void audio_stream_set_echo_canceller_params(AudioStream *stream, int tail_len_ms
 	}
 }
 
+void audio_stream_enable_async_echo_canceller(AudioStream *stream, bool_t val){
+	if (stream->ec && ms_filter_has_method(stream->ec,MS_ECHO_CANCELLER_SET_ASYNC))
+		ms_filter_call_method(stream->ec,MS_ECHO_CANCELLER_SET_ASYNC,&val);
+	else if (val) ms_warning("audio_stream_enable_async_echo_canceller(): the echo canceller cannot run asynchronously.");
+}
+
+float audio_stream_get_echo_canceller_load(AudioStream *stream){
+	float load=0;
+	if (stream->ec && ms_filter_has_method(stream->ec,MS_ECHO_CANCELLER_GET_ASYNC_LOAD))
+		ms_filter_call_method(stream->ec,MS_ECHO_CANCELLER_GET_ASYNC_LOAD,&load);
+	return load;
+}
+
 void audio_stream_enable_echo_limiter(AudioStream *stream, EchoLimiterType type){
 	stream->el_type=type;
 	if (stream->volsend){
@@ -729,6 +858,20 @@ void audio_stream_enable_noise_gate(AudioStream *stream, bool_t val){
 	}
 }
 
+void audio_stream_enable_dtx(AudioStream *stream, bool_t val){
+	stream->use_dtx=val;
+	if (stream->volsend){
+		int tmp=val;
+		ms_filter_call_method(stream->volsend,MS_VOLUME_ENABLE_DTX,&tmp);
+	} else if (val) {
+		ms_warning("cannot enable dtx because no volume send");
+	}
+}
+
+void audio_stream_enable_float_samples(AudioStream *stream, bool_t val){
+	stream->use_float=val;
+}
+
 void audio_stream_set_mic_gain(AudioStream *stream, float gain){
 	if (stream->volsend){
 		ms_filter_call_method(stream->volsend,MS_VOLUME_SET_GAIN,&gain);
@@ -792,6 +935,8 @@ void audio_stream_stop(AudioStream * stream)
 			/*dismantle the receiving graph*/
 			ms_connection_helper_start(&h);
 			ms_connection_helper_unlink(&h,stream->ms.rtprecv,-1,0);
+			if (stream->payload_tee)
+				ms_connection_helper_unlink(&h,stream->payload_tee,0,0);
 			ms_connection_helper_unlink(&h,stream->ms.decoder,0,0);
 			if (stream->plc!=NULL)
 				ms_connection_helper_unlink(&h,stream->plc,0,0);
@@ -815,6 +960,8 @@ void audio_stream_stop(AudioStream * stream)
 				ms_filter_unlink(stream->recv_tee,1,stream->recorder_mixer,1);
 				ms_filter_unlink(stream->recorder_mixer,0,stream->recorder,0);
 			}
+			if (stream->payload_recorder)
+				ms_filter_unlink(stream->payload_tee,1,stream->payload_recorder,0);
 		}
 	}
 	audio_stream_free(stream);
@@ -0,0 +1,242 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+
+ * Copyright (C) 2013  Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/complexitygovernor.h"
+
+#define UPDATE_INTERVAL 1000 /*ms*/
+#define HOLD_TIME 3000 /*ms, lets the average load settle after a change*/
+#define LOW_LOAD_TIME 5 /*number of updates with a low load before raising complexity*/
+#define STEP_DOWN 2
+#define STEP_UP 1
+
+typedef struct _GovernedFilter{
+	MSFilter *f;
+	int max_complexity;
+	int complexity;
+	uint64_t last_elapsed;
+	uint64_t cost; /*processing time during the last update interval, in ns*/
+}GovernedFilter;
+
+struct _MSComplexityGovernor{
+	MSTicker *ticker;
+	ms_mutex_t lock; /*the streams sharing the governor may be iterated from different threads*/
+	int refcount;
+	MSList *filters;
+	float low_load;
+	float high_load;
+	uint64_t last_update;
+	uint64_t hold_until;
+	int low_count;
+};
+
+/*the governors shared by the streams, one per ticker*/
+static MSList *governors=NULL;
+static ms_mutex_t governors_lock;
+static bool_t governors_initialized=FALSE;
+
+static uint64_t get_time_ms(void){
+	MSTimeSpec ts;
+	ms_get_cur_time(&ts);
+	return (ts.tv_sec*1000LL)+(ts.tv_nsec/1000000LL);
+}
+
+static void governed_filter_set_complexity(GovernedFilter *gf, int complexity){
+	if (ms_filter_call_method(gf->f,MS_FILTER_SET_COMPLEXITY,&complexity)==0){
+		ms_message("MSComplexityGovernor: complexity of %s:%p set to %i",gf->f->desc->name,gf->f,complexity);
+		gf->complexity=complexity;
+	}
+}
+
+static void governed_filter_release(GovernedFilter *gf){
+	if (gf->complexity!=gf->max_complexity) governed_filter_set_complexity(gf,gf->max_complexity);
+	gf->f->measure_time=FALSE;
+	ms_free(gf);
+}
+
+MSComplexityGovernor *ms_complexity_governor_new(MSTicker *ticker){
+	MSComplexityGovernor *obj=ms_new0(MSComplexityGovernor,1);
+	obj->ticker=ticker;
+	ms_mutex_init(&obj->lock,NULL);
+	obj->refcount=1;
+	obj->low_load=50;
+	obj->high_load=80;
+	obj->last_update=get_time_ms();
+	return obj;
+}
+
+int ms_complexity_governor_add_filter(MSComplexityGovernor *obj, MSFilter *f){
+	GovernedFilter *gf;
+	int complexity;
+	if (!ms_filter_has_method(f,MS_FILTER_SET_COMPLEXITY)
+		|| ms_filter_call_method(f,MS_FILTER_GET_COMPLEXITY,&complexity)!=0){
+		ms_message("MSComplexityGovernor: %s has no complexity setting",f->desc->name);
+		return -1;
+	}
+	gf=ms_new0(GovernedFilter,1);
+	gf->f=f;
+	gf->max_complexity=gf->complexity=complexity;
+	gf->last_elapsed=f->elapsed;
+	f->measure_time=TRUE;
+	ms_mutex_lock(&obj->lock);
+	obj->filters=ms_list_append(obj->filters,gf);
+	ms_mutex_unlock(&obj->lock);
+	return 0;
+}
+
+void ms_complexity_governor_remove_filter(MSComplexityGovernor *obj, MSFilter *f){
+	MSList *elem;
+	ms_mutex_lock(&obj->lock);
+	for(elem=obj->filters;elem!=NULL;elem=elem->next){
+		GovernedFilter *gf=(GovernedFilter*)elem->data;
+		if (gf->f==f){
+			obj->filters=ms_list_remove_link(obj->filters,elem);
+			governed_filter_release(gf);
+			break;
+		}
+	}
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_complexity_governor_set_thresholds(MSComplexityGovernor *obj, float low_load, float high_load){
+	ms_mutex_lock(&obj->lock);
+	obj->low_load=low_load;
+	obj->high_load=high_load;
+	ms_mutex_unlock(&obj->lock);
+}
+
+MSTicker *ms_complexity_governor_get_ticker(const MSComplexityGovernor *obj){
+	return obj->ticker;
+}
+
+/*the filter that spent the most (or the least) time processing among those that can still be stepped down (or up)*/
+static GovernedFilter *find_candidate(MSComplexityGovernor *obj, bool_t down){
+	GovernedFilter *ret=NULL;
+	MSList *elem;
+	for(elem=obj->filters;elem!=NULL;elem=elem->next){
+		GovernedFilter *gf=(GovernedFilter*)elem->data;
+		if (down){
+			if (gf->complexity>0 && (ret==NULL || gf->cost>ret->cost)) ret=gf;
+		}else{
+			if (gf->complexity<gf->max_complexity && (ret==NULL || gf->cost<ret->cost)) ret=gf;
+		}
+	}
+	return ret;
+}
+
+void ms_complexity_governor_update(MSComplexityGovernor *obj){
+	uint64_t now=get_time_ms();
+	MSList *elem;
+	GovernedFilter *gf;
+	float load;
+
+	ms_mutex_lock(&obj->lock);
+	if (now-obj->last_update<UPDATE_INTERVAL){
+		ms_mutex_unlock(&obj->lock);
+		return;
+	}
+	obj->last_update=now;
+	for(elem=obj->filters;elem!=NULL;elem=elem->next){
+		uint64_t elapsed;
+		gf=(GovernedFilter*)elem->data;
+		elapsed=gf->f->elapsed;
+		gf->cost=elapsed-gf->last_elapsed;
+		gf->last_elapsed=elapsed;
+	}
+	load=ms_ticker_get_average_load(obj->ticker);
+	if (load>=obj->high_load){
+		obj->low_count=0;
+		if (now>=obj->hold_until && (gf=find_candidate(obj,TRUE))!=NULL){
+			ms_message("MSComplexityGovernor: ticker %s load is %f%%, lowering complexity",obj->ticker->name,load);
+			governed_filter_set_complexity(gf,MAX(gf->complexity-STEP_DOWN,0));
+			obj->hold_until=now+HOLD_TIME;
+		}
+	}else if (load<obj->low_load){
+		if (++obj->low_count>=LOW_LOAD_TIME && now>=obj->hold_until){
+			gf=find_candidate(obj,FALSE);
+			if (gf){
+				governed_filter_set_complexity(gf,MIN(gf->complexity+STEP_UP,gf->max_complexity));
+				obj->hold_until=now+HOLD_TIME;
+			}
+			obj->low_count=0;
+		}
+	}else obj->low_count=0;
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_complexity_governor_destroy(MSComplexityGovernor *obj){
+	ms_list_for_each(obj->filters,(void (*)(void*))governed_filter_release);
+	ms_list_free(obj->filters);
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+void ms_complexity_governors_init(void){
+	if (governors_initialized) return;
+	ms_mutex_init(&governors_lock,NULL);
+	governors_initialized=TRUE;
+}
+
+void ms_complexity_governors_uninit(void){
+	MSList *elem;
+	if (!governors_initialized) return;
+	for(elem=governors;elem!=NULL;elem=elem->next){
+		MSComplexityGovernor *obj=(MSComplexityGovernor*)elem->data;
+		ms_warning("MSComplexityGovernor: governor of ticker %s still in use.",obj->ticker->name);
+	}
+	governors=ms_list_free(governors);
+	ms_mutex_destroy(&governors_lock);
+	governors_initialized=FALSE;
+}
+
+MSComplexityGovernor *ms_complexity_governor_get(MSTicker *ticker){
+	MSComplexityGovernor *obj=NULL;
+	MSList *elem;
+	if (!governors_initialized) return ms_complexity_governor_new(ticker);
+	ms_mutex_lock(&governors_lock);
+	for(elem=governors;elem!=NULL;elem=elem->next){
+		MSComplexityGovernor *it=(MSComplexityGovernor*)elem->data;
+		if (it->ticker==ticker){
+			obj=it;
+			obj->refcount++;
+			break;
+		}
+	}
+	if (obj==NULL){
+		obj=ms_complexity_governor_new(ticker);
+		governors=ms_list_append(governors,obj);
+	}
+	ms_mutex_unlock(&governors_lock);
+	return obj;
+}
+
+/*governors no longer in the list, because created without it or left in use by ms_complexity_governors_uninit(), are
+ destroyed with their last user*/
+void ms_complexity_governor_release(MSComplexityGovernor *obj){
+	if (!governors_initialized){
+		if (--obj->refcount==0) ms_complexity_governor_destroy(obj);
+		return;
+	}
+	ms_mutex_lock(&governors_lock);
+	if (--obj->refcount==0){
+		governors=ms_list_remove(governors,obj);
+		ms_complexity_governor_destroy(obj);
+	}
+	ms_mutex_unlock(&governors_lock);
+}
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/msaudioconvert.h"
 #include "private.h"
 
 #include <ctype.h>
@@ -49,6 +50,28 @@ static void disable_checksums(ortp_socket_t sock) {
 #endif
 }
 
+/*
+ * Gives the new decoder the sample format of the one it replaces. If it only outputs 16 bit samples, the filters
+ * downstream that were fed with floats are switched back to 16 bit samples.
+ */
+static void media_stream_transfer_sample_format(MSFilter *olddec, MSFilter *newdec, MSFilter *next) {
+	int format = MSSampleFormatS16;
+	if (ms_filter_call_method(olddec, MS_FILTER_GET_SAMPLE_FORMAT, &format) != 0 || format == MSSampleFormatS16)
+		return;
+	if (ms_filter_call_method(newdec, MS_FILTER_SET_SAMPLE_FORMAT, &format) == 0)
+		return;
+	ms_message("%s decoder does not support float samples, switching to 16 bit samples.", newdec->desc->name);
+	while (next != NULL) {
+		int cur;
+		if (ms_filter_call_method(next, MS_FILTER_GET_SAMPLE_FORMAT, &cur) == 0) {
+			if (cur == MSSampleFormatS16) break;
+			cur = MSSampleFormatS16;
+			ms_filter_call_method(next, MS_FILTER_SET_SAMPLE_FORMAT, &cur);
+		}
+		next = (next->desc->noutputs > 0 && next->outputs[0] != NULL) ? next->outputs[0]->next.filter : NULL;
+	}
+}
+
 /**
  * This function must be called from the MSTicker thread:
  * it replaces one filter by another one.
@@ -70,12 +93,18 @@ static void media_stream_change_decoder(MediaStream *stream, int payload) {
 			return;
 		}
 
+		if (strcasecmp(pt->mime_type, "CN") == 0) {
+			/* Comfort noise goes to the current decoder, see MSRtpRecv. */
+			return;
+		}
+
 		dec = ms_filter_create_decoder(pt->mime_type);
 		if (dec != NULL) {
 			MSFilter *nextFilter = stream->decoder->outputs[0]->next.filter;
 			ms_filter_unlink(stream->rtprecv, 0, stream->decoder, 0);
 			ms_filter_unlink(stream->decoder, 0, nextFilter, 0);
 			ms_filter_postprocess(stream->decoder);
+			media_stream_transfer_sample_format(stream->decoder, dec, nextFilter);
 			ms_filter_destroy(stream->decoder);
 			stream->decoder = dec;
 			if (pt->recv_fmtp != NULL)
@@ -156,6 +185,14 @@ const char * media_stream_type_str(MediaStream *stream) {
 	}
 }
 
+/*the governor may be shared with other streams: only the encoder of this one is released*/
+static void media_stream_release_governor(MediaStream *stream) {
+	if (stream->governor == NULL) return;
+	if (stream->encoder != NULL) ms_complexity_governor_remove_filter(stream->governor, stream->encoder);
+	ms_complexity_governor_release(stream->governor);
+	stream->governor = NULL;
+}
+
 void media_stream_free(MediaStream *stream) {
 	if (stream->zrtp_context != NULL) {
 		ortp_zrtp_context_destroy(stream->zrtp_context);
@@ -167,6 +204,7 @@ void media_stream_free(MediaStream *stream) {
 	}
 	if (stream->evq) ortp_ev_queue_destroy(stream->evq);
 	if (stream->rc != NULL) ms_bitrate_controller_destroy(stream->rc);
+	media_stream_release_governor(stream);
 	if (stream->rtpsend != NULL) ms_filter_destroy(stream->rtpsend);
 	if (stream->rtprecv != NULL) ms_filter_destroy(stream->rtprecv);
 	if (stream->encoder != NULL) ms_filter_destroy(stream->encoder);
@@ -198,6 +236,11 @@ void media_stream_enable_adaptive_bitrate_control(MediaStream *stream, bool_t en
 	stream->use_rc = enabled;
 }
 
+void media_stream_enable_complexity_governor(MediaStream *stream, bool_t enabled) {
+	stream->use_governor = enabled;
+	if (!enabled) media_stream_release_governor(stream);
+}
+
 void media_stream_enable_adaptive_jittcomp(MediaStream *stream, bool_t enabled) {
 	rtp_session_enable_adaptive_jitter_compensation(stream->session, enabled);
 }
@@ -262,6 +305,17 @@ void media_stream_iterate(MediaStream *stream){
 	/*we choose to update the quality indicator as much as possible, since local statistics can be computed realtime. */
 	if (stream->qi && curtime>stream->last_iterate_time) ms_quality_indicator_update_local(stream->qi);
 	stream->last_iterate_time=curtime;
+	if (stream->use_governor && stream->encoder){
+		/*the governor is the one of the ticker running the encoder, which is not the stream's one in a conference*/
+		MSTicker *ticker=stream->encoder->ticker;
+		if (stream->governor && ms_complexity_governor_get_ticker(stream->governor)!=ticker)
+			media_stream_release_governor(stream);
+		if (stream->governor==NULL && ticker){
+			stream->governor=ms_complexity_governor_get(ticker);
+			ms_complexity_governor_add_filter(stream->governor,stream->encoder);
+		}
+	}
+	if (stream->governor) ms_complexity_governor_update(stream->governor);
 }
 
 float media_stream_get_quality_rating(MediaStream *stream){
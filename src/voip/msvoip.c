@@ -32,6 +32,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mscommon.h"
 #include "mediastreamer2/mscodecutils.h"
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msresampler.h"
+#include "mediastreamer2/dsptools.h"
+#include "mediastreamer2/dtmfgen.h"
+#include "mediastreamer2/complexitygovernor.h"
+#include "asyncwriter.h"
+#include "filecache.h"
 
 extern void __register_ffmpeg_encoders_if_possible(void);
 extern void ms_ffmpeg_check_init();
@@ -227,6 +233,12 @@ void ms_voip_init(){
 	for (i=0;ms_voip_filter_descs[i]!=NULL;i++){
 		ms_filter_register(ms_voip_filter_descs[i]);
 	}
+	ms_resampler_tables_init();
+	ms_fft_plans_init();
+	ms_dtmf_gen_cadences_init();
+	ms_async_writers_init();
+	ms_file_cache_init();
+	ms_complexity_governors_init();
 	ms_message("Registering all soundcard handlers");
 	cm=ms_snd_card_manager_get();
 	for (i=0;ms_snd_card_descs[i]!=NULL;i++){
@@ -263,6 +275,12 @@ void ms_voip_init(){
 
 void ms_voip_exit(){
 	ms_snd_card_manager_destroy();
+	ms_resampler_tables_uninit();
+	ms_fft_plans_uninit();
+	ms_dtmf_gen_cadences_uninit();
+	ms_async_writers_uninit();
+	ms_file_cache_uninit();
+	ms_complexity_governors_uninit();
 #ifdef VIDEO_ENABLED
 	ms_web_cam_manager_destroy();
 #endif
@@ -34,6 +34,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 void video_stream_free(VideoStream *stream) {
+	/* The encoder is released from the governor before it is hidden below */
+	media_stream_enable_complexity_governor(&stream->ms, FALSE);
 	/* Prevent filters from being destroyed two times */
 	if (stream->source_performs_encoding == TRUE) {
 		stream->ms.encoder = NULL;
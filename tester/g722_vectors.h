@@ -0,0 +1,145 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006-2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef _G722_VECTORS_H
+#define _G722_VECTORS_H
+
+/*
+ * Output of the reference G.722 code, as it was before g722_encode_block() and g722_decode_block() were added,
+ * on the signal of g722_test_signal() at 64 kbit/s: the samples halved then encoded 20 ms at a time, and that
+ * stream decoded 10 ms at a time with the samples doubled, as MSG722Enc and MSG722Dec did.
+ */
+
+static const uint8_t g722_golden_encoded[480]={
+	0x27,0x84,0x20,0x84,0x20,0x84,0x84,0x08,0x15,0x31,0x1b,0xb4,0x24,0x2c,0xa4,0x23,
+	0x2e,0x35,0xb0,0x10,0x12,0x19,0x87,0x08,0x13,0x0c,0x3f,0x31,0x7d,0xf8,0x26,0x74,
+	0x24,0x65,0x9f,0x37,0xef,0xcc,0x17,0x77,0x48,0xca,0xd2,0x8d,0xfc,0xf1,0x9f,0xf0,
+	0x28,0x31,0x64,0xe4,0xdf,0xbb,0x72,0x0d,0x17,0xd7,0x4a,0x4b,0xbe,0x54,0xfc,0xb7,
+	0x57,0x69,0xe8,0x6b,0x68,0x28,0xd6,0x39,0x2d,0xd0,0x5c,0x15,0x0a,0x4c,0x5e,0xcf,
+	0x6e,0xf1,0x97,0xef,0xec,0xb4,0x26,0x6c,0xd7,0xf5,0xb3,0x4f,0x55,0xbe,0x08,0xce,
+	0xd9,0xd5,0x38,0x76,0xd5,0x2c,0xeb,0x71,0xe8,0xee,0x5b,0x38,0xbb,0x15,0x53,0x15,
+	0x09,0x52,0xfb,0x4c,0xf9,0xf6,0x15,0xec,0x2b,0x74,0x28,0x6f,0x52,0xb1,0x7b,0x4e,
+	0xdf,0x51,0x4d,0x0f,0xf7,0xd1,0xf7,0x38,0x16,0xab,0xea,0x35,0xe8,0x2e,0x51,0x74,
+	0x6e,0x4f,0x5c,0xda,0xc8,0x10,0x1b,0xd8,0x78,0x3a,0xd8,0xee,0x29,0x73,0x29,0xf0,
+	0x1a,0x34,0x78,0x4d,0xbc,0x7c,0xf2,0x5c,0xde,0x5d,0x7c,0x79,0xfd,0xff,0x7e,0xff,
+	0x7c,0xfb,0xdf,0x7c,0x7d,0x7d,0x7f,0x7f,0x5f,0xfd,0x7f,0xff,0xff,0xff,0x7f,0x7c,
+	0x7b,0x7d,0xfa,0x7b,0xdd,0xfb,0xfe,0xdf,0x7d,0xff,0x1d,0xde,0x5f,0xfd,0xfc,0x3a,
+	0xde,0xfb,0x39,0x79,0x78,0x79,0x5f,0x77,0x7d,0x5e,0x9d,0x3f,0x56,0xdf,0xbe,0xda,
+	0xfa,0x3c,0x3c,0xfa,0x73,0x7f,0xf1,0x7a,0x5f,0xf6,0xfe,0x5b,0xbe,0x5b,0x58,0x19,
+	0xff,0x16,0x77,0x7a,0x7c,0xf6,0x77,0x38,0x2e,0x75,0xd9,0x76,0x7b,0x58,0x9d,0x5d,
+	0xd4,0x5c,0xdf,0xdb,0x75,0xf8,0xdd,0x79,0x72,0xb7,0x30,0xf4,0xd8,0x37,0x37,0xd4,
+	0xfe,0x5b,0x58,0x14,0xde,0x1a,0x7c,0xf7,0x5a,0xf6,0x32,0xba,0xef,0xf9,0x9c,0xf4,
+	0xfb,0x17,0x76,0x19,0xd6,0xd7,0x3c,0x5f,0xfc,0xfa,0x5b,0x70,0x31,0x7a,0x2d,0x7c,
+	0x7f,0x5f,0x73,0x52,0xf5,0xd7,0x98,0xd6,0x7a,0x1a,0x7b,0xb6,0x5b,0x71,0x36,0x7c,
+	0x70,0xb7,0x33,0x88,0x20,0x84,0x08,0x3d,0x04,0x86,0x31,0x46,0x24,0x2e,0x8e,0x2a,
+	0xe3,0xb4,0xa3,0x36,0x12,0x3b,0x31,0x08,0x51,0x19,0x45,0x8e,0x0f,0xcc,0x25,0xf6,
+	0x47,0x23,0xed,0xe5,0x6a,0xea,0xdc,0x35,0x36,0x88,0x15,0x53,0x46,0xd6,0x3d,0x46,
+	0x6f,0x66,0x46,0x63,0xe8,0x71,0xa3,0x34,0x7b,0x98,0x2a,0x09,0x36,0x10,0x46,0x8c,
+	0x1b,0x4f,0x6a,0x2e,0x87,0x22,0x6f,0xe8,0xa3,0x76,0x4d,0x2c,0xe6,0x47,0xf0,0x4c,
+	0x09,0x88,0x6f,0xc6,0x62,0xce,0x15,0x27,0x67,0xf0,0x67,0x69,0x11,0xeb,0x2d,0x48,
+	0xd7,0x92,0x46,0xd1,0x0c,0xcc,0x72,0x5e,0x1d,0x26,0x23,0x95,0xe4,0x6d,0x3f,0x34,
+	0xf9,0xc5,0x2a,0xc8,0xce,0xc7,0x6b,0xca,0xad,0x72,0x08,0x67,0xe3,0x1c,0x64,0x6e,
+	0x2f,0x6e,0x75,0x45,0x6c,0x92,0x06,0x52,0xd3,0x19,0x37,0x72,0xd8,0x2b,0xe4,0x32,
+	0x65,0xec,0x9c,0xfa,0x7e,0x14,0x14,0x5c,0xc4,0x8a,0xdb,0x10,0xe9,0x51,0x17,0x67
+};
+
+static const int16_t g722_golden_decoded[960]={
+	0,-2,-2,0,0,-2,-2,6,0,-28,0,96,
+	-2,-230,22,466,-32,-928,-120,1670,1014,-2634,-6218,-8970,
+	-12338,-14856,-13408,-8012,-1068,3270,2798,-874,-2708,-84,6796,13228,
+	12992,7708,7472,13486,18218,17874,14660,9894,6558,4718,6696,7758,
+	3502,-3150,-6556,-7276,-3750,-4398,-7092,-13626,-20328,-20404,-13936,-12434,
+	-10160,-15794,-11282,-8420,1128,-2008,3804,650,1852,1836,5708,8536,
+	13798,5842,8512,12310,23676,17492,14592,12740,4332,2070,12066,8410,
+	1976,-2068,-6992,-10282,646,-1540,-3768,-13398,-16726,-17128,-15550,-12332,
+	-13896,-12914,-16614,-8012,-4150,-930,-2204,1776,-2804,4420,6872,9454,
+	13558,4832,13044,13720,22470,23646,18702,12402,5808,8620,5188,9322,
+	6622,-4918,-3018,-11274,-886,-6298,-10090,-13558,-16790,-22052,-18042,-10050,
+	-13288,-11606,-10064,-8402,-6206,1722,-4444,-3002,102,3756,10032,12770,
+	12060,12572,14760,16430,20844,19510,19882,10884,5180,3714,11960,7492,
+	9726,-678,-5640,-3318,-76,-6080,-3882,-15792,-13254,-21528,-16348,-13760,
+	-11200,-15582,-15594,-9224,-382,1470,-14,484,-3356,4154,7846,11300,
+	9260,11622,7792,12380,21476,17556,15310,10008,5282,6538,7478,11232,
+	3174,-174,-5716,-10446,-6636,-830,-7764,-15842,-16550,-19560,-17958,-13132,
+	-13310,-11526,-11792,-10954,-2030,-3316,-1932,-3000,-2538,144,9756,10242,
+	9690,9836,12716,15550,17376,18452,14944,11002,8608,4458,7466,7534,
+	1538,-1858,-718,-7386,-6554,-9522,-6956,-19444,-16700,-22166,-15632,-10748,
+	-11840,-15966,-15272,-12006,-6318,-140,-972,-6164,-1090,2304,6946,8378,
+	13912,9762,11950,11816,20890,17592,14784,6036,4204,7550,5346,7448,
+	3782,-5634,-7782,-5578,-5466,-8002,-10348,-14602,-17288,-21484,-15426,-11950,
+	-10788,-11270,-12218,-8476,-3712,-422,2476,-4732,-950,3896,6244,15342,
+	14126,8500,13774,15754,19110,18010,18826,6412,3036,2874,7886,9212,
+	7558,-1210,-5752,-8000,-3966,-2452,-6546,-13884,-20226,-21348,-15096,-16178,
+	-11076,-12954,-12498,-8300,-3312,-3856,260,-2098,-1986,3146,7292,9520,
+	14266,10370,12414,13744,20834,19606,15876,9860,10260,3498,10456,6830,
+	3522,-5732,-8286,-4402,-6514,-3566,-908,-18,-60,-736,-122,188,
+	-626,-372,370,-532,168,-454,252,116,-480,346,-12,-200,
+	348,278,-2,82,480,410,8,326,-4,-100,212,-76,
+	142,-110,-4,-256,-58,-156,10,-320,-184,-192,-234,-250,
+	-112,-178,-246,-104,-112,0,-62,-68,50,16,148,92,
+	188,138,236,232,300,360,350,120,8,104,152,144,
+	36,-10,-94,-120,-48,-26,-88,-256,-202,-270,-272,-280,
+	-200,-214,-194,-116,-28,-42,72,-16,-58,0,94,102,
+	256,172,210,208,288,254,232,104,110,106,190,156,
+	134,-6,-50,-94,-106,-102,-52,-282,-328,-334,-252,-170,
+	-242,-234,-246,-166,-88,-56,66,-72,50,0,90,176,
+	258,128,184,252,322,290,248,126,120,124,144,124,
+	50,-56,-78,-64,-104,-110,-124,-232,-256,-328,-188,-172,
+	-176,-298,-188,-196,-46,-14,42,-4,52,72,142,152,
+	192,112,228,186,388,324,296,124,78,76,192,130,
+	96,-72,-92,-94,-102,-88,-104,-226,-278,-288,-188,-174,
+	-164,-196,-168,-122,10,38,44,-4,-10,-6,86,116,
+	168,166,166,188,320,290,232,116,54,18,158,94,
+	124,-58,-132,-116,-64,-106,-88,-184,-228,-338,-252,-242,
+	-204,-256,-158,-216,-92,-38,2,-48,-16,-6,92,114,
+	222,170,116,226,296,290,222,164,50,126,158,154,
+	50,-96,-38,-64,6,-104,-44,-214,-260,-266,-236,-288,
+	-108,-232,-166,-156,-108,-22,-18,-68,4,18,166,154,
+	242,124,196,214,404,258,256,140,134,14,100,84,
+	78,-118,-108,-88,-34,-98,-164,-206,-312,-300,-284,-226,
+	-172,-248,-172,-228,-80,44,14,-6,24,46,188,138,
+	236,82,156,202,276,194,270,378,112,-342,-34,710,
+	850,-944,-4668,-7440,-6746,-5514,-5498,-11248,-21296,-31042,-29230,-19936,
+	-19756,-30822,-32236,-21176,-5504,576,1122,-4318,-6600,534,15672,24778,
+	25674,21568,18734,28474,32640,-31376,30536,15930,12044,4318,13458,7386,
+	8906,-14338,-11554,-20952,-8392,-14046,-7534,-32676,32254,-31096,-31588,-32656,
+	-23940,32034,-29542,-23554,4140,2548,-3736,-13018,-5502,-4466,19122,16718,
+	18130,18308,20070,23774,31536,32396,28884,24518,16798,12908,18066,5232,
+	8004,-788,-16428,-19644,-4000,-15488,-16504,-31764,32198,-32558,-26726,-24872,
+	-14252,-31672,-31842,-28490,-7412,5218,8028,-8732,-9754,-3956,16352,27554,
+	26500,16122,16508,28426,-32544,32664,32494,19980,13808,13294,9452,10686,
+	11914,-10460,-6024,-17642,1804,-15980,-4544,-32270,-28902,-31828,-30888,-32418,
+	-14906,32096,-25336,-19682,410,-1082,8686,-2566,-10274,-2144,25106,15092,
+	18412,13584,19112,-31894,31244,-30650,30050,15912,10902,5406,21390,21218,
+	10952,-4904,-9582,-9392,-4962,-7632,-10482,-27428,-29184,32594,-32572,-17362,
+	-16376,-28602,-29892,-13708,1788,2612,-5820,-11166,-1220,-228,19010,17208,
+	20952,16784,18038,20608,-32268,-32338,31306,13232,13488,11108,16680,16094,
+	17488,-4284,-10854,-12328,-6430,-3722,-17862,-29270,32002,32436,-31736,-32642,
+	-28772,-32292,-32612,-22698,-10062,-7630,-5424,-8644,2222,2654,21364,20778,
+	32024,24942,15916,26066,-32156,30960,28414,14488,17916,960,13616,10354,
+	1160,-12478,-15444,-16456,-296,-15838,-21594,-22284,-27820,-32170,-30612,-21188,
+	-14772,-21980,-27256,-14984,-10506,3304,4000,-8688,-6156,-5022,11244,26072,
+	25440,14392,20386,20246,-32458,32172,32566,20582,22134,13294,21696,19302,
+	13748,-7474,-11304,-10030,582,-2596,-16986,-31442,-30166,32752,-23944,-20632,
+	-22002,-27978,-21400,-23690,-4236,-4956,3502,1864,2842,52,19944,22342,
+	25360,14872,24944,22600,32458,31754,30026,24514,12090,13608,12204,8580,
+	5466,-3344,-2608,-13436,-3746,-7788,-7940,-21276,-29092,-30118,-32686,-23970
+};
+
+#endif /* _G722_VECTORS_H */
@@ -0,0 +1,190 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006-2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/msqueue.h"
+#include "g711common.h"
+#include "g722.h"
+#include "g722_vectors.h"
+#include "mediastreamer2_tester.h"
+#include "mediastreamer2_tester_private.h"
+
+#include <stdio.h>
+#include "CUnit/Basic.h"
+
+
+static int audio_codec_tester_init(void) {
+	ms_init();
+	return 0;
+}
+
+static int audio_codec_tester_cleanup(void) {
+	ms_exit();
+	return 0;
+}
+
+#define G722_TEST_SAMPLES (sizeof(g722_golden_decoded) / sizeof(g722_golden_decoded[0]))
+
+/* Integer only, so that the golden vectors do not depend on the math library: a loud triangle and square mix with
+ * noise, then the same very quiet, then the same clipping, 20 ms each. */
+static void g722_test_signal(int16_t *pcm, int nsamples) {
+	uint32_t seed = 1;
+	int i;
+	for (i = 0; i < nsamples; ++i) {
+		int tri = (i % 36 < 18 ? i % 36 : 36 - i % 36) * 2 - 18;
+		int square = (i % 6 < 3) ? 3000 : -3000;
+		int v;
+		seed = seed * 1103515245 + 12345;
+		v = tri * 1000 + square + (int)((seed >> 16) & 0x1fff) - 4096;
+		if (i / 320 == 1) v /= 64;
+		else if (i / 320 == 2) v *= 2;
+		pcm[i] = (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+	}
+}
+
+static void g722_block_golden_vectors(void) {
+	int16_t pcm[G722_TEST_SAMPLES];
+	int16_t decoded[G722_TEST_SAMPLES];
+	uint8_t encoded[G722_TEST_SAMPLES / 2];
+	struct g722_encode_state *enc = g722_encode_init(NULL, 64000, 0);
+	struct g722_decode_state *dec = g722_decode_init(NULL, 64000, 0);
+	int i, nbytes = 0, nsamples = 0;
+
+	g722_test_signal(pcm, G722_TEST_SAMPLES);
+	for (i = 0; i < (int)G722_TEST_SAMPLES; i += 320)
+		nbytes += g722_encode_block(enc, encoded + nbytes, pcm + i, 320);
+	CU_ASSERT_EQUAL(nbytes, sizeof(g722_golden_encoded));
+	CU_ASSERT_EQUAL(memcmp(encoded, g722_golden_encoded, sizeof(g722_golden_encoded)), 0);
+
+	/* the reference stream, so that an encoder mismatch does not hide the decoder's */
+	for (i = 0; i < (int)sizeof(g722_golden_encoded); i += 160)
+		nsamples += g722_decode_block(dec, decoded + nsamples, g722_golden_encoded + i, 160);
+	CU_ASSERT_EQUAL(nsamples, G722_TEST_SAMPLES);
+	CU_ASSERT_EQUAL(memcmp(decoded, g722_golden_decoded, sizeof(g722_golden_decoded)), 0);
+	g722_encode_release(enc);
+	g722_decode_release(dec);
+}
+
+static void g722_per_sample_golden_vectors(void) {
+	int16_t pcm[G722_TEST_SAMPLES];
+	int16_t decoded[G722_TEST_SAMPLES];
+	uint8_t encoded[G722_TEST_SAMPLES / 2];
+	struct g722_encode_state *enc = g722_encode_init(NULL, 64000, 0);
+	struct g722_decode_state *dec = g722_decode_init(NULL, 64000, 0);
+	int i, nbytes = 0, nsamples = 0;
+
+	g722_test_signal(pcm, G722_TEST_SAMPLES);
+	for (i = 0; i < (int)G722_TEST_SAMPLES; ++i) pcm[i] = pcm[i] >> 1;
+	for (i = 0; i < (int)G722_TEST_SAMPLES; i += 320)
+		nbytes += g722_encode(enc, encoded + nbytes, pcm + i, 320);
+	CU_ASSERT_EQUAL(nbytes, sizeof(g722_golden_encoded));
+	CU_ASSERT_EQUAL(memcmp(encoded, g722_golden_encoded, sizeof(g722_golden_encoded)), 0);
+
+	for (i = 0; i < (int)sizeof(g722_golden_encoded); i += 160)
+		nsamples += g722_decode(dec, decoded + nsamples, g722_golden_encoded + i, 160);
+	CU_ASSERT_EQUAL(nsamples, G722_TEST_SAMPLES);
+	for (i = 0; i < nsamples; ++i) decoded[i] = (int16_t)(decoded[i] << 1);
+	CU_ASSERT_EQUAL(memcmp(decoded, g722_golden_decoded, sizeof(g722_golden_decoded)), 0);
+	g722_encode_release(enc);
+	g722_decode_release(dec);
+}
+
+typedef unsigned char (*G711EncodeFunc)(int);
+typedef int (*G711DecodeFunc)(unsigned char);
+typedef void (*G711EncodeBufFunc)(const int16_t *, uint8_t *, int);
+typedef void (*G711DecodeBufFunc)(const uint8_t *, int16_t *, int);
+
+/* every input, through buffers of all lengths and alignments so that the vectorized parts and their tails are covered */
+static void g711_check_tables(G711EncodeFunc encode, G711DecodeFunc decode, G711EncodeBufFunc encode_buf, G711DecodeBufFunc decode_buf) {
+	int16_t *pcm = ms_new(int16_t, 65536);
+	uint8_t *coded = ms_new(uint8_t, 65536);
+	uint8_t codes[256];
+	int16_t decoded[256];
+	int i, len, encode_errors = 0, decode_errors = 0;
+
+	g711_init_tables();
+	for (i = 0; i < 65536; ++i) pcm[i] = (int16_t)(i - 32768);
+	for (i = 0, len = 1; i < 65536; i += len, len = len % 37 + 1)
+		encode_buf(pcm + i, coded + i, MIN(len, 65536 - i));
+	for (i = 0; i < 65536; ++i)
+		if (coded[i] != encode(pcm[i])) encode_errors++;
+	CU_ASSERT_EQUAL(encode_errors, 0);
+
+	for (i = 0; i < 256; ++i) codes[i] = (uint8_t)i;
+	for (i = 0, len = 1; i < 256; i += len, len = len % 11 + 1)
+		decode_buf(codes + i, decoded + i, MIN(len, 256 - i));
+	for (i = 0; i < 256; ++i)
+		if (decoded[i] != decode(codes[i])) decode_errors++;
+	CU_ASSERT_EQUAL(decode_errors, 0);
+	ms_free(pcm);
+	ms_free(coded);
+}
+
+static void g711_alaw_tables(void) {
+	g711_check_tables(s16_to_alaw, alaw_to_s16, s16_to_alaw_buf, alaw_to_s16_buf);
+}
+
+static void g711_ulaw_tables(void) {
+	g711_check_tables(s16_to_ulaw, ulaw_to_s16, s16_to_ulaw_buf, ulaw_to_s16_buf);
+}
+
+/* samples split across blocks of odd sizes, some of them misaligned */
+static void g711_encode_from_fragmented_bufferizer(void) {
+	MSBufferizer *bz = ms_bufferizer_new();
+	int16_t pcm[400];
+	uint8_t coded[400];
+	int i, pos = 0, len = 1, errors = 0;
+
+	g711_init_tables();
+	for (i = 0; i < 400; ++i) pcm[i] = (int16_t)((i * 2654435761u) >> 16);
+	while (pos < (int)sizeof(pcm)) {
+		int n = MIN(len, (int)sizeof(pcm) - pos);
+		mblk_t *m = allocb(n + 1, 0);
+		m->b_rptr += (len & 2) ? 1 : 0;
+		m->b_wptr = m->b_rptr;
+		memcpy(m->b_wptr, (uint8_t *)pcm + pos, n);
+		m->b_wptr += n;
+		ms_bufferizer_put(bz, m);
+		pos += n;
+		len = len % 13 + 1;
+	}
+	g711_encode_from_bufferizer(bz, coded, 400, s16_to_ulaw_buf);
+	for (i = 0; i < 400; ++i)
+		if (coded[i] != s16_to_ulaw(pcm[i])) errors++;
+	CU_ASSERT_EQUAL(errors, 0);
+	CU_ASSERT_EQUAL(ms_bufferizer_get_avail(bz), 0);
+	ms_bufferizer_destroy(bz);
+}
+
+
+test_t audio_codec_tests[] = {
+	{ "g722-block-golden-vectors", g722_block_golden_vectors },
+	{ "g722-per-sample-golden-vectors", g722_per_sample_golden_vectors },
+	{ "g711-alaw-tables", g711_alaw_tables },
+	{ "g711-ulaw-tables", g711_ulaw_tables },
+	{ "g711-encode-from-fragmented-bufferizer", g711_encode_from_fragmented_bufferizer }
+};
+
+test_suite_t audio_codec_test_suite = {
+	"Audio Codecs",
+	audio_codec_tester_init,
+	audio_codec_tester_cleanup,
+	sizeof(audio_codec_tests) / sizeof(audio_codec_tests[0]),
+	audio_codec_tests
+};
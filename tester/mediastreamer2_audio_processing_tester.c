@@ -0,0 +1,760 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006-2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/msaudiomixer.h"
+#include "mediastreamer2/msaudiorelay.h"
+#include "mediastreamer2/msequalizer.h"
+#include "mediastreamer2/mscodecutils.h"
+#include "mediastreamer2/msvolume.h"
+#include "mediastreamer2/mspayloadrec.h"
+#include "g711common.h"
+#include "mediastreamer2_tester.h"
+#include "mediastreamer2_tester_private.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "CUnit/Basic.h"
+
+
+#ifdef _MSC_VER
+#define unlink _unlink
+#endif
+
+/* The filters of this suite are run by hand, one tick at a time, through queues connected to their pins, so that
+ * their outputs can be checked sample by sample. The ticker is not running, its time only moves with the ticks. */
+
+#define MAX_TEST_PINS 4
+
+static MSTicker test_ticker;
+static MSQueue test_inputs[MAX_TEST_PINS];
+static MSQueue test_outputs[MAX_TEST_PINS];
+
+static int audio_processing_tester_init(void) {
+	ms_init();
+	return 0;
+}
+
+static int audio_processing_tester_cleanup(void) {
+	ms_exit();
+	return 0;
+}
+
+static MSFilter *create_test_filter(MSFilterId id, int ninputs, int noutputs) {
+	MSFilter *f = ms_filter_new(id);
+	int i;
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	for (i = 0; i < ninputs; ++i) {
+		ms_queue_init(&test_inputs[i]);
+		f->inputs[i] = &test_inputs[i];
+	}
+	for (i = 0; i < noutputs; ++i) {
+		ms_queue_init(&test_outputs[i]);
+		f->outputs[i] = &test_outputs[i];
+	}
+	memset(&test_ticker, 0, sizeof(test_ticker));
+	test_ticker.interval = 10;
+	f->ticker = &test_ticker;
+	return f;
+}
+
+static void preprocess_test_filter(MSFilter *f) {
+	if (f->desc->preprocess) f->desc->preprocess(f);
+}
+
+static void postprocess_test_filter(MSFilter *f) {
+	if (f->desc->postprocess) f->desc->postprocess(f);
+}
+
+static void process_tick(MSFilter *f) {
+	f->desc->process(f);
+	test_ticker.time += test_ticker.interval;
+}
+
+static void destroy_test_filter(MSFilter *f) {
+	int i;
+	for (i = 0; i < MIN(f->desc->ninputs, MAX_TEST_PINS); ++i) {
+		if (f->inputs[i]) ms_queue_flush(f->inputs[i]);
+		f->inputs[i] = NULL;
+	}
+	for (i = 0; i < MIN(f->desc->noutputs, MAX_TEST_PINS); ++i) {
+		if (f->outputs[i]) ms_queue_flush(f->outputs[i]);
+		f->outputs[i] = NULL;
+	}
+	ms_filter_destroy(f);
+}
+
+static void put_constant(MSQueue *q, int16_t value, int nsamples) {
+	mblk_t *m = allocb(nsamples * 2, 0);
+	int i;
+	for (i = 0; i < nsamples; ++i) ((int16_t *)m->b_wptr)[i] = value;
+	m->b_wptr += nsamples * 2;
+	ms_queue_put(q, m);
+}
+
+/* the first sample of the last block of the queue, -1 if empty, the queue is flushed */
+static int get_last_sample(MSQueue *q) {
+	mblk_t *m;
+	int value = -1;
+	while ((m = ms_queue_get(q)) != NULL) {
+		if (m->b_wptr > m->b_rptr) value = *(int16_t *)m->b_rptr;
+		freemsg(m);
+	}
+	return value;
+}
+
+/* minimum and maximum of the samples of the blocks in the queue, which is flushed. Returns the number of samples */
+static int get_sample_range(MSQueue *q, int *min, int *max) {
+	mblk_t *m;
+	int n = 0;
+	*min = 32767;
+	*max = -32768;
+	while ((m = ms_queue_get(q)) != NULL) {
+		int16_t *samples = (int16_t *)m->b_rptr;
+		int i, count = (int)(m->b_wptr - m->b_rptr) / 2;
+		for (i = 0; i < count; ++i) {
+			if (samples[i] < *min) *min = samples[i];
+			if (samples[i] > *max) *max = samples[i];
+		}
+		n += count;
+		freemsg(m);
+	}
+	return n;
+}
+
+static void mixer_max_speakers(void) {
+	MSFilter *mixer;
+	int values[MAX_TEST_PINS] = { 1000, 2000, 4000, 0 };
+	int conf_mode = 1;
+	int max_speakers = 2;
+	int rate = 8000;
+	int nsamples, i, tick;
+
+	mixer = create_test_filter(MS_AUDIO_MIXER_ID, MAX_TEST_PINS, MAX_TEST_PINS);
+	ms_filter_call_method(mixer, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE, &conf_mode);
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_SET_MAX_SPEAKERS, &max_speakers);
+	nsamples = (rate * test_ticker.interval) / 1000;
+	preprocess_test_filter(mixer);
+
+	for (tick = 0; tick < 50; ++tick) {
+		for (i = 0; i < MAX_TEST_PINS; ++i) put_constant(&test_inputs[i], values[i], nsamples);
+		process_tick(mixer);
+		if (tick == 5) {
+			/* the first two channels got the slots, the loudest one waits for the hold time of the weakest */
+			CU_ASSERT_EQUAL(get_last_sample(&test_outputs[3]), 3000);
+			CU_ASSERT_EQUAL(get_last_sample(&test_outputs[2]), 3000);
+			CU_ASSERT_EQUAL(get_last_sample(&test_outputs[0]), 2000);
+		}
+	}
+	/* the loudest channel took the place of the weakest, which now only listens */
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[3]), 6000);
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[0]), 6000);
+	/* speakers do not hear themselves */
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[1]), 4000);
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[2]), 2000);
+
+	/* back to mixing everybody */
+	max_speakers = 0;
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_SET_MAX_SPEAKERS, &max_speakers);
+	for (i = 0; i < MAX_TEST_PINS; ++i) put_constant(&test_inputs[i], values[i], nsamples);
+	process_tick(mixer);
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[3]), 7000);
+	CU_ASSERT_EQUAL(get_last_sample(&test_outputs[0]), 6000);
+
+	postprocess_test_filter(mixer);
+	destroy_test_filter(mixer);
+}
+
+static void mixer_output_rate(void) {
+	MSFilter *mixer;
+	MSAudioMixerCtl ctl;
+	int conf_mode = 1;
+	int rate = 8000;
+	int nsamples, tick, n, min, max;
+
+	mixer = create_test_filter(MS_AUDIO_MIXER_ID, 3, 3);
+	ms_filter_call_method(mixer, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE, &conf_mode);
+	/* a speaker and a listener at 16 kHz, another speaker at the mixer rate */
+	ctl.pin = 0;
+	ctl.param.rate = 16000;
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_SET_OUTPUT_RATE, &ctl);
+	ctl.pin = 2;
+	ms_filter_call_method(mixer, MS_AUDIO_MIXER_SET_OUTPUT_RATE, &ctl);
+	nsamples = (rate * test_ticker.interval) / 1000;
+	preprocess_test_filter(mixer);
+
+	for (tick = 0; tick < 20; ++tick) {
+		put_constant(&test_inputs[0], 1000, nsamples);
+		put_constant(&test_inputs[1], 2000, nsamples);
+		put_constant(&test_inputs[2], 0, nsamples);
+		process_tick(mixer);
+		if (tick < 10) {
+			/* let the resamplers settle */
+			ms_queue_flush(&test_outputs[0]);
+			ms_queue_flush(&test_outputs[1]);
+			ms_queue_flush(&test_outputs[2]);
+		}
+	}
+	n = get_sample_range(&test_outputs[0], &min, &max);
+	CU_ASSERT_TRUE(n >= 10 * 2 * nsamples - 2 * nsamples && n <= 10 * 2 * nsamples + 2 * nsamples);
+	CU_ASSERT_TRUE(min >= 1980 && max <= 2020);
+	get_sample_range(&test_outputs[2], &min, &max);
+	CU_ASSERT_TRUE(min >= 2970 && max <= 3030);
+	n = get_sample_range(&test_outputs[1], &min, &max);
+	CU_ASSERT_EQUAL(n, 10 * nsamples);
+	CU_ASSERT_TRUE(min == 1000 && max == 1000);
+
+	/* the first speaker stops: the tail of its contribution that the resampler of the bus still outputs must not be
+	 * heard back */
+	for (tick = 0; tick < 5; ++tick) {
+		put_constant(&test_inputs[1], 2000, nsamples);
+		put_constant(&test_inputs[2], 0, nsamples);
+		process_tick(mixer);
+	}
+	get_sample_range(&test_outputs[0], &min, &max);
+	CU_ASSERT_TRUE(min >= 1980 && max <= 2020);
+
+	postprocess_test_filter(mixer);
+	destroy_test_filter(mixer);
+}
+
+#define PLC_TEST_PERIOD 80 /*100 Hz at 8 kHz*/
+
+static int16_t plc_test_signal(int n) {
+	double phase = 2 * M_PI * (double)(n % PLC_TEST_PERIOD) / PLC_TEST_PERIOD;
+	return (int16_t)(8000 * sin(phase) + 4000 * sin(3 * phase + 0.5));
+}
+
+static void put_plc_test_signal(MSQueue *q, int from, int nsamples) {
+	mblk_t *m = allocb(nsamples * 2, 0);
+	int i;
+	for (i = 0; i < nsamples; ++i) ((int16_t *)m->b_wptr)[i] = plc_test_signal(from + i);
+	m->b_wptr += nsamples * 2;
+	ms_queue_put(q, m);
+}
+
+static void generic_plc_pitch_substitution(void) {
+	MSFilter *plc;
+	int rate = 8000;
+	int nsamples, n = 0, tick, i;
+	int max_error = 0, concealed = 0, muted = 0;
+	mblk_t *m;
+
+	plc = create_test_filter(MS_GENERIC_PLC_ID, 1, 1);
+	ms_filter_call_method(plc, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	nsamples = (rate * test_ticker.interval) / 1000;
+	preprocess_test_filter(plc);
+	for (tick = 0; tick < 10; ++tick, n += nsamples) {
+		put_plc_test_signal(&test_inputs[0], n, nsamples);
+		process_tick(plc);
+	}
+	ms_queue_flush(&test_outputs[0]);
+
+	/* 100 ms lost: the first concealed block is the continuation of the periodic signal, then it fades out */
+	for (tick = 0; tick < 10; ++tick) {
+		process_tick(plc);
+		while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+			int16_t *samples = (int16_t *)m->b_rptr;
+			int count = (int)(m->b_wptr - m->b_rptr) / 2;
+			bool_t silent = TRUE;
+			CU_ASSERT_TRUE(mblk_get_plc_flag(m));
+			CU_ASSERT_EQUAL(count, nsamples);
+			for (i = 0; i < count; ++i) {
+				if (concealed == 0) max_error = MAX(max_error, abs(samples[i] - plc_test_signal(n + i)));
+				if (samples[i] != 0) silent = FALSE;
+			}
+			if (concealed == 0) CU_ASSERT_FALSE(silent);
+			if (silent) muted++;
+			concealed++;
+			n += count;
+			freemsg(m);
+		}
+	}
+	CU_ASSERT_TRUE(concealed >= 8);
+	CU_ASSERT_TRUE(max_error <= 2);
+	CU_ASSERT_TRUE(muted >= 2);
+
+	/* reception resumes: the received blocks are output again, without any concealment */
+	for (tick = 0; tick < 3; ++tick, n += nsamples) {
+		put_plc_test_signal(&test_inputs[0], n, nsamples);
+		process_tick(plc);
+	}
+	while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+		CU_ASSERT_FALSE(mblk_get_plc_flag(m));
+		freemsg(m);
+	}
+
+	postprocess_test_filter(plc);
+	destroy_test_filter(plc);
+}
+
+#define EQUALIZER_TEST_RATE 16000 /*256 taps, convolved in the frequency domain*/
+#define EQUALIZER_TEST_SAMPLES 3200
+#define EQUALIZER_TEST_TAPS 256
+#define EQUALIZER_IMPULSE 16384
+
+/* runs the samples through an equalizer cutting the highs and boosting the lows, in blocks of varying lengths */
+static void run_equalizer(const int16_t *in, int16_t *out, int nsamples) {
+	static const int block_lengths[] = { 160, 97, 257, 40 };
+	MSEqualizerGain cut = { 3000, 0.2f, 1000 };
+	MSEqualizerGain boost = { 500, 1.2f, 200 };
+	MSFilter *eq;
+	mblk_t *m;
+	int rate = EQUALIZER_TEST_RATE;
+	int pos = 0, outpos = 0, i;
+
+	eq = create_test_filter(MS_EQUALIZER_ID, 1, 1);
+	ms_filter_call_method(eq, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	ms_filter_call_method(eq, MS_EQUALIZER_SET_GAIN, &cut);
+	ms_filter_call_method(eq, MS_EQUALIZER_SET_GAIN, &boost);
+	preprocess_test_filter(eq);
+	for (i = 0; pos < nsamples; ++i) {
+		int n = MIN(block_lengths[i % 4], nsamples - pos);
+		m = allocb(n * 2, 0);
+		memcpy(m->b_wptr, in + pos, n * 2);
+		m->b_wptr += n * 2;
+		ms_queue_put(&test_inputs[0], m);
+		process_tick(eq);
+		pos += n;
+	}
+	while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+		int count = (int)(m->b_wptr - m->b_rptr) / 2;
+		if (outpos + count <= nsamples) memcpy(out + outpos, m->b_rptr, count * 2);
+		outpos += count;
+		freemsg(m);
+	}
+	CU_ASSERT_EQUAL(outpos, nsamples);
+	postprocess_test_filter(eq);
+	destroy_test_filter(eq);
+}
+
+/* the output of the overlap-add convolution against the direct fir with the impulse response of the same filter */
+static void equalizer_overlap_add(void) {
+	int16_t *impulse = ms_new0(int16_t, EQUALIZER_TEST_SAMPLES);
+	int16_t *response = ms_new0(int16_t, EQUALIZER_TEST_SAMPLES);
+	int16_t *in = ms_new0(int16_t, EQUALIZER_TEST_SAMPLES);
+	int16_t *out = ms_new0(int16_t, EQUALIZER_TEST_SAMPLES);
+	uint32_t seed = 1;
+	double max_error = 0, max_diff = 0;
+	int i, k, tail = 0;
+
+	impulse[0] = EQUALIZER_IMPULSE;
+	run_equalizer(impulse, response, EQUALIZER_TEST_SAMPLES);
+	for (i = EQUALIZER_TEST_TAPS; i < EQUALIZER_TEST_SAMPLES; ++i) tail = MAX(tail, abs(response[i]));
+	CU_ASSERT_EQUAL(tail, 0);
+
+	for (i = 0; i < EQUALIZER_TEST_SAMPLES; ++i) {
+		seed = seed * 1103515245 + 12345;
+		in[i] = (int16_t)(((seed >> 16) & 0x1fff) - 4096);
+	}
+	run_equalizer(in, out, EQUALIZER_TEST_SAMPLES);
+	for (i = 0; i < EQUALIZER_TEST_SAMPLES; ++i) {
+		double expected = 0;
+		for (k = 0; k < EQUALIZER_TEST_TAPS && k <= i; ++k) expected += (double)response[k] * in[i - k];
+		expected /= EQUALIZER_IMPULSE;
+		max_error = MAX(max_error, fabs(out[i] - expected));
+		max_diff = MAX(max_diff, fabs(out[i] - in[i]));
+	}
+	/* the rounding of the impulse response and of the output only */
+	CU_ASSERT_TRUE(max_error <= 8);
+	/* and the equalizer did change the signal */
+	CU_ASSERT_TRUE(max_diff >= 500);
+	ms_free(impulse);
+	ms_free(response);
+	ms_free(in);
+	ms_free(out);
+}
+
+/* speech, then silence for the whole 200 ms hangover before the blocks are flagged, then speech again */
+static void volume_dtx(void) {
+	MSFilter *vol;
+	int enable = 1;
+	int nsamples, n = 0, tick;
+	int speech_flagged = 0, hangover = -1;
+	mblk_t *m;
+
+	vol = create_test_filter(MS_VOLUME_ID, 1, 1);
+	ms_filter_call_method(vol, MS_VOLUME_ENABLE_DTX, &enable);
+	nsamples = (8000 * test_ticker.interval) / 1000;
+	preprocess_test_filter(vol);
+	for (tick = 0; tick < 10; ++tick, n += nsamples) {
+		put_plc_test_signal(&test_inputs[0], n, nsamples);
+		process_tick(vol);
+	}
+	while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+		if (mblk_get_silence_flag(m)) speech_flagged++;
+		freemsg(m);
+	}
+	CU_ASSERT_EQUAL(speech_flagged, 0);
+
+	for (tick = 0; tick < 40; ++tick) {
+		put_constant(&test_inputs[0], 0, nsamples);
+		process_tick(vol);
+		while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+			if (hangover == -1 && mblk_get_silence_flag(m)) hangover = tick * test_ticker.interval;
+			if (hangover != -1) CU_ASSERT_TRUE(mblk_get_silence_flag(m));
+			freemsg(m);
+		}
+	}
+	CU_ASSERT_TRUE(hangover >= 180 && hangover <= 210);
+
+	put_plc_test_signal(&test_inputs[0], n, nsamples);
+	process_tick(vol);
+	m = ms_queue_get(&test_outputs[0]);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+	CU_ASSERT_FALSE(mblk_get_silence_flag(m));
+	freemsg(m);
+
+	postprocess_test_filter(vol);
+	destroy_test_filter(vol);
+}
+
+#define DTX_TEST_CN_LEVEL 50
+
+typedef struct _DtxTestOutput {
+	int frames;
+	int cn_frames;
+	int cn_level;
+	uint32_t resume_ts; /*timestamp of the first frame after the silence*/
+	mblk_t *first_cn;
+} DtxTestOutput;
+
+/* 100 ms of speech, 1.5 s of noise marked as silence, 100 ms of speech, through a 20 ms G.711 encoder */
+static void run_g711_dtx(MSFilterId id, bool_t cn, DtxTestOutput *res) {
+	MSFilter *enc;
+	uint32_t seed = 1;
+	int nsamples, n = 0, tick;
+	mblk_t *m;
+
+	memset(res, 0, sizeof(*res));
+	res->cn_level = -1;
+	enc = create_test_filter(id, 1, 1);
+	ms_filter_call_method(enc, MS_AUDIO_ENCODER_ENABLE_CN, &cn);
+	nsamples = (8000 * test_ticker.interval) / 1000;
+	preprocess_test_filter(enc);
+	for (tick = 0; tick < 170; ++tick, n += nsamples) {
+		if (tick < 10 || tick >= 160) {
+			put_plc_test_signal(&test_inputs[0], n, nsamples);
+		} else {
+			m = allocb(nsamples * 2, 0);
+			ms_comfort_noise_generate(DTX_TEST_CN_LEVEL, (int16_t *)m->b_wptr, nsamples, &seed);
+			m->b_wptr += nsamples * 2;
+			mblk_set_silence_flag(m, 1);
+			ms_queue_put(&test_inputs[0], m);
+		}
+		process_tick(enc);
+		while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+			res->frames++;
+			if (mblk_get_cn_flag(m)) {
+				CU_ASSERT_EQUAL(msgdsize(m), 1);
+				if (res->cn_frames++ == 0) {
+					res->cn_level = m->b_rptr[0];
+					res->first_cn = m;
+					continue;
+				}
+			} else {
+				CU_ASSERT_EQUAL(msgdsize(m), 160);
+				if (tick >= 160 && res->resume_ts == 0) res->resume_ts = mblk_get_timestamp_info(m);
+			}
+			freemsg(m);
+		}
+	}
+	postprocess_test_filter(enc);
+	destroy_test_filter(enc);
+}
+
+static void g711_dtx_comfort_noise(void) {
+	DtxTestOutput res;
+	MSFilter *dec;
+	mblk_t *m;
+	int16_t *samples;
+
+	/* one CN payload when the silence begins, and one refresh a second later */
+	run_g711_dtx(MS_ULAW_ENC_ID, TRUE, &res);
+	CU_ASSERT_EQUAL(res.cn_frames, 2);
+	CU_ASSERT_EQUAL(res.frames, 5 + 2 + 5);
+	CU_ASSERT_TRUE(abs(res.cn_level - DTX_TEST_CN_LEVEL) <= 1);
+	CU_ASSERT_EQUAL(res.resume_ts, 160 * 80);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(res.first_cn);
+
+	/* the decoder turns it back into noise of the same level */
+	dec = create_test_filter(MS_ULAW_DEC_ID, 1, 1);
+	preprocess_test_filter(dec);
+	ms_queue_put(&test_inputs[0], res.first_cn);
+	process_tick(dec);
+	m = ms_queue_get(&test_outputs[0]);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+	CU_ASSERT_TRUE(mblk_get_silence_flag(m));
+	CU_ASSERT_FALSE(mblk_get_cn_flag(m));
+	samples = (int16_t *)m->b_rptr;
+	CU_ASSERT_TRUE(abs(ms_comfort_noise_get_level(samples, (int)(m->b_wptr - m->b_rptr) / 2) - DTX_TEST_CN_LEVEL) <= 2);
+	freemsg(m);
+	postprocess_test_filter(dec);
+	destroy_test_filter(dec);
+
+	/* without a negotiated CN payload type, the silence is encoded like speech */
+	run_g711_dtx(MS_ALAW_ENC_ID, FALSE, &res);
+	CU_ASSERT_EQUAL(res.cn_frames, 0);
+	CU_ASSERT_EQUAL(res.frames, 85);
+}
+
+#define RELAY_TEST_MEMBERS 3
+#define RELAY_TEST_PAYLOAD 80
+
+/* a 10 ms PCMU payload, the periodic test signal for a speaker, and a quiet constant specific to each member otherwise,
+ * so that the member a forwarded payload comes from can be told */
+static void put_relay_payload(MSQueue *q, int member, bool_t speaking, int tick, uint8_t *payload) {
+	uint32_t ts = member * 100000 + tick * RELAY_TEST_PAYLOAD;
+	mblk_t *m = allocb(RELAY_TEST_PAYLOAD, 0);
+	int i;
+	for (i = 0; i < RELAY_TEST_PAYLOAD; ++i)
+		payload[i] = s16_to_ulaw(speaking ? plc_test_signal(tick * RELAY_TEST_PAYLOAD + i) : member * 16 + 8);
+	memcpy(m->b_wptr, payload, RELAY_TEST_PAYLOAD);
+	m->b_wptr += RELAY_TEST_PAYLOAD;
+	mblk_set_timestamp_info(m, ts);
+	ms_queue_put(q, m);
+}
+
+static int get_relay_source(mblk_t *m, uint8_t payloads[RELAY_TEST_MEMBERS][RELAY_TEST_PAYLOAD]) {
+	int i;
+	for (i = 0; i < RELAY_TEST_MEMBERS; ++i)
+		if (msgdsize(m) == RELAY_TEST_PAYLOAD && memcmp(m->b_rptr, payloads[i], RELAY_TEST_PAYLOAD) == 0) return i;
+	return -1;
+}
+
+/* member 0 speaks, then member 1, which is then muted. Member 2 listens and must receive a single continuous stream */
+static void audio_relay_speaker_switch(void) {
+	MSFilter *relay;
+	uint8_t payloads[RELAY_TEST_MEMBERS][RELAY_TEST_PAYLOAD];
+	MSAudioMixerCtl ctl;
+	int rate = 8000;
+	int tick, i, speaker = -1, switch_tick = -1;
+	int listener_packets = 0, markers = 0, ts_errors = 0, source_errors = 0, previous_speaker_packets = 0;
+	uint32_t last_ts = 0;
+	mblk_t *m;
+
+	relay = create_test_filter(MS_AUDIO_RELAY_ID, RELAY_TEST_MEMBERS, RELAY_TEST_MEMBERS);
+	ms_filter_call_method(relay, MS_AUDIO_RELAY_SET_CODEC, "pcmu");
+	ms_filter_call_method(relay, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	preprocess_test_filter(relay);
+	for (tick = 0; tick < 100; ++tick) {
+		if (tick == 80) {
+			ctl.pin = 1;
+			ctl.param.active = 0;
+			ms_filter_call_method(relay, MS_AUDIO_RELAY_SET_ACTIVE, &ctl);
+		}
+		for (i = 0; i < RELAY_TEST_MEMBERS; ++i)
+			put_relay_payload(&test_inputs[i], i, (i == 0 && tick < 40) || (i == 1 && tick >= 40), tick, payloads[i]);
+		process_tick(relay);
+		ms_filter_call_method(relay, MS_AUDIO_RELAY_GET_SPEAKER, &speaker);
+		if (tick == 39) CU_ASSERT_EQUAL(speaker, 0);
+		if (speaker == 1 && switch_tick == -1) switch_tick = tick;
+
+		while ((m = ms_queue_get(&test_outputs[2])) != NULL) {
+			uint32_t ts = mblk_get_timestamp_info(m);
+			if (get_relay_source(m, payloads) != speaker) source_errors++;
+			if (listener_packets > 0 && ts != last_ts + RELAY_TEST_PAYLOAD) ts_errors++;
+			if (mblk_get_marker_info(m)) markers++;
+			last_ts = ts;
+			listener_packets++;
+			freemsg(m);
+		}
+		/* the active speaker hears the previous one */
+		while ((m = ms_queue_get(&test_outputs[1])) != NULL) {
+			if (speaker == 1) {
+				if (get_relay_source(m, payloads) != 0) source_errors++;
+				else previous_speaker_packets++;
+			}
+			freemsg(m);
+		}
+		while ((m = ms_queue_get(&test_outputs[0])) != NULL) {
+			if (get_relay_source(m, payloads) != 1) source_errors++;
+			freemsg(m);
+		}
+	}
+	CU_ASSERT_TRUE(switch_tick >= 40 && switch_tick <= 45);
+	/* a muted member cannot remain the speaker */
+	CU_ASSERT_EQUAL(speaker, -1);
+	CU_ASSERT_EQUAL(listener_packets, 80);
+	CU_ASSERT_EQUAL(source_errors, 0);
+	CU_ASSERT_EQUAL(ts_errors, 0);
+	CU_ASSERT_EQUAL(markers, 2);
+	CU_ASSERT_EQUAL(previous_speaker_packets, 80 - switch_tick);
+
+	postprocess_test_filter(relay);
+	destroy_test_filter(relay);
+}
+
+#define PAYLOAD_REC_TEST_FILE "payloadrec_test.opus"
+#define PAYLOAD_REC_TEST_PACKETS 70
+#define PAYLOAD_REC_TEST_DURATION 960 /*20 ms at 48 kHz*/
+#define OPUS_TEST_TOC 0xf8 /*CELT fullband 20 ms, code 0: one frame*/
+
+/* sizes around the 255 bytes lacing values, packet 5 is lost and packet 7 is comfort noise */
+static int payload_rec_test_size(int i) {
+	static const int sizes[] = { 10, 254, 255, 256, 600, 0, 510, 0, 2, 1 };
+	return i < 10 ? sizes[i] : 20 + i;
+}
+
+static void payload_rec_test_packet(int i, uint8_t *data) {
+	int k;
+	data[0] = OPUS_TEST_TOC;
+	for (k = 1; k < payload_rec_test_size(i); ++k) data[k] = (uint8_t)(i * 31 + k);
+}
+
+/* table driven, unlike the recorder's */
+static uint32_t test_ogg_crc(const uint8_t *data, int len) {
+	static uint32_t table[256];
+	uint32_t crc = 0;
+	int i, j;
+	if (table[1] == 0) {
+		for (i = 0; i < 256; ++i) {
+			uint32_t r = (uint32_t)i << 24;
+			for (j = 0; j < 8; ++j) r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : r << 1;
+			table[i] = r;
+		}
+	}
+	for (i = 0; i < len; ++i) crc = (crc << 8) ^ table[(crc >> 24) ^ data[i]];
+	return crc;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* records Opus packets, then reads the Ogg pages back, checks them and rebuilds the packets from the lacing values */
+static void payload_rec_ogg_round_trip(void) {
+	MSFilter *rec;
+	FILE *file;
+	uint8_t packet[600];
+	uint8_t *buf;
+	int rate = 48000, nchannels = 1;
+	int size, pos = 0, page = 0, npackets = 0, plen = 0, i;
+	int crc_errors = 0, granule_errors = 0, packet_errors = 0;
+	uint32_t serial = 0;
+	uint8_t flags = 0;
+	mblk_t *m;
+
+	rec = create_test_filter(MS_PAYLOAD_REC_ID, 1, 0);
+	ms_filter_call_method(rec, MS_PAYLOAD_REC_SET_CODEC, "opus");
+	ms_filter_call_method(rec, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	ms_filter_call_method(rec, MS_FILTER_SET_NCHANNELS, &nchannels);
+	if (ms_filter_call_method(rec, MS_RECORDER_OPEN, PAYLOAD_REC_TEST_FILE) != 0) {
+		CU_FAIL("cannot open " PAYLOAD_REC_TEST_FILE);
+		destroy_test_filter(rec);
+		return;
+	}
+	ms_filter_call_method_noarg(rec, MS_RECORDER_START);
+	for (i = 0; i < PAYLOAD_REC_TEST_PACKETS; ++i) {
+		if (i != 5) {
+			m = allocb(600, 0);
+			payload_rec_test_packet(i, m->b_wptr);
+			m->b_wptr += (i == 7) ? 1 : payload_rec_test_size(i);
+			mblk_set_cn_flag(m, (i == 7));
+			mblk_set_timestamp_info(m, 1000 + i * PAYLOAD_REC_TEST_DURATION);
+			ms_queue_put(&test_inputs[0], m);
+		}
+		process_tick(rec);
+	}
+	ms_filter_call_method_noarg(rec, MS_RECORDER_CLOSE);
+	destroy_test_filter(rec);
+
+	file = fopen(PAYLOAD_REC_TEST_FILE, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	fseek(file, 0, SEEK_END);
+	size = (int)ftell(file);
+	fseek(file, 0, SEEK_SET);
+	buf = ms_new(uint8_t, size);
+	CU_ASSERT_EQUAL(fread(buf, 1, size, file), (size_t)size);
+	fclose(file);
+	unlink(PAYLOAD_REC_TEST_FILE);
+
+	while (pos + 27 <= size) {
+		uint8_t *header = buf + pos;
+		int nsegments = header[26], hlen = 27 + nsegments, data_len = 0, offset;
+		uint32_t crc = get_le32(header + 22);
+		int64_t granule = (int64_t)get_le32(header + 6) | ((int64_t)get_le32(header + 10) << 32);
+
+		if (memcmp(header, "OggS", 4) != 0 || header[4] != 0 || pos + hlen > size) break;
+		for (i = 0; i < nsegments; ++i) data_len += header[27 + i];
+		if (pos + hlen + data_len > size) break;
+		flags = header[5];
+		CU_ASSERT_EQUAL(flags & 0x2, page == 0 ? 0x2 : 0);
+		CU_ASSERT_EQUAL(flags & 0x1, 0); /*packets never span pages*/
+		if (page == 0) serial = get_le32(header + 14);
+		CU_ASSERT_EQUAL(get_le32(header + 14), serial);
+		CU_ASSERT_EQUAL(get_le32(header + 18), (uint32_t)page);
+		memset(header + 22, 0, 4);
+		if (test_ogg_crc(header, hlen + data_len) != crc) crc_errors++;
+
+		offset = pos + hlen;
+		for (i = 0; i < nsegments; ++i) {
+			plen += header[27 + i];
+			if (header[27 + i] == 255) continue;
+			/*the identification and comment headers, then the audio packets*/
+			if (npackets == 0) {
+				CU_ASSERT_TRUE(plen == 19 && memcmp(buf + offset, "OpusHead", 8) == 0 && get_le32(buf + offset + 12) == 48000);
+			} else if (npackets == 1) {
+				CU_ASSERT_TRUE(plen >= 8 && memcmp(buf + offset, "OpusTags", 8) == 0);
+			} else {
+				int k = npackets - 2;
+				int expected = (k == 5 || k == 7) ? 1 : payload_rec_test_size(k);
+				payload_rec_test_packet(k, packet);
+				if (k >= PAYLOAD_REC_TEST_PACKETS || plen != expected || memcmp(buf + offset, packet, plen) != 0) packet_errors++;
+			}
+			offset += plen;
+			plen = 0;
+			npackets++;
+		}
+		if (granule != (int64_t)MAX(npackets - 2, 0) * PAYLOAD_REC_TEST_DURATION) granule_errors++;
+		pos += hlen + data_len;
+		page++;
+	}
+	CU_ASSERT_EQUAL(pos, size);
+	CU_ASSERT_TRUE(page >= 4);
+	CU_ASSERT_EQUAL(flags & 0x4, 0x4);
+	CU_ASSERT_EQUAL(npackets, 2 + PAYLOAD_REC_TEST_PACKETS);
+	CU_ASSERT_EQUAL(crc_errors, 0);
+	CU_ASSERT_EQUAL(granule_errors, 0);
+	CU_ASSERT_EQUAL(packet_errors, 0);
+	ms_free(buf);
+}
+
+
+test_t audio_processing_tests[] = {
+	{ "mixer-max-speakers", mixer_max_speakers },
+	{ "mixer-output-rate", mixer_output_rate },
+	{ "generic-plc-pitch-substitution", generic_plc_pitch_substitution },
+	{ "equalizer-overlap-add", equalizer_overlap_add },
+	{ "volume-dtx", volume_dtx },
+	{ "g711-dtx-comfort-noise", g711_dtx_comfort_noise },
+	{ "audio-relay-speaker-switch", audio_relay_speaker_switch },
+	{ "payload-rec-ogg-round-trip", payload_rec_ogg_round_trip }
+};
+
+test_suite_t audio_processing_test_suite = {
+	"Audio Processing",
+	audio_processing_tester_init,
+	audio_processing_tester_cleanup,
+	sizeof(audio_processing_tests) / sizeof(audio_processing_tests[0]),
+	audio_processing_tests
+};
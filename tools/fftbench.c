@@ -0,0 +1,96 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Compares the native FFT with kiss_fft: speed of a forward+backward transform pair, and the difference between
+ * the spectra they compute.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/dsptools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+
+static double now(void){
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec+tv.tv_usec*1e-6;
+}
+
+/*returns the time in nanoseconds of a forward+backward pair*/
+static double bench(const MSFFTBackend *backend, int size, const ms_word16_t *in, ms_word16_t *spectrum, int iterations){
+	void *fft;
+	ms_word16_t *tmp=ms_new(ms_word16_t,size);
+	double start;
+	int i;
+
+	ms_fft_set_backend(backend);
+	fft=ms_fft_init(size);
+	ms_fft(fft,(ms_word16_t*)in,spectrum);
+	start=now();
+	for(i=0;i<iterations;++i){
+		ms_fft(fft,(ms_word16_t*)in,tmp);
+		ms_ifft(fft,tmp,tmp);
+	}
+	start=(now()-start)*1e9/iterations;
+	ms_fft_destroy(fft);
+	ms_fft_set_backend(NULL);
+	ms_free(tmp);
+	return start;
+}
+
+int main(int argc, char *argv[]){
+	const MSFFTBackend *native=ms_fft_get_native_backend();
+	int size;
+
+	if (native==NULL){
+		printf("No native FFT in this build.\n");
+		return 0;
+	}
+	ms_fft_plans_init();
+	printf("%6s %12s %12s %8s %12s\n","size","kiss (ns)","native (ns)","speedup","max diff");
+	for(size=64;size<=8192;size*=2){
+		ms_word16_t *in=ms_new(ms_word16_t,size);
+		ms_word16_t *ref=ms_new(ms_word16_t,size);
+		ms_word16_t *out=ms_new(ms_word16_t,size);
+		int iterations=(1<<24)/size;
+		double tkiss,tnative,maxdiff=0;
+		int i;
+
+		for(i=0;i<size;++i) in[i]=(ms_word16_t)(rand()%65536-32768);
+		tkiss=bench(ms_fft_get_kiss_backend(),size,in,ref,iterations);
+		tnative=bench(native,size,in,out,iterations);
+		for(i=0;i<size;++i){
+			double d=fabs(ref[i]-out[i]);
+			if (d>maxdiff) maxdiff=d;
+		}
+		printf("%6i %12.0f %12.0f %8.2f %12g\n",size,tkiss,tnative,tkiss/tnative,maxdiff);
+		ms_free(in);
+		ms_free(ref);
+		ms_free(out);
+	}
+	ms_fft_plans_uninit();
+	return 0;
+}
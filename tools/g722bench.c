@@ -0,0 +1,133 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Compares the G.722 block functions, used by MSG722Enc/Dec and MSCodecFarm, with the per-sample reference code
+ * preceded or followed by the scaling these filters used to do: speed, and bit exactness of the encoded stream and
+ * of the decoded samples, at the three bitrates.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/mscommon.h"
+#include "g722.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define SAMPLE_RATE 16000
+#define DURATION 60 /*seconds*/
+#define FRAME_SIZE 320 /*20 ms*/
+
+static double now(void){
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec+tv.tv_usec*1e-6;
+}
+
+/*speech-like signal: two tones with a varying envelope, noise, and some clipping at the end*/
+static void generate(int16_t *pcm, int nsamples){
+	int i;
+	for(i=0;i<nsamples;++i){
+		double t=(double)i/SAMPLE_RATE;
+		double env=0.5+0.5*sin(2*M_PI*0.7*t);
+		double v=env*(16000*sin(2*M_PI*440*t)+8000*sin(2*M_PI*(2000+1000*sin(t))*t)+(rand()%8001-4000));
+		if (i>nsamples-SAMPLE_RATE) v*=3;
+		pcm[i]=(int16_t)(v>32767 ? 32767 : (v<-32768 ? -32768 : v));
+	}
+}
+
+static int run(int rate, const int16_t *pcm, int nsamples, uint8_t *code_ref, uint8_t *code_blk, int16_t *out_ref, int16_t *out_blk){
+	g722_encode_state_t enc;
+	g722_decode_state_t dec;
+	int16_t frame[FRAME_SIZE];
+	double tenc_ref,tenc_blk,tdec_ref,tdec_blk,start;
+	int ncodes,nref,nblk,i,j;
+
+	/*reference: scaling done by the caller, and the per-sample code*/
+	g722_encode_init(&enc,rate,0);
+	start=now();
+	for(j=0,nref=0;j<nsamples;j+=FRAME_SIZE){
+		for(i=0;i<FRAME_SIZE;++i) frame[i]=pcm[j+i]>>1;
+		nref+=g722_encode(&enc,code_ref+nref,frame,FRAME_SIZE);
+	}
+	tenc_ref=now()-start;
+	g722_encode_init(&enc,rate,0);
+	start=now();
+	for(j=0,nblk=0;j<nsamples;j+=FRAME_SIZE)
+		nblk+=g722_encode_block(&enc,code_blk+nblk,pcm+j,FRAME_SIZE);
+	tenc_blk=now()-start;
+	if (nref!=nblk || memcmp(code_ref,code_blk,nref)!=0){
+		printf("%i bit/s: encoded streams differ.\n",rate);
+		return -1;
+	}
+
+	ncodes=nref;
+	g722_decode_init(&dec,rate,0);
+	start=now();
+	for(j=0,nref=0;j<ncodes;j+=FRAME_SIZE/2){
+		int n=g722_decode(&dec,out_ref+nref,code_ref+j,FRAME_SIZE/2);
+		for(i=0;i<n;++i) out_ref[nref+i]=(int16_t)(out_ref[nref+i]<<1);
+		nref+=n;
+	}
+	tdec_ref=now()-start;
+	g722_decode_init(&dec,rate,0);
+	start=now();
+	for(j=0,nblk=0;j<ncodes;j+=FRAME_SIZE/2)
+		nblk+=g722_decode_block(&dec,out_blk+nblk,code_ref+j,FRAME_SIZE/2);
+	tdec_blk=now()-start;
+	if (nref!=nblk || memcmp(out_ref,out_blk,nref*sizeof(int16_t))!=0){
+		printf("%i bit/s: decoded samples differ.\n",rate);
+		return -1;
+	}
+
+	printf("%8i %14.3f %14.3f %8.2f %14.3f %14.3f %8.2f\n",rate,
+		tenc_ref*1e9/nsamples,tenc_blk*1e9/nsamples,tenc_ref/tenc_blk,
+		tdec_ref*1e9/nsamples,tdec_blk*1e9/nsamples,tdec_ref/tdec_blk);
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	static const int rates[3]={64000,56000,48000};
+	int nsamples=SAMPLE_RATE*DURATION;
+	int16_t *pcm=ms_new(int16_t,nsamples);
+	int16_t *out_ref=ms_new(int16_t,nsamples);
+	int16_t *out_blk=ms_new(int16_t,nsamples);
+	uint8_t *code_ref=ms_new(uint8_t,nsamples/2);
+	uint8_t *code_blk=ms_new(uint8_t,nsamples/2);
+	int err=0,i;
+
+	generate(pcm,nsamples);
+	printf("%8s %14s %14s %8s %14s %14s %8s\n","bitrate","enc ref (ns)","enc block (ns)","speedup",
+		"dec ref (ns)","dec block (ns)","speedup");
+	for(i=0;i<3 && err==0;++i)
+		err=run(rates[i],pcm,nsamples,code_ref,code_blk,out_ref,out_blk);
+	if (err==0) printf("Block functions are bit exact.\n");
+	ms_free(pcm);
+	ms_free(out_ref);
+	ms_free(out_blk);
+	ms_free(code_ref);
+	ms_free(code_blk);
+	return err==0 ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2013 Belledonne Communications, Grenoble
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Renders the recordings of MSPayloadRec to 16 bits wav files: Ogg Opus, Ogg Speex, and raw G.711.
+ * The granule positions of the Ogg pages are followed, so that the rendered file keeps the timeline of the call
+ * even where the recorder could not store the missing packets.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msqueue.h"
+#include "g711common.h"
+
+#ifdef HAVE_OPUS
+#include <opus/opus.h>
+#endif
+#ifdef HAVE_SPEEX
+#include <speex/speex.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PACKET_SIZE 65536
+#define MAX_FRAME_SAMPLES (5760*2) /*120 ms at 48 kHz, stereo*/
+
+static const char *usage="payloadrender <recording> <output.wav> [--codec pcmu|pcma] [--rate <rate>] [--channels <n>]\n"
+	"The codec of raw G.711 recordings is guessed from the .ul or .al extension, pcmu by default.\n";
+
+typedef struct WavWriter{
+	FILE *file;
+	int rate;
+	int nchannels;
+	int64_t nframes;
+} WavWriter;
+
+typedef struct OggReader{
+	FILE *file;
+	int64_t granule; /*granule position of the last page read*/
+	uint8_t page[255*255];
+	uint8_t segments[255];
+	int nsegments;
+	int segment; /*next segment to read*/
+	int offset; /*position of the next segment in the page*/
+	bool_t page_complete; /*the last segment of the current page ends a packet*/
+} OggReader;
+
+typedef struct Decoder{
+	void (*decode)(struct Decoder *d, const uint8_t *packet, int len, WavWriter *out);
+	void (*destroy)(struct Decoder *d);
+	void *state;
+	int preskip;
+} Decoder;
+
+static void put_le32(uint8_t *p, uint32_t val){
+	p[0]=val&0xff;
+	p[1]=(val>>8)&0xff;
+	p[2]=(val>>16)&0xff;
+	p[3]=(val>>24)&0xff;
+}
+
+static void put_le16(uint8_t *p, uint16_t val){
+	p[0]=val&0xff;
+	p[1]=(val>>8)&0xff;
+}
+
+static uint32_t get_le32(const uint8_t *p){
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static void wav_write_header(WavWriter *w){
+	uint8_t header[44];
+	uint32_t size=(uint32_t)(w->nframes*w->nchannels*2);
+	memcpy(header,"RIFF",4);
+	put_le32(header+4,size+36);
+	memcpy(header+8,"WAVEfmt ",8);
+	put_le32(header+16,16);
+	put_le16(header+20,1);
+	put_le16(header+22,w->nchannels);
+	put_le32(header+24,w->rate);
+	put_le32(header+28,w->rate*w->nchannels*2);
+	put_le16(header+32,w->nchannels*2);
+	put_le16(header+34,16);
+	memcpy(header+36,"data",4);
+	put_le32(header+40,size);
+	fseek(w->file,0,SEEK_SET);
+	fwrite(header,1,sizeof(header),w->file);
+}
+
+static void wav_write(WavWriter *w, const int16_t *samples, int nframes){
+	int i;
+	uint8_t buf[2*MAX_FRAME_SAMPLES];
+	int n=nframes*w->nchannels;
+	for(i=0;i<n;++i) put_le16(buf+2*i,(uint16_t)samples[i]);
+	fwrite(buf,2,n,w->file);
+	w->nframes+=nframes;
+}
+
+/*up to the given position, used for the gaps that the recording could not represent by packets*/
+static void wav_write_silence(WavWriter *w, int64_t position){
+	int16_t silence[MAX_FRAME_SAMPLES];
+	memset(silence,0,sizeof(silence));
+	while(w->nframes<position){
+		int n=(int)MIN(position-w->nframes,MAX_FRAME_SAMPLES/w->nchannels);
+		wav_write(w,silence,n);
+	}
+}
+
+/*returns FALSE at the end of the file*/
+static bool_t ogg_read_page(OggReader *r){
+	uint8_t header[27];
+	int len=0;
+	int i;
+	if (fread(header,1,sizeof(header),r->file)!=sizeof(header)) return FALSE;
+	if (memcmp(header,"OggS",4)!=0){
+		fprintf(stderr,"Lost Ogg page synchronization.\n");
+		return FALSE;
+	}
+	r->granule=(int64_t)get_le32(header+6) | ((int64_t)get_le32(header+10)<<32);
+	r->nsegments=header[26];
+	if (fread(r->segments,1,r->nsegments,r->file)!=(size_t)r->nsegments) return FALSE;
+	for(i=0;i<r->nsegments;++i) len+=r->segments[i];
+	if (fread(r->page,1,len,r->file)!=(size_t)len) return FALSE;
+	r->segment=0;
+	r->offset=0;
+	r->page_complete=(r->nsegments>0 && r->segments[r->nsegments-1]<255);
+	return TRUE;
+}
+
+/*returns the size of the next packet, -1 at the end of the file. page_end tells whether the packet ends a page*/
+static int ogg_read_packet(OggReader *r, uint8_t *packet, bool_t *page_end){
+	int len=0;
+	for(;;){
+		while(r->segment<r->nsegments){
+			int slen=r->segments[r->segment++];
+			if (len+slen>MAX_PACKET_SIZE) return -1;
+			memcpy(packet+len,r->page+r->offset,slen);
+			r->offset+=slen;
+			len+=slen;
+			if (slen<255){
+				*page_end=(r->segment==r->nsegments);
+				return len;
+			}
+		}
+		if (!ogg_read_page(r)) return -1;
+	}
+}
+
+#ifdef HAVE_OPUS
+
+static void opus_render(Decoder *d, const uint8_t *packet, int len, WavWriter *out){
+	int16_t pcm[MAX_FRAME_SAMPLES];
+	int n;
+	if (len<=1){
+		/*recorded missing packet, concealed*/
+		n=opus_decode((OpusDecoder*)d->state,NULL,0,pcm,len==1 ? opus_packet_get_samples_per_frame(packet,48000) : 960,0);
+	}else n=opus_decode((OpusDecoder*)d->state,packet,len,pcm,MAX_FRAME_SAMPLES/out->nchannels,0);
+	if (n<0){
+		fprintf(stderr,"Opus decoding error: %s\n",opus_strerror(n));
+		return;
+	}
+	if (d->preskip>0){
+		int skip=MIN(n,d->preskip);
+		d->preskip-=skip;
+		memmove(pcm,pcm+skip*out->nchannels,(n-skip)*out->nchannels*2);
+		n-=skip;
+	}
+	wav_write(out,pcm,n);
+}
+
+static void opus_destroy(Decoder *d){
+	opus_decoder_destroy((OpusDecoder*)d->state);
+}
+
+static int opus_setup(Decoder *d, const uint8_t *head, int len, WavWriter *out){
+	int err;
+	if (len<19 || head[18]!=0){
+		fprintf(stderr,"Unsupported Opus header.\n");
+		return -1;
+	}
+	out->rate=48000;
+	out->nchannels=head[9];
+	d->preskip=head[10] | (head[11]<<8);
+	d->state=opus_decoder_create(48000,out->nchannels,&err);
+	if (d->state==NULL) return -1;
+	d->decode=opus_render;
+	d->destroy=opus_destroy;
+	return 0;
+}
+
+#endif
+
+#ifdef HAVE_SPEEX
+
+typedef struct SpeexDecoder{
+	void *state;
+	SpeexBits bits;
+	int frame_size;
+} SpeexDecoder;
+
+static void speex_render(Decoder *d, const uint8_t *packet, int len, WavWriter *out){
+	SpeexDecoder *sd=(SpeexDecoder*)d->state;
+	int16_t pcm[MAX_FRAME_SAMPLES];
+	if (len==0){
+		/*recorded missing packet, concealed*/
+		speex_decode_int(sd->state,NULL,pcm);
+		wav_write(out,pcm,sd->frame_size);
+		return;
+	}
+	speex_bits_read_from(&sd->bits,(char*)packet,len);
+	/*as in MSSpeexDec, RTP packets may carry several frames*/
+	do{
+		if (speex_decode_int(sd->state,&sd->bits,pcm)!=0) break;
+		wav_write(out,pcm,sd->frame_size);
+	}while(speex_bits_remaining(&sd->bits)>10);
+}
+
+static void speex_destroy(Decoder *d){
+	SpeexDecoder *sd=(SpeexDecoder*)d->state;
+	speex_bits_destroy(&sd->bits);
+	speex_decoder_destroy(sd->state);
+	ms_free(sd);
+}
+
+static int speex_setup(Decoder *d, const uint8_t *head, int len, WavWriter *out){
+	SpeexDecoder *sd;
+	int mode;
+	if (len<80) return -1;
+	out->rate=get_le32(head+36);
+	out->nchannels=1;
+	mode=get_le32(head+40);
+	if (mode<0 || mode>2) return -1;
+	sd=ms_new0(SpeexDecoder,1);
+	sd->state=speex_decoder_init(speex_lib_get_mode(mode));
+	speex_decoder_ctl(sd->state,SPEEX_GET_FRAME_SIZE,&sd->frame_size);
+	speex_bits_init(&sd->bits);
+	d->state=sd;
+	d->decode=speex_render;
+	d->destroy=speex_destroy;
+	return 0;
+}
+
+#endif
+
+static int render_ogg(FILE *in, WavWriter *out){
+	OggReader *r=ms_new0(OggReader,1);
+	uint8_t *packet=ms_new(uint8_t,MAX_PACKET_SIZE);
+	Decoder d;
+	bool_t page_end;
+	int len;
+	int err=-1;
+
+	memset(&d,0,sizeof(d));
+	r->file=in;
+	len=ogg_read_packet(r,packet,&page_end);
+	if (len>=8 && memcmp(packet,"OpusHead",8)==0){
+#ifdef HAVE_OPUS
+		err=opus_setup(&d,packet,len,out);
+#else
+		fprintf(stderr,"Opus support not compiled.\n");
+#endif
+	}else if (len>=8 && memcmp(packet,"Speex   ",8)==0){
+#ifdef HAVE_SPEEX
+		err=speex_setup(&d,packet,len,out);
+#else
+		fprintf(stderr,"Speex support not compiled.\n");
+#endif
+	}else fprintf(stderr,"Unsupported Ogg stream.\n");
+
+	if (err==0){
+		wav_write_header(out);
+		/*the comment header*/
+		ogg_read_packet(r,packet,&page_end);
+		while((len=ogg_read_packet(r,packet,&page_end))>=0){
+			d.decode(&d,packet,len,out);
+			/*the page ends at its granule position: what the packets did not cover is silence*/
+			if (page_end && r->page_complete) wav_write_silence(out,r->granule-d.preskip);
+		}
+		d.destroy(&d);
+	}
+	ms_free(packet);
+	ms_free(r);
+	return err;
+}
+
+static int render_g711(FILE *in, WavWriter *out, bool_t alaw){
+	uint8_t buf[MAX_FRAME_SAMPLES];
+	int16_t pcm[MAX_FRAME_SAMPLES];
+	size_t n;
+	wav_write_header(out);
+	while((n=fread(buf,1,sizeof(buf)/out->nchannels*out->nchannels,in))>0){
+		size_t i;
+		for(i=0;i<n;++i) pcm[i]=alaw ? alaw_to_s16(buf[i]) : ulaw_to_s16(buf[i]);
+		wav_write(out,pcm,n/out->nchannels);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	const char *codec=NULL;
+	WavWriter out;
+	FILE *in;
+	char magic[4];
+	int i,err;
+
+	if (argc<3){
+		printf("%s",usage);
+		return 1;
+	}
+	memset(&out,0,sizeof(out));
+	out.rate=8000;
+	out.nchannels=1;
+	for(i=3;i<argc;++i){
+		if (strcmp(argv[i],"--codec")==0 && i+1<argc) codec=argv[++i];
+		else if (strcmp(argv[i],"--rate")==0 && i+1<argc) out.rate=atoi(argv[++i]);
+		else if (strcmp(argv[i],"--channels")==0 && i+1<argc) out.nchannels=atoi(argv[++i]);
+		else{
+			printf("%s",usage);
+			return 1;
+		}
+	}
+	if (out.nchannels<1 || out.nchannels>2){
+		fprintf(stderr,"Unsupported number of channels.\n");
+		return 1;
+	}
+	if ((in=fopen(argv[1],"rb"))==NULL){
+		fprintf(stderr,"Cannot open %s\n",argv[1]);
+		return 1;
+	}
+	if ((out.file=fopen(argv[2],"wb"))==NULL){
+		fprintf(stderr,"Cannot create %s\n",argv[2]);
+		fclose(in);
+		return 1;
+	}
+	if (fread(magic,1,4,in)==4 && memcmp(magic,"OggS",4)==0){
+		rewind(in);
+		err=render_ogg(in,&out);
+	}else{
+		size_t len=strlen(argv[1]);
+		rewind(in);
+		if (codec==NULL) codec=(len>3 && strcmp(argv[1]+len-3,".al")==0) ? "pcma" : "pcmu";
+		err=render_g711(in,&out,strcasecmp(codec,"pcma")==0);
+	}
+	if (err==0){
+		wav_write_header(&out);
+		printf("%s: %.1f seconds at %i Hz\n",argv[2],(double)out.nframes/out.rate,out.rate);
+	}
+	fclose(in);
+	fclose(out.file);
+	return err==0 ? 0 : 1;
+}